@@ -0,0 +1,159 @@
+#include "syntheticsensorbackend.h"
+#include <QAccelerometer>
+#include <QAccelerometerReading>
+#include <QGyroscope>
+#include <QGyroscopeReading>
+#include <QMagnetometer>
+#include <QMagnetometerReading>
+#include <QTimer>
+#include <QDebug>
+#include <cmath>
+
+namespace {
+
+const double kRadToDeg = 180.0 / M_PI;
+const double kMinRate = 1.0;
+const double kMaxRate = 5000.0;
+// After a stall, skip ahead instead of bursting more than this much backlog
+const double kMaxBacklogSeconds = 0.1;
+
+double envDouble(const char *name, double defaultValue)
+{
+    bool ok = false;
+    double value = qEnvironmentVariable(name).toDouble(&ok);
+    return ok ? value : defaultValue;
+}
+
+}
+
+SyntheticSensorConfig SyntheticSensorConfig::fromEnvironment()
+{
+    SyntheticSensorConfig config;
+
+    const QString profileName = qEnvironmentVariable("SYNTHETIC_IMU_PROFILE", QStringLiteral("handheld"));
+    std::string error;
+    if (!MotionProfile::load(profileName.toStdString(), config.profile, &error)) {
+        qWarning() << "SyntheticSensors: Cannot load profile" << profileName << "-" << QString::fromStdString(error)
+                   << "- using handheld";
+        MotionProfile::fromName("handheld", config.profile);
+    }
+
+    // Noise and bias are given in sensor units (deg/s, m/s^2, uT)
+    const double degToRad = M_PI / 180.0;
+    ImuNoiseModel &noise = config.noise;
+    noise.gyroNoiseDensity = envDouble("SYNTHETIC_IMU_GYRO_NOISE", noise.gyroNoiseDensity / degToRad) * degToRad;
+    noise.gyroBiasWalk = envDouble("SYNTHETIC_IMU_GYRO_BIAS_WALK", noise.gyroBiasWalk / degToRad) * degToRad;
+    noise.accelNoiseDensity = envDouble("SYNTHETIC_IMU_ACCEL_NOISE", noise.accelNoiseDensity);
+    noise.magNoise = envDouble("SYNTHETIC_IMU_MAG_NOISE", noise.magNoise);
+
+    const QStringList bias = qEnvironmentVariable("SYNTHETIC_IMU_GYRO_BIAS").split(',', Qt::SkipEmptyParts);
+    if (bias.size() == 3) {
+        for (int i = 0; i < 3; ++i) {
+            noise.gyroBias[i] = bias[i].toDouble() * degToRad;
+        }
+    } else if (!bias.isEmpty()) {
+        qWarning() << "SyntheticSensors: SYNTHETIC_IMU_GYRO_BIAS needs three comma-separated values";
+    }
+
+    config.defaultRate = qBound(kMinRate, envDouble("SYNTHETIC_IMU_RATE", config.defaultRate), kMaxRate);
+    config.seed = unsigned(envDouble("SYNTHETIC_IMU_SEED", config.seed));
+
+    qDebug() << "SyntheticSensors: Profile" << profileName << "default rate" << config.defaultRate << "Hz";
+    return config;
+}
+
+SyntheticSensorBackend::SyntheticSensorBackend(Kind kind, const SyntheticSensorConfig &config,
+                                               const QElapsedTimer &epoch, QSensor *sensor)
+    : QSensorBackend(sensor)
+    , m_kind(kind)
+    , m_imu(config.profile, config.noise, config.seed + unsigned(kind))
+    , m_defaultRate(config.defaultRate)
+    , m_epoch(epoch)
+    , m_timer(new QTimer(this))
+    , m_rate(config.defaultRate)
+    , m_nextSample(0)
+    , m_accelerometerReading(nullptr)
+    , m_gyroscopeReading(nullptr)
+    , m_magnetometerReading(nullptr)
+{
+    switch (m_kind) {
+    case Accelerometer:
+        m_accelerometerReading = setReading<QAccelerometerReading>(nullptr);
+        setDescription(QStringLiteral("Synthetic accelerometer"));
+        break;
+    case Gyroscope:
+        m_gyroscopeReading = setReading<QGyroscopeReading>(nullptr);
+        setDescription(QStringLiteral("Synthetic gyroscope"));
+        break;
+    case Magnetometer:
+        m_magnetometerReading = setReading<QMagnetometerReading>(nullptr);
+        setDescription(QStringLiteral("Synthetic magnetometer"));
+        break;
+    }
+    addDataRate(kMinRate, kMaxRate);
+
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &SyntheticSensorBackend::generate);
+}
+
+void SyntheticSensorBackend::start()
+{
+    // A data rate of 0 means "device default"
+    const int requested = sensor()->dataRate();
+    m_rate = requested > 0 ? qBound(kMinRate, double(requested), kMaxRate) : m_defaultRate;
+
+    const double now = m_epoch.nsecsElapsed() / 1e9;
+    m_nextSample = qint64(std::ceil(now * m_rate));
+
+    m_timer->start(qMax(1, int(1000.0 / m_rate)));
+    qDebug() << "SyntheticSensors:" << description() << "started at" << m_rate << "Hz";
+}
+
+void SyntheticSensorBackend::stop()
+{
+    m_timer->stop();
+}
+
+void SyntheticSensorBackend::generate()
+{
+    const double now = m_epoch.nsecsElapsed() / 1e9;
+    const qint64 due = qint64(std::floor(now * m_rate));
+    const qint64 maxBacklog = qMax<qint64>(1, qint64(m_rate * kMaxBacklogSeconds));
+    if (due - m_nextSample >= maxBacklog) {
+        m_nextSample = due - maxBacklog + 1;
+    }
+
+    // Each sample is published on its own so readingChanged handlers see every one
+    for (; m_nextSample <= due; ++m_nextSample) {
+        publish(m_imu.sample(m_nextSample / m_rate, m_rate));
+    }
+}
+
+void SyntheticSensorBackend::publish(const ImuSample &sample)
+{
+    const quint64 timestamp = quint64(sample.t * 1e6);
+
+    switch (m_kind) {
+    case Accelerometer:
+        m_accelerometerReading->setTimestamp(timestamp);
+        m_accelerometerReading->setX(sample.accel[0]);
+        m_accelerometerReading->setY(sample.accel[1]);
+        m_accelerometerReading->setZ(sample.accel[2]);
+        break;
+    case Gyroscope:
+        m_gyroscopeReading->setTimestamp(timestamp);
+        m_gyroscopeReading->setX(sample.gyro[0] * kRadToDeg);
+        m_gyroscopeReading->setY(sample.gyro[1] * kRadToDeg);
+        m_gyroscopeReading->setZ(sample.gyro[2] * kRadToDeg);
+        break;
+    case Magnetometer:
+        // Qt reports the field in tesla
+        m_magnetometerReading->setTimestamp(timestamp);
+        m_magnetometerReading->setX(sample.mag[0] * 1e-6);
+        m_magnetometerReading->setY(sample.mag[1] * 1e-6);
+        m_magnetometerReading->setZ(sample.mag[2] * 1e-6);
+        m_magnetometerReading->setCalibrationLevel(1.0);
+        break;
+    }
+    newReadingAvailable();
+}
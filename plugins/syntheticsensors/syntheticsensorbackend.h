@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QSensorBackend>
+#include <QElapsedTimer>
+#include "syntheticmotion.h"
+
+class QTimer;
+class QAccelerometerReading;
+class QGyroscopeReading;
+class QMagnetometerReading;
+
+// Settings shared by all synthetic sensors, read once from the environment
+struct SyntheticSensorConfig {
+    MotionProfile profile;
+    ImuNoiseModel noise;
+    double defaultRate = 100.0; // Hz, used when the sensor asks for the default rate
+    unsigned seed = 1;
+
+    static SyntheticSensorConfig fromEnvironment();
+};
+
+// Qt Sensors backend producing accelerometer, gyroscope or magnetometer
+// readings from a SyntheticImu. All backends run the same motion profile from
+// a common start time, so their streams describe one consistent device.
+//
+// The timer fires at most every millisecond; for higher rates each tick emits
+// every sample that has come due, with its own timestamp, so rates of several
+// kHz are delivered in small bursts.
+class SyntheticSensorBackend : public QSensorBackend
+{
+    Q_OBJECT
+
+public:
+    enum Kind {
+        Accelerometer,
+        Gyroscope,
+        Magnetometer
+    };
+
+    SyntheticSensorBackend(Kind kind, const SyntheticSensorConfig &config, const QElapsedTimer &epoch, QSensor *sensor);
+
+    void start() override;
+    void stop() override;
+
+private slots:
+    void generate();
+
+private:
+    void publish(const ImuSample &sample);
+
+    Kind m_kind;
+    SyntheticImu m_imu;
+    double m_defaultRate;
+    QElapsedTimer m_epoch;
+    QTimer *m_timer;
+    double m_rate;
+    qint64 m_nextSample;
+
+    QAccelerometerReading *m_accelerometerReading;
+    QGyroscopeReading *m_gyroscopeReading;
+    QMagnetometerReading *m_magnetometerReading;
+};
@@ -0,0 +1,58 @@
+#include "syntheticsensorbackend.h"
+#include <QAccelerometer>
+#include <QGyroscope>
+#include <QMagnetometer>
+#include <QSensorBackendFactory>
+#include <QSensorManager>
+#include <QSensorPluginInterface>
+#include <QElapsedTimer>
+#include <QDebug>
+
+// Registers the synthetic backends as "synthetic.accelerometer",
+// "synthetic.gyroscope" and "synthetic.magnetometer". Configuration comes
+// from SYNTHETIC_IMU_* environment variables, see the README.
+class SyntheticSensorPlugin : public QObject, public QSensorPluginInterface, public QSensorBackendFactory
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID "com.qt-project.Qt.QSensorPluginInterface/1.0" FILE "plugin.json")
+    Q_INTERFACES(QSensorPluginInterface)
+
+public:
+    void registerSensors() override
+    {
+        m_config = SyntheticSensorConfig::fromEnvironment();
+        m_epoch.start();
+
+        registerType(QAccelerometer::sensorType, "synthetic.accelerometer");
+        registerType(QGyroscope::sensorType, "synthetic.gyroscope");
+        registerType(QMagnetometer::sensorType, "synthetic.magnetometer");
+    }
+
+    QSensorBackend *createBackend(QSensor *sensor) override
+    {
+        const QByteArray identifier = sensor->identifier();
+        if (identifier == "synthetic.accelerometer") {
+            return new SyntheticSensorBackend(SyntheticSensorBackend::Accelerometer, m_config, m_epoch, sensor);
+        }
+        if (identifier == "synthetic.gyroscope") {
+            return new SyntheticSensorBackend(SyntheticSensorBackend::Gyroscope, m_config, m_epoch, sensor);
+        }
+        if (identifier == "synthetic.magnetometer") {
+            return new SyntheticSensorBackend(SyntheticSensorBackend::Magnetometer, m_config, m_epoch, sensor);
+        }
+        return nullptr;
+    }
+
+private:
+    void registerType(const QByteArray &type, const QByteArray &identifier)
+    {
+        if (!QSensorManager::isBackendRegistered(type, identifier)) {
+            QSensorManager::registerBackend(type, identifier, this);
+        }
+    }
+
+    SyntheticSensorConfig m_config;
+    QElapsedTimer m_epoch;
+};
+
+#include "syntheticsensorplugin.moc"
@@ -1,6 +1,7 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
+import OpenIGTLinkMobile
 
 GroupBox {
     id: root
@@ -24,9 +25,10 @@ GroupBox {
             TextField {
                 id: hostField
                 Layout.fillWidth: true
-                text: appController.serverHost
+                enabled: !AppController.serverMode
+                text: AppController.serverHost
                 placeholderText: "e.g., 192.168.1.100"
-                onTextChanged: appController.serverHost = text
+                onTextChanged: AppController.serverHost = text
             }
             
             Label {
@@ -36,14 +38,69 @@ GroupBox {
             TextField {
                 id: portField
                 Layout.preferredWidth: 100
-                text: appController.serverPort.toString()
+                text: AppController.serverPort.toString()
                 validator: IntValidator { bottom: 1; top: 65535 }
                 onTextChanged: {
                     if (text.length > 0) {
-                        appController.serverPort = parseInt(text)
+                        AppController.serverPort = parseInt(text)
                     }
                 }
             }
+            
+            // Name in the TRANSFORM header, lets a server tell phones apart
+            Label {
+                text: "Device:"
+            }
+            
+            TextField {
+                id: deviceField
+                Layout.fillWidth: true
+                enabled: !AppController.isConnected
+                text: AppController.deviceName
+                maximumLength: 20
+                onEditingFinished: AppController.deviceName = text
+            }
+            
+            // Hot standby, kept connected and taken over on failure
+            Label {
+                text: "Standby:"
+                visible: !AppController.serverMode
+            }
+            
+            TextField {
+                id: standbyField
+                Layout.fillWidth: true
+                visible: !AppController.serverMode
+                enabled: !AppController.isConnected
+                text: AppController.secondaryHost.length > 0
+                      ? AppController.secondaryHost + ":" + AppController.secondaryPort : ""
+                placeholderText: "optional, host:port"
+                onEditingFinished: {
+                    var parts = text.split(":")
+                    AppController.secondaryHost = parts[0]
+                    if (parts.length > 1 && parts[1].length > 0) {
+                        AppController.secondaryPort = parseInt(parts[1])
+                    }
+                }
+            }
+        }
+        
+        Label {
+            visible: !AppController.serverMode && AppController.secondaryHost.length > 0 && AppController.isConnected
+            text: (AppController.standbyReady ? "Standby ready" : "Standby not connected")
+                  + (AppController.failoverCount > 0
+                     ? " - " + AppController.failoverCount + " failover(s), last " + AppController.lastFailoverMs.toFixed(1) + " ms"
+                     : "")
+            font.pixelSize: 12
+            color: AppController.standbyReady ? "green" : "gray"
+        }
+        
+        Label {
+            visible: AppController.eventLoop.stallCount > 0
+            text: "UI thread: " + AppController.eventLoop.stallCount + " stall(s), max "
+                  + AppController.eventLoop.maxLagMs.toFixed(0) + " ms"
+            font.pixelSize: 12
+            color: "darkorange"
         }
         
         // Connection buttons
@@ -52,18 +109,33 @@ GroupBox {
             spacing: 10
             
             Button {
-                text: "Connect"
-                enabled: !appController.isConnected && hostField.text.length > 0
+                text: AppController.serverMode ? "Listen" : "Connect"
+                enabled: !AppController.isConnected && (AppController.serverMode || hostField.text.length > 0)
                 Layout.fillWidth: true
-                onClicked: appController.connectToServer()
+                onClicked: AppController.connectToServer()
             }
             
             Button {
                 text: "Disconnect"
-                enabled: appController.isConnected
+                // Also ends reconnecting after a lost connection
+                enabled: AppController.isConnected || AppController.isBuffering
                 Layout.fillWidth: true
-                onClicked: appController.disconnectFromServer()
+                onClicked: AppController.disconnectFromServer()
             }
         }
+        
+        // Server mode: receivers connect to the phone on the port above
+        Switch {
+            text: "Server mode"
+            checked: AppController.serverMode
+            onToggled: AppController.serverMode = checked
+        }
+        
+        // Tee the outgoing stream into a session file for later replay
+        Switch {
+            text: "Record session"
+            checked: AppController.isRecording
+            onToggled: AppController.isRecording = checked
+        }
     }
 }
\ No newline at end of file
@@ -36,5 +36,11 @@ Item {
             Layout.fillWidth: true
             Layout.fillHeight: true
         }
+
+        // Orientation history
+        TrendView {
+            Layout.fillWidth: true
+            Layout.preferredHeight: 180
+        }
     }
 }
\ No newline at end of file
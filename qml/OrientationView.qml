@@ -1,6 +1,7 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
+import OpenIGTLinkMobile
 
 GroupBox {
     id: root
@@ -14,15 +15,27 @@ GroupBox {
     
     // Connect to orientation data signals
     Connections {
-        target: appController
+        target: AppController
         function onRotationDataSent(w, x, y, z) {
             root.rotationW = w
             root.rotationX = x
             root.rotationY = y
             root.rotationZ = z
         }
+        function onZAxisOffsetChanged() {
+            root.showZOffset(AppController.zAxisOffset)
+        }
+    }
+    
+    // Moves the slider to an offset set elsewhere (settings, pivot calibration)
+    function showZOffset(offset) {
+        root.zOffset = offset
+        var center = (sliderTrack.width - sliderHandle.width) / 2
+        sliderHandle.x = center + Math.max(-1, Math.min(1, offset / 500)) * center
     }
     
+    Component.onCompleted: showZOffset(AppController.zAxisOffset)
+    
     ColumnLayout {
         anchors.fill: parent
         spacing: 3
@@ -271,11 +284,22 @@ GroupBox {
                 width: 12
                 height: 12
                 radius: 6
-                color: appController.isConnected ? "#4CAF50" : "#F44336"
+                color: AppController.isConnected ? "#4CAF50" : "#F44336"
                 border.color: "white"
                 border.width: 1
             }
             
+            // Motion activity (sensor/output rates are lowered while still)
+            Label {
+                anchors.top: parent.top
+                anchors.right: parent.right
+                anchors.margins: 8
+                visible: AppController.isSendingRotation
+                text: AppController.motionActivity
+                color: "white"
+                font.pixelSize: 10
+            }
+            
         }
         
         // Heading Indicator
@@ -452,7 +476,7 @@ GroupBox {
                                 root.zOffset = (position / maxRange) * 500
                                 
                                 // Update application controller
-                                appController.zAxisOffset = root.zOffset
+                                AppController.zAxisOffset = root.zOffset
                             }
                         }
                     }
@@ -469,6 +493,60 @@ GroupBox {
             }
         }
         
+        // Pivot calibration: pivot the device about its tip, then apply the
+        // estimated tip offset in place of the slider's
+        ColumnLayout {
+            id: pivotPanel
+            Layout.fillWidth: true
+            spacing: 4
+            
+            property var pivot: AppController.pivotCalibration
+            
+            Label {
+                Layout.fillWidth: true
+                font.pixelSize: 11
+                wrapMode: Text.WordWrap
+                text: {
+                    var p = pivotPanel.pivot
+                    if (!p.active) {
+                        return "Pivot calibration: pivot the device about its tip to measure the tip offset"
+                    }
+                    if (!p.valid) {
+                        return "Pivoting... " + p.samples + " samples, keep the tip fixed and rotate the device"
+                    }
+                    return "Tip: " + p.tipX.toFixed(1) + ", " + p.tipY.toFixed(1) + ", " + p.tipZ.toFixed(1)
+                           + " mm \u00B1" + p.errorMm.toFixed(1) + " mm (residual "
+                           + p.residual.toFixed(2) + " m/s\u00B2, " + p.samples + " samples)"
+                }
+            }
+            
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+                
+                Button {
+                    text: "Pivot"
+                    enabled: !pivotPanel.pivot.active
+                    Layout.fillWidth: true
+                    onClicked: AppController.startPivotCalibration()
+                }
+                
+                Button {
+                    text: "Apply"
+                    enabled: pivotPanel.pivot.active && pivotPanel.pivot.valid
+                    Layout.fillWidth: true
+                    onClicked: AppController.applyPivotCalibration()
+                }
+                
+                Button {
+                    text: "Cancel"
+                    enabled: pivotPanel.pivot.active
+                    Layout.fillWidth: true
+                    onClicked: AppController.cancelPivotCalibration()
+                }
+            }
+        }
+        
         // Control buttons
         RowLayout {
             Layout.fillWidth: true
@@ -476,26 +554,26 @@ GroupBox {
             
             Button {
                 text: "Start"
-                enabled: appController.isConnected && !appController.isSendingRotation
+                enabled: AppController.isConnected && !AppController.isSendingRotation
                 Layout.fillWidth: true
-                onClicked: appController.startSendingRotation()
+                onClicked: AppController.startSendingRotation()
             }
             
             Button {
                 text: "Stop"
-                enabled: appController.isSendingRotation
+                enabled: AppController.isSendingRotation
                 Layout.fillWidth: true
-                onClicked: appController.stopSendingRotation()
+                onClicked: AppController.stopSendingRotation()
             }
             
             Button {
                 text: "Reset"
                 Layout.fillWidth: true
                 onClicked: {
-                    appController.resetOrientation()
+                    AppController.resetOrientation()
                     // Reset Z-axis offset
                     root.zOffset = 0.0
-                    appController.zAxisOffset = 0.0
+                    AppController.zAxisOffset = 0.0
                     // Reset slider handle to center
                     sliderHandle.x = sliderTrack.width / 2 - sliderHandle.width / 2
                     // Reset heading to North (0°)
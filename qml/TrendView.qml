@@ -0,0 +1,146 @@
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+import OpenIGTLinkMobile
+
+GroupBox {
+    id: root
+    title: "Trend"
+
+    // Window shown, in seconds
+    property double windowSeconds: 60
+    readonly property var channelColors: ["#F44336", "#4CAF50", "#2196F3"]
+    readonly property var channelNames: ["Roll", "Pitch", "Yaw"]
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 4
+
+        RowLayout {
+            Layout.fillWidth: true
+            spacing: 8
+
+            ComboBox {
+                id: windowBox
+                model: [
+                    { text: "1 min", seconds: 60 },
+                    { text: "10 min", seconds: 600 },
+                    { text: "1 h", seconds: 3600 },
+                    { text: "12 h", seconds: 43200 }
+                ]
+                textRole: "text"
+                onActivated: {
+                    root.windowSeconds = model[currentIndex].seconds
+                    plot.requestPaint()
+                }
+            }
+
+            Repeater {
+                model: root.channelNames
+                Label {
+                    text: modelData
+                    color: root.channelColors[index]
+                    font.pixelSize: 12
+                }
+            }
+
+            Item { Layout.fillWidth: true }
+
+            Button {
+                text: "Export"
+                onClicked: {
+                    var path = AppController.history.exportCsv(root.windowSeconds / 60)
+                    exportLabel.text = path.length > 0 ? "Saved " + path : "Export failed"
+                }
+            }
+        }
+
+        Canvas {
+            id: plot
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            Layout.minimumHeight: 80
+
+            onPaint: {
+                var ctx = getContext("2d")
+                ctx.reset()
+                ctx.fillStyle = "#FAFAFA"
+                ctx.fillRect(0, 0, width, height)
+
+                var history = AppController.history
+                var level = history.levelFor(root.windowSeconds, Math.max(1, Math.floor(width)))
+                var series = []
+                var lo = Infinity
+                var hi = -Infinity
+                for (var c = 0; c < root.channelNames.length; ++c) {
+                    var points = history.series(level, c, root.windowSeconds)
+                    series.push(points)
+                    for (var i = 0; i < points.length; ++i) {
+                        lo = Math.min(lo, points[i].min)
+                        hi = Math.max(hi, points[i].max)
+                    }
+                }
+                if (lo > hi) {
+                    return
+                }
+                if (hi - lo < 1) {
+                    lo -= 0.5
+                    hi += 0.5
+                }
+
+                function xOf(t) { return width * (1 + t / root.windowSeconds) }
+                function yOf(v) { return height - (v - lo) / (hi - lo) * height }
+
+                for (c = 0; c < series.length; ++c) {
+                    points = series[c]
+                    if (points.length === 0) {
+                        continue
+                    }
+
+                    // Min/max band
+                    ctx.globalAlpha = 0.2
+                    ctx.fillStyle = root.channelColors[c]
+                    ctx.beginPath()
+                    ctx.moveTo(xOf(points[0].t), yOf(points[0].max))
+                    for (i = 1; i < points.length; ++i) {
+                        ctx.lineTo(xOf(points[i].t), yOf(points[i].max))
+                    }
+                    for (i = points.length - 1; i >= 0; --i) {
+                        ctx.lineTo(xOf(points[i].t), yOf(points[i].min))
+                    }
+                    ctx.closePath()
+                    ctx.fill()
+
+                    // Mean
+                    ctx.globalAlpha = 1.0
+                    ctx.strokeStyle = root.channelColors[c]
+                    ctx.lineWidth = 1.5
+                    ctx.beginPath()
+                    ctx.moveTo(xOf(points[0].t), yOf(points[0].mean))
+                    for (i = 1; i < points.length; ++i) {
+                        ctx.lineTo(xOf(points[i].t), yOf(points[i].mean))
+                    }
+                    ctx.stroke()
+                }
+
+                ctx.fillStyle = "#757575"
+                ctx.font = "10px sans-serif"
+                ctx.fillText(hi.toFixed(1) + "°", 2, 10)
+                ctx.fillText(lo.toFixed(1) + "°", 2, height - 2)
+            }
+
+            Connections {
+                target: AppController.history
+                function onUpdated() { plot.requestPaint() }
+            }
+        }
+
+        Label {
+            id: exportLabel
+            Layout.fillWidth: true
+            elide: Text.ElideMiddle
+            font.pixelSize: 10
+            color: "#757575"
+        }
+    }
+}
@@ -1,24 +1,62 @@
 #include "applicationcontroller.h"
 #include "rotationsensor.h"
+#include "orientationsensor.h"
 #include "networkmanager.h"
+#include "metricsregistry.h"
+#include "poseresampler.h"
+#include "posehistory.h"
+#include "eventloopmonitor.h"
+#include "startupprofiler.h"
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
 #include <QSettings>
+#include <QStandardPaths>
+
+ApplicationController *ApplicationController::s_instance = nullptr;
 
 ApplicationController::ApplicationController(QObject *parent)
     : QObject(parent)
-    , m_rotationSensor(new RotationSensor(this))
+    , m_rotationSensor(nullptr) // Created on first use, see rotationSensor()
+    , m_orientationSensor(nullptr)
+    , m_poseSource(nullptr)
+    , m_poseSourceSetting("fusion")
     , m_networkManager(new NetworkManager(this))
+    , m_resampler(new PoseResampler(this))
+    , m_history(new PoseHistory(this))
+    , m_eventLoop(new EventLoopMonitor(this))
+    , m_resamplingEnabled(true)
+    , m_rawImuMode(RawImuOff)
+    , m_serverPort(18944)
+    , m_secondaryPort(18944)
+    , m_serverMode(false)
     , m_isConnected(false)
     , m_isSendingRotation(false)
     , m_connectionStatus("Disconnected")
+    , m_showingBacklog(false)
+    , m_pivotStartedSensor(false)
     , m_zAxisOffset(0.0)
+    , m_tipOffsetX(0.0)
+    , m_tipOffsetY(0.0)
 {
+    Q_ASSERT(!s_instance);
+    s_instance = this;
+
     // Load saved settings
-    loadSettings();
+    {
+        StartupPhase phase("loadSettings");
+        loadSettings();
+    }
+    startMetricsExport();
+    startEventLoopMonitor();
+    setUpStoreAndForward();
     // Connect signals
     connect(m_networkManager, &NetworkManager::connectionStateChanged,
             this, &ApplicationController::onConnectionStateChanged);
     
+    connect(m_networkManager, &NetworkManager::backlogChanged,
+            this, &ApplicationController::onBacklogChanged);
+    
     connect(m_networkManager, &NetworkManager::connectionError,
             this, [this](const QString &error) {
                 qDebug() << "Connection error:" << error;
@@ -26,12 +64,107 @@ ApplicationController::ApplicationController(QObject *parent)
                 emit connectionStatusChanged();
             });
     
-    connect(m_rotationSensor, &RotationSensor::rotationChanged,
-            this, &ApplicationController::onRotationChanged);
+    // Poses leave on the resampler's fixed-rate clock
+    connect(m_resampler, &PoseResampler::poseReady,
+            this, &ApplicationController::sendPose);
+    
+    connect(m_networkManager, &NetworkManager::subscriberCountChanged,
+            this, [this]() {
+                updateServerStatus();
+                emit subscriberCountChanged();
+            });
+    
+    connect(m_networkManager, &NetworkManager::recordingChanged,
+            this, &ApplicationController::recordingChanged);
+    
+    connect(m_networkManager, &NetworkManager::standbyChanged,
+            this, &ApplicationController::standbyChanged);
+    
+    connect(m_networkManager, &NetworkManager::failoverOccurred,
+            this, [this](const QString &server) {
+                m_connectionStatus = QString("Connected (failed over to %1 in %2 ms)")
+                                         .arg(server)
+                                         .arg(m_networkManager->lastFailoverMs(), 0, 'f', 1);
+                emit connectionStatusChanged();
+                emit failoverChanged();
+            });
+    
+    connect(m_networkManager, &NetworkManager::outputRateRequested,
+            this, [this](double hz) {
+                qDebug() << "Server requested output rate:" << hz << "Hz";
+                rotationSensor()->setOutputRate(hz);
+                if (m_orientationSensor) {
+                    m_orientationSensor->setOutputRate(hz);
+                }
+                updateOutputRate();
+            });
 }
 
 ApplicationController::~ApplicationController()
 {
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+ApplicationController *ApplicationController::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine);
+    Q_UNUSED(jsEngine);
+    Q_ASSERT(s_instance);
+    // The controller is owned by main(), not by the QML engine
+    QJSEngine::setObjectOwnership(s_instance, QJSEngine::CppOwnership);
+    return s_instance;
+}
+
+RotationSensor *ApplicationController::rotationSensor()
+{
+    // Sensor objects and their backends are not needed before the user starts
+    // streaming, so keep them out of the startup path
+    if (!m_rotationSensor) {
+        m_rotationSensor = new RotationSensor(this);
+        connect(m_rotationSensor, &RotationSensor::rotationChanged,
+                this, &ApplicationController::onRotationChanged);
+        connect(m_rotationSensor->motionScheduler(), &MotionScheduler::activityChanged,
+                this, &ApplicationController::motionActivityChanged);
+        connect(m_rotationSensor->motionScheduler(), &MotionScheduler::activityChanged,
+                this, &ApplicationController::updateOutputRate);
+        // Little runs on the loop while the device is still, and probing it
+        // then would only keep the CPU awake
+        connect(m_rotationSensor->motionScheduler(), &MotionScheduler::activityChanged,
+                this, [this](MotionScheduler::Activity activity) {
+                    m_eventLoop->setPaused(activity == MotionScheduler::Still);
+                });
+        connect(m_rotationSensor, &RotationSensor::fusionTuned,
+                this, &ApplicationController::saveFusionTuning);
+        connect(m_rotationSensor, &RotationSensor::pivotCalibrationUpdated,
+                this, &ApplicationController::pivotCalibrationChanged);
+        connect(m_rotationSensor, &RotationSensor::sensorSample,
+                this, &ApplicationController::onSensorSample);
+        loadFusionSettings();
+    }
+    return m_rotationSensor;
+}
+
+OrientationSensor *ApplicationController::orientationSensor()
+{
+    if (!m_orientationSensor) {
+        m_orientationSensor = new OrientationSensor(this);
+        connect(m_orientationSensor, &OrientationSensor::rotationChanged,
+                this, &ApplicationController::onRotationChanged);
+    }
+    return m_orientationSensor;
+}
+
+PoseSource *ApplicationController::selectPoseSource()
+{
+    if (m_poseSourceSetting == "hardware") {
+        if (orientationSensor()->isAvailable()) {
+            return m_orientationSensor;
+        }
+        qWarning() << "No hardware rotation sensor, falling back to app fusion";
+    }
+    return rotationSensor();
 }
 
 bool ApplicationController::isConnected() const
@@ -44,6 +177,11 @@ bool ApplicationController::isSendingRotation() const
     return m_isSendingRotation;
 }
 
+bool ApplicationController::isBuffering() const
+{
+    return m_networkManager->isBuffering();
+}
+
 QString ApplicationController::serverHost() const
 {
     return m_serverHost;
@@ -72,6 +210,68 @@ void ApplicationController::setServerPort(int port)
     }
 }
 
+QString ApplicationController::deviceName() const
+{
+    return m_networkManager->deviceName();
+}
+
+void ApplicationController::setDeviceName(const QString &name)
+{
+    // OpenIGTLink device names are at most 20 bytes
+    const QString trimmed = QString::fromUtf8(name.trimmed().toUtf8().left(20));
+    if (trimmed.isEmpty() || trimmed == m_networkManager->deviceName()) {
+        return;
+    }
+    m_networkManager->setDeviceName(trimmed);
+    saveSettings();
+    emit deviceNameChanged();
+}
+
+QString ApplicationController::secondaryHost() const
+{
+    return m_secondaryHost;
+}
+
+void ApplicationController::setSecondaryHost(const QString &host)
+{
+    if (m_secondaryHost != host) {
+        m_secondaryHost = host;
+        m_networkManager->setSecondaryServer(m_secondaryHost, m_secondaryPort);
+        saveSettings();
+        emit secondaryServerChanged();
+    }
+}
+
+int ApplicationController::secondaryPort() const
+{
+    return m_secondaryPort;
+}
+
+void ApplicationController::setSecondaryPort(int port)
+{
+    if (m_secondaryPort != port) {
+        m_secondaryPort = port;
+        m_networkManager->setSecondaryServer(m_secondaryHost, m_secondaryPort);
+        saveSettings();
+        emit secondaryServerChanged();
+    }
+}
+
+bool ApplicationController::standbyReady() const
+{
+    return m_networkManager->isStandbyReady();
+}
+
+int ApplicationController::failoverCount() const
+{
+    return m_networkManager->failoverCount();
+}
+
+double ApplicationController::lastFailoverMs() const
+{
+    return m_networkManager->lastFailoverMs();
+}
+
 QString ApplicationController::connectionStatus() const
 {
     return m_connectionStatus;
@@ -86,12 +286,279 @@ void ApplicationController::setZAxisOffset(double offset)
 {
     if (m_zAxisOffset != offset) {
         m_zAxisOffset = offset;
+        m_transformChain.setTipOffset(m_tipOffsetX, m_tipOffsetY, m_zAxisOffset);
         emit zAxisOffsetChanged();
     }
 }
 
+QString ApplicationController::axisMap() const
+{
+    return QString::fromStdString(m_transformChain.axisMap());
+}
+
+void ApplicationController::setAxisMap(const QString &spec)
+{
+    if (spec == axisMap()) {
+        return;
+    }
+    if (!m_transformChain.setAxisMap(spec.toStdString())) {
+        qWarning() << "Invalid axis map" << spec << "- expected e.g. \"-x,y,z\"";
+        return;
+    }
+    qDebug() << "Axis map set to" << axisMap();
+    saveTransform();
+    emit transformChanged();
+}
+
+bool ApplicationController::setRegistration(const QVariantList &matrix)
+{
+    if (matrix.size() != 12 && matrix.size() != 16) {
+        qWarning() << "Registration needs a 3x4 or 4x4 matrix, got" << matrix.size() << "values";
+        return false;
+    }
+
+    double rows[3][4];
+    for (int i = 0; i < 12; ++i) {
+        bool ok = false;
+        rows[i / 4][i % 4] = matrix[i].toDouble(&ok);
+        if (!ok || !qIsFinite(rows[i / 4][i % 4])) {
+            qWarning() << "Registration matrix has a non-numeric value at" << i;
+            return false;
+        }
+    }
+    // A 4x4 matrix must be affine: bottom row 0, 0, 0, 1
+    if (matrix.size() == 16) {
+        for (int i = 0; i < 4; ++i) {
+            bool ok = false;
+            const double value = matrix[12 + i].toDouble(&ok);
+            if (!ok || !(qAbs(value - (i == 3 ? 1.0 : 0.0)) <= 1e-3)) {
+                qWarning() << "Registration matrix bottom row must be 0, 0, 0, 1";
+                return false;
+            }
+        }
+    }
+
+    if (!m_transformChain.setRegistration(rows)) {
+        qWarning() << "Registration matrix is not a rigid transform (orthonormal rotation, det 1)";
+        return false;
+    }
+    m_registration = matrix.mid(0, 12);
+    qDebug() << "Registration set";
+    saveTransform();
+    emit transformChanged();
+    return true;
+}
+
+QVariantMap ApplicationController::pivotCalibration() const
+{
+    QVariantMap state;
+    state["active"] = m_rotationSensor && m_rotationSensor->isPivotCalibrating();
+    if (!m_rotationSensor) {
+        state["samples"] = 0;
+        state["valid"] = false;
+        return state;
+    }
+    const PivotCalibration::Result result = m_rotationSensor->pivotResult();
+    double tip[3];
+    m_transformChain.toOutputAxes(result.tip, tip);
+    state["samples"] = qulonglong(result.samples);
+    state["valid"] = result.valid;
+    state["tipX"] = tip[0];
+    state["tipY"] = tip[1];
+    state["tipZ"] = tip[2];
+    state["residual"] = result.residualRms;
+    state["errorMm"] = result.tipErrorMm;
+    return state;
+}
+
+QString ApplicationController::poseSource() const
+{
+    return m_poseSourceSetting;
+}
+
+void ApplicationController::setPoseSource(const QString &source)
+{
+    if (source != "fusion" && source != "hardware") {
+        qWarning() << "Ignoring invalid pose source" << source;
+        return;
+    }
+    if (m_poseSourceSetting != source) {
+        m_poseSourceSetting = source;
+        QSettings settings;
+        settings.setValue("sensors/poseSource", source);
+        emit poseSourceChanged();
+    }
+}
+
+QVariantList ApplicationController::poseSourceStats() const
+{
+    QVariantList list;
+    const QList<PoseSource *> sources = {m_rotationSensor, m_orientationSensor};
+    for (PoseSource *source : sources) {
+        if (!source) {
+            continue;
+        }
+        const PoseSource::Stats stats = source->stats();
+        QVariantMap entry;
+        entry["name"] = source->name();
+        entry["available"] = source->isAvailable();
+        entry["active"] = source == m_poseSource && m_isSendingRotation;
+        entry["poses"] = qulonglong(stats.poses);
+        entry["cpuUsPerPose"] = stats.cpuUsPerPose;
+        entry["meanLatencyMs"] = stats.meanLatencyMs;
+        entry["maxLatencyMs"] = stats.maxLatencyMs;
+        list.append(entry);
+    }
+    return list;
+}
+
+void ApplicationController::startPivotCalibration()
+{
+    RotationSensor *sensor = rotationSensor();
+    if (!sensor->isActive()) {
+        sensor->start();
+        m_pivotStartedSensor = true;
+    }
+    sensor->startPivotCalibration();
+}
+
+bool ApplicationController::applyPivotCalibration()
+{
+    if (!m_rotationSensor) {
+        return false;
+    }
+    const PivotCalibration::Result result = m_rotationSensor->pivotResult();
+    if (!result.valid) {
+        qWarning() << "Pivot calibration has no solution yet after" << result.samples << "samples";
+        return false;
+    }
+    cancelPivotCalibration();
+    
+    double tip[3];
+    m_transformChain.toOutputAxes(result.tip, tip);
+    qDebug() << "Pivot calibration: tip" << tip[0] << tip[1] << tip[2] << "mm, +-" << result.tipErrorMm
+             << "mm, residual" << result.residualRms << "m/s^2 over" << result.samples << "samples";
+    m_tipOffsetX = tip[0];
+    m_tipOffsetY = tip[1];
+    m_zAxisOffset = tip[2];
+    m_transformChain.setTipOffset(m_tipOffsetX, m_tipOffsetY, m_zAxisOffset);
+    
+    QSettings settings;
+    settings.setValue("transform/tipOffsetX", m_tipOffsetX);
+    settings.setValue("transform/tipOffsetY", m_tipOffsetY);
+    settings.setValue("transform/tipOffsetZ", m_zAxisOffset);
+    emit zAxisOffsetChanged();
+    emit transformChanged();
+    return true;
+}
+
+void ApplicationController::cancelPivotCalibration()
+{
+    if (!m_rotationSensor) {
+        return;
+    }
+    m_rotationSensor->stopPivotCalibration();
+    if (m_pivotStartedSensor && !m_isSendingRotation) {
+        m_rotationSensor->stop();
+    }
+    m_pivotStartedSensor = false;
+}
+
+void ApplicationController::resetRegistration()
+{
+    m_transformChain.resetRegistration();
+    m_registration.clear();
+    saveTransform();
+    emit transformChanged();
+}
+
+QString ApplicationController::motionActivity() const
+{
+    if (!m_rotationSensor) {
+        return MotionScheduler::activityName(MotionScheduler::Moving);
+    }
+    return MotionScheduler::activityName(m_rotationSensor->motionScheduler()->activity());
+}
+
+MetricsRegistry *ApplicationController::metrics() const
+{
+    return MetricsRegistry::instance();
+}
+
+bool ApplicationController::isRecording() const
+{
+    return m_networkManager->isRecording();
+}
+
+void ApplicationController::setRecording(bool recording)
+{
+    if (recording == m_networkManager->isRecording()) {
+        return;
+    }
+    if (recording) {
+        // One session file per recording in <app data>/sessions
+        const QString dir = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("sessions");
+        const QString name = "session-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".igtls";
+        m_networkManager->startRecording(QDir(dir).filePath(name));
+    } else {
+        m_networkManager->stopRecording();
+    }
+}
+
+PoseResampler *ApplicationController::resampler() const
+{
+    return m_resampler;
+}
+
+PoseHistory *ApplicationController::history() const
+{
+    return m_history;
+}
+
+EventLoopMonitor *ApplicationController::eventLoop() const
+{
+    return m_eventLoop;
+}
+
+bool ApplicationController::serverMode() const
+{
+    return m_serverMode;
+}
+
+void ApplicationController::setServerMode(bool enabled)
+{
+    if (m_serverMode != enabled) {
+        // Switching modes ends the current session
+        if (m_isConnected) {
+            disconnectFromServer();
+        }
+        m_serverMode = enabled;
+        saveSettings();
+        emit serverModeChanged();
+    }
+}
+
+int ApplicationController::subscriberCount() const
+{
+    return m_networkManager->subscriberCount();
+}
+
+void ApplicationController::updateServerStatus()
+{
+    if (m_serverMode && m_isConnected) {
+        m_connectionStatus = QString("Listening on port %1 (%2 receivers)").arg(m_serverPort).arg(subscriberCount());
+        emit connectionStatusChanged();
+    }
+}
+
 void ApplicationController::connectToServer()
 {
+    if (m_serverMode) {
+        qDebug() << "Starting OpenIGTLink server on port" << m_serverPort;
+        m_networkManager->startServer(m_serverPort);
+        return;
+    }
+    
     qDebug() << "Attempting to connect to" << m_serverHost << ":" << m_serverPort;
     m_connectionStatus = "Connecting...";
     emit connectionStatusChanged();
@@ -111,7 +578,31 @@ void ApplicationController::startSendingRotation()
     
     if (m_isConnected && !m_isSendingRotation) {
         qDebug() << "Starting rotation sensor...";
-        m_rotationSensor->start();
+        // Raw readings for fusion on the server, next to our own pose or
+        // instead of it (client connections only)
+        const bool raw = m_rawImuMode != RawImuOff && m_networkManager->canSendImu();
+        const bool fused = !raw || m_rawImuMode == RawImuAlongside;
+        m_poseSource = selectPoseSource();
+        if (m_poseSource == m_rotationSensor) {
+            rotationSensor()->setRawOutput(raw);
+            rotationSensor()->setFusionEnabled(fused);
+            rotationSensor()->start();
+        } else {
+            // Hardware poses; the raw sensors only run for raw output
+            if (raw) {
+                rotationSensor()->setRawOutput(true);
+                rotationSensor()->setFusionEnabled(false);
+                rotationSensor()->start();
+            }
+            if (fused) {
+                m_poseSource->start();
+            }
+        }
+        qDebug() << "Pose source:" << m_poseSource->name();
+        if (m_resamplingEnabled && fused) {
+            updateOutputRate();
+            m_resampler->start();
+        }
         m_isSendingRotation = true;
         emit sendingStatusChanged();
         qDebug() << "Rotation sending started";
@@ -123,7 +614,21 @@ void ApplicationController::startSendingRotation()
 void ApplicationController::stopSendingRotation()
 {
     if (m_isSendingRotation) {
-        m_rotationSensor->stop();
+        if (m_poseSource && m_poseSource != m_rotationSensor) {
+            m_poseSource->stop();
+        }
+        // A running pivot calibration keeps the sensor until it ends
+        if (m_rotationSensor) {
+            if (m_rotationSensor->isPivotCalibrating()) {
+                m_pivotStartedSensor = true;
+            } else {
+                m_rotationSensor->stop();
+            }
+            m_rotationSensor->setRawOutput(false);
+            m_rotationSensor->setFusionEnabled(true);
+        }
+        m_resampler->stop();
+        m_networkManager->flush();
         m_isSendingRotation = false;
         emit sendingStatusChanged();
     }
@@ -135,34 +640,92 @@ void ApplicationController::onConnectionStateChanged()
     if (m_isConnected != connected) {
         m_isConnected = connected;
         
-        if (!connected) {
+        // While a lost connection is being re-established the poses are
+        // buffered, so streaming goes on
+        if (!connected && !m_networkManager->isBuffering()) {
             stopSendingRotation();
         }
         
-        m_connectionStatus = connected ? "Connected" : "Disconnected";
+        m_showingBacklog = !connected && m_networkManager->isBuffering();
+        m_connectionStatus = connected ? "Connected" : m_showingBacklog ? "Connection lost, buffering" : "Disconnected";
         
         emit connectionChanged();
         emit connectionStatusChanged();
+        updateServerStatus();
     }
 }
 
+void ApplicationController::onBacklogChanged()
+{
+    const quint64 backlog = m_networkManager->backlogCount();
+    if (m_networkManager->isBuffering()) {
+        m_connectionStatus = QString("Connection lost, buffering (%1 poses)").arg(backlog);
+    } else if (m_isConnected && backlog > 0) {
+        m_connectionStatus = QString("Connected (sending %1 buffered poses)").arg(backlog);
+    } else if (m_showingBacklog) {
+        m_connectionStatus = m_isConnected ? "Connected" : "Disconnected";
+    } else {
+        return;
+    }
+    m_showingBacklog = m_networkManager->isBuffering() || backlog > 0;
+    emit connectionStatusChanged();
+}
+
 void ApplicationController::onRotationChanged(double w, double x, double y, double z)
 {
+    // Poses of the app fusion while it only runs for a pivot calibration
+    if (m_poseSource && sender() != m_poseSource) {
+        return;
+    }
     qDebug() << "ApplicationController::onRotationChanged:" << w << x << y << z;
     
-    if (m_isConnected && m_isSendingRotation) {
-        qDebug() << "Sending rotation data to network with Z-offset:" << m_zAxisOffset;
-        m_networkManager->sendRotationData(w, x, y, z, m_zAxisOffset);
+    m_history->addPose(w, x, y, z);
+
+    if (m_resamplingEnabled) {
+        m_resampler->addSample(w, x, y, z);
+    } else {
+        sendPose(w, x, y, z);
+    }
+}
+
+void ApplicationController::onSensorSample(const FusionInput &input, quint64 timeNs)
+{
+    if (m_isSendingRotation) {
+        m_networkManager->sendImuSample(input, timeNs);
+    }
+}
+
+void ApplicationController::sendPose(double w, double x, double y, double z)
+{
+    if ((m_isConnected || m_networkManager->isBuffering()) && m_isSendingRotation) {
+        // All frame transforms in one step, right before encoding
+        m_networkManager->sendPose(m_transformChain.apply(w, x, y, z));
         emit rotationDataSent(w, x, y, z);
     } else {
         qDebug() << "Not sending - connected:" << m_isConnected << "sending:" << m_isSendingRotation;
     }
 }
 
+void ApplicationController::updateOutputRate()
+{
+    // The resampler follows the source's scheduled rate (motion activity and
+    // server requests), it only makes the output clock precise
+    if (m_poseSource) {
+        m_resampler->setRate(m_poseSource->outputRate());
+    } else if (m_rotationSensor) {
+        m_resampler->setRate(m_rotationSensor->outputRate());
+    }
+}
+
 void ApplicationController::resetOrientation()
 {
     qDebug() << "ApplicationController::resetOrientation() called";
-    m_rotationSensor->resetOrientation();
+    if (m_rotationSensor) {
+        m_rotationSensor->resetOrientation();
+    }
+    if (m_orientationSensor) {
+        m_orientationSensor->resetOrientation();
+    }
 }
 
 void ApplicationController::loadSettings()
@@ -170,6 +733,44 @@ void ApplicationController::loadSettings()
     QSettings settings;
     m_serverHost = settings.value("connection/serverHost", "localhost").toString();
     m_serverPort = settings.value("connection/serverPort", 18944).toInt();
+    m_serverMode = settings.value("connection/serverMode", false).toBool();
+    m_networkManager->setDeviceName(settings.value("connection/deviceName", "MobileDevice").toString());
+    m_secondaryHost = settings.value("connection/secondaryHost").toString();
+    m_secondaryPort = settings.value("connection/secondaryPort", 18944).toInt();
+    m_networkManager->setSecondaryServer(m_secondaryHost, m_secondaryPort);
+    m_networkManager->setHeartbeat(settings.value("failover/heartbeatIntervalMs", 200).toInt(),
+                                   settings.value("failover/heartbeatTimeoutMs", 600).toInt());
+    m_resamplingEnabled = settings.value("output/resampling", true).toBool();
+    const QString rawImu = settings.value("output/rawImu", "off").toString();
+    if (rawImu == "alongside") {
+        m_rawImuMode = RawImuAlongside;
+    } else if (rawImu == "only") {
+        m_rawImuMode = RawImuOnly;
+    } else {
+        if (rawImu != "off") {
+            qWarning() << "Ignoring invalid output/rawImu setting" << rawImu;
+        }
+        m_rawImuMode = RawImuOff;
+    }
+    m_networkManager->setImuBatch(settings.value("output/rawImuBatch", 4).toInt());
+    m_poseSourceSetting = settings.value("sensors/poseSource", "fusion").toString();
+    if (m_poseSourceSetting != "fusion" && m_poseSourceSetting != "hardware") {
+        qWarning() << "Ignoring invalid sensors/poseSource setting" << m_poseSourceSetting;
+        m_poseSourceSetting = "fusion";
+    }
+    
+    // Frame transforms; the tip offset along Z is the UI's Z-axis offset
+    if (!m_transformChain.setAxisMap(settings.value("transform/axisMap", "-x,y,z").toString().toStdString())) {
+        qWarning() << "Ignoring invalid transform/axisMap setting";
+    }
+    m_tipOffsetX = settings.value("transform/tipOffsetX", 0.0).toDouble();
+    m_tipOffsetY = settings.value("transform/tipOffsetY", 0.0).toDouble();
+    m_zAxisOffset = settings.value("transform/tipOffsetZ", 0.0).toDouble();
+    m_transformChain.setTipOffset(m_tipOffsetX, m_tipOffsetY, m_zAxisOffset);
+    const QVariantList registration = settings.value("transform/registration").toList();
+    if (!registration.isEmpty()) {
+        setRegistration(registration);
+    }
     qDebug() << "Loaded settings - Host:" << m_serverHost << "Port:" << m_serverPort;
 }
 
@@ -178,5 +779,98 @@ void ApplicationController::saveSettings()
     QSettings settings;
     settings.setValue("connection/serverHost", m_serverHost);
     settings.setValue("connection/serverPort", m_serverPort);
+    settings.setValue("connection/serverMode", m_serverMode);
+    settings.setValue("connection/deviceName", m_networkManager->deviceName());
+    settings.setValue("connection/secondaryHost", m_secondaryHost);
+    settings.setValue("connection/secondaryPort", m_secondaryPort);
     qDebug() << "Saved settings - Host:" << m_serverHost << "Port:" << m_serverPort;
-}
\ No newline at end of file
+}
+
+void ApplicationController::startEventLoopMonitor()
+{
+    // Stalls of the GUI thread delay poses; 50 ms is 1.5 frames at 30 Hz.
+    // Off by default: the probes keep the CPU from sleeping.
+    QSettings settings;
+    if (settings.value("diagnostics/eventLoopMonitor", false).toBool()) {
+        m_eventLoop->start(settings.value("diagnostics/eventLoopIntervalMs", 10).toInt(),
+                           settings.value("diagnostics/stallThresholdMs", 50).toInt(),
+                           settings.value("diagnostics/eventLoopStacks", false).toBool());
+    }
+}
+
+void ApplicationController::setUpStoreAndForward()
+{
+    QSettings settings;
+    if (!settings.value("buffer/storeAndForward", false).toBool()) {
+        return;
+    }
+    // Overflow beyond the memory ring goes to <app data>/backlog.spill
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    m_networkManager->setStoreAndForward(settings.value("buffer/memoryPoses", 18000).toInt(),
+                                         settings.value("buffer/fileLimitMB", 64).toLongLong() * 1024 * 1024,
+                                         QDir(dir).filePath("backlog.spill"),
+                                         settings.value("buffer/burstKBps", 64).toInt() * 1024);
+}
+
+void ApplicationController::loadFusionSettings()
+{
+    // Last tuning result of this device, so it applies before the gyroscope
+    // has been characterized again
+    QSettings settings;
+    FusionCore::Parameters parameters;
+    const QByteArray algorithm = settings.value("fusion/algorithm").toString().toUtf8();
+    if (!algorithm.isEmpty() && !FusionCore::algorithmFromName(algorithm.constData(), parameters.algorithm)) {
+        qWarning() << "Ignoring invalid fusion/algorithm setting";
+    }
+    parameters.beta = settings.value("fusion/beta", parameters.beta).toDouble();
+    const QByteArray integrator = settings.value("fusion/integrator").toString().toUtf8();
+    if (!integrator.isEmpty() && !FusionCore::integratorFromName(integrator.constData(), parameters.integrator)) {
+        qWarning() << "Ignoring invalid fusion/integrator setting";
+    }
+    const QVariantList gyroBias = settings.value("fusion/gyroBias").toList();
+    if (gyroBias.size() == 3) {
+        for (int axis = 0; axis < 3; ++axis) {
+            parameters.gyroBias[axis] = gyroBias[axis].toDouble();
+        }
+    }
+    m_rotationSensor->setFusionParameters(parameters);
+    m_rotationSensor->setAlignmentMaxWait(settings.value("sensors/alignMaxWaitMs", 20.0).toDouble());
+    m_rotationSensor->setAutoTune(settings.value("fusion/autoTune", false).toBool(),
+                                  settings.value("fusion/driftTargetDegPerMin", 1.0).toDouble());
+}
+
+void ApplicationController::saveFusionTuning()
+{
+    const FusionCore::Parameters parameters = m_rotationSensor->fusionParameters();
+    const NoiseEstimator::Estimate estimate = m_rotationSensor->noiseEstimate();
+    QSettings settings;
+    settings.setValue("fusion/algorithm", FusionCore::algorithmName(parameters.algorithm));
+    settings.setValue("fusion/beta", parameters.beta);
+    settings.setValue("fusion/gyroAngleRandomWalk", estimate.angleRandomWalk);
+    settings.setValue("fusion/gyroBiasInstability", estimate.biasInstability);
+    settings.setValue("fusion/gyroBias", QVariantList{parameters.gyroBias[0], parameters.gyroBias[1], parameters.gyroBias[2]});
+}
+
+void ApplicationController::saveTransform()
+{
+    QSettings settings;
+    settings.setValue("transform/axisMap", axisMap());
+    if (m_registration.isEmpty()) {
+        settings.remove("transform/registration");
+    } else {
+        settings.setValue("transform/registration", m_registration);
+    }
+}
+
+void ApplicationController::startMetricsExport()
+{
+    // Prometheus text file in the app data directory by default; the localhost
+    // HTTP endpoint is opt-in
+    QSettings settings;
+    const QString defaultFile = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("metrics.prom");
+    const QString exportFile = settings.value("metrics/exportFile", defaultFile).toString();
+    const int httpPort = settings.value("metrics/httpPort", 0).toInt();
+    const int intervalMs = settings.value("metrics/intervalMs", 5000).toInt();
+    MetricsRegistry::instance()->startExport(intervalMs, exportFile, quint16(httpPort));
+}
@@ -3,35 +3,112 @@
 #include <QObject>
 #include <QQmlEngine>
 #include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+#include "fusioncore.h"
+#include "transformchain.h"
 
 class RotationSensor;
+class OrientationSensor;
+class PoseSource;
 class NetworkManager;
+class MetricsRegistry;
+class PoseResampler;
+class PoseHistory;
+class EventLoopMonitor;
 
 class ApplicationController : public QObject
 {
     Q_OBJECT
-    QML_ELEMENT
+    QML_NAMED_ELEMENT(AppController)
+    QML_SINGLETON
 
     Q_PROPERTY(bool isConnected READ isConnected NOTIFY connectionChanged)
     Q_PROPERTY(bool isSendingRotation READ isSendingRotation NOTIFY sendingStatusChanged)
     Q_PROPERTY(QString serverHost READ serverHost WRITE setServerHost NOTIFY serverHostChanged)
     Q_PROPERTY(int serverPort READ serverPort WRITE setServerPort NOTIFY serverPortChanged)
+    Q_PROPERTY(QString deviceName READ deviceName WRITE setDeviceName NOTIFY deviceNameChanged)
     Q_PROPERTY(QString connectionStatus READ connectionStatus NOTIFY connectionStatusChanged)
+    Q_PROPERTY(bool isBuffering READ isBuffering NOTIFY connectionStatusChanged)
     Q_PROPERTY(double zAxisOffset READ zAxisOffset WRITE setZAxisOffset NOTIFY zAxisOffsetChanged)
+    Q_PROPERTY(QString axisMap READ axisMap WRITE setAxisMap NOTIFY transformChanged)
+    Q_PROPERTY(QString motionActivity READ motionActivity NOTIFY motionActivityChanged)
+    Q_PROPERTY(MetricsRegistry *metrics READ metrics CONSTANT)
+    Q_PROPERTY(bool isRecording READ isRecording WRITE setRecording NOTIFY recordingChanged)
+    Q_PROPERTY(PoseResampler *resampler READ resampler CONSTANT)
+    Q_PROPERTY(PoseHistory *history READ history CONSTANT)
+    Q_PROPERTY(EventLoopMonitor *eventLoop READ eventLoop CONSTANT)
+    Q_PROPERTY(bool serverMode READ serverMode WRITE setServerMode NOTIFY serverModeChanged)
+    Q_PROPERTY(int subscriberCount READ subscriberCount NOTIFY subscriberCountChanged)
+    Q_PROPERTY(QString secondaryHost READ secondaryHost WRITE setSecondaryHost NOTIFY secondaryServerChanged)
+    Q_PROPERTY(int secondaryPort READ secondaryPort WRITE setSecondaryPort NOTIFY secondaryServerChanged)
+    Q_PROPERTY(bool standbyReady READ standbyReady NOTIFY standbyChanged)
+    Q_PROPERTY(int failoverCount READ failoverCount NOTIFY failoverChanged)
+    Q_PROPERTY(double lastFailoverMs READ lastFailoverMs NOTIFY failoverChanged)
+    Q_PROPERTY(QVariantMap pivotCalibration READ pivotCalibration NOTIFY pivotCalibrationChanged)
+    Q_PROPERTY(QString poseSource READ poseSource WRITE setPoseSource NOTIFY poseSourceChanged)
 
 public:
     explicit ApplicationController(QObject *parent = nullptr);
     ~ApplicationController();
 
+    // QML singleton factory; returns the instance created in main()
+    static ApplicationController *create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+
     bool isConnected() const;
     bool isSendingRotation() const;
+    // Lost connection being retried, poses are stored (store-and-forward)
+    bool isBuffering() const;
     QString serverHost() const;
     void setServerHost(const QString &host);
     int serverPort() const;
     void setServerPort(int port);
+    QString deviceName() const;
+    void setDeviceName(const QString &name);
     QString connectionStatus() const;
     double zAxisOffset() const;
     void setZAxisOffset(double offset);
+    QString axisMap() const;
+    void setAxisMap(const QString &spec);
+    QString motionActivity() const;
+    MetricsRegistry *metrics() const;
+    bool isRecording() const;
+    PoseResampler *resampler() const;
+    PoseHistory *history() const;
+    EventLoopMonitor *eventLoop() const;
+    bool serverMode() const;
+    void setServerMode(bool enabled);
+    int subscriberCount() const;
+    void setRecording(bool recording);
+    QString secondaryHost() const;
+    void setSecondaryHost(const QString &host);
+    int secondaryPort() const;
+    void setSecondaryPort(int port);
+    bool standbyReady() const;
+    int failoverCount() const;
+    double lastFailoverMs() const;
+    // {active, samples, valid, tipX, tipY, tipZ (mm, remapped axes),
+    // residual (m/s^2), errorMm}
+    QVariantMap pivotCalibration() const;
+    // "fusion" (the app fuses the raw sensors) or "hardware" (the OS or sensor
+    // hub does, with app fusion as the fallback); applies from the next start
+    QString poseSource() const;
+    void setPoseSource(const QString &source);
+    
+    // One entry per pose source used so far: {name, available, active,
+    // poses, cpuUsPerPose, meanLatencyMs, maxLatencyMs}
+    Q_INVOKABLE QVariantList poseSourceStats() const;
+
+    // Device-to-reference registration as a row-major 3x4 or 4x4 matrix (mm)
+    Q_INVOKABLE bool setRegistration(const QVariantList &matrix);
+    Q_INVOKABLE void resetRegistration();
+    
+    // Pivot calibration of the tool tip: start, pivot the device about its
+    // tip, then apply the estimate as the tip offset (replacing the Z-axis
+    // offset) or cancel
+    Q_INVOKABLE void startPivotCalibration();
+    Q_INVOKABLE bool applyPivotCalibration();
+    Q_INVOKABLE void cancelPivotCalibration();
 
 public slots:
     void connectToServer();
@@ -45,24 +122,72 @@ signals:
     void sendingStatusChanged();
     void serverHostChanged();
     void serverPortChanged();
+    void deviceNameChanged();
     void connectionStatusChanged();
     void zAxisOffsetChanged();
+    void transformChanged();
+    void motionActivityChanged();
+    void recordingChanged();
+    void serverModeChanged();
+    void subscriberCountChanged();
+    void secondaryServerChanged();
+    void standbyChanged();
+    void failoverChanged();
+    void pivotCalibrationChanged();
+    void poseSourceChanged();
     void rotationDataSent(double w, double x, double y, double z);
 
 private slots:
     void onConnectionStateChanged();
+    void onBacklogChanged();
     void onRotationChanged(double w, double x, double y, double z);
+    void onSensorSample(const FusionInput &input, quint64 timeNs);
+    void sendPose(double w, double x, double y, double z);
+    void updateOutputRate();
 
 private:
     void loadSettings();
     void saveSettings();
+    void updateServerStatus();
+    void startMetricsExport();
+    void startEventLoopMonitor();
+    void setUpStoreAndForward();
+    void saveTransform();
+    void loadFusionSettings();
+    void saveFusionTuning();
+    RotationSensor *rotationSensor();
+    OrientationSensor *orientationSensor();
+    PoseSource *selectPoseSource();
+
+    static ApplicationController *s_instance;
     
     RotationSensor *m_rotationSensor;
+    OrientationSensor *m_orientationSensor;
+    // The source streaming poses; null until the first start
+    PoseSource *m_poseSource;
+    QString m_poseSourceSetting;
     NetworkManager *m_networkManager;
+    PoseResampler *m_resampler;
+    PoseHistory *m_history;
+    EventLoopMonitor *m_eventLoop;
+    bool m_resamplingEnabled;
+    // Raw SENSOR streaming (output/rawImu): off, alongside the fused pose, or
+    // instead of it
+    enum RawImuMode { RawImuOff, RawImuAlongside, RawImuOnly };
+    RawImuMode m_rawImuMode;
     QString m_serverHost;
     int m_serverPort;
+    QString m_secondaryHost;
+    int m_secondaryPort;
+    bool m_serverMode;
     bool m_isConnected;
     bool m_isSendingRotation;
     QString m_connectionStatus;
+    bool m_showingBacklog; // connectionStatus describes the backlog
+    bool m_pivotStartedSensor; // the sensor runs only for the calibration
     double m_zAxisOffset;
+    double m_tipOffsetX;
+    double m_tipOffsetY;
+    QVariantList m_registration;
+    TransformChain m_transformChain;
 };
\ No newline at end of file
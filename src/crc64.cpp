@@ -0,0 +1,213 @@
+#include "crc64.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC64_HAVE_CLMUL 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint64_t kPolynomial = 0x42F0E1EBA9EA3693ULL;
+
+// Folding constants, x^n mod P
+const uint64_t kX128 = 0x05F5C3C7EB52FAB6ULL;
+const uint64_t kX192 = 0x4EB938A7D257740EULL;
+const uint64_t kX512 = 0x5F6843CA540DF020ULL;
+const uint64_t kX576 = 0xDDF4B6981205B83FULL;
+
+struct Tables {
+    // table[k][b]: CRC contribution of byte b followed by k zero bytes
+    uint64_t table[8][256];
+
+    Tables()
+    {
+        for (int b = 0; b < 256; ++b) {
+            uint64_t crc = uint64_t(b) << 56;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & (1ULL << 63)) ? (crc << 1) ^ kPolynomial : crc << 1;
+            }
+            table[0][b] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int b = 0; b < 256; ++b) {
+                const uint64_t previous = table[k - 1][b];
+                table[k][b] = (previous << 8) ^ table[0][previous >> 56];
+            }
+        }
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables instance;
+    return instance;
+}
+
+uint64_t loadBigEndian64(const uint8_t *p)
+{
+    return (uint64_t(p[0]) << 56) | (uint64_t(p[1]) << 48) | (uint64_t(p[2]) << 40) | (uint64_t(p[3]) << 32)
+           | (uint64_t(p[4]) << 24) | (uint64_t(p[5]) << 16) | (uint64_t(p[6]) << 8) | uint64_t(p[7]);
+}
+
+uint64_t crcBytewise(const uint8_t *p, size_t size, uint64_t crc)
+{
+    const uint64_t *table = tables().table[0];
+    while (size--) {
+        crc = table[(crc >> 56) ^ *p++] ^ (crc << 8);
+    }
+    return crc;
+}
+
+uint64_t crcSlice8(const uint8_t *p, size_t size, uint64_t crc)
+{
+    const Tables &t = tables();
+    while (size >= 8) {
+        crc ^= loadBigEndian64(p);
+        crc = t.table[7][crc >> 56] ^ t.table[6][(crc >> 48) & 0xff]
+              ^ t.table[5][(crc >> 40) & 0xff] ^ t.table[4][(crc >> 32) & 0xff]
+              ^ t.table[3][(crc >> 24) & 0xff] ^ t.table[2][(crc >> 16) & 0xff]
+              ^ t.table[1][(crc >> 8) & 0xff] ^ t.table[0][crc & 0xff];
+        p += 8;
+        size -= 8;
+    }
+    return crcBytewise(p, size, crc);
+}
+
+#ifdef CRC64_HAVE_CLMUL
+
+// Loads 16 bytes so that the first byte is the most significant
+__attribute__((target("pclmul,ssse3")))
+__m128i loadBlock(const uint8_t *p)
+{
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), reverse);
+}
+
+// x * x^n mod P with n given by the constants (high half, low half), still
+// 128 bits wide
+__attribute__((target("pclmul,ssse3")))
+__m128i fold(__m128i x, __m128i constants)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, constants, 0x11), _mm_clmulepi64_si128(x, constants, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+uint64_t crcClmul(const uint8_t *p, size_t size, uint64_t crc)
+{
+    if (size < 32) {
+        return crcSlice8(p, size, crc);
+    }
+
+    const __m128i fold128 = _mm_set_epi64x(int64_t(kX192), int64_t(kX128));
+    __m128i x = _mm_xor_si128(loadBlock(p), _mm_set_epi64x(int64_t(crc), 0));
+
+    if (size >= 128) {
+        // Four blocks in parallel, 64 bytes apart
+        const __m128i fold512 = _mm_set_epi64x(int64_t(kX576), int64_t(kX512));
+        __m128i x1 = loadBlock(p + 16);
+        __m128i x2 = loadBlock(p + 32);
+        __m128i x3 = loadBlock(p + 48);
+        p += 64;
+        size -= 64;
+        while (size >= 64) {
+            x = _mm_xor_si128(fold(x, fold512), loadBlock(p));
+            x1 = _mm_xor_si128(fold(x1, fold512), loadBlock(p + 16));
+            x2 = _mm_xor_si128(fold(x2, fold512), loadBlock(p + 32));
+            x3 = _mm_xor_si128(fold(x3, fold512), loadBlock(p + 48));
+            p += 64;
+            size -= 64;
+        }
+        x = _mm_xor_si128(fold(x, fold128), x1);
+        x = _mm_xor_si128(fold(x, fold128), x2);
+        x = _mm_xor_si128(fold(x, fold128), x3);
+    } else {
+        p += 16;
+        size -= 16;
+    }
+
+    while (size >= 16) {
+        x = _mm_xor_si128(fold(x, fold128), loadBlock(p));
+        p += 16;
+        size -= 16;
+    }
+
+    // x is congruent to everything folded so far; its CRC continues into
+    // the tail
+    uint8_t remainder[16];
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(remainder), _mm_shuffle_epi8(x, reverse));
+    return crcSlice8(p, size, crcSlice8(remainder, sizeof(remainder), 0));
+}
+
+bool clmulSupported()
+{
+    static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+#endif
+
+}
+
+namespace Crc64 {
+
+Implementation best()
+{
+    return isAvailable(Clmul) ? Clmul : Slice8;
+}
+
+bool isAvailable(Implementation implementation)
+{
+    switch (implementation) {
+    case Bytewise:
+    case Slice8:
+        return true;
+    case Clmul:
+#ifdef CRC64_HAVE_CLMUL
+        return clmulSupported();
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *name(Implementation implementation)
+{
+    switch (implementation) {
+    case Bytewise:
+        return "bytewise";
+    case Slice8:
+        return "slice8";
+    case Clmul:
+        return "clmul";
+    }
+    return "unknown";
+}
+
+uint64_t compute(const void *data, size_t size, uint64_t crc)
+{
+    static const Implementation implementation = best();
+    return compute(implementation, data, size, crc);
+}
+
+uint64_t compute(Implementation implementation, const void *data, size_t size, uint64_t crc)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    switch (implementation) {
+    case Bytewise:
+        return crcBytewise(p, size, crc);
+    case Slice8:
+        return crcSlice8(p, size, crc);
+    case Clmul:
+#ifdef CRC64_HAVE_CLMUL
+        if (clmulSupported()) {
+            return crcClmul(p, size, crc);
+        }
+#endif
+        return crcSlice8(p, size, crc);
+    }
+    return crcSlice8(p, size, crc);
+}
+
+}
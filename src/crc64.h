@@ -0,0 +1,34 @@
+#pragma once
+
+// CRC-64/ECMA-182 as used by OpenIGTLink for message bodies (polynomial
+// 0x42F0E1EBA9EA3693, MSB first, initial value 0, no final xor). Plain C++
+// so the tools can use and benchmark it.
+//
+// Three implementations give the same result:
+//   Bytewise  one table lookup per byte, like igtl_util_crc64 (reference)
+//   Slice8    eight tables, eight bytes per step
+//   Clmul     carry-less multiply folding (x86 PCLMULQDQ), 16 bytes per step;
+//             only available when the CPU supports it
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Crc64 {
+
+enum Implementation {
+    Bytewise,
+    Slice8,
+    Clmul
+};
+
+// Fastest implementation available on this CPU, chosen once
+Implementation best();
+bool isAvailable(Implementation implementation);
+const char *name(Implementation implementation);
+
+// CRC of data, continuing from crc (pass the previous result to checksum
+// data in pieces)
+uint64_t compute(const void *data, size_t size, uint64_t crc = 0);
+uint64_t compute(Implementation implementation, const void *data, size_t size, uint64_t crc = 0);
+
+}
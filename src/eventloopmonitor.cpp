@@ -0,0 +1,448 @@
+#include "eventloopmonitor.h"
+#include "metricsregistry.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QEvent>
+#include <QFileInfo>
+#include <QMetaEnum>
+#include <QTimer>
+#include <QVariantMap>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__linux__)
+#define EVENTLOOPMONITOR_STACKS 1
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unwind.h>
+#endif
+
+namespace {
+
+const int kMaxStalls = 20;
+
+#ifdef EVENTLOOPMONITOR_STACKS
+
+const int kMaxFrames = 32;
+// The signal handler and the kernel's signal trampoline
+const int kSkippedFrames = 2;
+const int kStackTimeoutMs = 20;
+
+// One monitor per process: the signal handler writes here. Each sample has
+// a sequence number; only the first handler run for the current one writes
+// the frames, and the sampler only reads them once that number is
+// published, so a handler arriving after the sampler gave up changes
+// nothing it reads.
+struct StackSample {
+    void *frames[kMaxFrames];
+    int depth = 0;
+    std::atomic<unsigned> requested{0};
+    std::atomic<unsigned> claimed{0};
+    std::atomic<unsigned> published{0};
+};
+
+StackSample g_stackSample;
+pthread_t g_guiThread;
+
+int stackSignal()
+{
+    return SIGRTMIN + 3;
+}
+
+_Unwind_Reason_Code addFrame(_Unwind_Context *context, void *)
+{
+    if (g_stackSample.depth >= kMaxFrames) {
+        return _URC_END_OF_STACK;
+    }
+    const uintptr_t pc = _Unwind_GetIP(context);
+    if (pc) {
+        g_stackSample.frames[g_stackSample.depth++] = reinterpret_cast<void *>(pc);
+    }
+    return _URC_NO_REASON;
+}
+
+// Runs on the GUI thread, wherever it is stuck. _Unwind_Backtrace() is not
+// async-signal-safe: interrupting the thread while it holds the unwinder's
+// lock (throwing, loading a library) deadlocks it, which is why stacks are
+// opt-in.
+void onStackSignal(int)
+{
+    const int savedErrno = errno;
+    const unsigned sequence = g_stackSample.requested.load(std::memory_order_acquire);
+    if (g_stackSample.claimed.exchange(sequence, std::memory_order_acq_rel) != sequence) {
+        g_stackSample.depth = 0;
+        _Unwind_Backtrace(addFrame, nullptr);
+        g_stackSample.published.store(sequence, std::memory_order_release);
+    }
+    errno = savedErrno;
+}
+
+QString symbolize(void *address)
+{
+    Dl_info info;
+    if (!dladdr(address, &info)) {
+        return QString("0x%1").arg(quintptr(address), 0, 16);
+    }
+    if (info.dli_sname) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        const QString name = QString::fromUtf8(status == 0 && demangled ? demangled : info.dli_sname);
+        std::free(demangled);
+        return QString("%1+0x%2").arg(name).arg(quintptr(address) - quintptr(info.dli_saddr), 0, 16);
+    }
+    return QString("%1+0x%2").arg(QFileInfo(QString::fromUtf8(info.dli_fname)).fileName())
+                             .arg(quintptr(address) - quintptr(info.dli_fbase), 0, 16);
+}
+
+// Interrupts the GUI thread and unwinds its stack there
+QStringList sampleGuiStack()
+{
+    const unsigned sequence = g_stackSample.requested.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (pthread_kill(g_guiThread, stackSignal()) != 0) {
+        return QStringList();
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kStackTimeoutMs);
+    while (g_stackSample.published.load(std::memory_order_acquire) != sequence) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return QStringList();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    QStringList stack;
+    for (int i = kSkippedFrames; i < g_stackSample.depth; ++i) {
+        stack.append(symbolize(g_stackSample.frames[i]));
+    }
+    return stack;
+}
+
+#endif
+
+}
+
+EventLoopMonitor::EventLoopMonitor(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+    , m_intervalMs(10)
+    , m_stallThresholdMs(50)
+    , m_maxLagMs(0.0)
+    , m_windowMaxLagMs(0.0)
+    , m_recentMaxLagMs(0.0)
+    , m_stallCount(0)
+    , m_windowStartNs(0)
+    , m_dueNs(0)
+    , m_probe(0)
+    , m_receiverClass(nullptr)
+    , m_parentClass(nullptr)
+    , m_eventType(QEvent::None)
+    , m_stopping(false)
+    , m_paused(false)
+    , m_sampleStacks(false)
+{
+    std::fill(m_buckets, m_buckets + kBucketCount, 0);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &EventLoopMonitor::probe);
+}
+
+EventLoopMonitor::~EventLoopMonitor()
+{
+    stop();
+}
+
+void EventLoopMonitor::start(int intervalMs, int stallThresholdMs, bool sampleStacks)
+{
+    stop();
+    m_intervalMs = qMax(1, intervalMs);
+    m_stallThresholdMs = qMax(m_intervalMs, stallThresholdMs);
+    m_sampleStacks = false;
+    m_clock.start();
+    m_windowStartNs = 0;
+
+#ifdef EVENTLOOPMONITOR_STACKS
+    if (sampleStacks) {
+        m_sampleStacks = true;
+        g_guiThread = pthread_self();
+        struct sigaction action = {};
+        action.sa_handler = onStackSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(stackSignal(), &action, nullptr);
+        // The unwinder loads lazily; do that here rather than in the handler
+        _Unwind_Backtrace(addFrame, nullptr);
+    }
+#else
+    Q_UNUSED(sampleStacks);
+#endif
+
+    m_stopping = false;
+    m_watchdog = std::thread(&EventLoopMonitor::watch, this);
+    if (!m_paused) {
+        // Sees every event delivered to objects of the GUI thread
+        QCoreApplication::instance()->installEventFilter(this);
+        arm();
+    }
+    qDebug() << "EventLoopMonitor: Probing every" << m_intervalMs << "ms, stalls from" << m_stallThresholdMs << "ms"
+             << (m_sampleStacks ? "with stacks" : "") << (m_paused ? "(paused)" : "");
+    emit runningChanged();
+}
+
+void EventLoopMonitor::stop()
+{
+    if (!m_watchdog.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    m_watchdog.join();
+    m_timer->stop();
+    if (QCoreApplication::instance()) {
+        QCoreApplication::instance()->removeEventFilter(this);
+    }
+    emit runningChanged();
+}
+
+bool EventLoopMonitor::isRunning() const
+{
+    return m_watchdog.joinable();
+}
+
+void EventLoopMonitor::setPaused(bool paused)
+{
+    if (m_paused == paused) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_paused = paused;
+    }
+    if (!isRunning()) {
+        return;
+    }
+    if (paused) {
+        m_timer->stop();
+        QCoreApplication::instance()->removeEventFilter(this);
+        // The probe that was pending is not a stall
+        m_probe.fetch_add(1);
+    } else {
+        m_wakeup.notify_all();
+        QCoreApplication::instance()->installEventFilter(this);
+        arm();
+    }
+}
+
+bool EventLoopMonitor::isPaused() const
+{
+    return m_paused;
+}
+
+double EventLoopMonitor::recentMaxLagMs() const
+{
+    return m_recentMaxLagMs;
+}
+
+double EventLoopMonitor::maxLagMs() const
+{
+    return m_maxLagMs;
+}
+
+quint64 EventLoopMonitor::stallCount() const
+{
+    return m_stallCount;
+}
+
+int EventLoopMonitor::stallThresholdMs() const
+{
+    return m_stallThresholdMs;
+}
+
+QVariantList EventLoopMonitor::histogram() const
+{
+    QVariantList buckets;
+    for (int i = 0; i < kBucketCount; ++i) {
+        QVariantMap bucket;
+        bucket["upperMs"] = i < kBucketCount - 1 ? (1 << i) : 0;
+        bucket["count"] = m_buckets[i];
+        buckets.append(bucket);
+    }
+    return buckets;
+}
+
+QStringList EventLoopMonitor::recentStalls() const
+{
+    QStringList lines;
+    for (const Stall &stall : m_stalls) {
+        lines.append(stallLine(stall));
+    }
+    return lines;
+}
+
+QString EventLoopMonitor::report() const
+{
+    QString text = QString("Event loop dispatch delay (probe every %1 ms)\n").arg(m_intervalMs);
+    for (int i = 0; i < kBucketCount; ++i) {
+        const QString range = i < kBucketCount - 1 ? QString("< %1 ms").arg(1 << i)
+                                                   : QString(">= %1 ms").arg(1 << (i - 1));
+        text += QString("  %1 %2\n").arg(range, -10).arg(m_buckets[i]);
+    }
+    text += QString("Max %1 ms, %2 stall(s) of %3 ms or more\n").arg(m_maxLagMs, 0, 'f', 1)
+                .arg(m_stallCount).arg(m_stallThresholdMs);
+    for (const Stall &stall : m_stalls) {
+        text += stallLine(stall) + '\n';
+        for (const QString &frame : stall.stack) {
+            text += "    " + frame + '\n';
+        }
+    }
+    return text;
+}
+
+void EventLoopMonitor::resetStatistics()
+{
+    std::fill(m_buckets, m_buckets + kBucketCount, 0);
+    m_maxLagMs = 0.0;
+    m_windowMaxLagMs = 0.0;
+    m_recentMaxLagMs = 0.0;
+    m_stallCount = 0;
+    m_stalls.clear();
+    emit updated();
+}
+
+bool EventLoopMonitor::eventFilter(QObject *watched, QEvent *event)
+{
+    // Class names of QML types live as long as their compilation units, which
+    // the app never unloads, so the pointers stay valid
+    QObject *parent = watched->parent();
+    m_receiverClass.store(watched->metaObject()->className(), std::memory_order_relaxed);
+    m_parentClass.store(parent ? parent->metaObject()->className() : nullptr, std::memory_order_relaxed);
+    m_eventType.store(event->type(), std::memory_order_relaxed);
+    return false;
+}
+
+void EventLoopMonitor::arm()
+{
+    m_dueNs.store(m_clock.nsecsElapsed() + qint64(m_intervalMs) * 1000000);
+    m_probe.fetch_add(1);
+    m_timer->start(m_intervalMs);
+}
+
+void EventLoopMonitor::probe()
+{
+    const qint64 nowNs = m_clock.nsecsElapsed();
+    const double lagMs = qMax<qint64>(0, nowNs - m_dueNs.load()) / 1e6;
+
+    int bucket = 0;
+    while (bucket < kBucketCount - 1 && lagMs >= double(1 << bucket)) {
+        ++bucket;
+    }
+    ++m_buckets[bucket];
+    m_maxLagMs = qMax(m_maxLagMs, lagMs);
+    m_windowMaxLagMs = qMax(m_windowMaxLagMs, lagMs);
+
+    if (lagMs >= m_stallThresholdMs) {
+        Stall stall;
+        stall.time = QDateTime::currentDateTime();
+        stall.durationMs = lagMs;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_capture.probe == m_probe.load()) {
+                stall.handler = m_capture.handler;
+                stall.stack = m_capture.stack;
+            }
+        }
+        if (stall.handler.isEmpty()) {
+            // Over before the watchdog looked
+            stall.handler = QStringLiteral("unknown");
+        }
+        ++m_stallCount;
+        m_stalls.append(stall);
+        if (m_stalls.size() > kMaxStalls) {
+            m_stalls.removeFirst();
+        }
+        MetricsRegistry::add(MetricsRegistry::EventLoopStalls);
+        qWarning().noquote() << "EventLoopMonitor: Stall of" << QString::number(lagMs, 'f', 1) << "ms in" << stall.handler
+                             << (stall.stack.isEmpty() ? QString() : "\n    " + stall.stack.join("\n    "));
+        emit stallDetected(lagMs, stall.handler);
+    }
+
+    if (nowNs - m_windowStartNs >= 1000000000) {
+        m_recentMaxLagMs = m_windowMaxLagMs;
+        m_windowMaxLagMs = 0.0;
+        m_windowStartNs = nowNs;
+        MetricsRegistry::set(MetricsRegistry::EventLoopLagUs, qint64(m_recentMaxLagMs * 1000.0));
+        emit updated();
+    }
+    arm();
+}
+
+void EventLoopMonitor::watch()
+{
+    // Looks twice per threshold, so a stall is caught while it lasts;
+    // sleeps for as long as the monitor is paused
+    const auto period = std::chrono::milliseconds(qMax(1, m_stallThresholdMs / 2));
+    quint64 reported = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        if (m_paused) {
+            m_wakeup.wait(lock, [this]() { return m_stopping || !m_paused; });
+            continue;
+        }
+        m_wakeup.wait_for(lock, period);
+        if (m_stopping) {
+            break;
+        }
+        if (m_paused) {
+            continue;
+        }
+        const quint64 probe = m_probe.load();
+        const qint64 overdueNs = m_clock.nsecsElapsed() - m_dueNs.load();
+        if (probe == reported || overdueNs < qint64(m_stallThresholdMs) * 1000000) {
+            continue;
+        }
+        reported = probe;
+
+        // The handler first, so the probe finds at least that if the stall
+        // ends while the stack is taken
+        m_capture.probe = probe;
+        m_capture.handler = currentHandler();
+        m_capture.stack.clear();
+#ifdef EVENTLOOPMONITOR_STACKS
+        if (m_sampleStacks) {
+            lock.unlock();
+            const QStringList stack = sampleGuiStack();
+            lock.lock();
+            // A stack taken after the stall ended shows something else
+            if (m_capture.probe == probe && m_probe.load() == probe) {
+                m_capture.stack = stack;
+            }
+        }
+#endif
+    }
+}
+
+QString EventLoopMonitor::currentHandler() const
+{
+    const char *receiver = m_receiverClass.load(std::memory_order_relaxed);
+    const char *parent = m_parentClass.load(std::memory_order_relaxed);
+    const int type = m_eventType.load(std::memory_order_relaxed);
+    if (!receiver) {
+        return QString();
+    }
+    const char *typeName = QMetaEnum::fromType<QEvent::Type>().valueToKey(type);
+    QString handler = QString::fromUtf8(receiver);
+    if (parent) {
+        handler += QStringLiteral(" in ") + QString::fromUtf8(parent);
+    }
+    return handler + QString(" (%1)").arg(typeName ? QString::fromUtf8(typeName) : QString::number(type));
+}
+
+QString EventLoopMonitor::stallLine(const Stall &stall) const
+{
+    return QString("%1 %2 ms %3").arg(stall.time.toString("hh:mm:ss.zzz"))
+                                  .arg(stall.durationMs, 0, 'f', 1).arg(stall.handler);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVariantList>
+#include <QVector>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class QTimer;
+
+// Watches the GUI thread's event loop, which sensor fusion, QML rendering,
+// settings I/O and socket handling all share. A precise single-shot timer
+// probes the loop every few milliseconds; how late it fires is the dispatch
+// delay, kept in a histogram with power-of-two millisecond buckets. Delays
+// from the stall threshold up are stalls. A watchdog thread notices a stall
+// while it is still going on and records which handler the loop is in: the
+// receiver class (and its parent's, which names the owner of a QTimer) and
+// event type of the last event dispatched on the GUI thread. On Linux and
+// Android it can also sample the GUI thread's stack, from a signal handler
+// that is not async-signal-safe; that is opt-in.
+class EventLoopMonitor : public QObject
+{
+    Q_OBJECT
+    QML_ANONYMOUS
+
+    Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+    Q_PROPERTY(double recentMaxLagMs READ recentMaxLagMs NOTIFY updated)
+    Q_PROPERTY(double maxLagMs READ maxLagMs NOTIFY updated)
+    Q_PROPERTY(quint64 stallCount READ stallCount NOTIFY updated)
+    Q_PROPERTY(int stallThresholdMs READ stallThresholdMs NOTIFY runningChanged)
+    Q_PROPERTY(QVariantList histogram READ histogram NOTIFY updated)
+    Q_PROPERTY(QStringList recentStalls READ recentStalls NOTIFY updated)
+
+public:
+    // Bucket i counts delays below 2^i ms; the last one everything above
+    static const int kBucketCount = 12;
+
+    explicit EventLoopMonitor(QObject *parent = nullptr);
+    ~EventLoopMonitor();
+
+    // Must be called on the GUI thread. sampleStacks adds the GUI thread's
+    // stack to each stall (Linux and Android); the unwinder can deadlock in
+    // a signal handler, so only turn it on to diagnose.
+    void start(int intervalMs, int stallThresholdMs, bool sampleStacks = false);
+    void stop();
+    bool isRunning() const;
+    // Stops probing and the watchdog's wakeups without ending the run, e.g.
+    // while the device is still and the app mostly sleeps. Kept across
+    // start() and stop().
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    double recentMaxLagMs() const; // over the last second
+    double maxLagMs() const;
+    quint64 stallCount() const;
+    int stallThresholdMs() const;
+    // {upperMs, count} maps, one per bucket; upperMs is 0 for the last one
+    QVariantList histogram() const;
+    // One line per recent stall, newest last
+    QStringList recentStalls() const;
+
+    // Histogram and recent stalls with their stacks, as plain text
+    Q_INVOKABLE QString report() const;
+    Q_INVOKABLE void resetStatistics();
+
+signals:
+    void runningChanged();
+    // Once per second while running
+    void updated();
+    void stallDetected(double durationMs, const QString &handler);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void probe();
+
+private:
+    struct Stall {
+        QDateTime time;
+        double durationMs = 0.0;
+        QString handler;
+        QStringList stack;
+    };
+
+    // What the watchdog saw while a probe was overdue
+    struct Capture {
+        quint64 probe = 0;
+        QString handler;
+        QStringList stack;
+    };
+
+    void arm();
+    void watch();
+    QString currentHandler() const;
+    QString stallLine(const Stall &stall) const;
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    int m_intervalMs;
+    int m_stallThresholdMs;
+
+    // Statistics, GUI thread only
+    quint64 m_buckets[kBucketCount];
+    double m_maxLagMs;
+    double m_windowMaxLagMs;
+    double m_recentMaxLagMs;
+    quint64 m_stallCount;
+    qint64 m_windowStartNs;
+    QVector<Stall> m_stalls;
+
+    // Shared with the watchdog thread
+    std::atomic<qint64> m_dueNs;     // when the pending probe should fire
+    std::atomic<quint64> m_probe;    // sequence number of the pending probe
+    std::atomic<const char *> m_receiverClass;
+    std::atomic<const char *> m_parentClass;
+    std::atomic<int> m_eventType;
+    std::thread m_watchdog;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stopping;
+    bool m_paused;
+    bool m_sampleStacks;
+    Capture m_capture;
+};
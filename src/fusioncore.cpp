@@ -0,0 +1,464 @@
+#include "fusioncore.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// cos and sin of 45 degrees, the half angle of a quarter turn
+const double kQuarterTurn = 0.70710678118654752440;
+
+}
+
+FusionCore::FusionCore()
+    : m_beta(0.1)
+    , m_q0(1.0), m_q1(0.0), m_q2(0.0), m_q3(0.0)
+    , m_previousGyro{0.0, 0.0, 0.0}
+    , m_hasPreviousGyro(false)
+{
+}
+
+const FusionCore::Parameters &FusionCore::parameters() const
+{
+    return m_parameters;
+}
+
+void FusionCore::setParameters(const Parameters &parameters)
+{
+    if (parameters.algorithm != m_parameters.algorithm) {
+        m_hasPreviousGyro = false;
+    }
+    m_parameters = parameters;
+    m_beta = parameters.beta;
+}
+
+void FusionCore::reset()
+{
+    m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
+    m_hasPreviousGyro = false;
+}
+
+void FusionCore::update(const FusionInput &input, double dt)
+{
+    double ax = input.accel[0], ay = input.accel[1], az = input.accel[2];
+    double mx = input.mag[0], my = input.mag[1], mz = input.mag[2];
+    const double gyro[3] = {input.gyro[0] - m_parameters.gyroBias[0], input.gyro[1] - m_parameters.gyroBias[1],
+                            input.gyro[2] - m_parameters.gyroBias[2]};
+    double gx = gyro[0], gy = gyro[1], gz = gyro[2];
+    bool dtValid = dt > m_parameters.minDt && dt < m_parameters.maxDt;
+
+    switch (m_parameters.algorithm) {
+    case GyroIntegration:
+        if (input.hasGyro) {
+            // After a gap the previous reading no longer marks the step's start
+            if (!dtValid) {
+                m_hasPreviousGyro = false;
+            }
+            if (dtValid && (std::abs(gx) + std::abs(gy) + std::abs(gz)) > 1e-6) {
+                gyroUpdate(gyro, dt);
+            }
+            std::memcpy(m_previousGyro, gyro, sizeof(m_previousGyro));
+            m_hasPreviousGyro = true;
+            return;
+        }
+        break;
+    case Madgwick:
+        if (input.hasGyro && input.hasAccel) {
+            if (dtValid) {
+                // Without a magnetometer the filter runs in IMU mode
+                if (!input.hasMag) {
+                    mx = my = mz = 0.0;
+                }
+                // The filter's world frame has x along the horizontal field
+                // (north), y west and z up: a quarter turn about z from ours
+                rotateWorldAboutZ(kQuarterTurn, -kQuarterTurn);
+                madgwickUpdate(gx, gy, gz, ax, ay, az, mx, my, mz, dt);
+                rotateWorldAboutZ(kQuarterTurn, kQuarterTurn);
+            }
+            return;
+        }
+        break;
+    case AccelMag:
+        break;
+    }
+
+    // Accelerometer + magnetometer
+    normalizeVector(ax, ay, az);
+    normalizeVector(mx, my, mz);
+    quaternionFromTwoVectors(ax, ay, az, mx, my, mz, m_q0, m_q1, m_q2, m_q3);
+}
+
+void FusionCore::orientation(double &w, double &x, double &y, double &z) const
+{
+    w = m_q0; x = m_q1; y = m_q2; z = m_q3;
+}
+
+const char *FusionCore::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm) {
+    case GyroIntegration:
+        return "gyro";
+    case Madgwick:
+        return "madgwick";
+    case AccelMag:
+        return "accelmag";
+    }
+    return "unknown";
+}
+
+bool FusionCore::algorithmFromName(const char *name, Algorithm &algorithm)
+{
+    const Algorithm candidates[] = {GyroIntegration, Madgwick, AccelMag};
+    for (Algorithm candidate : candidates) {
+        if (std::strcmp(name, algorithmName(candidate)) == 0) {
+            algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *FusionCore::integratorName(Integrator integrator)
+{
+    switch (integrator) {
+    case Euler:
+        return "euler";
+    case ExpMap:
+        return "expmap";
+    case RK4:
+        return "rk4";
+    }
+    return "unknown";
+}
+
+bool FusionCore::integratorFromName(const char *name, Integrator &integrator)
+{
+    const Integrator candidates[] = {Euler, ExpMap, RK4};
+    for (Integrator candidate : candidates) {
+        if (std::strcmp(name, integratorName(candidate)) == 0) {
+            integrator = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FusionCore::gyroUpdate(const double gyro[3], double dt)
+{
+    // Body-frame rates: q' = 1/2 q * (0, omega)
+    const double *start = m_hasPreviousGyro ? m_previousGyro : gyro;
+    switch (m_parameters.integrator) {
+    case Euler: {
+        double half_dt = dt * 0.5;
+        double gx = gyro[0], gy = gyro[1], gz = gyro[2];
+        double dq0 = -m_q1 * gx * half_dt - m_q2 * gy * half_dt - m_q3 * gz * half_dt;
+        double dq1 = m_q0 * gx * half_dt + m_q2 * gz * half_dt - m_q3 * gy * half_dt;
+        double dq2 = m_q0 * gy * half_dt - m_q1 * gz * half_dt + m_q3 * gx * half_dt;
+        double dq3 = m_q0 * gz * half_dt + m_q1 * gy * half_dt - m_q2 * gx * half_dt;
+        m_q0 += dq0;
+        m_q1 += dq1;
+        m_q2 += dq2;
+        m_q3 += dq3;
+        break;
+    }
+    case ExpMap: {
+        // Rotation vector of the step for a linearly changing rate: the mean
+        // rate plus the coning term (start x end) dt^2 / 12
+        double cx, cy, cz;
+        vectorCross(start[0], start[1], start[2], gyro[0], gyro[1], gyro[2], cx, cy, cz);
+        const double coning = dt * dt / 12.0;
+        const double px = 0.5 * (start[0] + gyro[0]) * dt + coning * cx;
+        const double py = 0.5 * (start[1] + gyro[1]) * dt + coning * cy;
+        const double pz = 0.5 * (start[2] + gyro[2]) * dt + coning * cz;
+        const double angle = sqrt(px*px + py*py + pz*pz);
+        // sin(angle / 2) / angle, by its series near zero
+        const double scale = angle > 1e-6 ? sin(0.5 * angle) / angle : 0.5 - angle * angle / 48.0;
+        const double w = cos(0.5 * angle);
+        double q0, q1, q2, q3;
+        quaternionMultiply(m_q0, m_q1, m_q2, m_q3, w, px * scale, py * scale, pz * scale, q0, q1, q2, q3);
+        m_q0 = q0; m_q1 = q1; m_q2 = q2; m_q3 = q3;
+        break;
+    }
+    case RK4: {
+        const double middle[3] = {0.5 * (start[0] + gyro[0]), 0.5 * (start[1] + gyro[1]), 0.5 * (start[2] + gyro[2])};
+        const double *rates[4] = {start, middle, middle, gyro};
+        const double offsets[4] = {0.0, 0.5 * dt, 0.5 * dt, dt};
+        const double weights[4] = {1.0, 2.0, 2.0, 1.0};
+        const double q[4] = {m_q0, m_q1, m_q2, m_q3};
+        double k[4] = {0.0, 0.0, 0.0, 0.0};
+        double sum[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int stage = 0; stage < 4; ++stage) {
+            double p[4];
+            for (int i = 0; i < 4; ++i) {
+                p[i] = q[i] + offsets[stage] * k[i];
+            }
+            const double *w = rates[stage];
+            quaternionMultiply(p[0], p[1], p[2], p[3], 0.0, 0.5 * w[0], 0.5 * w[1], 0.5 * w[2], k[0], k[1], k[2], k[3]);
+            for (int i = 0; i < 4; ++i) {
+                sum[i] += weights[stage] * k[i];
+            }
+        }
+        m_q0 += dt / 6.0 * sum[0];
+        m_q1 += dt / 6.0 * sum[1];
+        m_q2 += dt / 6.0 * sum[2];
+        m_q3 += dt / 6.0 * sum[3];
+        break;
+    }
+    }
+    normalizeOrientation();
+}
+
+void FusionCore::rotateWorldAboutZ(double cosHalf, double sinHalf)
+{
+    double q0, q1, q2, q3;
+    quaternionMultiply(cosHalf, 0.0, 0.0, sinHalf, m_q0, m_q1, m_q2, m_q3, q0, q1, q2, q3);
+    m_q0 = q0; m_q1 = q1; m_q2 = q2; m_q3 = q3;
+}
+
+void FusionCore::normalizeOrientation()
+{
+    double norm = sqrt(m_q0*m_q0 + m_q1*m_q1 + m_q2*m_q2 + m_q3*m_q3);
+    if (norm > 1e-6) {
+        m_q0 /= norm; m_q1 /= norm; m_q2 /= norm; m_q3 /= norm;
+    } else {
+        m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
+    }
+}
+
+void FusionCore::quaternionFromTwoVectors(double ax, double ay, double az, double mx, double my, double mz, double &w, double &x, double &y, double &z)
+{
+    // World axes in the device frame (right-handed)
+    // Z-axis: the accelerometer reading (up)
+    double zx = ax, zy = ay, zz = az;
+    
+    // X-axis: cross product of magnetic field and Z (east)
+    double xx, xy, xz;
+    vectorCross(mx, my, mz, zx, zy, zz, xx, xy, xz);
+    normalizeVector(xx, xy, xz);
+    
+    // Y-axis: cross product of Z and X (north)
+    double yx, yy, yz;
+    vectorCross(zx, zy, zz, xx, xy, xz, yx, yy, yz);
+    normalizeVector(yx, yy, yz);
+    
+    // The world axes are the rows of the device-to-world rotation matrix:
+    // [xx, xy, xz]  (X=east, Y=north, Z=up)
+    // [yx, yy, yz]
+    // [zx, zy, zz]
+    
+    double trace = xx + yy + zz;
+    
+    if (trace > 0.0) {
+        double s = sqrt(trace + 1.0) * 2.0; // s = 4 * qw
+        w = 0.25 * s;
+        x = (zy - yz) / s;
+        y = (xz - zx) / s;
+        z = (yx - xy) / s;
+    } else if ((xx > yy) && (xx > zz)) {
+        double s = sqrt(1.0 + xx - yy - zz) * 2.0; // s = 4 * qx
+        w = (zy - yz) / s;
+        x = 0.25 * s;
+        y = (xy + yx) / s;
+        z = (xz + zx) / s;
+    } else if (yy > zz) {
+        double s = sqrt(1.0 + yy - xx - zz) * 2.0; // s = 4 * qy
+        w = (xz - zx) / s;
+        x = (xy + yx) / s;
+        y = 0.25 * s;
+        z = (yz + zy) / s;
+    } else {
+        double s = sqrt(1.0 + zz - xx - yy) * 2.0; // s = 4 * qz
+        w = (yx - xy) / s;
+        x = (xz + zx) / s;
+        y = (yz + zy) / s;
+        z = 0.25 * s;
+    }
+}
+
+void FusionCore::normalizeVector(double &x, double &y, double &z)
+{
+    double length = sqrt(x*x + y*y + z*z);
+    if (length > 0.0) {
+        x /= length;
+        y /= length;
+        z /= length;
+    }
+}
+
+double FusionCore::vectorDot(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+    return x1*x2 + y1*y2 + z1*z2;
+}
+
+void FusionCore::vectorCross(double x1, double y1, double z1, double x2, double y2, double z2, double &x, double &y, double &z)
+{
+    x = y1*z2 - z1*y2;
+    y = z1*x2 - x1*z2;
+    z = x1*y2 - y1*x2;
+}
+
+void FusionCore::quaternionMultiply(double q1w, double q1x, double q1y, double q1z, 
+                                       double q2w, double q2x, double q2y, double q2z, 
+                                       double &qw, double &qx, double &qy, double &qz)
+{
+    qw = q1w * q2w - q1x * q2x - q1y * q2y - q1z * q2z;
+    qx = q1w * q2x + q1x * q2w + q1y * q2z - q1z * q2y;
+    qy = q1w * q2y - q1x * q2z + q1y * q2w + q1z * q2x;
+    qz = q1w * q2z + q1x * q2y - q1y * q2x + q1z * q2w;
+}
+
+void FusionCore::quaternionConjugate(double qw, double qx, double qy, double qz, 
+                                         double &conjW, double &conjX, double &conjY, double &conjZ)
+{
+    conjW = qw;
+    conjX = -qx;
+    conjY = -qy;
+    conjZ = -qz;
+}
+
+bool FusionCore::madgwickUpdate(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, double dt)
+{
+    // Safety checks for NaN prevention
+    if (!std::isfinite(gx) || !std::isfinite(gy) || !std::isfinite(gz) ||
+        !std::isfinite(ax) || !std::isfinite(ay) || !std::isfinite(az) ||
+        !std::isfinite(mx) || !std::isfinite(my) || !std::isfinite(mz) ||
+        !std::isfinite(dt) || dt <= 0.0) {
+        return false;
+    }
+    
+    // Check if accelerometer data is valid (not zero vector)
+    double accel_norm = sqrt(ax * ax + ay * ay + az * az);
+    if (accel_norm < 1e-6) {
+        return false;
+    }
+    
+    double recipNorm;
+    double s0, s1, s2, s3;
+    double qDot1, qDot2, qDot3, qDot4;
+    double hx, hy;
+    double _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
+    double q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+
+    // Use IMU algorithm if magnetometer measurement is invalid (avoids NaN in magnetometer normalisation)
+    if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+        // IMU algorithm without magnetometer
+        recipNorm = 1.0 / sqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Gradient decent algorithm corrective step
+        s0 = -2.0 * (2.0 * m_q1 * m_q3 - 2.0 * m_q0 * m_q2 - ax);
+        s1 = -2.0 * (2.0 * m_q0 * m_q1 + 2.0 * m_q2 * m_q3 - ay);
+        s2 = -2.0 * (1.0 - 2.0 * m_q1 * m_q1 - 2.0 * m_q2 * m_q2 - az);
+        s3 = -4.0 * m_q3 * (1.0 - 2.0 * m_q2 * m_q2 - 2.0 * m_q3 * m_q3 - az) + (-4.0) * m_q1 * (2.0 * m_q1 * m_q3 - 2.0 * m_q0 * m_q2 - ax);
+
+        double s_norm = sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        if (s_norm < 1e-12) {
+            // Degenerate correction, integrate the gyroscope only
+            qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz);
+            qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy);
+            qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx);
+            qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx);
+        } else {
+            recipNorm = 1.0 / s_norm;
+            s0 *= recipNorm;
+            s1 *= recipNorm;
+            s2 *= recipNorm;
+            s3 *= recipNorm;
+        }
+
+        // Apply feedback step
+        qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz) - m_beta * s0;
+        qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy) - m_beta * s1;
+        qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx) - m_beta * s2;
+        qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx) - m_beta * s3;
+    } else {
+        // Full Madgwick algorithm with magnetometer
+        
+        // Normalise accelerometer measurement
+        recipNorm = 1.0 / sqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Normalise magnetometer measurement
+        recipNorm = 1.0 / sqrt(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        _2q0mx = 2.0 * m_q0 * mx;
+        _2q0my = 2.0 * m_q0 * my;
+        _2q0mz = 2.0 * m_q0 * mz;
+        _2q1mx = 2.0 * m_q1 * mx;
+        _2q0 = 2.0 * m_q0;
+        _2q1 = 2.0 * m_q1;
+        _2q2 = 2.0 * m_q2;
+        _2q3 = 2.0 * m_q3;
+        _2q0q2 = 2.0 * m_q0 * m_q2;
+        _2q2q3 = 2.0 * m_q2 * m_q3;
+        q0q0 = m_q0 * m_q0;
+        q0q1 = m_q0 * m_q1;
+        q0q2 = m_q0 * m_q2;
+        q0q3 = m_q0 * m_q3;
+        q1q1 = m_q1 * m_q1;
+        q1q2 = m_q1 * m_q2;
+        q1q3 = m_q1 * m_q3;
+        q2q2 = m_q2 * m_q2;
+        q2q3 = m_q2 * m_q3;
+        q3q3 = m_q3 * m_q3;
+
+        // Reference direction of Earth's magnetic field
+        hx = mx * q0q0 - _2q0my * m_q3 + _2q0mz * m_q2 + mx * q1q1 + _2q1 * my * m_q2 + _2q1 * mz * m_q3 - mx * q2q2 - mx * q3q3;
+        hy = _2q0mx * m_q3 + my * q0q0 - _2q0mz * m_q1 + _2q1mx * m_q2 - my * q1q1 + my * q2q2 + _2q2 * mz * m_q3 - my * q3q3;
+        _2bx = sqrt(hx * hx + hy * hy);
+        _2bz = -_2q0mx * m_q2 + _2q0my * m_q1 + mz * q0q0 + _2q1mx * m_q3 - mz * q1q1 + _2q2 * my * m_q3 - mz * q2q2 + mz * q3q3;
+        _4bx = 2.0 * _2bx;
+        _4bz = 2.0 * _2bz;
+
+        // Gradient descent algorithm corrective step
+        s0 = -_2q2 * (2.0 * q1q3 - _2q0q2 - ax) + _2q1 * (2.0 * q0q1 + _2q2q3 - ay) - _2bz * m_q2 * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * m_q3 + _2bz * m_q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * m_q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
+        s1 = _2q3 * (2.0 * q1q3 - _2q0q2 - ax) + _2q0 * (2.0 * q0q1 + _2q2q3 - ay) - 4.0 * m_q1 * (1.0 - 2.0 * q1q1 - 2.0 * q2q2 - az) + _2bz * m_q3 * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * m_q2 + _2bz * m_q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * m_q3 - _4bz * m_q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
+        s2 = -_2q0 * (2.0 * q1q3 - _2q0q2 - ax) + _2q3 * (2.0 * q0q1 + _2q2q3 - ay) - 4.0 * m_q2 * (1.0 - 2.0 * q1q1 - 2.0 * q2q2 - az) + (-_4bx * m_q2 - _2bz * m_q0) * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * m_q1 + _2bz * m_q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * m_q0 - _4bz * m_q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
+        s3 = _2q1 * (2.0 * q1q3 - _2q0q2 - ax) + _2q2 * (2.0 * q0q1 + _2q2q3 - ay) + (-_4bx * m_q3 + _2bz * m_q1) * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * m_q0 + _2bz * m_q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * m_q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
+        
+        recipNorm = 1.0 / sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); 
+        s0 *= recipNorm;
+        s1 *= recipNorm;
+        s2 *= recipNorm;
+        s3 *= recipNorm;
+
+        // Apply feedback step
+        qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz) - m_beta * s0;
+        qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy) - m_beta * s1;
+        qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx) - m_beta * s2;
+        qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx) - m_beta * s3;
+    }
+
+    // Integrate rate of change of quaternion to yield quaternion
+    m_q0 += qDot1 * dt;
+    m_q1 += qDot2 * dt;
+    m_q2 += qDot3 * dt;
+    m_q3 += qDot4 * dt;
+
+    // Normalise quaternion
+    double q_norm = sqrt(m_q0 * m_q0 + m_q1 * m_q1 + m_q2 * m_q2 + m_q3 * m_q3);
+    if (q_norm < 1e-12) {
+        // Quaternion collapsed, start over from identity
+        m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
+    } else {
+        recipNorm = 1.0 / q_norm;
+        m_q0 *= recipNorm;
+        m_q1 *= recipNorm;
+        m_q2 *= recipNorm;
+        m_q3 *= recipNorm;
+    }
+    
+    // Final validation
+    if (!std::isfinite(m_q0) || !std::isfinite(m_q1) || !std::isfinite(m_q2) || !std::isfinite(m_q3)) {
+        m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
+    }
+    return true;
+}
\ No newline at end of file
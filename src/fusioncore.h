@@ -0,0 +1,91 @@
+#pragma once
+
+// Orientation fusion shared by RotationSensor and the offline tools. Plain
+// C++ (no Qt), so it can run outside the event loop and on many threads at
+// once (one instance per thread).
+//
+// All algorithms use the same frames, those of the synthetic IMU (see
+// syntheticmotion.h): orientations rotate the device frame into a world
+// frame with x east, y north and z up. The accelerometer reads the reaction
+// to gravity, pointing up (+Z when the device lies flat, as QAccelerometer
+// and Android report it).
+
+struct FusionInput {
+    double accel[3] = {0.0, 0.0, 1.0};   // any unit, only the direction is used
+    double gyro[3] = {0.0, 0.0, 0.0};    // rad/s
+    double mag[3] = {1.0, 0.0, 0.0};     // any unit, only the direction is used
+    bool hasAccel = false;
+    bool hasGyro = false;
+    bool hasMag = false;
+};
+
+class FusionCore
+{
+public:
+    enum Algorithm {
+        GyroIntegration, // integrate the gyroscope, accelerometer + magnetometer without one (app default)
+        Madgwick,        // Madgwick gradient-descent filter
+        AccelMag         // accelerometer + magnetometer only, no drift but noisy
+    };
+
+    // How GyroIntegration advances the orientation over one step. The step
+    // has a reading at each end; the rate is taken to change linearly
+    // between them.
+    enum Integrator {
+        Euler,  // first-order step with the newer reading, then renormalize
+        ExpMap, // exact rotation by the step's rotation vector: mean rate plus
+                // the coning term of the two readings
+        RK4     // classical Runge-Kutta on the quaternion derivative
+    };
+
+    struct Parameters {
+        Algorithm algorithm = GyroIntegration;
+        Integrator integrator = ExpMap;
+        double beta = 0.1;   // Madgwick filter gain
+        double gyroBias[3] = {0.0, 0.0, 0.0}; // rad/s, subtracted from every reading
+        double minDt = 0.001; // s, shorter steps are skipped
+        double maxDt = 0.5;   // s, longer gaps are skipped (covers the slow still-state interval)
+    };
+
+    FusionCore();
+
+    const Parameters &parameters() const;
+    void setParameters(const Parameters &parameters);
+
+    void reset();
+
+    // Feeds one set of readings taken dt seconds after the previous one
+    void update(const FusionInput &input, double dt);
+
+    // Current absolute orientation, device to world
+    void orientation(double &w, double &x, double &y, double &z) const;
+
+    static const char *algorithmName(Algorithm algorithm);
+    static bool algorithmFromName(const char *name, Algorithm &algorithm);
+    static const char *integratorName(Integrator integrator);
+    static bool integratorFromName(const char *name, Integrator &integrator);
+
+    // Math helpers
+    // Device-to-world orientation from the accelerometer (up) and the
+    // magnetometer readings, both in the device frame
+    static void quaternionFromTwoVectors(double gx, double gy, double gz, double mx, double my, double mz, double &w, double &x, double &y, double &z);
+    static void normalizeVector(double &x, double &y, double &z);
+    static double vectorDot(double x1, double y1, double z1, double x2, double y2, double z2);
+    static void vectorCross(double x1, double y1, double z1, double x2, double y2, double z2, double &x, double &y, double &z);
+    static void quaternionMultiply(double q1w, double q1x, double q1y, double q1z, double q2w, double q2x, double q2y, double q2z, double &qw, double &qx, double &qy, double &qz);
+    static void quaternionConjugate(double qw, double qx, double qy, double qz, double &conjW, double &conjX, double &conjY, double &conjZ);
+
+private:
+    void gyroUpdate(const double gyro[3], double dt);
+    // Rotates the world frame of the orientation about its z axis, by the
+    // angle whose half has the given cosine and sine
+    void rotateWorldAboutZ(double cosHalf, double sinHalf);
+    void normalizeOrientation();
+    bool madgwickUpdate(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, double dt);
+
+    Parameters m_parameters;
+    double m_beta; // Madgwick filter gain
+    double m_q0, m_q1, m_q2, m_q3; // Fused orientation
+    double m_previousGyro[3];      // rad/s, reading at the start of the next step
+    bool m_hasPreviousGyro;
+};
@@ -1,13 +1,56 @@
 #include "igtlclient.h"
+#include "fusioncore.h"
+#include "igtlmessages.h"
+#include "metricsregistry.h"
+#include "posebacklog.h"
+#include "sessionrecorder.h"
+#include "transformchain.h"
 #include <QDebug>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QRegularExpression>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QtEndian>
 
 // OpenIGTLink includes
 #ifdef OPENIGTLINK_FOUND
 #include "igtlClientSocket.h"
-#include "igtlTransformMessage.h"
-#include "igtlTimeStamp.h"
-#include "igtlMath.h"
+#include "igtlMessageHeader.h"
+#include "igtlStatusMessage.h"
+#include "igtlStringMessage.h"
+#include <cerrno>
 #include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// ClientSocket that exposes its descriptor so incoming data can be picked up
+// by a QSocketNotifier on the event loop instead of blocking reads
+class NotifyingClientSocket : public igtl::ClientSocket
+{
+public:
+    typedef NotifyingClientSocket Self;
+    typedef igtl::ClientSocket Superclass;
+    typedef igtl::SmartPointer<Self> Pointer;
+    typedef igtl::SmartPointer<const Self> ConstPointer;
+
+    igtlTypeMacro(NotifyingClientSocket, igtl::ClientSocket);
+    igtlNewMacro(NotifyingClientSocket);
+
+    int GetDescriptor() const { return m_SocketDescriptor; }
+
+    // Takes over a descriptor connected outside ConnectToServer() (see
+    // IGTLClient::startConnecting)
+    void Adopt(int descriptor)
+    {
+        CloseSocket();
+        m_SocketDescriptor = descriptor;
+    }
+};
 #else
 // Stub implementations when OpenIGTLink is not available
 namespace igtl {
@@ -18,32 +61,57 @@ namespace igtl {
         int Send(void*, int) { return 0; }
         bool GetConnected() { return false; }
     };
-    
-    class TransformMessage {
-    public:
-        typedef void* Pointer;
-        static Pointer New() { return nullptr; }
-        void SetDeviceName(const char*) {}
-        void SetMatrix(void*) {}
-        void Pack() {}
-        void* GetPackPointer() { return nullptr; }
-        int GetPackSize() { return 0; }
-    };
-    
-    class TimeStamp {
-    public:
-        static void GetTime(void*) {}
-    };
 }
 #endif
 
+namespace {
+
+// A connect to a host that does not answer would otherwise take as long as
+// the TCP connect timeout (minutes), and no other attempt starts meanwhile
+const int kConnectTimeoutMs = 5000;
+// Longest a partial batch waits for more messages
+const int kBatchDeadlineMs = 50;
+// Incoming control messages are small; larger ones are skipped unread
+const quint64 kMaxControlBodySize = 64 * 1024;
+
+}
+
 IGTLClient::IGTLClient(QObject *parent)
     : QObject(parent)
+    , m_readNotifier(nullptr)
+    , m_recorder(nullptr)
     , m_isConnected(false)
+    , m_isConnecting(false)
+    , m_lookupId(-1)
+    , m_connectDescriptor(-1)
+    , m_connectNotifier(nullptr)
+    , m_connectTimer(new QTimer(this))
+    , m_port(0)
+    , m_deviceName("MobileDevice")
+    , m_answersHeartbeats(false)
+    , m_skipBytes(0)
+    , m_sendPolicy(Stream)
+    , m_batchSize(1)
+    , m_ackWindow(0)
+    , m_pendingCount(0)
+    , m_flushTimer(new QTimer(this))
+    , m_sentCount(0)
+    , m_ackedCount(0)
+    , m_droppedCount(0)
 {
 #ifdef OPENIGTLINK_FOUND
-    m_socket = igtl::ClientSocket::New();
+    m_socket = NotifyingClientSocket::New().GetPointer();
 #endif
+    m_connectTimer->setSingleShot(true);
+    m_connectTimer->setInterval(kConnectTimeoutMs);
+    connect(m_connectTimer, &QTimer::timeout, this, [this]() {
+        abandonConnecting();
+        qWarning() << "IGTLClient: Connecting to" << m_host << ":" << m_port << "timed out";
+        emit connectionError("Timed out connecting to server");
+    });
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(kBatchDeadlineMs);
+    connect(m_flushTimer, &QTimer::timeout, this, &IGTLClient::flushPending);
 }
 
 IGTLClient::~IGTLClient()
@@ -51,46 +119,189 @@ IGTLClient::~IGTLClient()
     disconnectFromServer();
 }
 
-bool IGTLClient::connectToServer(const QString &hostname, int port)
+void IGTLClient::startConnecting(const QString &hostname, int port)
 {
-    qDebug() << "IGTLClient: connectToServer called with" << hostname << ":" << port;
-    
+    if (m_isConnected || m_isConnecting) {
+        return;
+    }
+    qDebug() << "IGTLClient: Connecting to" << hostname << ":" << port << "in the background";
+    m_host = hostname;
+    m_port = port;
+
 #ifdef OPENIGTLINK_FOUND
-    qDebug() << "OPENIGTLINK_FOUND is defined";
+    m_isConnecting = true;
+    m_connectTimer->start();
+    // ClientSocket speaks IPv4 only, like the blocking path
+    m_lookupId = QHostInfo::lookupHost(hostname, this, [this](const QHostInfo &info) {
+        if (!m_isConnecting || info.lookupId() != m_lookupId) {
+            return;
+        }
+        m_lookupId = -1;
+        const QList<QHostAddress> addresses = info.addresses();
+        for (const QHostAddress &address : addresses) {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+                connectToAddress(address.toIPv4Address());
+                return;
+            }
+        }
+        failConnecting("Cannot resolve " + m_host + ": " + info.errorString());
+    });
 #else
-    qDebug() << "OPENIGTLINK_FOUND is NOT defined";
+    emit connectionError("OpenIGTLink library not available");
 #endif
-    
-    if (m_isConnected) {
-        qDebug() << "IGTLClient: Already connected";
-        return true;
-    }
+}
 
+void IGTLClient::connectToAddress(quint32 ipv4Address)
+{
 #ifdef OPENIGTLINK_FOUND
-    qDebug() << "IGTLClient: Using real OpenIGTLink library";
-    int result = m_socket->ConnectToServer(hostname.toLocal8Bit().data(), port);
-    qDebug() << "IGTLClient: ConnectToServer returned:" << result;
-    if (result == 0) {
-        m_isConnected = true;
-        emit connected();
-        return true;
-    } else {
-        emit connectionError("Failed to connect to server");
-        return false;
+    const int descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (descriptor < 0) {
+        failConnecting("Failed to connect to server: " + QString::fromLocal8Bit(std::strerror(errno)));
+        return;
     }
+    ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(quint16(m_port));
+    address.sin_addr.s_addr = htonl(ipv4Address);
+    if (::connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+        finishConnecting(descriptor);
+        return;
+    }
+    if (errno != EINPROGRESS) {
+        const QString error = QString::fromLocal8Bit(std::strerror(errno));
+        ::close(descriptor);
+        failConnecting("Failed to connect to server: " + error);
+        return;
+    }
+
+    // Writable once the connect completed, one way or the other
+    m_connectDescriptor = descriptor;
+    m_connectNotifier = new QSocketNotifier(descriptor, QSocketNotifier::Write, this);
+    connect(m_connectNotifier, &QSocketNotifier::activated, this, [this]() {
+        const int descriptor = m_connectDescriptor;
+        m_connectNotifier->setEnabled(false);
+        m_connectNotifier->deleteLater();
+        m_connectNotifier = nullptr;
+        m_connectDescriptor = -1;
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            ::close(descriptor);
+            failConnecting("Failed to connect to server: " + QString::fromLocal8Bit(std::strerror(error)));
+            return;
+        }
+        finishConnecting(descriptor);
+    });
 #else
-    // Stub implementation - always fail gracefully
-    qDebug() << "IGTLClient: Using stub implementation";
-    emit connectionError("OpenIGTLink library not available");
-    return false;
+    Q_UNUSED(ipv4Address);
+#endif
+}
+
+void IGTLClient::finishConnecting(int descriptor)
+{
+#ifdef OPENIGTLINK_FOUND
+    // The rest of the client expects a blocking socket, as ConnectToServer()
+    // leaves it, without Nagle's delay
+    ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) & ~O_NONBLOCK);
+    int noDelay = 1;
+    ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    static_cast<NotifyingClientSocket *>(m_socket.GetPointer())->Adopt(descriptor);
+
+    m_connectTimer->stop();
+    m_isConnecting = false;
+    qDebug() << "IGTLClient: Connected to" << m_host << ":" << m_port;
+    setUpConnection();
+#else
+    Q_UNUSED(descriptor);
+#endif
+}
+
+void IGTLClient::failConnecting(const QString &error)
+{
+    abandonConnecting();
+    qDebug() << "IGTLClient: Connecting to" << m_host << ":" << m_port << "failed:" << error;
+    emit connectionError(error);
+}
+
+void IGTLClient::abandonConnecting()
+{
+    if (!m_isConnecting) {
+        return;
+    }
+    m_isConnecting = false;
+    m_connectTimer->stop();
+    if (m_lookupId >= 0) {
+        QHostInfo::abortHostLookup(m_lookupId);
+        m_lookupId = -1;
+    }
+    delete m_connectNotifier;
+    m_connectNotifier = nullptr;
+#ifdef OPENIGTLINK_FOUND
+    if (m_connectDescriptor >= 0) {
+        ::close(m_connectDescriptor);
+    }
+#endif
+    m_connectDescriptor = -1;
+}
+
+void IGTLClient::setUpConnection()
+{
+#ifdef OPENIGTLINK_FOUND
+    m_isConnected = true;
+    
+    // Fresh flow-control state for every connection
+    m_sendPolicy = Stream;
+    m_batchSize = 1;
+    m_ackWindow = 0;
+    m_pending.clear();
+    m_pendingCount = 0;
+    m_held.clear();
+    m_sentCount = 0;
+    m_ackedCount = 0;
+    m_droppedCount = 0;
+    m_lastSend.start();
+    m_lastReceive.invalidate();
+    m_answersHeartbeats = false;
+    m_replyWait.invalidate();
+    m_ackWait.invalidate();
+    m_received.clear();
+    m_skipBytes = 0;
+    
+    int descriptor = static_cast<NotifyingClientSocket *>(m_socket.GetPointer())->GetDescriptor();
+    m_readNotifier = new QSocketNotifier(descriptor, QSocketNotifier::Read, this);
+    connect(m_readNotifier, &QSocketNotifier::activated, this, &IGTLClient::onSocketReadyRead);
+    
+    emit connected();
 #endif
 }
 
 void IGTLClient::disconnectFromServer()
 {
+    abandonConnecting();
     if (m_isConnected) {
+        // A partial batch still goes out; should that fail, the failure
+        // handling may already have disconnected us
+        flushPending();
+        if (!m_isConnected) {
+            return;
+        }
+        // Stop watching the descriptor before it is closed
+        delete m_readNotifier;
+        m_readNotifier = nullptr;
+#ifdef OPENIGTLINK_FOUND
         m_socket->CloseSocket();
+#endif
         m_isConnected = false;
+        m_flushTimer->stop();
+        m_received.clear();
+        m_skipBytes = 0;
         emit disconnected();
     }
 }
@@ -100,88 +311,563 @@ bool IGTLClient::isConnected() const
     return m_isConnected;
 }
 
-void IGTLClient::sendRotationData(double w, double x, double y, double z, double zOffset)
+bool IGTLClient::isConnecting() const
+{
+    return m_isConnecting;
+}
+
+QString IGTLClient::host() const
+{
+    return m_host;
+}
+
+int IGTLClient::port() const
+{
+    return m_port;
+}
+
+bool IGTLClient::sendHeartbeat()
+{
+    if (!m_isConnected) {
+        return false;
+    }
+#ifdef OPENIGTLINK_FOUND
+    igtl::StatusMessage::Pointer statusMsg = igtl::StatusMessage::New();
+    statusMsg->SetDeviceName("Heartbeat");
+    statusMsg->SetCode(igtl::StatusMessage::STATUS_OK);
+    statusMsg->SetStatusString("heartbeat");
+    statusMsg->Pack();
+    markAckWait();
+    if (!m_socket->Send(statusMsg->GetPackPointer(), statusMsg->GetPackSize())) {
+        MetricsRegistry::add(MetricsRegistry::SendErrors);
+        return false;
+    }
+    m_lastSend.start();
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 IGTLClient::msSinceLastSend() const
+{
+    return m_lastSend.isValid() ? m_lastSend.elapsed() : 0;
+}
+
+qint64 IGTLClient::msAwaitingReply() const
+{
+    if (m_answersHeartbeats) {
+        return m_lastReceive.elapsed();
+    }
+    if (m_ackWindow > 0 && m_sentCount > m_ackedCount && m_replyWait.isValid()) {
+        return m_replyWait.elapsed();
+    }
+    return 0;
+}
+
+qint64 IGTLClient::msAwaitingAck() const
+{
+#if defined(OPENIGTLINK_FOUND) && defined(__linux__)
+    if (!m_isConnected) {
+        return 0;
+    }
+    tcp_info info;
+    socklen_t length = sizeof(info);
+    const int descriptor = static_cast<NotifyingClientSocket *>(m_socket.GetPointer())->GetDescriptor();
+    if (::getsockopt(descriptor, IPPROTO_TCP, TCP_INFO, &info, &length) != 0 || info.tcpi_unacked == 0
+        || !m_ackWait.isValid()) {
+        return 0;
+    }
+    // The last acknowledgment can predate the wait by an idle gap; any
+    // acknowledgment since then shows the host is alive
+    return qMin(m_ackWait.elapsed(), qint64(info.tcpi_last_ack_recv));
+#else
+    return 0;
+#endif
+}
+
+QByteArray IGTLClient::deviceName() const
+{
+    return m_deviceName;
+}
+
+void IGTLClient::setDeviceName(const QByteArray &name)
+{
+    m_deviceName = name;
+}
+
+void IGTLClient::sendPose(const Pose &pose)
 {
     if (!m_isConnected) {
         return;
     }
+    sendPacked(packPose(pose, m_deviceName));
+}
 
-#ifdef OPENIGTLINK_FOUND
-    // Create transform message
-    igtl::TransformMessage::Pointer transformMsg = igtl::TransformMessage::New();
-    transformMsg->SetDeviceName("MobileDevice");
+void IGTLClient::sendPacked(const QByteArray &message, int messageCount)
+{
+    if (!m_isConnected || message.isEmpty()) {
+        return;
+    }
+    queueMessage(message.constData(), int(message.size()), qMax(1, messageCount));
+}
+
+void IGTLClient::flush()
+{
+    if (m_isConnected) {
+        flushPending();
+    }
+}
+
+QByteArray IGTLClient::packPose(const Pose &pose, const QByteArray &deviceName)
+{
+    double rows[3][4];
+    pose.toMatrix(rows);
+
+    // Packed by hand (see igtlmessages.h); the result can be sent to any
+    // number of receivers
+    QByteArray message(int(IgtlMessages::kTransformMessageSize), Qt::Uninitialized);
+    IgtlMessages::packTransform(reinterpret_cast<uint8_t *>(message.data()), deviceName.constData(),
+                                IgtlMessages::timestampNow(), rows);
+    return message;
+}
+
+int IGTLClient::packImuSample(QByteArray &out, const FusionInput &input, quint64 timeNs, const QByteArray &deviceName)
+{
+    using IgtlMessages::UnitFactor;
+    static const UnitFactor kAccel[] = {{IgtlMessages::kUnitMeter, 1}, {IgtlMessages::kUnitSecond, -2}};
+    static const UnitFactor kGyro[] = {{IgtlMessages::kUnitRadian, 1}, {IgtlMessages::kUnitSecond, -1}};
+    static const UnitFactor kMag[] = {{IgtlMessages::kUnitTesla, 1}};
+    static const uint64_t kAccelUnit = IgtlMessages::packUnit(kAccel, 2);
+    static const uint64_t kGyroUnit = IgtlMessages::packUnit(kGyro, 2);
+    static const uint64_t kMagUnit = IgtlMessages::packUnit(kMag, 1);
     
-    // Create a 4x4 transformation matrix from quaternion
-    igtl::Matrix4x4 matrix;
-    igtl::IdentityMatrix(matrix);
+    struct Channel {
+        bool present;
+        const double *values;
+        const char *suffix;
+        uint64_t unit;
+    };
+    const Channel channels[] = {
+        {input.hasAccel, input.accel, "-Accel", kAccelUnit},
+        {input.hasGyro, input.gyro, "-Gyro", kGyroUnit},
+        {input.hasMag, input.mag, "-Mag", kMagUnit},
+    };
     
-    // Convert quaternion (w, x, y, z) to rotation matrix
-    // Normalize quaternion first
-    double norm = sqrt(w*w + x*x + y*y + z*z);
-    if (norm > 0.0) {
-        w /= norm; x /= norm; y /= norm; z /= norm;
-        
-        // Invert X-axis rotation direction
-        x = -x;
-        
-        qDebug() << "IGTLClient: Normalized quaternion - w=" << w << "x=" << x << "y=" << y << "z=" << z;
-        
-        // Quaternion to rotation matrix conversion
-        matrix[0][0] = 1.0 - 2.0 * (y*y + z*z);
-        matrix[0][1] = 2.0 * (x*y - w*z);
-        matrix[0][2] = 2.0 * (x*z + w*y);
-        matrix[1][0] = 2.0 * (x*y + w*z);
-        matrix[1][1] = 1.0 - 2.0 * (x*x + z*z);
-        matrix[1][2] = 2.0 * (y*z - w*x);
-        matrix[2][0] = 2.0 * (x*z - w*y);
-        matrix[2][1] = 2.0 * (y*z + w*x);
-        matrix[2][2] = 1.0 - 2.0 * (x*x + y*y);
-        
-        // Rotate about offset point along device's Z-axis
-        // Sequence: T = T_to_point * R * T_back
-        // T_back: translate by -zOffset along device Z (move rotation center to origin)
-        // R: rotate about origin  
-        // T_to_point: translate by +zOffset along device Z (move back to offset point)
-        
-        // The offset point is at (0, 0, zOffset) in device coordinates
-        // After rotation, this becomes the translation component
+    const uint64_t timestamp = IgtlMessages::timestamp(uint32_t(timeNs / 1000000000), uint32_t(timeNs % 1000000000));
+    const int messageSize = int(IgtlMessages::sensorMessageSize(3));
+    int count = 0;
+    for (const Channel &channel : channels) {
+        if (!channel.present) {
+            continue;
+        }
+        // The suffix must survive the 20-byte device name field
+        const QByteArray name = deviceName.left(int(IgtlMessages::kDeviceNameSize) - int(qstrlen(channel.suffix)))
+                                + channel.suffix;
+        const qsizetype offset = out.size();
+        out.resize(offset + messageSize);
+        IgtlMessages::packSensor(reinterpret_cast<uint8_t *>(out.data() + offset), name.constData(), timestamp,
+                                 channel.values, 3, channel.unit);
+        ++count;
+    }
+    return count;
+}
+
+IGTLClient::SendPolicy IGTLClient::sendPolicy() const
+{
+    return m_sendPolicy;
+}
+
+void IGTLClient::setSendPolicy(SendPolicy policy)
+{
+    if (m_sendPolicy == policy) {
+        return;
+    }
+    m_sendPolicy = policy;
+    if (policy == Paused) {
+        // Nothing queued before the pause should trickle out later. Backlog
+        // batches are not live and go back to whoever queued them.
+        QByteArray backlog;
+        int backlogCount = 0;
+        qsizetype offset = 0;
+        while (m_pending.size() - offset >= qsizetype(IgtlMessages::kHeaderSize)) {
+            const char *message = m_pending.constData() + offset;
+            const quint64 bodySize = qFromBigEndian<quint64>(message + 42);
+            const qsizetype size = qsizetype(IgtlMessages::kHeaderSize) + qsizetype(bodySize);
+            if (qstrncmp(message + 2, PoseBacklog::kMessageType, 12) == 0) {
+                backlog.append(message, size);
+                ++backlogCount;
+            }
+            offset += size;
+        }
+        const int dropped = m_pendingCount - backlogCount + (m_held.isEmpty() ? 0 : 1);
+        m_droppedCount += quint64(dropped);
+        MetricsRegistry::add(MetricsRegistry::MessagesDropped, quint64(dropped));
+        if (!backlog.isEmpty()) {
+            emit backlogReturned(backlog);
+        }
+        m_pending.clear();
+        m_pendingCount = 0;
+        m_held.clear();
+    }
+    qDebug() << "IGTLClient: Send policy" << policy;
+    emit flowControlChanged();
+}
+
+int IGTLClient::batchSize() const
+{
+    return m_batchSize;
+}
+
+void IGTLClient::setBatchSize(int messages)
+{
+    messages = qBound(1, messages, 256);
+    if (m_batchSize == messages) {
+        return;
+    }
+    m_batchSize = messages;
+    if (m_pendingCount >= m_batchSize) {
+        flushPending();
+    }
+    qDebug() << "IGTLClient: Batch size" << m_batchSize;
+    emit flowControlChanged();
+}
+
+int IGTLClient::ackWindow() const
+{
+    return m_ackWindow;
+}
+
+void IGTLClient::setAckWindow(int messages)
+{
+    messages = qMax(0, messages);
+    if (m_ackWindow == messages) {
+        return;
+    }
+    m_ackWindow = messages;
+    // Start counting from the current position
+    m_ackedCount = m_sentCount;
+    qDebug() << "IGTLClient: Acknowledgment window" << m_ackWindow;
+    emit flowControlChanged();
+}
+
+quint64 IGTLClient::droppedCount() const
+{
+    return m_droppedCount;
+}
+
+bool IGTLClient::hasSpareWindow() const
+{
+    if (!m_isConnected || m_sendPolicy == Paused || !m_held.isEmpty()) {
+        return false;
+    }
+    if (m_ackWindow <= 0) {
+        return true;
+    }
+    return m_sentCount + quint64(m_pendingCount) + 1 - m_ackedCount < quint64(m_ackWindow);
+}
+
+void IGTLClient::setRecorder(SessionRecorder *recorder)
+{
+    m_recorder = recorder;
+}
+
+void IGTLClient::onSocketReadyRead()
+{
+#ifdef OPENIGTLINK_FOUND
+    // Only what has arrived is read, so the event loop never waits for the
+    // rest of a message; messages are handled once they are complete
+    const int descriptor = static_cast<NotifyingClientSocket *>(m_socket.GetPointer())->GetDescriptor();
+    bool closed = false;
+    char chunk[4096];
+    for (;;) {
+        const ssize_t received = ::recv(descriptor, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received > 0) {
+            m_received.append(chunk, qsizetype(received));
+            m_lastReceive.start();
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        // Readable with no data: the server closed the connection
+        closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+    
+    processReceived();
+    if (closed && m_isConnected) {
+        qDebug() << "IGTLClient: Server closed the connection";
+        disconnectFromServer();
+    }
+#endif
+}
+
+void IGTLClient::processReceived()
+{
+    const qsizetype headerSize = qsizetype(IgtlMessages::kHeaderSize);
+    const qsizetype bodySizeOffset = 42;
+    qsizetype offset = 0;
+    for (;;) {
+        if (m_skipBytes > 0) {
+            const qsizetype skipped = qsizetype(qMin(m_skipBytes, quint64(m_received.size() - offset)));
+            offset += skipped;
+            m_skipBytes -= quint64(skipped);
+            if (m_skipBytes > 0) {
+                break;
+            }
+        }
+        if (m_received.size() - offset < headerSize) {
+            break;
+        }
         
-        // For rotation about offset point, the final translation is:
-        // translation = rotation_center_offset - rotated(rotation_center_offset)
-        // where rotation_center_offset = (0, 0, zOffset) in device coordinates
+        const char *message = m_received.constData() + offset;
+        const quint64 bodySize = qFromBigEndian<quint64>(message + bodySizeOffset);
+        const QByteArray deviceType(message + 2, qsizetype(qstrnlen(message + 2, 12)));
+        if ((deviceType != "STRING" && deviceType != "STATUS") || bodySize > kMaxControlBodySize) {
+            qDebug() << "IGTLClient: Ignoring incoming" << deviceType << "message of" << bodySize << "bytes";
+            offset += headerSize;
+            m_skipBytes = bodySize;
+            continue;
+        }
+        if (quint64(m_received.size() - offset - headerSize) < bodySize) {
+            break;
+        }
         
-        double offset_x = 0.0;
-        double offset_y = 0.0; 
-        double offset_z = zOffset;
+        handleMessage(message, headerSize + qsizetype(bodySize));
+        if (!m_isConnected) {
+            // Handling it failed a send and the connection was dropped
+            return;
+        }
+        offset += headerSize + qsizetype(bodySize);
+    }
+    m_received.remove(0, offset);
+}
+
+void IGTLClient::handleMessage(const char *data, qsizetype size)
+{
+#ifdef OPENIGTLINK_FOUND
+    igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+    header->InitPack();
+    std::memcpy(header->GetPackPointer(), data, IgtlMessages::kHeaderSize);
+    header->Unpack();
+    const char *body = data + IgtlMessages::kHeaderSize;
+    const size_t bodySize = size_t(size) - IgtlMessages::kHeaderSize;
+    
+    const QString deviceType = QString::fromLatin1(header->GetDeviceType());
+    if (deviceType == "STRING") {
+        igtl::StringMessage::Pointer stringMsg = igtl::StringMessage::New();
+        stringMsg->SetMessageHeader(header);
+        stringMsg->AllocatePack();
+        std::memcpy(stringMsg->GetPackBodyPointer(), body, bodySize);
+        if (stringMsg->Unpack(1) & igtl::MessageHeader::UNPACK_BODY) {
+            handleControlString(QString::fromUtf8(stringMsg->GetString()));
+        }
+    } else if (deviceType == "STATUS") {
+        igtl::StatusMessage::Pointer statusMsg = igtl::StatusMessage::New();
+        statusMsg->SetMessageHeader(header);
+        statusMsg->AllocatePack();
+        std::memcpy(statusMsg->GetPackBodyPointer(), body, bodySize);
+        if (statusMsg->Unpack(1) & igtl::MessageHeader::UNPACK_BODY) {
+            if (std::strcmp(header->GetDeviceName(), "Heartbeat") == 0) {
+                // From now on its silence counts (see msAwaitingReply())
+                m_answersHeartbeats = true;
+            }
+            // The sub-code is a 64-bit field; acknowledgment counts use all of it
+            handleStatus(statusMsg->GetCode(), quint64(statusMsg->GetSubCode()),
+                         QString::fromUtf8(statusMsg->GetStatusString()));
+        }
+    }
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+#endif
+}
+
+void IGTLClient::handleControlString(const QString &command)
+{
+    // Commands are key=value pairs separated by whitespace, ',' or ';', e.g.
+    // "rate=60 batch=4 policy=latest window=8" or "ack=120"
+    qDebug() << "IGTLClient: Control command:" << command;
+    
+    static const QRegularExpression separators("[\\s,;]+");
+    const QStringList pairs = command.split(separators, Qt::SkipEmptyParts);
+    for (const QString &pair : pairs) {
+        const int eq = pair.indexOf('=');
+        if (eq <= 0) {
+            qWarning() << "IGTLClient: Malformed control entry" << pair;
+            continue;
+        }
+        const QString key = pair.left(eq).trimmed().toLower();
+        const QString value = pair.mid(eq + 1).trimmed();
+        bool ok = false;
         
-        // Apply rotation to the offset point to see where it ends up
-        double rotated_offset_x = matrix[0][0] * offset_x + matrix[0][1] * offset_y + matrix[0][2] * offset_z;
-        double rotated_offset_y = matrix[1][0] * offset_x + matrix[1][1] * offset_y + matrix[1][2] * offset_z;
-        double rotated_offset_z = matrix[2][0] * offset_x + matrix[2][1] * offset_y + matrix[2][2] * offset_z;
+        if (key == "rate") {
+            double hz = value.toDouble(&ok);
+            if (ok && hz >= 0.0) {
+                emit outputRateRequested(hz);
+            }
+        } else if (key == "batch") {
+            int messages = value.toInt(&ok);
+            if (ok) {
+                setBatchSize(messages);
+            }
+        } else if (key == "window") {
+            int messages = value.toInt(&ok);
+            if (ok) {
+                setAckWindow(messages);
+            }
+        } else if (key == "ack") {
+            quint64 count = value.toULongLong(&ok);
+            if (ok) {
+                acknowledge(count);
+            }
+        } else if (key == "policy") {
+            const QString policy = value.toLower();
+            ok = true;
+            if (policy == "stream") {
+                setSendPolicy(Stream);
+            } else if (policy == "latest") {
+                setSendPolicy(Latest);
+            } else if (policy == "pause") {
+                setSendPolicy(Paused);
+            } else {
+                ok = false;
+            }
+        }
         
-        //// Translation = original_offset - rotated_offset
-        //matrix[0][3] = -offset_x + 0*rotated_offset_x; // = -rotated_offset_x (since offset_x = 0)
-        //matrix[1][3] = -offset_y + 0*rotated_offset_y; // = -rotated_offset_y (since offset_y = 0)
-        //matrix[2][3] = -offset_z + 0*rotated_offset_z; // = zOffset - rotated_offset_z
-        matrix[0][3] = rotated_offset_x; // = -rotated_offset_x (since offset_x = 0)
-        matrix[1][3] = rotated_offset_y; // = -rotated_offset_y (since offset_y = 0)
-        matrix[2][3] = rotated_offset_z; // = zOffset - rotated_offset_z
-
-        qDebug() << "IGTLClient: Rotation matrix with Z-offset (" << zOffset << "mm):";
-        qDebug() << QString("[%1, %2, %3, %4]").arg(matrix[0][0], 6, 'f', 3).arg(matrix[0][1], 6, 'f', 3).arg(matrix[0][2], 6, 'f', 3).arg(matrix[0][3], 6, 'f', 3);
-        qDebug() << QString("[%1, %2, %3, %4]").arg(matrix[1][0], 6, 'f', 3).arg(matrix[1][1], 6, 'f', 3).arg(matrix[1][2], 6, 'f', 3).arg(matrix[1][3], 6, 'f', 3);
-        qDebug() << QString("[%1, %2, %3, %4]").arg(matrix[2][0], 6, 'f', 3).arg(matrix[2][1], 6, 'f', 3).arg(matrix[2][2], 6, 'f', 3).arg(matrix[2][3], 6, 'f', 3);
+        if (!ok) {
+            qWarning() << "IGTLClient: Unsupported control entry" << pair;
+        }
+    }
+}
+
+void IGTLClient::handleStatus(int code, quint64 subCode, const QString &status)
+{
+#ifdef OPENIGTLINK_FOUND
+    qDebug() << "IGTLClient: Status received - code" << code << "subcode" << subCode << status;
+    
+    // OK acknowledges messages (sub-code = total consumed, 0 = everything sent)
+    // and resumes a paused stream; NOT_READY pauses it
+    if (code == igtl::StatusMessage::STATUS_OK) {
+        acknowledge(subCode > 0 ? subCode : m_sentCount);
+        if (m_sendPolicy == Paused) {
+            setSendPolicy(Stream);
+        }
+    } else if (code == igtl::StatusMessage::STATUS_NOT_READY) {
+        setSendPolicy(Paused);
+    }
+#else
+    Q_UNUSED(code);
+    Q_UNUSED(subCode);
+    Q_UNUSED(status);
+#endif
+}
+
+void IGTLClient::acknowledge(quint64 messageCount)
+{
+    const quint64 acked = qMax(m_ackedCount, qMin(messageCount, m_sentCount));
+    if (acked > m_ackedCount) {
+        // Progress; the rest is awaited from now
+        m_replyWait.start();
     }
+    m_ackedCount = acked;
     
-    transformMsg->SetMatrix(matrix);
+    // A held pose goes out as soon as the window has room again
+    if (!m_held.isEmpty() && !isWindowFull()) {
+        QByteArray held;
+        held.swap(m_held);
+        queueMessage(held.constData(), held.size());
+    }
+}
+
+void IGTLClient::queueMessage(const char *data, int size, int messageCount)
+{
+    if (m_sendPolicy == Paused) {
+        m_droppedCount += quint64(messageCount);
+        MetricsRegistry::add(MetricsRegistry::MessagesDropped, quint64(messageCount));
+        return;
+    }
     
-    // Set timestamp
-    igtl::TimeStamp::Pointer ts = igtl::TimeStamp::New();
-    ts->GetTime();
-    transformMsg->SetTimeStamp(ts);
+    if (isWindowFull()) {
+        // Only single poses are worth holding; batches are dropped
+        if (m_sendPolicy == Latest && messageCount == 1) {
+            if (!m_held.isEmpty()) {
+                ++m_droppedCount;
+                MetricsRegistry::add(MetricsRegistry::MessagesDropped);
+            }
+            m_held = QByteArray(data, size);
+        } else {
+            m_droppedCount += quint64(messageCount);
+            MetricsRegistry::add(MetricsRegistry::MessagesDropped, quint64(messageCount));
+        }
+        return;
+    }
+    
+    m_pending.append(data, size);
+    m_pendingCount += messageCount;
+    MetricsRegistry::set(MetricsRegistry::SendQueueDepth, m_pendingCount);
     
-    // Pack and send
-    transformMsg->Pack();
-    m_socket->Send(transformMsg->GetPackPointer(), transformMsg->GetPackSize());
+    if (m_pendingCount >= m_batchSize || isWindowFull()) {
+        flushPending();
+    } else if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+bool IGTLClient::isWindowFull() const
+{
+    if (m_ackWindow <= 0) {
+        return false;
+    }
+    return m_sentCount + quint64(m_pendingCount) - m_ackedCount >= quint64(m_ackWindow);
+}
+
+void IGTLClient::flushPending()
+{
+    m_flushTimer->stop();
+    if (m_pendingCount == 0) {
+        return;
+    }
+#ifdef OPENIGTLINK_FOUND
+    // One Send() per batch
+    markAckWait();
+    if (m_socket->Send(m_pending.constData(), m_pending.size())) {
+        if (m_sentCount == m_ackedCount) {
+            m_replyWait.start();
+        }
+        MetricsRegistry::add(MetricsRegistry::MessagesSent, m_pendingCount);
+        MetricsRegistry::add(MetricsRegistry::BytesSent, m_pending.size());
+        m_lastSend.start();
+        if (m_recorder) {
+            m_recorder->append(m_pending.constData(), int(m_pending.size()));
+        }
+    } else {
+        MetricsRegistry::add(MetricsRegistry::SendErrors);
+        // The connection is gone; hand the batch to whoever can still send it
+        QByteArray unsent;
+        unsent.swap(m_pending);
+        const int unsentCount = m_pendingCount;
+        m_pendingCount = 0;
+        MetricsRegistry::set(MetricsRegistry::SendQueueDepth, 0);
+        emit sendFailed(unsent, unsentCount);
+        return;
+    }
+#endif
+    m_sentCount += quint64(m_pendingCount);
+    m_pending.clear();
+    m_pendingCount = 0;
+    MetricsRegistry::set(MetricsRegistry::SendQueueDepth, 0);
+}
+
+void IGTLClient::markAckWait()
+{
+#if defined(OPENIGTLINK_FOUND) && defined(__linux__)
+    tcp_info info;
+    socklen_t length = sizeof(info);
+    const int descriptor = static_cast<NotifyingClientSocket *>(m_socket.GetPointer())->GetDescriptor();
+    if (::getsockopt(descriptor, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 && info.tcpi_unacked == 0) {
+        m_ackWait.start();
+    }
 #endif
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
 
 #ifdef OPENIGTLINK_FOUND
 #include "igtlClientSocket.h"
@@ -11,28 +13,160 @@ namespace igtl {
 }
 #endif
 
+class QSocketNotifier;
+class QTimer;
+class SessionRecorder;
+struct FusionInput;
+struct Pose;
+
 class IGTLClient : public QObject
 {
     Q_OBJECT
 
 public:
+    // How poses are handled while the acknowledgment window is full
+    enum SendPolicy {
+        Stream, // send every pose, drop while the window is full
+        Latest, // hold the newest pose and send it once the window opens
+        Paused  // send nothing until the server resumes the stream
+    };
+    Q_ENUM(SendPolicy)
+
     explicit IGTLClient(QObject *parent = nullptr);
     ~IGTLClient();
 
-    bool connectToServer(const QString &hostname, int port);
+    // Connects without blocking the event loop: the name lookup runs in the
+    // background and the connect is watched with a QSocketNotifier.
+    // connected() or connectionError() follows; nothing happens while
+    // already connected or connecting.
+    void startConnecting(const QString &hostname, int port);
+    // Also abandons an attempt in progress, without a signal
     void disconnectFromServer();
     bool isConnected() const;
+    bool isConnecting() const;
+    
+    // Endpoint of the last connection attempt
+    QString host() const;
+    int port() const;
+    
+    // Liveness, used for failover (see NetworkManager). Heartbeats are STATUS
+    // OK messages named "Heartbeat"; they bypass batching and flow control.
+    bool sendHeartbeat();
+    qint64 msSinceLastSend() const;
+    // How long a server that promised replies has kept quiet: since its last
+    // message once it has answered a heartbeat, or since messages went
+    // unacknowledged while it has set an acknowledgment window. 0 for
+    // servers that never reply; their silence means nothing.
+    qint64 msAwaitingReply() const;
+    // How long data sent has gone without a TCP acknowledgment from the
+    // server's host, 0 while nothing is outstanding. Catches a dead server
+    // that never sends anything itself; Linux and Android only, 0 elsewhere.
+    qint64 msAwaitingAck() const;
+    
+    // Device name of the poses sent with sendPose(), "MobileDevice" by default
+    QByteArray deviceName() const;
+    void setDeviceName(const QByteArray &name);
+    
+    void sendPose(const Pose &pose);
+    // messageCount: OpenIGTLink messages in the data, as the server counts
+    // them for acknowledgments
+    void sendPacked(const QByteArray &message, int messageCount = 1);
+    // Sends a partial batch now instead of at its deadline (a partial batch
+    // goes out at most 50 ms after its first message), e.g. when the stream
+    // stops. disconnectFromServer() does this too.
+    void flush();
     
-    void sendRotationData(double w, double x, double y, double z, double zOffset = 0.0);
+    // Packs a pose as an OpenIGTLink TRANSFORM message from deviceName (at
+    // most 20 bytes are used). Frame transforms (see TransformChain) have
+    // already been applied.
+    static QByteArray packPose(const Pose &pose, const QByteArray &deviceName);
+    
+    // Packs one set of raw sensor readings as SENSOR messages stamped with
+    // timeNs (Unix time): accelerometer (m/s^2), gyroscope (rad/s) and
+    // magnetometer (T), each present one from deviceName plus "-Accel",
+    // "-Gyro" or "-Mag". Appends to out and returns the number of messages.
+    static int packImuSample(QByteArray &out, const FusionInput &input, quint64 timeNs, const QByteArray &deviceName);
+
+    // Flow control, normally driven by the server (see handleControlString)
+    SendPolicy sendPolicy() const;
+    void setSendPolicy(SendPolicy policy);
+    int batchSize() const;
+    void setBatchSize(int messages);
+    int ackWindow() const;
+    void setAckWindow(int messages);
+    quint64 droppedCount() const;
+    // Whether a message other than a live pose can go out now without
+    // taking the place of one: the stream is not paused, no pose is held and
+    // the acknowledgment window keeps a slot free
+    bool hasSpareWindow() const;
+    
+    // Optional tee: everything written to the socket is also appended here
+    void setRecorder(SessionRecorder *recorder);
 
 signals:
     void connected();
     void disconnected();
     void connectionError(const QString &error);
+    void outputRateRequested(double hz);
+    void flowControlChanged();
+    // A write failed; unsent holds the messageCount messages that did not
+    // go out
+    void sendFailed(const QByteArray &unsent, int messageCount);
+    // Queued POSEDELTA batches (see PoseBacklog) taken back unsent when the
+    // stream was paused
+    void backlogReturned(const QByteArray &batches);
+
+private slots:
+    void onSocketReadyRead();
 
 private:
+    void connectToAddress(quint32 ipv4Address);
+    void finishConnecting(int descriptor);
+    void failConnecting(const QString &error);
+    void abandonConnecting();
+    void setUpConnection();
+    void processReceived();
+    void handleMessage(const char *data, qsizetype size);
+    void handleControlString(const QString &command);
+    void handleStatus(int code, quint64 subCode, const QString &status);
+    void acknowledge(quint64 messageCount);
+    void queueMessage(const char *data, int size, int messageCount = 1);
+    bool isWindowFull() const;
+    void flushPending();
+    // Called before every write: data going out while nothing is awaiting a
+    // TCP acknowledgment starts a new wait for msAwaitingAck()
+    void markAckWait();
+
 #ifdef OPENIGTLINK_FOUND
     igtl::ClientSocket::Pointer m_socket;
 #endif
+    QSocketNotifier *m_readNotifier;
+    SessionRecorder *m_recorder;
     bool m_isConnected;
-};
\ No newline at end of file
+    bool m_isConnecting;
+    int m_lookupId; // -1 when no name lookup is running
+    int m_connectDescriptor; // -1 when no connect is in progress
+    QSocketNotifier *m_connectNotifier;
+    QTimer *m_connectTimer; // gives up on a connect that does not complete
+    QString m_host;
+    int m_port;
+    QByteArray m_deviceName;
+    QElapsedTimer m_lastSend;
+    QElapsedTimer m_lastReceive;
+    bool m_answersHeartbeats; // a heartbeat has been answered on this connection
+    QElapsedTimer m_replyWait; // since messages went unacknowledged
+    QElapsedTimer m_ackWait; // since data went out with no TCP acknowledgment outstanding
+    QByteArray m_received; // incoming data not yet parsed
+    quint64 m_skipBytes; // rest of an ignored incoming message
+
+    SendPolicy m_sendPolicy;
+    int m_batchSize;
+    int m_ackWindow; // 0 = no acknowledgments expected
+    QByteArray m_pending;
+    int m_pendingCount;
+    QTimer *m_flushTimer; // deadline of a partial batch
+    QByteArray m_held;
+    quint64 m_sentCount;
+    quint64 m_ackedCount;
+    quint64 m_droppedCount;
+};
@@ -0,0 +1,177 @@
+#include "igtlmessages.h"
+#include "crc64.h"
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const uint16_t kHeaderVersion = 1;
+const size_t kTypeSize = 12;
+
+void writeBigEndian16(uint8_t *p, uint16_t value)
+{
+    p[0] = uint8_t(value >> 8);
+    p[1] = uint8_t(value);
+}
+
+void writeBigEndian32(uint8_t *p, uint32_t value)
+{
+    p[0] = uint8_t(value >> 24);
+    p[1] = uint8_t(value >> 16);
+    p[2] = uint8_t(value >> 8);
+    p[3] = uint8_t(value);
+}
+
+void writeBigEndian64(uint8_t *p, uint64_t value)
+{
+    writeBigEndian32(p, uint32_t(value >> 32));
+    writeBigEndian32(p + 4, uint32_t(value));
+}
+
+void writeDouble(uint8_t *p, double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeBigEndian64(p, bits);
+}
+
+void writeFloat(uint8_t *p, double value)
+{
+    const float f = float(value);
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    writeBigEndian32(p, bits);
+}
+
+uint32_t readBigEndian32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint64_t readBigEndian64(const uint8_t *p)
+{
+    return (uint64_t(readBigEndian32(p)) << 32) | readBigEndian32(p + 4);
+}
+
+double readFloat(const uint8_t *p)
+{
+    const uint32_t bits = readBigEndian32(p);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return double(f);
+}
+
+// Zero-padded, possibly unterminated like strncpy
+void writeString(uint8_t *p, const char *text, size_t size)
+{
+    std::memset(p, 0, size);
+    if (text) {
+        std::memcpy(p, text, strnlen(text, size));
+    }
+}
+
+}
+
+namespace IgtlMessages {
+
+uint64_t timestamp(uint32_t seconds, uint32_t nanoseconds)
+{
+    // Same binary expansion as igtl_nanosec_to_frac(), so messages match the
+    // library bit for bit
+    uint32_t base = 1000000000;
+    uint32_t fraction = 0;
+    for (uint32_t mask = 0x80000000; mask; mask >>= 1) {
+        base = (base + 1) >> 1;
+        if (nanoseconds >= base) {
+            fraction |= mask;
+            nanoseconds -= base;
+        }
+    }
+    return (uint64_t(seconds) << 32) | fraction;
+}
+
+uint64_t timestampNow()
+{
+    const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch - seconds);
+    return timestamp(uint32_t(seconds.count()), uint32_t(nanoseconds.count()));
+}
+
+void packHeader(uint8_t *out, const char *type, const char *deviceName, uint64_t timestamp, uint64_t bodySize)
+{
+    writeBigEndian16(out, kHeaderVersion);
+    writeString(out + 2, type, kTypeSize);
+    writeString(out + 14, deviceName, kDeviceNameSize);
+    writeBigEndian64(out + 34, timestamp);
+    writeBigEndian64(out + 42, bodySize);
+    writeBigEndian64(out + 50, Crc64::compute(out + kHeaderSize, size_t(bodySize)));
+}
+
+void packTransform(uint8_t *out, const char *deviceName, uint64_t timestamp, const double matrix[3][4])
+{
+    // Body: the rotation column by column, then the translation
+    uint8_t *body = out + kHeaderSize;
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 3; ++row) {
+            writeFloat(body, matrix[row][column]);
+            body += 4;
+        }
+    }
+    packHeader(out, "TRANSFORM", deviceName, timestamp, kTransformBodySize);
+}
+
+bool unpackTransform(const uint8_t *message, size_t size, uint64_t &timestamp, double matrix[3][4])
+{
+    if (size != kTransformMessageSize
+        || std::strncmp(reinterpret_cast<const char *>(message) + 2, "TRANSFORM", kTypeSize) != 0
+        || readBigEndian64(message + 42) != kTransformBodySize) {
+        return false;
+    }
+    timestamp = readBigEndian64(message + 34);
+    const uint8_t *body = message + kHeaderSize;
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 3; ++row) {
+            matrix[row][column] = readFloat(body);
+            body += 4;
+        }
+    }
+    return true;
+}
+
+uint64_t timestampToNs(uint64_t timestamp)
+{
+    // The fraction is in units of 2^-32 s
+    const uint64_t seconds = timestamp >> 32;
+    const uint64_t fraction = timestamp & 0xffffffffu;
+    return seconds * 1000000000u + ((fraction * 1000000000u) >> 32);
+}
+
+uint64_t packUnit(const UnitFactor *factors, size_t count)
+{
+    // No prefix; the factors fill the 10-bit slots from the top
+    uint64_t packed = 0;
+    for (size_t i = 0; i < count && i < 6; ++i) {
+        const uint64_t slot = (uint64_t(factors[i].unit & 0x3f) << 4) | uint64_t(factors[i].exponent & 0x0f);
+        packed |= slot << (50 - 10 * i);
+    }
+    return packed;
+}
+
+void packSensor(uint8_t *out, const char *deviceName, uint64_t timestamp, const double *values, size_t count,
+                uint64_t unit, uint8_t status)
+{
+    if (count > kMaxSensorValues) {
+        count = kMaxSensorValues;
+    }
+    uint8_t *body = out + kHeaderSize;
+    body[0] = uint8_t(count);
+    body[1] = status;
+    writeBigEndian64(body + 2, unit);
+    for (size_t i = 0; i < count; ++i) {
+        writeDouble(body + kSensorFixedSize + 8 * i, values[i]);
+    }
+    packHeader(out, "SENSOR", deviceName, timestamp, kSensorFixedSize + 8 * count);
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Hand-rolled OpenIGTLink message packing for the messages the app streams
+// at high rate. Writes the same bytes as igtl::TransformMessage::Pack() but
+// without allocating a message object per pose, and checksums the body with
+// the fast Crc64. Plain C++ so the tools can use it.
+//
+// Header (version 1): version(2) type(12) device(20) timestamp(8)
+// body size(8) crc(8), all big-endian.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace IgtlMessages {
+
+const size_t kHeaderSize = 58;
+const size_t kDeviceNameSize = 20;
+const size_t kTransformBodySize = 48;
+const size_t kTransformMessageSize = kHeaderSize + kTransformBodySize;
+
+// SENSOR body: length(1) status(1) unit(8), then length float64 values
+const size_t kSensorFixedSize = 10;
+const size_t kMaxSensorValues = 255;
+
+inline size_t sensorMessageSize(size_t count)
+{
+    return kHeaderSize + kSensorFixedSize + 8 * count;
+}
+
+// OpenIGTLink units (as igtl::Unit::Pack() encodes them): a 4-bit prefix, then up to
+// six SI units of a 6-bit code and a signed 4-bit exponent each
+const uint8_t kUnitMeter = 0x01;
+const uint8_t kUnitSecond = 0x03;
+const uint8_t kUnitRadian = 0x08;
+const uint8_t kUnitTesla = 0x15;
+
+struct UnitFactor {
+    uint8_t unit;
+    int exponent;
+};
+
+uint64_t packUnit(const UnitFactor *factors, size_t count);
+
+// OpenIGTLink timestamp: seconds in the high 32 bits, fraction of a second
+// (as igtl::TimeStamp encodes it) in the low 32 bits
+uint64_t timestamp(uint32_t seconds, uint32_t nanoseconds);
+uint64_t timestampNow();
+
+// Writes the header for a body of bodySize bytes that already sits at
+// out + kHeaderSize
+void packHeader(uint8_t *out, const char *type, const char *deviceName, uint64_t timestamp, uint64_t bodySize);
+
+// Writes a complete TRANSFORM message (kTransformMessageSize bytes) for a
+// row-major 3x4 matrix
+void packTransform(uint8_t *out, const char *deviceName, uint64_t timestamp, const double matrix[3][4]);
+
+// Reads back a TRANSFORM message as packTransform() writes it (to float
+// precision). Returns false unless message holds a complete TRANSFORM
+// message of size bytes.
+bool unpackTransform(const uint8_t *message, size_t size, uint64_t &timestamp, double matrix[3][4]);
+
+// Nanoseconds since the epoch of a timestamp()
+uint64_t timestampToNs(uint64_t timestamp);
+
+// Writes a complete SENSOR message (sensorMessageSize(count) bytes) with
+// count values (at most kMaxSensorValues) in the given unit
+void packSensor(uint8_t *out, const char *deviceName, uint64_t timestamp, const double *values, size_t count,
+                uint64_t unit, uint8_t status = 0);
+
+}
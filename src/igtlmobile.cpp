@@ -0,0 +1,188 @@
+#include "igtlmobile.h"
+#include "fusioncore.h"
+#include "igtlmessages.h"
+#include "transformchain.h"
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#ifndef IGTLM_VERSION
+#define IGTLM_VERSION "unknown"
+#endif
+
+static_assert(IGTLM_TRANSFORM_MESSAGE_SIZE == IgtlMessages::kTransformMessageSize, "TRANSFORM size");
+
+// The same steps as RotationSensor::fuseSensors() and
+// ApplicationController::sendPose(), without the Qt signals in between
+struct igtlm_pipeline {
+    FusionCore fusion;
+    TransformChain transformChain;
+    char deviceName[IgtlMessages::kDeviceNameSize + 1] = "MobileDevice";
+    uint64_t lastTimeNs = 0;
+    bool hasLastTime = false;
+    bool hasReference = false;
+    double reference[4] = {1.0, 0.0, 0.0, 0.0}; // conjugate of the orientation at the reset
+};
+
+const char *igtlm_version(void)
+{
+    return IGTLM_VERSION;
+}
+
+igtlm_pipeline *igtlm_create(void)
+{
+    return new (std::nothrow) igtlm_pipeline;
+}
+
+void igtlm_destroy(igtlm_pipeline *pipeline)
+{
+    delete pipeline;
+}
+
+int igtlm_set_fusion(igtlm_pipeline *pipeline, const char *algorithm, double beta)
+{
+    FusionCore::Algorithm value;
+    if (!pipeline || !algorithm || !FusionCore::algorithmFromName(algorithm, value) || !(beta >= 0.0)) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    FusionCore::Parameters parameters = pipeline->fusion.parameters();
+    parameters.algorithm = value;
+    parameters.beta = beta;
+    pipeline->fusion.setParameters(parameters);
+    return IGTLM_OK;
+}
+
+int igtlm_set_integrator(igtlm_pipeline *pipeline, const char *integrator)
+{
+    FusionCore::Integrator value;
+    if (!pipeline || !integrator || !FusionCore::integratorFromName(integrator, value)) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    FusionCore::Parameters parameters = pipeline->fusion.parameters();
+    parameters.integrator = value;
+    pipeline->fusion.setParameters(parameters);
+    return IGTLM_OK;
+}
+
+int igtlm_set_axis_map(igtlm_pipeline *pipeline, const char *spec)
+{
+    if (!pipeline || !spec) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    try {
+        return pipeline->transformChain.setAxisMap(spec) ? IGTLM_OK : IGTLM_ERROR_INVALID_ARGUMENT;
+    } catch (const std::bad_alloc &) {
+        // Exceptions must not cross the C boundary
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+void igtlm_set_tip_offset(igtlm_pipeline *pipeline, double x, double y, double z)
+{
+    if (pipeline) {
+        pipeline->transformChain.setTipOffset(x, y, z);
+    }
+}
+
+int igtlm_set_registration(igtlm_pipeline *pipeline, const double matrix[12])
+{
+    if (!pipeline || !matrix) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    double rows[3][4];
+    std::memcpy(rows, matrix, sizeof(rows));
+    return pipeline->transformChain.setRegistration(rows) ? IGTLM_OK : IGTLM_ERROR_INVALID_ARGUMENT;
+}
+
+void igtlm_reset_registration(igtlm_pipeline *pipeline)
+{
+    if (pipeline) {
+        pipeline->transformChain.resetRegistration();
+    }
+}
+
+int igtlm_set_device_name(igtlm_pipeline *pipeline, const char *name)
+{
+    if (!pipeline || !name || std::strlen(name) > IgtlMessages::kDeviceNameSize) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    std::strcpy(pipeline->deviceName, name);
+    return IGTLM_OK;
+}
+
+void igtlm_reset_orientation(igtlm_pipeline *pipeline)
+{
+    if (pipeline) {
+        pipeline->fusion.reset();
+        pipeline->hasReference = false;
+        pipeline->hasLastTime = false;
+    }
+}
+
+int igtlm_update(igtlm_pipeline *pipeline, const igtlm_sensor_sample *sample, igtlm_pose *pose)
+{
+    if (!pipeline || !sample) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+
+    FusionInput input;
+    std::memcpy(input.accel, sample->accel, sizeof(input.accel));
+    std::memcpy(input.gyro, sample->gyro, sizeof(input.gyro));
+    std::memcpy(input.mag, sample->mag, sizeof(input.mag));
+    input.hasAccel = sample->has_accel != 0;
+    input.hasGyro = sample->has_gyro != 0;
+    input.hasMag = sample->has_mag != 0;
+
+    // The first sample and samples out of order give no step (FusionCore
+    // skips steps outside its dt range)
+    double dt = 0.0;
+    if (pipeline->hasLastTime && sample->time_ns > pipeline->lastTimeNs) {
+        dt = double(sample->time_ns - pipeline->lastTimeNs) * 1e-9;
+    }
+    pipeline->lastTimeNs = sample->time_ns;
+    pipeline->hasLastTime = true;
+    pipeline->fusion.update(input, dt);
+
+    double w, x, y, z;
+    pipeline->fusion.orientation(w, x, y, z);
+    if (!pipeline->hasReference) {
+        FusionCore::quaternionConjugate(w, x, y, z, pipeline->reference[0], pipeline->reference[1],
+                                        pipeline->reference[2], pipeline->reference[3]);
+        pipeline->hasReference = true;
+    }
+
+    // Relative rotation: current * inverse(reference)
+    double relativeW, relativeX, relativeY, relativeZ;
+    FusionCore::quaternionMultiply(w, x, y, z, pipeline->reference[0], pipeline->reference[1],
+                                   pipeline->reference[2], pipeline->reference[3],
+                                   relativeW, relativeX, relativeY, relativeZ);
+    if (pose) {
+        const Pose output = pipeline->transformChain.apply(relativeW, relativeX, relativeY, relativeZ);
+        std::memcpy(pose->q, output.q, sizeof(pose->q));
+        std::memcpy(pose->t, output.t, sizeof(pose->t));
+        pose->time_ns = sample->time_ns;
+    }
+    return IGTLM_OK;
+}
+
+int igtlm_pack_transform(const igtlm_pipeline *pipeline, const igtlm_pose *pose, uint8_t *out, size_t capacity)
+{
+    if (!pipeline || !pose || !out) {
+        return IGTLM_ERROR_INVALID_ARGUMENT;
+    }
+    if (capacity < IgtlMessages::kTransformMessageSize) {
+        return IGTLM_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    Pose output;
+    std::memcpy(output.q, pose->q, sizeof(output.q));
+    std::memcpy(output.t, pose->t, sizeof(output.t));
+    double rows[3][4];
+    output.toMatrix(rows);
+
+    const uint64_t timestamp = pose->time_ns == 0
+        ? IgtlMessages::timestampNow()
+        : IgtlMessages::timestamp(uint32_t(pose->time_ns / 1000000000), uint32_t(pose->time_ns % 1000000000));
+    IgtlMessages::packTransform(out, pipeline->deviceName, timestamp, rows);
+    return int(IgtlMessages::kTransformMessageSize);
+}
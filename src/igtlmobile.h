@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * C API of the igtlmobile core library: the app's sensor-to-pose-to-packet
+ * pipeline (FusionCore, TransformChain, IgtlMessages) for processes that
+ * embed it instead of receiving its stream over the network. No Qt, no
+ * OpenIGTLink library and no global state; a pipeline is not thread-safe,
+ * so use one per thread.
+ *
+ * Typical use:
+ *
+ *   igtlm_pipeline *pipeline = igtlm_create();
+ *   igtlm_set_device_name(pipeline, "Probe");
+ *   for each sensor reading:
+ *       igtlm_update(pipeline, &sample, &pose);
+ *       size = igtlm_pack_transform(pipeline, &pose, buffer, sizeof(buffer));
+ *   igtlm_destroy(pipeline);
+ *
+ * Functions that can fail return an IGTLM_ERROR_* code (negative).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(IGTLM_STATIC)
+#define IGTLM_API
+#elif defined(_WIN32)
+#if defined(IGTLM_BUILDING)
+#define IGTLM_API __declspec(dllexport)
+#else
+#define IGTLM_API __declspec(dllimport)
+#endif
+#else
+#define IGTLM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IGTLM_OK 0
+#define IGTLM_ERROR_INVALID_ARGUMENT (-1)
+#define IGTLM_ERROR_BUFFER_TOO_SMALL (-2)
+
+/* Size of a packed TRANSFORM message */
+#define IGTLM_TRANSFORM_MESSAGE_SIZE 106
+
+typedef struct igtlm_pipeline igtlm_pipeline;
+
+/* One set of sensor readings. Readings that are missing are flagged with
+ * has_* = 0; the fusion falls back the same way the app does. */
+typedef struct igtlm_sensor_sample {
+    uint64_t time_ns;  /* capture time; differences give the integration step */
+    double accel[3];   /* any unit, only the direction is used: up, +Z when
+                        * lying flat (as Android reports it) */
+    double gyro[3];    /* rad/s */
+    double mag[3];     /* any unit, only the direction is used */
+    int has_accel;
+    int has_gyro;
+    int has_mag;
+} igtlm_sensor_sample;
+
+/* Output pose: rotation relative to the orientation at the last reset, after
+ * the frame transforms */
+typedef struct igtlm_pose {
+    double q[4];      /* w, x, y, z */
+    double t[3];      /* mm */
+    uint64_t time_ns; /* time_ns of the sample it came from */
+} igtlm_pose;
+
+/* Library version, e.g. "1.0.0" */
+IGTLM_API const char *igtlm_version(void);
+
+/* NULL when out of memory */
+IGTLM_API igtlm_pipeline *igtlm_create(void);
+IGTLM_API void igtlm_destroy(igtlm_pipeline *pipeline);
+
+/* Fusion algorithm by name ("gyro", "madgwick" or "accelmag", as in the
+ * fusion/algorithm setting) and Madgwick gain */
+IGTLM_API int igtlm_set_fusion(igtlm_pipeline *pipeline, const char *algorithm, double beta);
+/* Gyro integrator ("euler", "expmap" or "rk4", as in fusion/integrator) */
+IGTLM_API int igtlm_set_integrator(igtlm_pipeline *pipeline, const char *integrator);
+
+/* Frame transforms, as the transform/... settings of the app: signed axis
+ * map such as "-x,y,z" (the default), tool-tip offset in mm along the
+ * remapped axes, and a rigid device-to-reference registration given as the
+ * 12 values of a row-major 3x4 matrix [R | t]. R must be a rotation
+ * (orthonormal, det +1); anything else, reflections included, gives
+ * IGTLM_ERROR_INVALID_ARGUMENT and keeps the previous registration. */
+IGTLM_API int igtlm_set_axis_map(igtlm_pipeline *pipeline, const char *spec);
+IGTLM_API void igtlm_set_tip_offset(igtlm_pipeline *pipeline, double x, double y, double z);
+IGTLM_API int igtlm_set_registration(igtlm_pipeline *pipeline, const double matrix[12]);
+IGTLM_API void igtlm_reset_registration(igtlm_pipeline *pipeline);
+
+/* Device name written into packed messages (up to 20 characters) */
+IGTLM_API int igtlm_set_device_name(igtlm_pipeline *pipeline, const char *name);
+
+/* The next sample defines the reference orientation and restarts the fusion */
+IGTLM_API void igtlm_reset_orientation(igtlm_pipeline *pipeline);
+
+/* Feeds one sample and writes the resulting pose (if pose is not NULL) */
+IGTLM_API int igtlm_update(igtlm_pipeline *pipeline, const igtlm_sensor_sample *sample, igtlm_pose *pose);
+
+/* Packs a pose as an OpenIGTLink TRANSFORM message (header and body, CRC
+ * included) stamped with the pose's time_ns taken as Unix time; time_ns = 0
+ * stamps the current time. Returns the message size or an error code. */
+IGTLM_API int igtlm_pack_transform(const igtlm_pipeline *pipeline, const igtlm_pose *pose, uint8_t *out, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,231 @@
+#include "igtlserver.h"
+#include "metricsregistry.h"
+#include <QRegularExpression>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+
+// OpenIGTLink v1 header: version(2) type(12) device(20) timestamp(8)
+// body size(8) crc(8), all big-endian
+const int kHeaderSize = 58;
+const int kTypeOffset = 2;
+const int kTypeSize = 12;
+const int kBodySizeOffset = 42;
+
+// Keep at most this much data in a socket's write buffer; the rest waits in
+// the subscriber queue where it can be dropped oldest-first
+const qint64 kMaxBytesInFlight = 16 * 1024;
+
+// Upper bound for control messages, protects against garbage input
+const quint64 kMaxControlBodySize = 4096;
+
+}
+
+IGTLServer::IGTLServer(QObject *parent)
+    : QObject(parent)
+    , m_server(new QTcpServer(this))
+    , m_defaultQueueLimit(8)
+    , m_defaultDecimation(1)
+{
+    connect(m_server, &QTcpServer::newConnection, this, &IGTLServer::onNewConnection);
+}
+
+IGTLServer::~IGTLServer()
+{
+    close();
+}
+
+bool IGTLServer::listen(int port)
+{
+    if (m_server->isListening()) {
+        return true;
+    }
+    if (!m_server->listen(QHostAddress::Any, quint16(port))) {
+        qWarning() << "IGTLServer: Cannot listen on port" << port << m_server->errorString();
+        return false;
+    }
+    qDebug() << "IGTLServer: Listening on port" << port;
+    return true;
+}
+
+void IGTLServer::close()
+{
+    m_server->close();
+    const QList<Subscriber *> subscribers = m_subscribers;
+    m_subscribers.clear();
+    for (Subscriber *subscriber : subscribers) {
+        subscriber->socket->disconnect(this);
+        subscriber->socket->abort();
+        subscriber->socket->deleteLater();
+        delete subscriber;
+    }
+    if (!subscribers.isEmpty()) {
+        emit subscriberCountChanged();
+    }
+}
+
+bool IGTLServer::isListening() const
+{
+    return m_server->isListening();
+}
+
+QString IGTLServer::errorString() const
+{
+    return m_server->errorString();
+}
+
+int IGTLServer::subscriberCount() const
+{
+    return m_subscribers.size();
+}
+
+void IGTLServer::broadcast(const QByteArray &message)
+{
+    for (Subscriber *subscriber : std::as_const(m_subscribers)) {
+        if (subscriber->offered++ % quint64(subscriber->decimation) != 0) {
+            continue;
+        }
+        if (subscriber->queue.size() >= subscriber->queueLimit) {
+            // Newest data matters most for a pose stream
+            subscriber->queue.dequeue();
+            ++subscriber->dropped;
+            MetricsRegistry::add(MetricsRegistry::MessagesDropped);
+        }
+        subscriber->queue.enqueue(message);
+        pump(subscriber);
+    }
+}
+
+void IGTLServer::setDefaultQueueLimit(int messages)
+{
+    m_defaultQueueLimit = qMax(1, messages);
+}
+
+void IGTLServer::setDefaultDecimation(int factor)
+{
+    m_defaultDecimation = qMax(1, factor);
+}
+
+void IGTLServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        Subscriber *subscriber = new Subscriber;
+        subscriber->socket = socket;
+        subscriber->queueLimit = m_defaultQueueLimit;
+        subscriber->decimation = m_defaultDecimation;
+        m_subscribers.append(subscriber);
+
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() {
+            if (Subscriber *s = findSubscriber(socket)) {
+                pump(s);
+            }
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            if (Subscriber *s = findSubscriber(socket)) {
+                readControl(s);
+            }
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            removeSubscriber(socket);
+        });
+
+        qDebug() << "IGTLServer: Subscriber connected from" << socket->peerAddress().toString()
+                 << "- total" << m_subscribers.size();
+        emit subscriberCountChanged();
+    }
+}
+
+IGTLServer::Subscriber *IGTLServer::findSubscriber(QTcpSocket *socket)
+{
+    for (Subscriber *subscriber : std::as_const(m_subscribers)) {
+        if (subscriber->socket == socket) {
+            return subscriber;
+        }
+    }
+    return nullptr;
+}
+
+void IGTLServer::pump(Subscriber *subscriber)
+{
+    QTcpSocket *socket = subscriber->socket;
+    while (!subscriber->queue.isEmpty() && socket->bytesToWrite() < kMaxBytesInFlight) {
+        const QByteArray message = subscriber->queue.dequeue();
+        if (socket->write(message) == message.size()) {
+            MetricsRegistry::add(MetricsRegistry::MessagesSent);
+            MetricsRegistry::add(MetricsRegistry::BytesSent, quint64(message.size()));
+        } else {
+            MetricsRegistry::add(MetricsRegistry::SendErrors);
+        }
+    }
+}
+
+void IGTLServer::readControl(Subscriber *subscriber)
+{
+    subscriber->incoming += subscriber->socket->readAll();
+
+    while (subscriber->incoming.size() >= kHeaderSize) {
+        const uchar *header = reinterpret_cast<const uchar *>(subscriber->incoming.constData());
+        quint64 bodySize = qFromBigEndian<quint64>(header + kBodySizeOffset);
+        if (bodySize > kMaxControlBodySize) {
+            qWarning() << "IGTLServer: Oversized message from subscriber, disconnecting";
+            subscriber->socket->abort();
+            return;
+        }
+        if (quint64(subscriber->incoming.size()) < kHeaderSize + bodySize) {
+            return; // wait for the rest
+        }
+
+        const QByteArray type = QByteArray(subscriber->incoming.constData() + kTypeOffset, kTypeSize).split('\0').first();
+        const QByteArray body = subscriber->incoming.mid(kHeaderSize, int(bodySize));
+        subscriber->incoming.remove(0, kHeaderSize + int(bodySize));
+
+        // STRING body: encoding(2) length(2) characters
+        if (type != "STRING" || body.size() < 4) {
+            continue;
+        }
+        quint16 length = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(body.constData()) + 2);
+        const QString command = QString::fromUtf8(body.mid(4, length));
+
+        static const QRegularExpression separators("[\\s,;]+");
+        for (const QString &pair : command.split(separators, Qt::SkipEmptyParts)) {
+            const QStringList keyValue = pair.split('=');
+            bool ok = false;
+            int value = keyValue.size() == 2 ? keyValue[1].toInt(&ok) : 0;
+            if (!ok || value < 1) {
+                qWarning() << "IGTLServer: Unsupported subscriber command" << pair;
+            } else if (keyValue[0] == "decimate") {
+                subscriber->decimation = value;
+            } else if (keyValue[0] == "queue") {
+                subscriber->queueLimit = value;
+                while (subscriber->queue.size() > value) {
+                    subscriber->queue.dequeue();
+                    ++subscriber->dropped;
+                }
+            } else {
+                qWarning() << "IGTLServer: Unsupported subscriber command" << pair;
+            }
+        }
+        qDebug() << "IGTLServer: Subscriber" << subscriber->socket->peerAddress().toString()
+                 << "decimation" << subscriber->decimation << "queue" << subscriber->queueLimit;
+    }
+}
+
+void IGTLServer::removeSubscriber(QTcpSocket *socket)
+{
+    for (int i = 0; i < m_subscribers.size(); ++i) {
+        Subscriber *subscriber = m_subscribers[i];
+        if (subscriber->socket == socket) {
+            qDebug() << "IGTLServer: Subscriber disconnected, dropped" << subscriber->dropped << "messages";
+            m_subscribers.removeAt(i);
+            socket->deleteLater();
+            delete subscriber;
+            emit subscriberCountChanged();
+            return;
+        }
+    }
+}
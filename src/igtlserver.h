@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QQueue>
+
+class QTcpServer;
+class QTcpSocket;
+
+// OpenIGTLink server mode: receivers connect to the phone and all get the
+// same stream. Each message is packed once by the caller and shared between
+// subscribers (QByteArray is implicitly shared). Every subscriber has its own
+// bounded queue and decimation, so a slow receiver only drops its own oldest
+// messages and never delays the others.
+//
+// Subscribers may adjust their own settings with an OpenIGTLink STRING
+// message such as "decimate=3 queue=16".
+class IGTLServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IGTLServer(QObject *parent = nullptr);
+    ~IGTLServer();
+
+    bool listen(int port);
+    void close();
+    bool isListening() const;
+    QString errorString() const;
+
+    int subscriberCount() const;
+
+    void broadcast(const QByteArray &message);
+
+    // Defaults for new subscribers
+    void setDefaultQueueLimit(int messages);
+    void setDefaultDecimation(int factor);
+
+signals:
+    void subscriberCountChanged();
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Subscriber {
+        QTcpSocket *socket = nullptr;
+        QQueue<QByteArray> queue;
+        QByteArray incoming;
+        int queueLimit = 8;
+        int decimation = 1;
+        quint64 offered = 0;
+        quint64 dropped = 0;
+    };
+
+    Subscriber *findSubscriber(QTcpSocket *socket);
+    void pump(Subscriber *subscriber);
+    void readControl(Subscriber *subscriber);
+    void removeSubscriber(QTcpSocket *socket);
+
+    QTcpServer *m_server;
+    QList<Subscriber *> m_subscribers;
+    int m_defaultQueueLimit;
+    int m_defaultDecimation;
+};
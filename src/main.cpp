@@ -1,11 +1,17 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
-#include <QQmlContext>
+#include <QQuickWindow>
+#include <memory>
 
 #include "applicationcontroller.h"
+#include "startupprofiler.h"
 
 int main(int argc, char *argv[])
 {
+    // Start the startup clock before anything else is constructed
+    StartupProfiler &profiler = StartupProfiler::instance();
+
+    profiler.beginPhase("QGuiApplication");
     QGuiApplication app(argc, argv);
 
     // Set application metadata
@@ -13,14 +19,16 @@ int main(int argc, char *argv[])
     QGuiApplication::setApplicationVersion("1.0.0");
     QGuiApplication::setOrganizationName("OpenIGTLink");
     QGuiApplication::setOrganizationDomain("openigtlink.org");
+    profiler.endPhase("QGuiApplication");
 
-    // Create the application controller
+    // Create the application controller (exposed to QML as the AppController singleton)
+    profiler.beginPhase("ApplicationController");
     ApplicationController controller;
+    profiler.endPhase("ApplicationController");
 
+    profiler.beginPhase("QQmlApplicationEngine");
     QQmlApplicationEngine engine;
-    
-    // Register the controller with QML
-    engine.rootContext()->setContextProperty("appController", &controller);
+    profiler.endPhase("QQmlApplicationEngine");
     
     // Load main QML file
     const QUrl url(u"qrc:/OpenIGTLinkMobile/qml/main.qml"_qs);
@@ -30,7 +38,21 @@ int main(int argc, char *argv[])
             QCoreApplication::exit(-1);
     }, Qt::QueuedConnection);
     
+    profiler.beginPhase("loadQml");
     engine.load(url);
+    profiler.endPhase("loadQml");
+
+    // Finish the startup trace once the first frame has been presented.
+    // frameSwapped is emitted on the render thread, so hop to the GUI thread.
+    if (!engine.rootObjects().isEmpty()) {
+        if (auto *window = qobject_cast<QQuickWindow *>(engine.rootObjects().first())) {
+            auto firstFrame = std::make_shared<QMetaObject::Connection>();
+            *firstFrame = QObject::connect(window, &QQuickWindow::frameSwapped, &app, [firstFrame]() {
+                QObject::disconnect(*firstFrame);
+                StartupProfiler::instance().finish();
+            }, Qt::QueuedConnection);
+        }
+    }
 
     return app.exec();
-}
\ No newline at end of file
+}
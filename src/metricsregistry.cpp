@@ -0,0 +1,201 @@
+#include "metricsregistry.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QDebug>
+
+MetricsRegistry::PaddedCounter MetricsRegistry::s_counters[MetricsRegistry::CounterCount];
+MetricsRegistry::PaddedGauge MetricsRegistry::s_gauges[MetricsRegistry::GaugeCount];
+
+namespace {
+
+struct MetricInfo {
+    const char *name;
+    const char *help;
+};
+
+const MetricInfo kCounterInfo[MetricsRegistry::CounterCount] = {
+    {"igtl_messages_sent_total", "OpenIGTLink messages written to the socket"},
+    {"igtl_bytes_sent_total", "Bytes written to the socket"},
+    {"igtl_send_errors_total", "Failed socket writes"},
+    {"igtl_messages_dropped_total", "Poses dropped before sending (disconnected, paused or flow control)"},
+    {"igtl_connects_total", "Successful connections to a server"},
+    {"igtl_reconnects_total", "Connections after the first one"},
+    {"igtl_fusion_samples_total", "Sensor fusion steps"},
+    {"igtl_fusion_time_ns_total", "Time spent in sensor fusion"},
+    {"igtl_failovers_total", "Switches from the active server to the standby"},
+    {"igtl_event_loop_stalls_total", "GUI event-loop dispatch delays above the stall threshold"},
+    {"igtl_sensor_readings_late_total", "Accelerometer and magnetometer readings held because they arrived after the gyroscope sample"},
+    {"igtl_sensor_readings_early_total", "Accelerometer and magnetometer readings held because only newer ones were buffered"},
+};
+
+const MetricInfo kGaugeInfo[MetricsRegistry::GaugeCount] = {
+    {"igtl_send_queue_depth", "Messages waiting in the send queue"},
+    {"igtl_last_failover_us", "Time from detecting a failed server until the stream continued on the standby"},
+    {"igtl_event_loop_max_lag_us", "Largest GUI event-loop dispatch delay in the last second"},
+};
+
+// Request headers larger than this are not from a scraper; the connection
+// is closed instead of buffering them
+const int kMaxRequestSize = 8192;
+
+}
+
+MetricsRegistry *MetricsRegistry::instance()
+{
+    // Lives on the GUI thread and is torn down with the application
+    static MetricsRegistry *registry = new MetricsRegistry(QCoreApplication::instance());
+    return registry;
+}
+
+MetricsRegistry::MetricsRegistry(QObject *parent)
+    : QObject(parent)
+    , m_exportTimer(new QTimer(this))
+    , m_httpServer(nullptr)
+    , m_lastFusionSamples(0)
+    , m_lastFusionTimeNs(0)
+    , m_fusionTimeUs(0.0)
+{
+    connect(m_exportTimer, &QTimer::timeout, this, &MetricsRegistry::publish);
+}
+
+void MetricsRegistry::startExport(int intervalMs, const QString &filePath, quint16 httpPort)
+{
+    stopExport();
+
+    m_filePath = filePath;
+    if (!m_filePath.isEmpty()) {
+        QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+        qDebug() << "MetricsRegistry: Exporting to" << m_filePath << "every" << intervalMs << "ms";
+    }
+
+    if (httpPort != 0) {
+        m_httpServer = new QTcpServer(this);
+        connect(m_httpServer, &QTcpServer::newConnection, this, &MetricsRegistry::onHttpConnection);
+        // Localhost only: the metrics are not meant to leave the device
+        if (m_httpServer->listen(QHostAddress::LocalHost, httpPort)) {
+            qDebug() << "MetricsRegistry: Serving metrics on http://127.0.0.1:" << httpPort << "/metrics";
+        } else {
+            qWarning() << "MetricsRegistry: Cannot listen on port" << httpPort << m_httpServer->errorString();
+            delete m_httpServer;
+            m_httpServer = nullptr;
+        }
+    }
+
+    m_exportTimer->start(qMax(100, intervalMs));
+}
+
+void MetricsRegistry::stopExport()
+{
+    m_exportTimer->stop();
+    delete m_httpServer;
+    m_httpServer = nullptr;
+    m_filePath.clear();
+}
+
+QString MetricsRegistry::prometheusText() const
+{
+    QString text;
+    for (int i = 0; i < CounterCount; ++i) {
+        text += QString("# HELP %1 %2\n# TYPE %1 counter\n%1 %3\n")
+                    .arg(kCounterInfo[i].name, kCounterInfo[i].help)
+                    .arg(value(Counter(i)));
+    }
+    for (int i = 0; i < GaugeCount; ++i) {
+        text += QString("# HELP %1 %2\n# TYPE %1 gauge\n%1 %3\n")
+                    .arg(kGaugeInfo[i].name, kGaugeInfo[i].help)
+                    .arg(value(Gauge(i)));
+    }
+    return text;
+}
+
+quint64 MetricsRegistry::messagesSent() const
+{
+    return value(MessagesSent);
+}
+
+quint64 MetricsRegistry::bytesSent() const
+{
+    return value(BytesSent);
+}
+
+quint64 MetricsRegistry::sendErrors() const
+{
+    return value(SendErrors);
+}
+
+quint64 MetricsRegistry::messagesDropped() const
+{
+    return value(MessagesDropped);
+}
+
+quint64 MetricsRegistry::reconnects() const
+{
+    return value(Reconnects);
+}
+
+double MetricsRegistry::fusionTimeUs() const
+{
+    return m_fusionTimeUs;
+}
+
+quint64 MetricsRegistry::queueDepth() const
+{
+    return quint64(qMax<qint64>(0, value(SendQueueDepth)));
+}
+
+void MetricsRegistry::publish()
+{
+    const quint64 samples = value(FusionSamples);
+    const quint64 timeNs = value(FusionTimeNs);
+    if (samples > m_lastFusionSamples) {
+        m_fusionTimeUs = double(timeNs - m_lastFusionTimeNs) / double(samples - m_lastFusionSamples) / 1000.0;
+    }
+    m_lastFusionSamples = samples;
+    m_lastFusionTimeNs = timeNs;
+
+    if (!m_filePath.isEmpty()) {
+        // Atomic replace so scrapers never see a half-written file
+        QSaveFile file(m_filePath);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(prometheusText().toUtf8());
+            if (!file.commit()) {
+                qWarning() << "MetricsRegistry: Cannot write" << m_filePath << file.errorString();
+            }
+        }
+    }
+
+    emit updated();
+}
+
+void MetricsRegistry::onHttpConnection()
+{
+    while (QTcpSocket *socket = m_httpServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+            // Every request gets the metrics page; only wait for the end of the headers
+            QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+            if (!request.contains("\r\n\r\n")) {
+                if (request.size() > kMaxRequestSize) {
+                    qWarning() << "MetricsRegistry: Request too large, closing" << socket->peerAddress().toString();
+                    socket->abort();
+                    socket->deleteLater();
+                    return;
+                }
+                socket->setProperty("request", request);
+                return;
+            }
+            const QByteArray body = prometheusText().toUtf8();
+            QByteArray response = "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                                  "Connection: close\r\n\r\n";
+            socket->write(response + body);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QString>
+#include <atomic>
+
+class QTimer;
+class QTcpServer;
+
+// Process-wide pipeline counters. Updates are lock-free relaxed atomics, each
+// on its own cache line so the sensor, network and GUI paths do not contend.
+// The registry periodically publishes a snapshot as Prometheus text (file
+// and/or a localhost HTTP endpoint) and as Q_PROPERTYs for QML.
+class MetricsRegistry : public QObject
+{
+    Q_OBJECT
+    QML_ANONYMOUS
+
+    Q_PROPERTY(quint64 messagesSent READ messagesSent NOTIFY updated)
+    Q_PROPERTY(quint64 bytesSent READ bytesSent NOTIFY updated)
+    Q_PROPERTY(quint64 sendErrors READ sendErrors NOTIFY updated)
+    Q_PROPERTY(quint64 messagesDropped READ messagesDropped NOTIFY updated)
+    Q_PROPERTY(quint64 reconnects READ reconnects NOTIFY updated)
+    Q_PROPERTY(double fusionTimeUs READ fusionTimeUs NOTIFY updated)
+    Q_PROPERTY(quint64 queueDepth READ queueDepth NOTIFY updated)
+
+public:
+    enum Counter {
+        MessagesSent,
+        BytesSent,
+        SendErrors,
+        MessagesDropped,
+        Connects,
+        Reconnects,
+        FusionSamples,
+        FusionTimeNs,
+        Failovers,
+        EventLoopStalls,
+        SensorReadingsLate,
+        SensorReadingsEarly,
+        CounterCount
+    };
+
+    enum Gauge {
+        SendQueueDepth,
+        FailoverTimeUs,
+        EventLoopLagUs,
+        GaugeCount
+    };
+
+    static MetricsRegistry *instance();
+
+    static void add(Counter counter, quint64 value = 1)
+    {
+        s_counters[counter].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void set(Gauge gauge, qint64 value)
+    {
+        s_gauges[gauge].value.store(value, std::memory_order_relaxed);
+    }
+
+    static quint64 value(Counter counter)
+    {
+        return s_counters[counter].value.load(std::memory_order_relaxed);
+    }
+
+    static qint64 value(Gauge gauge)
+    {
+        return s_gauges[gauge].value.load(std::memory_order_relaxed);
+    }
+
+    // Publishes every intervalMs. An empty filePath disables the file export,
+    // httpPort 0 disables the HTTP endpoint.
+    void startExport(int intervalMs, const QString &filePath, quint16 httpPort);
+    void stopExport();
+
+    QString prometheusText() const;
+
+    quint64 messagesSent() const;
+    quint64 bytesSent() const;
+    quint64 sendErrors() const;
+    quint64 messagesDropped() const;
+    quint64 reconnects() const;
+    double fusionTimeUs() const; // mean over the last export interval
+    quint64 queueDepth() const;
+
+signals:
+    void updated();
+
+private slots:
+    void publish();
+    void onHttpConnection();
+
+private:
+    explicit MetricsRegistry(QObject *parent = nullptr);
+
+    struct alignas(64) PaddedCounter {
+        std::atomic<quint64> value{0};
+    };
+    struct alignas(64) PaddedGauge {
+        std::atomic<qint64> value{0};
+    };
+
+    static PaddedCounter s_counters[CounterCount];
+    static PaddedGauge s_gauges[GaugeCount];
+
+    QTimer *m_exportTimer;
+    QTcpServer *m_httpServer;
+    QString m_filePath;
+
+    // Snapshot used for interval-based values
+    quint64 m_lastFusionSamples;
+    quint64 m_lastFusionTimeNs;
+    double m_fusionTimeUs;
+};
@@ -0,0 +1,153 @@
+#include "motionscheduler.h"
+#include <QDebug>
+#include <ctime>
+
+namespace {
+
+// Rates per activity. Moving keeps the original 30 FPS output (unless the
+// server asks for another rate) and the backend default sensor rate; still
+// drops both to a trickle that is enough to keep the receiver's view alive
+// and to notice motion again.
+const int kDefaultMovingIntervalMs = 33;
+const int kStillIntervalMs = 200;
+const int kMovingDataRate = 0;
+const int kStillDataRate = 10;
+
+qint64 processCpuMs()
+{
+    return qint64(std::clock()) * 1000 / CLOCKS_PER_SEC;
+}
+
+}
+
+MotionScheduler::MotionScheduler(QObject *parent)
+    : QObject(parent)
+    , m_activity(Moving)
+    , m_moveThreshold(0.15)  // ~8.6 deg/s
+    , m_stillThreshold(0.03) // ~1.7 deg/s, still above the bias of most phone gyroscopes
+    , m_stillHoldMs(2000)
+    , m_movingIntervalMs(kDefaultMovingIntervalMs)
+    , m_isBelow(false)
+    , m_lastCpuMs(0)
+{
+    reset();
+}
+
+void MotionScheduler::reset()
+{
+    m_activity = Moving;
+    m_isBelow = false;
+    m_stats[Moving] = StateStats();
+    m_stats[Still] = StateStats();
+    m_stateClock.start();
+    m_lastCpuMs = processCpuMs();
+}
+
+void MotionScheduler::addGyroMagnitude(double magnitude)
+{
+    if (magnitude > m_moveThreshold) {
+        m_isBelow = false;
+        if (m_activity != Moving) {
+            setActivity(Moving);
+        }
+        return;
+    }
+
+    if (magnitude >= m_stillThreshold) {
+        m_isBelow = false;
+        return;
+    }
+
+    if (!m_isBelow) {
+        m_isBelow = true;
+        m_belowSince.start();
+    } else if (m_activity != Still && m_belowSince.elapsed() >= m_stillHoldMs) {
+        setActivity(Still);
+    }
+}
+
+void MotionScheduler::recordMessage()
+{
+    ++m_stats[m_activity].messages;
+}
+
+MotionScheduler::Activity MotionScheduler::activity() const
+{
+    return m_activity;
+}
+
+QString MotionScheduler::activityName(Activity activity)
+{
+    return activity == Still ? QStringLiteral("Still") : QStringLiteral("Moving");
+}
+
+int MotionScheduler::outputIntervalMs() const
+{
+    return m_activity == Still ? qMax(kStillIntervalMs, m_movingIntervalMs) : m_movingIntervalMs;
+}
+
+int MotionScheduler::sensorDataRate() const
+{
+    return m_activity == Still ? kStillDataRate : kMovingDataRate;
+}
+
+void MotionScheduler::setThresholds(double moveThreshold, double stillThreshold, int stillHoldMs)
+{
+    if (stillThreshold > moveThreshold) {
+        qWarning() << "MotionScheduler: still threshold above move threshold, ignoring";
+        return;
+    }
+    m_moveThreshold = moveThreshold;
+    m_stillThreshold = stillThreshold;
+    m_stillHoldMs = stillHoldMs;
+}
+
+int MotionScheduler::movingIntervalMs() const
+{
+    return m_movingIntervalMs;
+}
+
+void MotionScheduler::setMovingIntervalMs(int intervalMs)
+{
+    m_movingIntervalMs = intervalMs > 0 ? intervalMs : kDefaultMovingIntervalMs;
+}
+
+MotionScheduler::StateStats MotionScheduler::stats(Activity activity)
+{
+    accumulate();
+    return m_stats[activity];
+}
+
+QString MotionScheduler::statsReport()
+{
+    accumulate();
+    QString report;
+    for (Activity activity : {Moving, Still}) {
+        const StateStats &s = m_stats[activity];
+        report += QString("%1: %2 s, CPU %3 ms (%4%), %5 msg/min\n")
+                      .arg(activityName(activity))
+                      .arg(s.wallMs / 1000.0, 0, 'f', 1)
+                      .arg(s.cpuMs)
+                      .arg(s.cpuPercent(), 0, 'f', 1)
+                      .arg(s.messagesPerMinute(), 0, 'f', 0);
+    }
+    return report;
+}
+
+void MotionScheduler::setActivity(Activity activity)
+{
+    accumulate();
+    m_activity = activity;
+    qDebug() << "MotionScheduler: Activity changed to" << activityName(activity);
+    qDebug().noquote() << statsReport();
+    emit activityChanged(activity);
+}
+
+void MotionScheduler::accumulate()
+{
+    const qint64 cpuMs = processCpuMs();
+    StateStats &s = m_stats[m_activity];
+    s.wallMs += m_stateClock.restart();
+    s.cpuMs += cpuMs - m_lastCpuMs;
+    m_lastCpuMs = cpuMs;
+}
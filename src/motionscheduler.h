@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QString>
+
+// Classifies device motion from the gyroscope magnitude and picks the sensor
+// and output rates for it. Motion is detected immediately; the device is only
+// considered still after the magnitude stayed below the (lower) still
+// threshold for stillHoldMs, which gives the classification hysteresis.
+class MotionScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Activity {
+        Moving,
+        Still
+    };
+    Q_ENUM(Activity)
+
+    struct StateStats {
+        qint64 wallMs = 0;
+        qint64 cpuMs = 0;
+        quint64 messages = 0;
+        double messagesPerMinute() const { return wallMs > 0 ? messages * 60000.0 / wallMs : 0.0; }
+        double cpuPercent() const { return wallMs > 0 ? 100.0 * cpuMs / wallMs : 0.0; }
+    };
+
+    explicit MotionScheduler(QObject *parent = nullptr);
+
+    void reset();
+
+    // Angular rate magnitude in rad/s
+    void addGyroMagnitude(double magnitude);
+    void recordMessage();
+
+    Activity activity() const;
+    static QString activityName(Activity activity);
+
+    int outputIntervalMs() const;
+    int sensorDataRate() const; // Hz, 0 = backend default
+
+    void setThresholds(double moveThreshold, double stillThreshold, int stillHoldMs);
+
+    // Output interval while moving, e.g. as requested by the server
+    int movingIntervalMs() const;
+    void setMovingIntervalMs(int intervalMs);
+
+    StateStats stats(Activity activity);
+    QString statsReport();
+
+signals:
+    void activityChanged(MotionScheduler::Activity activity);
+
+private:
+    void setActivity(Activity activity);
+    void accumulate();
+
+    Activity m_activity;
+    double m_moveThreshold;  // rad/s, above = moving
+    double m_stillThreshold; // rad/s, below for stillHoldMs = still
+    int m_stillHoldMs;
+    int m_movingIntervalMs;
+
+    QElapsedTimer m_belowSince;
+    bool m_isBelow;
+
+    // Per-state accounting
+    QElapsedTimer m_stateClock;
+    qint64 m_lastCpuMs;
+    StateStats m_stats[2];
+};
@@ -1,21 +1,76 @@
 #include "networkmanager.h"
 #include "igtlclient.h"
+#include "igtlmessages.h"
+#include "igtlserver.h"
+#include "metricsregistry.h"
+#include "sessionrecorder.h"
 #include <QDebug>
+#include <QTimer>
+#include <QtEndian>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Poses per POSEDELTA batch taken from memory while sending the backlog
+const int kBacklogBatchPoses = 256;
+
+}
 
 NetworkManager::NetworkManager(QObject *parent)
     : QObject(parent)
     , m_igtlClient(new IGTLClient(this))
+    , m_standbyClient(new IGTLClient(this))
+    , m_igtlServer(new IGTLServer(this))
+    , m_recorder(new SessionRecorder(this))
+    , m_deviceName("MobileDevice")
     , m_isConnected(false)
+    , m_hasConnected(false)
+    , m_switching(false)
+    , m_primaryPort(0)
+    , m_secondaryPort(0)
+    , m_heartbeatTimer(new QTimer(this))
+    , m_reconnectTimer(new QTimer(this))
+    , m_heartbeatTimeoutMs(0)
+    , m_failoverCount(0)
+    , m_lastFailoverMs(0.0)
+    , m_storeAndForward(false)
+    , m_buffering(false)
+    , m_disconnecting(false)
+    , m_retryTimer(new QTimer(this))
+    , m_backlogTimer(new QTimer(this))
+    , m_burstBytesPerSecond(64 * 1024)
+    , m_burstBudget(0.0)
+    , m_imuBatchMessages(0)
+    , m_imuBatchSamples(0)
+    , m_imuBatchSize(4)
 {
-    // Connect IGTL client signals
-    connect(m_igtlClient, &IGTLClient::connected,
-            this, &NetworkManager::onConnected);
+    // Both clients swap roles on failover, so their signals are routed by role
+    watchClient(m_igtlClient);
+    watchClient(m_standbyClient);
+    
+    m_heartbeatTimer->setInterval(200);
+    connect(m_heartbeatTimer, &QTimer::timeout, this, &NetworkManager::checkHeartbeats);
+    
+    m_reconnectTimer->setInterval(1000);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &NetworkManager::reconnectStandby);
     
-    connect(m_igtlClient, &IGTLClient::disconnected,
-            this, &NetworkManager::onDisconnected);
+    m_retryTimer->setInterval(1000);
+    connect(m_retryTimer, &QTimer::timeout, this, &NetworkManager::retryConnection);
     
-    connect(m_igtlClient, &IGTLClient::connectionError,
-            this, &NetworkManager::onConnectionError);
+    m_backlogTimer->setInterval(20);
+    connect(m_backlogTimer, &QTimer::timeout, this, &NetworkManager::sendBacklog);
+    
+    connect(m_igtlServer, &IGTLServer::subscriberCountChanged,
+            this, &NetworkManager::subscriberCountChanged);
+    
+    connect(m_recorder, &SessionRecorder::error,
+            this, [this](const QString &error) {
+                m_igtlClient->setRecorder(nullptr);
+                emit connectionError("Recording stopped: " + error);
+                emit recordingChanged();
+            });
 }
 
 NetworkManager::~NetworkManager()
@@ -23,20 +78,378 @@ NetworkManager::~NetworkManager()
     disconnectFromServer();
 }
 
+void NetworkManager::watchClient(IGTLClient *client)
+{
+    connect(client, &IGTLClient::connected, this, [this, client]() {
+        if (client == m_igtlClient) {
+            onConnected();
+        } else {
+            qDebug() << "NetworkManager: Standby connected to" << client->host() << ":" << client->port();
+            m_reconnectTimer->stop();
+            emit standbyChanged();
+        }
+    });
+    
+    connect(client, &IGTLClient::disconnected, this, [this, client]() {
+        if (m_switching) {
+            return;
+        }
+        if (client != m_igtlClient) {
+            qDebug() << "NetworkManager: Standby disconnected";
+            emit standbyChanged();
+            m_reconnectTimer->start();
+        } else if (m_standbyClient->isConnected()) {
+            failover(QByteArray(), 0);
+        } else {
+            onDisconnected();
+        }
+    });
+    
+    connect(client, &IGTLClient::connectionError, this, [this, client](const QString &error) {
+        if (client != m_igtlClient) {
+            qDebug() << "NetworkManager: Standby connection failed:" << error;
+            return;
+        }
+        const bool onPrimary = client->host() == m_primaryHost && client->port() == m_primaryPort;
+        if (onPrimary && !m_secondaryHost.isEmpty()) {
+            // Start on the secondary; the primary is retried as the standby.
+            // Only the outcome of the secondary attempt is reported.
+            qDebug() << "NetworkManager: Primary unreachable (" << error << "), trying secondary"
+                     << m_secondaryHost << ":" << m_secondaryPort;
+            std::swap(m_igtlClient, m_standbyClient);
+            m_igtlClient->startConnecting(m_secondaryHost, m_secondaryPort);
+            return;
+        }
+        onConnectionError(error);
+    });
+    
+    connect(client, &IGTLClient::sendFailed, this, [this, client](const QByteArray &unsent, int messageCount) {
+        if (client != m_igtlClient) {
+            return;
+        }
+        if (m_standbyClient->isConnected()) {
+            failover(unsent, messageCount);
+        } else if (m_storeAndForward) {
+            // Buffering starts with the disconnect; the failed batch leads it
+            qWarning() << "NetworkManager: Send failed and no standby, buffering";
+            returnToSpill(unsent);
+            client->disconnectFromServer();
+        } else {
+            qWarning() << "NetworkManager: Send failed and no standby, disconnecting";
+            MetricsRegistry::add(MetricsRegistry::MessagesDropped, quint64(messageCount));
+            client->disconnectFromServer();
+            emit connectionError("Connection lost");
+        }
+    });
+    
+    connect(client, &IGTLClient::backlogReturned, this, [this, client](const QByteArray &batches) {
+        if (client != m_igtlClient) {
+            return;
+        }
+        returnToSpill(batches);
+        if (m_isConnected && !m_backlogTimer->isActive()) {
+            m_burstClock.start();
+            m_backlogTimer->start();
+        }
+    });
+    
+    // Server-side flow control, only from the server we are streaming to
+    connect(client, &IGTLClient::outputRateRequested, this, [this, client](double hz) {
+        if (client == m_igtlClient) {
+            emit outputRateRequested(hz);
+        }
+    });
+}
+
 void NetworkManager::connectToServer(const QString &hostname, int port)
 {
     qDebug() << "NetworkManager: Connecting to" << hostname << ":" << port;
-    if (!m_isConnected) {
-        bool result = m_igtlClient->connectToServer(hostname, port);
-        qDebug() << "NetworkManager: Connection result:" << result;
+    if (m_isConnected) {
+        return;
+    }
+    if (hostname.startsWith("shm:")) {
+        openSharedMemory(hostname.mid(4));
+        return;
+    }
+    m_primaryHost = hostname;
+    m_primaryPort = port;
+    
+    // The result comes as connected() or connectionError(); the secondary
+    // server is tried from there
+    if (!m_igtlClient->isConnecting()) {
+        m_igtlClient->startConnecting(hostname, port);
     }
 }
 
 void NetworkManager::disconnectFromServer()
 {
-    if (m_isConnected) {
+    if (m_buffering) {
+        qDebug() << "NetworkManager: Giving up reconnecting";
+        m_buffering = false;
+        m_retryTimer->stop();
+        m_igtlClient->disconnectFromServer();
+        m_spill.clear();
+        emit backlogChanged();
+    } else if (m_igtlClient->isConnecting()) {
+        qDebug() << "NetworkManager: Connection attempt abandoned";
         m_igtlClient->disconnectFromServer();
+    } else if (m_igtlServer->isListening()) {
+        stopServer();
+    } else if (m_shmRing.isOpen()) {
+        qDebug() << "NetworkManager: Closing shared-memory ring" << QString::fromStdString(m_shmRing.name());
+        m_shmRing.close();
+        m_isConnected = false;
+        emit connectionStateChanged();
+    } else if (m_isConnected) {
+        m_reconnectTimer->stop();
+        m_heartbeatTimer->stop();
+        dropStandby();
+        m_backlogTimer->stop();
+        m_spill.clear();
+        m_disconnecting = true;
+        m_igtlClient->disconnectFromServer();
+        m_disconnecting = false;
+        emit backlogChanged();
+    }
+}
+
+void NetworkManager::setSecondaryServer(const QString &hostname, int port)
+{
+    if (hostname == m_secondaryHost && port == m_secondaryPort) {
+        return;
+    }
+    m_secondaryHost = hostname;
+    m_secondaryPort = port;
+    qDebug() << "NetworkManager: Secondary server" << (hostname.isEmpty() ? QString("disabled") : hostname + ":" + QString::number(port));
+    
+    // Apply to a running connection: the standby follows the new setting.
+    // Heartbeats only run while there is a standby to fail over to.
+    dropStandby();
+    if (hostname.isEmpty()) {
+        m_heartbeatTimer->stop();
+    } else if (m_isConnected && !m_igtlServer->isListening() && !m_shmRing.isOpen()) {
+        m_heartbeatTimer->start();
+        reconnectStandby();
+    }
+}
+
+void NetworkManager::setStoreAndForward(int memoryPoses, qint64 fileLimitBytes, const QString &spillPath, int burstBytesPerSecond)
+{
+    m_storeAndForward = memoryPoses > 0;
+    m_burstBytesPerSecond = qMax(1024, burstBytesPerSecond);
+    if (m_storeAndForward) {
+        m_spill.configure(memoryPoses, fileLimitBytes, spillPath);
+        m_spill.setDeviceName(m_deviceName);
+        qDebug() << "NetworkManager: Store-and-forward for" << memoryPoses << "poses in memory,"
+                 << fileLimitBytes / (1024 * 1024) << "MiB spill file, burst" << m_burstBytesPerSecond / 1024 << "KiB/s";
+    } else {
+        m_spill.clear();
+    }
+}
+
+bool NetworkManager::isBuffering() const
+{
+    return m_buffering;
+}
+
+quint64 NetworkManager::backlogCount() const
+{
+    return m_spill.poseCount();
+}
+
+void NetworkManager::setHeartbeat(int intervalMs, int timeoutMs)
+{
+    const int interval = qMax(20, intervalMs);
+    m_heartbeatTimer->setInterval(interval);
+    m_heartbeatTimeoutMs = qMax(0, timeoutMs);
+    if (m_heartbeatTimeoutMs > 0 && m_heartbeatTimeoutMs < 2 * interval) {
+        // A timeout has to span more than one heartbeat, or every pause
+        // between two of them looks like a dead server
+        qWarning() << "NetworkManager: Heartbeat timeout" << timeoutMs << "ms raised to" << 2 * interval << "ms";
+        m_heartbeatTimeoutMs = 2 * interval;
+    }
+}
+
+bool NetworkManager::isStandbyReady() const
+{
+    return m_standbyClient->isConnected();
+}
+
+int NetworkManager::failoverCount() const
+{
+    return m_failoverCount;
+}
+
+double NetworkManager::lastFailoverMs() const
+{
+    return m_lastFailoverMs;
+}
+
+void NetworkManager::checkHeartbeats()
+{
+    // Poses double as heartbeats on the active connection, so it only gets
+    // one when idle; the standby gets one every tick. A server that answers
+    // heartbeats or acknowledges messages times out when it goes silent.
+    // Any server also times out, right from the connect, when its host
+    // stops acknowledging what we send.
+    const auto isDead = [this](IGTLClient *client, bool idleOnly) {
+        if (m_heartbeatTimeoutMs > 0
+            && (client->msAwaitingReply() > m_heartbeatTimeoutMs
+                || client->msAwaitingAck() > m_heartbeatTimeoutMs)) {
+            qWarning() << "NetworkManager: Heartbeat timeout on" << client->host() << ":" << client->port();
+            return true;
+        }
+        if (!idleOnly || client->msSinceLastSend() >= m_heartbeatTimer->interval()) {
+            return !client->sendHeartbeat();
+        }
+        return false;
+    };
+    
+    if (m_igtlClient->isConnected() && isDead(m_igtlClient, true)) {
+        if (m_standbyClient->isConnected()) {
+            failover(QByteArray(), 0);
+        } else {
+            // With store-and-forward the disconnect starts buffering, which
+            // is the status to show
+            m_igtlClient->disconnectFromServer();
+            if (!m_storeAndForward) {
+                emit connectionError("Connection lost");
+            }
+        }
+    }
+    if (m_standbyClient->isConnected() && isDead(m_standbyClient, false)) {
+        dropStandby();
+        m_reconnectTimer->start();
+    }
+}
+
+void NetworkManager::reconnectStandby()
+{
+    if (m_secondaryHost.isEmpty() || !m_isConnected || m_igtlServer->isListening() || m_standbyClient->isConnected()) {
+        m_reconnectTimer->stop();
+        return;
+    }
+    
+    if (m_standbyClient->isConnecting()) {
+        return;
+    }
+    
+    // The standby is whichever of the two servers we are not streaming to.
+    // The attempt runs in the background; the timer keeps retrying until
+    // the standby is connected.
+    const bool onPrimary = m_igtlClient->host() == m_primaryHost && m_igtlClient->port() == m_primaryPort;
+    const QString host = onPrimary ? m_secondaryHost : m_primaryHost;
+    const int port = onPrimary ? m_secondaryPort : m_primaryPort;
+    m_standbyClient->startConnecting(host, port);
+    if (!m_standbyClient->isConnected()) {
+        m_reconnectTimer->start();
+    }
+}
+
+void NetworkManager::failover(const QByteArray &unsent, int messageCount)
+{
+    m_failoverClock.start();
+    IGTLClient *failed = m_igtlClient;
+    qWarning() << "NetworkManager: Lost" << failed->host() << ":" << failed->port()
+               << "- switching to standby" << m_standbyClient->host() << ":" << m_standbyClient->port();
+    
+    m_switching = true;
+    failed->setRecorder(nullptr);
+    failed->disconnectFromServer();
+    m_igtlClient = m_standbyClient;
+    m_standbyClient = failed;
+    m_switching = false;
+    
+    if (m_recorder->isOpen()) {
+        m_igtlClient->setRecorder(m_recorder);
+    }
+    ++m_failoverCount;
+    MetricsRegistry::add(MetricsRegistry::Failovers);
+    
+    // The batch that failed goes out on the new connection right away;
+    // otherwise the next pose completes the switch
+    if (!unsent.isEmpty()) {
+        m_igtlClient->sendPacked(unsent, messageCount);
+        finishFailoverTiming();
+    }
+    
+    emit standbyChanged();
+    emit connectionStateChanged();
+    m_reconnectTimer->start();
+}
+
+void NetworkManager::dropStandby()
+{
+    if (m_standbyClient->isConnecting()) {
+        m_standbyClient->disconnectFromServer();
+    }
+    if (m_standbyClient->isConnected()) {
+        m_switching = true;
+        m_standbyClient->disconnectFromServer();
+        m_switching = false;
+        emit standbyChanged();
+    }
+}
+
+void NetworkManager::finishFailoverTiming()
+{
+    if (!m_failoverClock.isValid()) {
+        return;
+    }
+    m_lastFailoverMs = m_failoverClock.nsecsElapsed() / 1e6;
+    m_failoverClock.invalidate();
+    MetricsRegistry::set(MetricsRegistry::FailoverTimeUs, qint64(m_lastFailoverMs * 1000.0));
+    qDebug() << "NetworkManager: Failover to" << m_igtlClient->host() << ":" << m_igtlClient->port()
+             << "took" << m_lastFailoverMs << "ms";
+    emit failoverOccurred(m_igtlClient->host() + ":" + QString::number(m_igtlClient->port()));
+}
+
+void NetworkManager::openSharedMemory(const QString &name)
+{
+    const QString ringName = name.isEmpty() ? QString(ShmRing::kDefaultName) : name;
+    std::string error;
+    if (!m_shmRing.open(ringName.toStdString(), ShmRing::kDefaultCapacity, &error)) {
+        qWarning() << "NetworkManager: Cannot open shared-memory ring" << ringName << QString::fromStdString(error);
+        emit connectionError("Shared memory: " + QString::fromStdString(error));
+        return;
+    }
+    qDebug() << "NetworkManager: Publishing to shared-memory ring" << QString::fromStdString(m_shmRing.name());
+    MetricsRegistry::add(MetricsRegistry::Connects);
+    m_isConnected = true;
+    emit connectionStateChanged();
+}
+
+bool NetworkManager::startServer(int port)
+{
+    if (m_isConnected) {
+        return m_igtlServer->isListening();
     }
+    if (!m_igtlServer->listen(port)) {
+        emit connectionError("Cannot listen on port " + QString::number(port) + ": " + m_igtlServer->errorString());
+        return false;
+    }
+    m_isConnected = true;
+    emit connectionStateChanged();
+    return true;
+}
+
+void NetworkManager::stopServer()
+{
+    if (m_igtlServer->isListening()) {
+        m_igtlServer->close();
+        m_isConnected = false;
+        emit connectionStateChanged();
+    }
+}
+
+bool NetworkManager::isServerRunning() const
+{
+    return m_igtlServer->isListening();
+}
+
+int NetworkManager::subscriberCount() const
+{
+    return m_igtlServer->subscriberCount();
 }
 
 bool NetworkManager::isConnected() const
@@ -44,28 +457,283 @@ bool NetworkManager::isConnected() const
     return m_isConnected;
 }
 
-void NetworkManager::sendRotationData(double w, double x, double y, double z, double zOffset)
+QString NetworkManager::deviceName() const
+{
+    return QString::fromUtf8(m_deviceName);
+}
+
+void NetworkManager::setDeviceName(const QString &name)
+{
+    m_deviceName = name.toUtf8();
+    m_igtlClient->setDeviceName(m_deviceName);
+    m_standbyClient->setDeviceName(m_deviceName);
+    m_spill.setDeviceName(m_deviceName);
+}
+
+void NetworkManager::sendPose(const Pose &pose)
+{
+    if (!m_isConnected) {
+        if (m_buffering) {
+            const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+            m_spill.append(quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count()), pose);
+        } else {
+            MetricsRegistry::add(MetricsRegistry::MessagesDropped);
+        }
+        return;
+    }
+    
+    // Pack once, whoever receives it
+    const QByteArray message = IGTLClient::packPose(pose, m_deviceName);
+    if (m_igtlServer->isListening()) {
+        m_igtlServer->broadcast(message);
+        if (m_recorder->isOpen()) {
+            m_recorder->append(message.constData(), int(message.size()));
+        }
+    } else if (m_shmRing.isOpen()) {
+        if (m_shmRing.publish(message.constData(), size_t(message.size()))) {
+            MetricsRegistry::add(MetricsRegistry::MessagesSent);
+            MetricsRegistry::add(MetricsRegistry::BytesSent, quint64(message.size()));
+        } else {
+            MetricsRegistry::add(MetricsRegistry::SendErrors);
+        }
+        if (m_recorder->isOpen()) {
+            m_recorder->append(message.constData(), int(message.size()));
+        }
+    } else {
+        m_igtlClient->sendPacked(message);
+        if (m_failoverClock.isValid() && m_igtlClient->isConnected()) {
+            finishFailoverTiming();
+        }
+    }
+}
+
+void NetworkManager::flush()
 {
+    flushImuSamples();
     if (m_isConnected) {
-        m_igtlClient->sendRotationData(w, x, y, z, zOffset);
+        m_igtlClient->flush();
     }
 }
 
+void NetworkManager::setImuBatch(int batchSamples)
+{
+    m_imuBatchSize = qBound(1, batchSamples, 64);
+    if (m_imuBatchSamples >= m_imuBatchSize) {
+        flushImuSamples();
+    }
+}
+
+bool NetworkManager::canSendImu() const
+{
+    // Server mode decimates per subscriber and the shared-memory ring carries
+    // one pose per record, neither suits a raw sample stream
+    return m_isConnected && !m_igtlServer->isListening() && !m_shmRing.isOpen();
+}
+
+void NetworkManager::sendImuSample(const FusionInput &input, quint64 timeNs)
+{
+    if (!canSendImu()) {
+        return;
+    }
+    m_imuBatchMessages += IGTLClient::packImuSample(m_imuBatch, input, timeNs, m_deviceName);
+    if (++m_imuBatchSamples >= m_imuBatchSize) {
+        flushImuSamples();
+    }
+}
+
+void NetworkManager::flushImuSamples()
+{
+    if (m_imuBatchMessages > 0 && m_isConnected) {
+        m_igtlClient->sendPacked(m_imuBatch, m_imuBatchMessages);
+    }
+    m_imuBatch.clear();
+    m_imuBatchMessages = 0;
+    m_imuBatchSamples = 0;
+}
+
+bool NetworkManager::startRecording(const QString &path)
+{
+    if (!m_recorder->open(path)) {
+        return false;
+    }
+    m_igtlClient->setRecorder(m_recorder);
+    emit recordingChanged();
+    return true;
+}
+
+void NetworkManager::stopRecording()
+{
+    if (m_recorder->isOpen()) {
+        m_igtlClient->setRecorder(nullptr);
+        m_recorder->close();
+        emit recordingChanged();
+    }
+}
+
+bool NetworkManager::isRecording() const
+{
+    return m_recorder->isOpen();
+}
+
 void NetworkManager::onConnected()
 {
+    MetricsRegistry::add(MetricsRegistry::Connects);
+    if (m_hasConnected) {
+        MetricsRegistry::add(MetricsRegistry::Reconnects);
+    }
+    m_hasConnected = true;
     m_isConnected = true;
+    if (!m_secondaryHost.isEmpty()) {
+        m_heartbeatTimer->start();
+    }
+    if (m_buffering) {
+        qDebug() << "NetworkManager: Reconnected with" << m_spill.poseCount() << "poses buffered";
+        m_buffering = false;
+        m_retryTimer->stop();
+    }
+    if (!m_spill.isEmpty()) {
+        m_burstBudget = 0.0;
+        m_burstClock.start();
+        m_backlogClock.start();
+        m_backlogTimer->start();
+    }
     emit connectionStateChanged();
+    emit backlogChanged();
+    
+    if (!m_secondaryHost.isEmpty()) {
+        reconnectStandby();
+    }
 }
 
 void NetworkManager::onDisconnected()
 {
     m_isConnected = false;
+    flushImuSamples();
+    m_heartbeatTimer->stop();
+    m_reconnectTimer->stop();
+    m_backlogTimer->stop();
+    startBuffering();
     emit connectionStateChanged();
 }
 
 void NetworkManager::onConnectionError(const QString &error)
 {
+    if (m_buffering) {
+        // A failed retry; the stream is still being buffered
+        qDebug() << "NetworkManager: Reconnect failed:" << error;
+        return;
+    }
     m_isConnected = false;
+    m_heartbeatTimer->stop();
     emit connectionError(error);
     emit connectionStateChanged();
-}
\ No newline at end of file
+}
+
+void NetworkManager::startBuffering()
+{
+    if (!m_storeAndForward || m_disconnecting || m_buffering) {
+        return;
+    }
+    qWarning() << "NetworkManager: Connection lost, buffering poses until it is back";
+    m_buffering = true;
+    m_retryTimer->start();
+    emit backlogChanged();
+}
+
+void NetworkManager::returnToSpill(const QByteArray &unsent)
+{
+    // POSEDELTA batches came from the spill and go back to its front;
+    // TRANSFORM messages are live poses, newer than anything in it. Other
+    // messages (IMU samples) are not kept.
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(unsent.constData());
+    const size_t size = size_t(unsent.size());
+    QList<QByteArray> batches;
+    quint64 dropped = 0;
+    size_t offset = 0;
+    while (size - offset >= IgtlMessages::kHeaderSize) {
+        const uint8_t *message = data + offset;
+        const quint64 bodySize = qFromBigEndian<quint64>(message + 42);
+        if (bodySize > size - offset - IgtlMessages::kHeaderSize) {
+            break;
+        }
+        const size_t messageSize = IgtlMessages::kHeaderSize + size_t(bodySize);
+        const QByteArray type(reinterpret_cast<const char *>(message) + 2,
+                              qsizetype(qstrnlen(reinterpret_cast<const char *>(message) + 2, 12)));
+        uint64_t timestamp = 0;
+        double matrix[3][4];
+        if (type == PoseBacklog::kMessageType) {
+            batches.append(unsent.mid(qsizetype(offset), qsizetype(messageSize)));
+        } else if (IgtlMessages::unpackTransform(message, messageSize, timestamp, matrix)) {
+            const double rotation[3][3] = {{matrix[0][0], matrix[0][1], matrix[0][2]},
+                                           {matrix[1][0], matrix[1][1], matrix[1][2]},
+                                           {matrix[2][0], matrix[2][1], matrix[2][2]}};
+            Pose pose;
+            TransformChain::quaternionFromMatrix(rotation, pose.q);
+            // Unpacked to float precision
+            const double norm = std::sqrt(pose.q[0] * pose.q[0] + pose.q[1] * pose.q[1]
+                                          + pose.q[2] * pose.q[2] + pose.q[3] * pose.q[3]);
+            for (double &component : pose.q) {
+                component /= norm;
+            }
+            for (int i = 0; i < 3; ++i) {
+                pose.t[i] = matrix[i][3];
+            }
+            m_spill.append(IgtlMessages::timestampToNs(timestamp), pose);
+        } else {
+            ++dropped;
+        }
+        offset += messageSize;
+    }
+    for (auto it = batches.crbegin(); it != batches.crend(); ++it) {
+        m_spill.putBack(*it);
+    }
+    if (dropped > 0) {
+        MetricsRegistry::add(MetricsRegistry::MessagesDropped, dropped);
+    }
+    emit backlogChanged();
+}
+
+void NetworkManager::retryConnection()
+{
+    if (!m_buffering) {
+        m_retryTimer->stop();
+        return;
+    }
+    // Same path as the first connection, including the secondary server
+    connectToServer(m_primaryHost, m_primaryPort);
+    if (m_buffering) {
+        emit backlogChanged();
+    }
+}
+
+void NetworkManager::sendBacklog()
+{
+    if (!m_isConnected || m_spill.isEmpty()) {
+        m_backlogTimer->stop();
+        return;
+    }
+    
+    // Token bucket holding at most 100 ms worth of bytes, so the backlog
+    // goes out in small bursts between live poses
+    const double elapsed = m_burstClock.nsecsElapsed() / 1e9;
+    m_burstClock.start();
+    m_burstBudget = qMin(m_burstBudget + elapsed * m_burstBytesPerSecond, 0.1 * m_burstBytesPerSecond);
+    bool sent = false;
+    while (m_burstBudget > 0.0 && m_igtlClient->hasSpareWindow()) {
+        const QByteArray batch = m_spill.takeBatch(kBacklogBatchPoses);
+        if (batch.isEmpty()) {
+            break;
+        }
+        m_igtlClient->sendPacked(batch);
+        m_burstBudget -= double(batch.size());
+        sent = true;
+    }
+    
+    if (m_spill.isEmpty()) {
+        m_backlogTimer->stop();
+        qDebug() << "NetworkManager: Backlog sent in" << m_backlogClock.elapsed() << "ms";
+    }
+    if (sent) {
+        emit backlogChanged();
+    }
+}
@@ -1,9 +1,17 @@
 #pragma once
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QString>
+#include "shmring.h"
+#include "spillbuffer.h"
 
 class IGTLClient;
+class IGTLServer;
+class SessionRecorder;
+class QTimer;
+struct FusionInput;
+struct Pose;
 
 class NetworkManager : public QObject
 {
@@ -13,22 +21,137 @@ public:
     explicit NetworkManager(QObject *parent = nullptr);
     ~NetworkManager();
 
+    // A hostname of "shm:<name>" publishes into a shared-memory ring for
+    // readers on the same host (see ShmRingWriter) instead of connecting;
+    // "shm:" alone uses the default ring name
     void connectToServer(const QString &hostname, int port);
     void disconnectFromServer();
     bool isConnected() const;
     
-    void sendRotationData(double w, double x, double y, double z, double zOffset = 0.0);
+    // Hot standby: a second server that is kept connected and heartbeated.
+    // A send error or heartbeat timeout on the active connection moves the
+    // stream to the standby right away (the failed batch is resent there);
+    // the old server is then reconnected in the background as the new
+    // standby. An empty host disables the standby.
+    void setSecondaryServer(const QString &hostname, int port);
+    // Heartbeats run only while a standby is configured. timeoutMs applies
+    // to servers that answer heartbeats or set an acknowledgment window and,
+    // where the platform reports it, to data that goes unacknowledged at the
+    // TCP level; it is raised to at least two intervals. 0 relies on send
+    // errors alone.
+    void setHeartbeat(int intervalMs, int timeoutMs);
+    bool isStandbyReady() const;
+    int failoverCount() const;
+    // Detection of the failure until the stream went out on the standby
+    double lastFailoverMs() const;
+    
+    // Server mode: receivers connect to us (see IGTLServer). While listening
+    // the manager counts as connected.
+    bool startServer(int port);
+    void stopServer();
+    bool isServerRunning() const;
+    int subscriberCount() const;
+    
+    // Device name in the TRANSFORM header, shared by all transports
+    QString deviceName() const;
+    void setDeviceName(const QString &name);
+    
+    // Sends a pose that already has all frame transforms applied
+    void sendPose(const Pose &pose);
+    // Sends whatever waits for a batch to fill up (IMU samples and poses)
+    // right away, e.g. when the stream stops
+    void flush();
+    
+    // Raw sensor streaming for fusion on the server: each set of readings
+    // becomes SENSOR messages with its own timestamp (see
+    // IGTLClient::packImuSample), and batchSamples sets go out in one write.
+    // Client connections only; samples are dropped while disconnected.
+    void setImuBatch(int batchSamples);
+    bool canSendImu() const;
+    void sendImuSample(const FusionInput &input, quint64 timeNs);
+    void flushImuSamples();
+    
+    // Store-and-forward: when a client connection is lost, the manager keeps
+    // retrying it and stores the poses sent meanwhile in a SpillBuffer
+    // instead of dropping them. Once connected again they go out as POSEDELTA
+    // batches (see posebacklog.h), oldest first, at up to burstBytesPerSecond
+    // and only while flow control has room to spare, so live poses are not
+    // held back. memoryPoses = 0 turns it off; an explicit disconnect
+    // discards the backlog.
+    void setStoreAndForward(int memoryPoses, qint64 fileLimitBytes, const QString &spillPath, int burstBytesPerSecond);
+    bool isBuffering() const; // connection lost, retrying and storing poses
+    quint64 backlogCount() const;
+    
+    // Tee the outgoing stream into a session file (see SessionRecorder)
+    bool startRecording(const QString &path);
+    void stopRecording();
+    bool isRecording() const;
 
 signals:
     void connectionStateChanged();
     void connectionError(const QString &error);
+    void outputRateRequested(double hz);
+    void recordingChanged();
+    void subscriberCountChanged();
+    void standbyChanged();
+    void failoverOccurred(const QString &server);
+    // Buffering started or ended, or the backlog changed (at most once per
+    // retry or burst tick)
+    void backlogChanged();
 
 private slots:
     void onConnected();
     void onDisconnected();
     void onConnectionError(const QString &error);
+    void checkHeartbeats();
+    void reconnectStandby();
+    void retryConnection();
+    void sendBacklog();
 
 private:
-    IGTLClient *m_igtlClient;
+    void watchClient(IGTLClient *client);
+    void failover(const QByteArray &unsent, int messageCount);
+    void dropStandby();
+    void finishFailoverTiming();
+    void openSharedMemory(const QString &name);
+    void startBuffering();
+    // Puts the poses of a failed or withdrawn write back into the spill
+    void returnToSpill(const QByteArray &unsent);
+
+    IGTLClient *m_igtlClient; // active connection
+    IGTLClient *m_standbyClient;
+    IGTLServer *m_igtlServer;
+    SessionRecorder *m_recorder;
+    ShmRingWriter m_shmRing;
+    QByteArray m_deviceName;
     bool m_isConnected;
+    bool m_hasConnected;
+    bool m_switching; // suppresses failover handling while roles change
+    
+    QString m_primaryHost;
+    int m_primaryPort;
+    QString m_secondaryHost;
+    int m_secondaryPort;
+    QTimer *m_heartbeatTimer;
+    QTimer *m_reconnectTimer;
+    int m_heartbeatTimeoutMs;
+    int m_failoverCount;
+    double m_lastFailoverMs;
+    QElapsedTimer m_failoverClock; // running while a failover is in progress
+    
+    SpillBuffer m_spill;
+    bool m_storeAndForward;
+    bool m_buffering;
+    bool m_disconnecting; // an explicit disconnect, nothing to buffer for
+    QTimer *m_retryTimer;
+    QTimer *m_backlogTimer;
+    int m_burstBytesPerSecond;
+    double m_burstBudget; // bytes, token bucket
+    QElapsedTimer m_burstClock;
+    QElapsedTimer m_backlogClock; // since the backlog started going out
+    
+    QByteArray m_imuBatch; // packed SENSOR messages waiting to go out
+    int m_imuBatchMessages;
+    int m_imuBatchSamples;
+    int m_imuBatchSize;
 };
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "noiseestimator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// A new series starts after a gap of this many mean sample intervals
+const double kMaxGapIntervals = 3.0;
+// Cluster differences a level needs before it is used for an estimate
+const unsigned long long kMinDifferences = 8;
+const unsigned long long kMinWhiteNoiseDifferences = 32;
+// Rest time before tune() trusts the estimate
+const double kMinStillSeconds = 30.0;
+// Readings of a series before its mean is good enough to reject motion
+const unsigned long long kMinSeriesSamples = 16;
+// Allan deviation minimum of flicker noise is 0.664 times the bias instability
+const double kBiasInstabilityFactor = 0.664;
+const double kMinBeta = 0.01;
+const double kMaxBeta = 0.5;
+
+}
+
+NoiseEstimator::NoiseEstimator()
+{
+    reset();
+}
+
+void NoiseEstimator::reset()
+{
+    for (Level &level : m_levels) {
+        level = Level();
+    }
+    m_lastT = 0.0;
+    m_hasLastT = false;
+    m_intervalSum = 0.0;
+    m_intervalCount = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        m_gyroSum[axis] = 0.0;
+    }
+    m_gyroCount = 0;
+    clearSeries();
+}
+
+void NoiseEstimator::clearSeries()
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        m_seriesSum[axis] = 0.0;
+    }
+    m_seriesCount = 0;
+}
+
+bool NoiseEstimator::addSample(const double gyro[3], double t)
+{
+    if (m_seriesCount >= kMinSeriesSamples) {
+        double squared = 0.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const double deviation = gyro[axis] - m_seriesSum[axis] / double(m_seriesCount);
+            squared += deviation * deviation;
+        }
+        if (squared > kMaxDeviation * kMaxDeviation) {
+            breakSeries();
+            return false;
+        }
+    }
+
+    if (m_hasLastT) {
+        const double dt = t - m_lastT;
+        const double meanInterval = m_intervalCount > 0 ? m_intervalSum / double(m_intervalCount) : 0.0;
+        if (dt <= 0.0 || (m_intervalCount >= kMinDifferences && dt > kMaxGapIntervals * meanInterval)) {
+            breakSeries();
+        } else {
+            m_intervalSum += dt;
+            ++m_intervalCount;
+        }
+    }
+    m_lastT = t;
+    m_hasLastT = true;
+    for (int axis = 0; axis < 3; ++axis) {
+        m_seriesSum[axis] += gyro[axis];
+        m_gyroSum[axis] += gyro[axis];
+    }
+    ++m_seriesCount;
+    ++m_gyroCount;
+    addCluster(0, gyro);
+    return true;
+}
+
+void NoiseEstimator::breakSeries()
+{
+    for (Level &level : m_levels) {
+        level.hasPending = false;
+        level.hasPrevious = false;
+    }
+    m_hasLastT = false;
+    clearSeries();
+}
+
+// A complete cluster mean of `level`: one more Allan difference for this
+// level, and half of a cluster of the next
+void NoiseEstimator::addCluster(int level, const double mean[3])
+{
+    Level &current = m_levels[level];
+    if (current.hasPrevious) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const double difference = mean[axis] - current.previous[axis];
+            current.sumSquares[axis] += difference * difference;
+        }
+        ++current.count;
+    }
+    std::copy(mean, mean + 3, current.previous);
+    current.hasPrevious = true;
+
+    if (level + 1 >= kLevelCount) {
+        return;
+    }
+    if (!current.hasPending) {
+        std::copy(mean, mean + 3, current.pending);
+        current.hasPending = true;
+        return;
+    }
+    double merged[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        merged[axis] = 0.5 * (current.pending[axis] + mean[axis]);
+    }
+    current.hasPending = false;
+    addCluster(level + 1, merged);
+}
+
+double NoiseEstimator::stillSeconds() const
+{
+    return m_intervalSum;
+}
+
+double NoiseEstimator::clusterTime(int level) const
+{
+    const double interval = m_intervalCount > 0 ? m_intervalSum / double(m_intervalCount) : 0.0;
+    return std::ldexp(interval, level);
+}
+
+double NoiseEstimator::allanDeviation(int level) const
+{
+    const Level &current = m_levels[level];
+    if (current.count == 0) {
+        return 0.0;
+    }
+    // AVAR(tau) = 1/2 <(mean[k+1] - mean[k])^2>
+    const double variance = (current.sumSquares[0] + current.sumSquares[1] + current.sumSquares[2])
+                            / (3.0 * 2.0 * double(current.count));
+    return std::sqrt(variance);
+}
+
+unsigned long long NoiseEstimator::clusterCount(int level) const
+{
+    return m_levels[level].count;
+}
+
+NoiseEstimator::Estimate NoiseEstimator::estimate() const
+{
+    Estimate result;
+    result.stillSeconds = stillSeconds();
+    result.sampleInterval = clusterTime(0);
+    if (m_gyroCount > 0) {
+        for (int axis = 0; axis < 3; ++axis) {
+            result.bias[axis] = m_gyroSum[axis] / double(m_gyroCount);
+        }
+    }
+    if (result.sampleInterval <= 0.0) {
+        return result;
+    }
+
+    // Angle random walk: sigma(tau) * sqrt(tau) on the white-noise slope,
+    // read as close to tau = 1 s as the data allows
+    int whiteNoiseLevel = -1;
+    for (int level = 0; level < kLevelCount; ++level) {
+        if (m_levels[level].count < kMinWhiteNoiseDifferences) {
+            break;
+        }
+        if (whiteNoiseLevel < 0 || std::abs(std::log2(clusterTime(level))) < std::abs(std::log2(clusterTime(whiteNoiseLevel)))) {
+            whiteNoiseLevel = level;
+        }
+    }
+    // Bias instability: the flat bottom of the curve. If the curve is still
+    // falling at the longest usable tau this overestimates it, which errs on
+    // the side of a stronger correction.
+    double minimum = 0.0;
+    for (int level = 0; level < kLevelCount && m_levels[level].count >= kMinDifferences; ++level) {
+        const double deviation = allanDeviation(level);
+        if (minimum == 0.0 || deviation < minimum) {
+            minimum = deviation;
+        }
+    }
+    if (whiteNoiseLevel < 0) {
+        return result;
+    }
+
+    result.angleRandomWalk = allanDeviation(whiteNoiseLevel) * std::sqrt(clusterTime(whiteNoiseLevel));
+    result.biasInstability = minimum / kBiasInstabilityFactor;
+    result.valid = result.stillSeconds >= kMinStillSeconds;
+    return result;
+}
+
+double NoiseEstimator::predictedDriftDegPerMin(const Estimate &estimate)
+{
+    // Bias and bias instability accumulate linearly, the random walk with sqrt(t)
+    const double minute = 60.0;
+    const double bias = std::sqrt(estimate.bias[0] * estimate.bias[0] + estimate.bias[1] * estimate.bias[1]
+                                  + estimate.bias[2] * estimate.bias[2]);
+    return ((bias + estimate.biasInstability) * minute + estimate.angleRandomWalk * std::sqrt(minute)) * 180.0 / M_PI;
+}
+
+bool NoiseEstimator::tune(const Estimate &estimate, double driftTargetDegPerMin, double fusionRateHz,
+                          FusionCore::Parameters &parameters)
+{
+    if (!estimate.valid || fusionRateHz <= 0.0) {
+        return false;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        parameters.gyroBias[axis] = estimate.bias[axis];
+    }
+    if (predictedDriftDegPerMin(estimate) <= driftTargetDegPerMin) {
+        parameters.algorithm = FusionCore::GyroIntegration;
+        return true;
+    }
+
+    // Madgwick: beta = sqrt(3/4) * mean zero gyroscope measurement error.
+    // Per fusion step that is the white noise at the fusion rate plus the
+    // slowly wandering bias.
+    const double whiteNoise = estimate.angleRandomWalk * std::sqrt(fusionRateHz);
+    const double gyroError = std::sqrt(whiteNoise * whiteNoise + estimate.biasInstability * estimate.biasInstability);
+    parameters.algorithm = FusionCore::Madgwick;
+    parameters.beta = std::clamp(std::sqrt(0.75) * gyroError, kMinBeta, kMaxBeta);
+    return true;
+}
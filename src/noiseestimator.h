@@ -0,0 +1,93 @@
+#pragma once
+
+// Streaming gyroscope noise characterization. Readings taken while the device
+// is at rest feed an Allan variance at octave-spaced cluster times
+// (tau = 2^k sample intervals). Each level only keeps its running cluster and
+// the accumulated squared differences of consecutive cluster means, so memory
+// stays constant however long the device rests. From the Allan deviation
+// curve come the angle random walk (white noise) and the bias instability
+// (its minimum), which in turn select the fusion algorithm and Madgwick gain
+// (see tune()). The Allan variance cannot see a constant bias, so the mean
+// reading at rest is kept as well. Plain C++ (no Qt), shared with igtlbatch.
+
+#include "fusioncore.h"
+
+class NoiseEstimator
+{
+public:
+    static const int kLevelCount = 16;
+
+    struct Estimate {
+        double angleRandomWalk = 0.0;  // rad/sqrt(s)
+        double biasInstability = 0.0;  // rad/s
+        double bias[3] = {0.0, 0.0, 0.0}; // rad/s, mean reading at rest
+        double sampleInterval = 0.0;   // s
+        double stillSeconds = 0.0;     // s of readings used
+        bool valid = false;            // enough data for tune()
+    };
+
+    NoiseEstimator();
+
+    void reset();
+
+    // Feeds one gyroscope reading (rad/s) taken at t seconds. Readings must
+    // come from a device at rest; gaps longer than a few sample intervals
+    // start a new series. Readings further than kMaxDeviation from the mean
+    // of their series are slow motion, not noise: they are left out and
+    // start a new series. Returns false for those.
+    bool addSample(const double gyro[3], double t);
+
+    static constexpr double kMaxDeviation = 0.01; // rad/s, ~0.6 deg/s
+
+    // Ends the current series, e.g. when the device starts moving. What has
+    // been accumulated so far is kept.
+    void breakSeries();
+
+    double stillSeconds() const;
+
+    // Allan deviation per level, averaged over the axes (rad/s); 0 while the
+    // level has no cluster differences yet
+    double clusterTime(int level) const;
+    double allanDeviation(int level) const;
+    unsigned long long clusterCount(int level) const;
+
+    Estimate estimate() const;
+
+    // Lightest configuration that meets the drift target: plain gyro
+    // integration if its predicted drift stays within driftTargetDegPerMin,
+    // otherwise Madgwick with beta = sqrt(3/4) * the gyro error at the fusion
+    // rate (fusionRateHz). Either way the mean bias is subtracted
+    // (Parameters::gyroBias). Leaves parameters alone for an invalid estimate.
+    static bool tune(const Estimate &estimate, double driftTargetDegPerMin, double fusionRateHz,
+                     FusionCore::Parameters &parameters);
+
+    // Predicted drift of gyro integration alone over one minute, in degrees.
+    // The mean bias counts in full: it is subtracted, but it changes with
+    // temperature after it was measured, and plain integration never
+    // corrects what is left.
+    static double predictedDriftDegPerMin(const Estimate &estimate);
+
+private:
+    struct Level {
+        double pending[3];         // first half of the next cluster of this level
+        double previous[3];        // last complete cluster mean
+        double sumSquares[3];      // sum of squared differences of consecutive means
+        unsigned long long count;  // number of differences
+        bool hasPending;
+        bool hasPrevious;
+    };
+
+    void addCluster(int level, const double mean[3]);
+    void clearSeries();
+
+    Level m_levels[kLevelCount];
+    double m_lastT;
+    bool m_hasLastT;
+    double m_intervalSum;
+    unsigned long long m_intervalCount;
+    // Sums of the readings in the current series and of all accepted ones
+    double m_seriesSum[3];
+    unsigned long long m_seriesCount;
+    double m_gyroSum[3];
+    unsigned long long m_gyroCount;
+};
@@ -1,54 +1,82 @@
 #include "orientationsensor.h"
+#include "fusioncore.h"
 #include <QRotationSensor>
 #include <QRotationReading>
 #include <QTimer>
 #include <QDebug>
 #include <cmath>
 
+namespace {
+
+const double kDefaultOutputRate = 30.0; // Hz, as the moving rate of RotationSensor
+
+}
+
 OrientationSensor::OrientationSensor(QObject *parent)
-    : QObject(parent)
+    : PoseSource(parent)
     , m_rotationSensor(new QRotationSensor(this))
     , m_timer(new QTimer(this))
     , m_isActive(false)
+    , m_backendConnected(false)
+    , m_outputRate(kDefaultOutputRate)
+    , m_initialW(1.0), m_initialX(0.0), m_initialY(0.0), m_initialZ(0.0)
+    , m_hasInitialOrientation(false)
+{
+    m_timer->setInterval(qRound(1000.0 / m_outputRate));
+    connect(m_timer, &QTimer::timeout, this, &OrientationSensor::simulateReading);
+    connect(m_rotationSensor, &QRotationSensor::readingChanged, this, &OrientationSensor::onReadingChanged);
+    m_clock.start();
+}
+
+OrientationSensor::~OrientationSensor()
+{
+    stop();
+}
+
+QString OrientationSensor::name() const
+{
+    return QStringLiteral("hardware");
+}
+
+void OrientationSensor::connectBackend()
 {
-    // Configure timer for regular readings (30 FPS)
-    m_timer->setInterval(33);
-    connect(m_timer, &QTimer::timeout, this, &OrientationSensor::readingSensor);
-    
-    // Check if rotation sensor is available
+    if (m_backendConnected) {
+        return;
+    }
+    m_backendConnected = true;
     if (!m_rotationSensor->connectToBackend()) {
         qWarning("Rotation sensor is not available on this device");
     }
 }
 
-OrientationSensor::~OrientationSensor()
+bool OrientationSensor::isAvailable()
 {
-    stop();
+    connectBackend();
+    return m_rotationSensor->isConnectedToBackend();
 }
 
 void OrientationSensor::start()
 {
     qDebug() << "OrientationSensor::start() called";
-    
-    if (!m_rotationSensor->isConnectedToBackend()) {
-        qDebug() << "OrientationSensor: Not connected to backend, using simulated data";
-        // Fallback to simulated data for desktop testing
-        if (!m_isActive) {
-            m_timer->start();
-            m_isActive = true;
-            qDebug() << "OrientationSensor: Started with simulated data";
-        }
+
+    if (m_isActive) {
+        qDebug() << "OrientationSensor: Already active";
         return;
     }
-    
-    if (!m_isActive) {
-        qDebug() << "OrientationSensor: Starting real sensor and timer";
-        m_rotationSensor->start();
+    resetStats();
+
+    if (!isAvailable()) {
+        qDebug() << "OrientationSensor: Not connected to backend, using simulated data";
+        // Fallback to simulated data for desktop testing
         m_timer->start();
         m_isActive = true;
-    } else {
-        qDebug() << "OrientationSensor: Already active";
+        return;
     }
+
+    qDebug() << "OrientationSensor: Starting real sensor at" << m_outputRate << "Hz";
+    m_rotationSensor->setDataRate(qRound(m_outputRate));
+    m_rotationSensor->start();
+    m_isActive = true;
 }
 
 void OrientationSensor::stop()
@@ -57,6 +85,7 @@ void OrientationSensor::stop()
         m_timer->stop();
         m_rotationSensor->stop();
         m_isActive = false;
+        qDebug().noquote() << "OrientationSensor: Poses -" << statsReport();
     }
 }
 
@@ -65,35 +94,80 @@ bool OrientationSensor::isActive() const
     return m_isActive;
 }
 
-void OrientationSensor::readingSensor()
+void OrientationSensor::resetOrientation()
 {
-    if (!m_rotationSensor->isConnectedToBackend()) {
-        // Generate simulated orientation data for desktop testing
-        static double angle = 0.0;
-        angle += 1.0; // Increment by 1 degree each time
-        if (angle >= 360.0) angle = 0.0;
-        
-        double x = sin(angle * M_PI / 180.0) * 10.0; // Simulate roll
-        double y = cos(angle * M_PI / 180.0) * 5.0;  // Simulate pitch
-        double z = angle; // Simulate yaw
-        
-        qDebug() << "OrientationSensor (simulated): x=" << x << "y=" << y << "z=" << z;
-        emit orientationChanged(x, y, z);
-        return;
+    qDebug() << "OrientationSensor::resetOrientation() called";
+    m_hasInitialOrientation = false;
+}
+
+void OrientationSensor::setOutputRate(double hz)
+{
+    m_outputRate = hz > 0.0 ? hz : kDefaultOutputRate;
+    qDebug() << "OrientationSensor: Output rate" << m_outputRate << "Hz";
+    m_timer->setInterval(qMax(1, qRound(1000.0 / m_outputRate)));
+
+    // Backends only pick up a new data rate when (re)started
+    if (m_isActive && m_rotationSensor->isConnectedToBackend()) {
+        m_rotationSensor->stop();
+        m_rotationSensor->setDataRate(qRound(m_outputRate));
+        m_rotationSensor->start();
     }
-    
-    if (!m_rotationSensor->reading()) {
-        qDebug() << "OrientationSensor: No reading available";
+}
+
+double OrientationSensor::outputRate() const
+{
+    return m_outputRate;
+}
+
+void OrientationSensor::onReadingChanged()
+{
+    QRotationReading *reading = m_rotationSensor->reading();
+    if (!m_isActive || !reading) {
         return;
     }
-    
-    QRotationReading *reading = m_rotationSensor->reading();
-    
-    // Get rotation values (in degrees)
-    double x = reading->x();
-    double y = reading->y();
-    double z = reading->z();
-    
-    qDebug() << "OrientationSensor (real): x=" << x << "y=" << y << "z=" << z;
-    emit orientationChanged(x, y, z);
-}
\ No newline at end of file
+    const qint64 startNs = m_clock.nsecsElapsed();
+
+    // Rotation in degrees, applied around z, then x, then y (device to world)
+    const double halfX = reading->x() * M_PI / 360.0;
+    const double halfY = reading->y() * M_PI / 360.0;
+    const double halfZ = reading->z() * M_PI / 360.0;
+    double zxW, zxX, zxY, zxZ;
+    FusionCore::quaternionMultiply(std::cos(halfZ), 0.0, 0.0, std::sin(halfZ),
+                                   std::cos(halfX), std::sin(halfX), 0.0, 0.0,
+                                   zxW, zxX, zxY, zxZ);
+    double w, x, y, z;
+    FusionCore::quaternionMultiply(zxW, zxX, zxY, zxZ,
+                                   std::cos(halfY), 0.0, std::sin(halfY), 0.0,
+                                   w, x, y, z);
+
+    // Handled as soon as it arrives, so the latency in the app is the time
+    // spent here; what the sensor hub takes is not visible to the app
+    emitRelative(w, x, y, z, m_clock.nsecsElapsed() - startNs);
+    addCpuTime(m_clock.nsecsElapsed() - startNs);
+}
+
+void OrientationSensor::simulateReading()
+{
+    // Generate simulated orientation data for desktop testing
+    static double angle = 0.0;
+    angle += 1.0; // Increment by 1 degree each time
+    if (angle >= 360.0) angle = 0.0;
+
+    const double radians = angle * M_PI / 180.0;
+    emitRelative(std::cos(radians / 2.0), 0.0, 0.0, std::sin(radians / 2.0), -1);
+}
+
+void OrientationSensor::emitRelative(double w, double x, double y, double z, qint64 latencyNs)
+{
+    if (!m_hasInitialOrientation) {
+        FusionCore::quaternionConjugate(w, x, y, z, m_initialW, m_initialX, m_initialY, m_initialZ);
+        m_hasInitialOrientation = true;
+        qDebug() << "OrientationSensor: Set initial orientation - w=" << w << "x=" << x << "y=" << y << "z=" << z;
+    }
+
+    // Relative rotation: current * inverse(initial)
+    double relativeW, relativeX, relativeY, relativeZ;
+    FusionCore::quaternionMultiply(w, x, y, z, m_initialW, m_initialX, m_initialY, m_initialZ,
+                                   relativeW, relativeX, relativeY, relativeZ);
+    emitPose(relativeW, relativeX, relativeY, relativeZ, latencyNs);
+}
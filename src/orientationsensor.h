@@ -1,12 +1,15 @@
 #pragma once
 
-#include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
+#include "posesource.h"
 
 class QRotationSensor;
 class QRotationReading;
 
-class OrientationSensor : public QObject
+// The rotation vector fused by the OS or the sensor hub (QRotationSensor), so
+// the app spends no CPU on fusion
+class OrientationSensor : public PoseSource
 {
     Q_OBJECT
 
@@ -14,18 +17,36 @@ public:
     explicit OrientationSensor(QObject *parent = nullptr);
     ~OrientationSensor();
 
-    void start();
-    void stop();
-    bool isActive() const;
+    QString name() const override;
+    // The device has a rotation sensor
+    bool isAvailable() override;
 
-signals:
-    void orientationChanged(double x, double y, double z);
+    void start() override;
+    void stop() override;
+    bool isActive() const override;
+
+    void resetOrientation() override;
+
+    // Requested as the sensor's data rate; poses follow its readings
+    void setOutputRate(double hz) override;
+    double outputRate() const override;
 
 private slots:
-    void readingSensor();
+    void onReadingChanged();
+    void simulateReading();
 
 private:
     QRotationSensor *m_rotationSensor;
-    QTimer *m_timer;
+    QTimer *m_timer; // simulated data without a backend
     bool m_isActive;
-};
\ No newline at end of file
+    bool m_backendConnected;
+    double m_outputRate;
+    QElapsedTimer m_clock;
+
+    void connectBackend();
+    void emitRelative(double w, double x, double y, double z, qint64 latencyNs);
+
+    // Conjugate of the orientation at the last reset
+    double m_initialW, m_initialX, m_initialY, m_initialZ;
+    bool m_hasInitialOrientation;
+};
@@ -0,0 +1,220 @@
+#include "pivotcalibration.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Readings further apart than this restart the filter
+const double kMaxGap = 0.25; // s
+// Low-pass time constant; pivoting motion is well below its 1 Hz corner
+const double kFilterTau = 0.15; // s
+const double kSettleTime = 3.0 * kFilterTau;
+const unsigned long long kMinSamples = 90;
+
+// In-place Cholesky factorization (lower triangle); false if the matrix is
+// not positive definite, i.e. the motion did not excite every unknown
+bool choleskyFactor(double a[PivotCalibration::kUnknowns][PivotCalibration::kUnknowns])
+{
+    const int n = PivotCalibration::kUnknowns;
+    for (int j = 0; j < n; ++j) {
+        double diagonal = a[j][j];
+        for (int k = 0; k < j; ++k) {
+            diagonal -= a[j][k] * a[j][k];
+        }
+        if (diagonal <= 1e-12 * (1.0 + std::abs(a[j][j]))) {
+            return false;
+        }
+        a[j][j] = std::sqrt(diagonal);
+        for (int i = j + 1; i < n; ++i) {
+            double sum = a[i][j];
+            for (int k = 0; k < j; ++k) {
+                sum -= a[i][k] * a[j][k];
+            }
+            a[i][j] = sum / a[j][j];
+        }
+    }
+    return true;
+}
+
+void choleskySolve(const double l[PivotCalibration::kUnknowns][PivotCalibration::kUnknowns],
+                   const double b[PivotCalibration::kUnknowns], double x[PivotCalibration::kUnknowns])
+{
+    const int n = PivotCalibration::kUnknowns;
+    for (int i = 0; i < n; ++i) {
+        double sum = b[i];
+        for (int k = 0; k < i; ++k) {
+            sum -= l[i][k] * x[k];
+        }
+        x[i] = sum / l[i][i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        double sum = x[i];
+        for (int k = i + 1; k < n; ++k) {
+            sum -= l[k][i] * x[k];
+        }
+        x[i] = sum / l[i][i];
+    }
+}
+
+}
+
+PivotCalibration::PivotCalibration()
+{
+    reset();
+}
+
+void PivotCalibration::reset()
+{
+    std::memset(m_normal, 0, sizeof(m_normal));
+    std::memset(m_rhs, 0, sizeof(m_rhs));
+    m_sumSquares = 0.0;
+    m_count = 0;
+    m_filtered = 0;
+    m_previousDt = 0.0;
+    m_settleTime = 0.0;
+    m_sampleTime = 0.0;
+}
+
+void PivotCalibration::addSample(const double q[4], const double gyro[3], const double accel[3], double dt)
+{
+    double rows[3][6];
+    modelRows(q, gyro, rows);
+
+    if (m_filtered == 0 || dt <= 0.0 || dt > kMaxGap) {
+        std::memcpy(m_rows, rows, sizeof(m_rows));
+        std::memcpy(m_gyro, gyro, sizeof(m_gyro));
+        std::memcpy(m_gyroBefore, gyro, sizeof(m_gyroBefore));
+        std::memcpy(m_accel, accel, sizeof(m_accel));
+        m_filtered = 1;
+        m_settleTime = 0.0;
+        m_previousDt = dt;
+        return;
+    }
+
+    // The filtered terms of the previous reading wait for this one: the
+    // central difference of the filtered gyroscope is L(alpha) there
+    const double gain = 1.0 - std::exp(-dt / kFilterTau);
+    double alpha[3];
+    for (int i = 0; i < 3; ++i) {
+        const double filtered = m_gyro[i] + gain * (gyro[i] - m_gyro[i]);
+        alpha[i] = (filtered - m_gyroBefore[i]) / (m_previousDt + dt);
+        m_gyroBefore[i] = m_gyro[i];
+        m_gyro[i] = filtered;
+    }
+    if (m_filtered >= 2 && m_settleTime >= kSettleTime) {
+        double model[3][kUnknowns];
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 6; ++column) {
+                model[row][column] = m_rows[row][column];
+            }
+            for (int column = 0; column < 3; ++column) {
+                model[row][6 + column] = row == column ? 1.0 : 0.0;
+            }
+        }
+        // + [alpha]x
+        model[0][1] -= alpha[2];
+        model[0][2] += alpha[1];
+        model[1][0] += alpha[2];
+        model[1][2] -= alpha[0];
+        model[2][0] -= alpha[1];
+        model[2][1] += alpha[0];
+        accumulate(model, m_accel);
+        m_sampleTime += m_previousDt;
+    }
+
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 6; ++column) {
+            m_rows[row][column] += gain * (rows[row][column] - m_rows[row][column]);
+        }
+        m_accel[row] += gain * (accel[row] - m_accel[row]);
+    }
+    m_settleTime += dt;
+    m_previousDt = dt;
+    ++m_filtered;
+}
+
+void PivotCalibration::modelRows(const double q[4], const double gyro[3], double rows[3][6]) const
+{
+    // [omega]x^2 = omega omega^T - |omega|^2 I
+    const double *w = gyro;
+    const double squared = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+    const double qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+    const double rotation[3][3] = {
+        {1.0 - 2.0 * (qy * qy + qz * qz), 2.0 * (qx * qy - qw * qz), 2.0 * (qx * qz + qw * qy)},
+        {2.0 * (qx * qy + qw * qz), 1.0 - 2.0 * (qx * qx + qz * qz), 2.0 * (qy * qz - qw * qx)},
+        {2.0 * (qx * qz - qw * qy), 2.0 * (qy * qz + qw * qx), 1.0 - 2.0 * (qx * qx + qy * qy)},
+    };
+    for (int row = 0; row < 3; ++row) {
+        for (int i = 0; i < 3; ++i) {
+            rows[row][i] = w[row] * w[i] - (row == i ? squared : 0.0);
+            rows[row][3 + i] = rotation[i][row]; // R^T
+        }
+    }
+}
+
+void PivotCalibration::accumulate(const double rows[3][kUnknowns], const double accel[3])
+{
+    for (int row = 0; row < 3; ++row) {
+        const double *a = rows[row];
+        for (int i = 0; i < kUnknowns; ++i) {
+            for (int j = 0; j <= i; ++j) {
+                m_normal[i][j] += a[i] * a[j];
+            }
+            m_rhs[i] += a[i] * accel[row];
+        }
+        m_sumSquares += accel[row] * accel[row];
+    }
+    ++m_count;
+}
+
+PivotCalibration::Result PivotCalibration::result() const
+{
+    Result result;
+    result.samples = m_count;
+    if (m_count < kMinSamples) {
+        return result;
+    }
+
+    double factor[kUnknowns][kUnknowns];
+    for (int i = 0; i < kUnknowns; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            factor[i][j] = m_normal[i][j];
+        }
+    }
+    if (!choleskyFactor(factor)) {
+        return result;
+    }
+    double x[kUnknowns];
+    choleskySolve(factor, m_rhs, x);
+
+    // At the least-squares solution the residual sum is |b|^2 - x . A^T b
+    double residual = m_sumSquares;
+    for (int i = 0; i < kUnknowns; ++i) {
+        residual -= x[i] * m_rhs[i];
+    }
+    residual = residual > 0.0 ? residual : 0.0;
+    const double rows = 3.0 * double(m_count);
+    result.residualRms = std::sqrt(residual / rows);
+
+    // Covariance of r: sigma^2 times the r block of the inverse normal matrix.
+    // Filtered samples are correlated over about 2 tau, so there are fewer
+    // independent ones than samples.
+    const double correlation = m_sampleTime > 0.0 ? std::max(1.0, 2.0 * kFilterTau * double(m_count) / m_sampleTime) : 1.0;
+    const double variance = correlation * residual / (rows - kUnknowns);
+    double trace = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        double unit[kUnknowns] = {};
+        double column[kUnknowns];
+        unit[i] = 1.0;
+        choleskySolve(factor, unit, column);
+        trace += column[i];
+    }
+    result.tipErrorMm = 1000.0 * std::sqrt(variance * trace);
+
+    for (int i = 0; i < 3; ++i) {
+        result.tip[i] = -1000.0 * x[i];
+    }
+    result.valid = true;
+    return result;
+}
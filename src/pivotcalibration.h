@@ -0,0 +1,69 @@
+#pragma once
+
+// Streaming pivot calibration from the device's own IMU. While the device is
+// pivoted about a fixed tip, the accelerometer sees the lever-arm
+// acceleration of its distance r from the tip on top of gravity and its bias:
+//
+//   accel = ([alpha]x + [omega]x [omega]x) r + R^T g + b
+//
+// with omega the gyroscope rate, alpha its derivative, R the fused
+// orientation (body to world), g gravity in the world frame and b the
+// accelerometer bias. That is linear in the nine unknowns r, g and b, so
+// every sample adds its rows to the normal equations (a 9x9 sum) and the
+// solution is available at any time without keeping the samples. The tip
+// offset is -r. Plain C++ (no Qt).
+//
+// Differentiating the gyroscope for alpha would amplify its noise, and noise
+// in the model terms biases the fit towards a short lever. Instead both sides
+// of the equation go through the same first-order low-pass L, which leaves
+// the unknowns unchanged; L(alpha) is then the central difference of the
+// smoothed rate.
+
+class PivotCalibration
+{
+public:
+    static const int kUnknowns = 9; // r, g, b
+
+    struct Result {
+        double tip[3] = {0.0, 0.0, 0.0}; // mm, tip relative to the IMU in the device frame
+        double residualRms = 0.0;        // m/s^2 per axis, what the model does not explain
+        double tipErrorMm = 0.0;         // standard error of the tip position (3D)
+        unsigned long long samples = 0;
+        bool valid = false;              // enough samples and motion for a solution
+    };
+
+    PivotCalibration();
+
+    void reset();
+
+    // Feeds one set of readings taken dt seconds after the previous one:
+    // orientation w, x, y, z (body to world), gyroscope (rad/s) and
+    // accelerometer (m/s^2). A gap restarts the filter, and samples are used
+    // once it has settled.
+    void addSample(const double q[4], const double gyro[3], const double accel[3], double dt);
+
+    // Solves the normal equations, O(1) in the number of samples
+    Result result() const;
+
+private:
+    // Model rows without the alpha term, [ [omega]x^2 | R^T ] (the bias
+    // columns are constant), and the measurement
+    void modelRows(const double q[4], const double gyro[3], double rows[3][6]) const;
+    void accumulate(const double rows[3][kUnknowns], const double accel[3]);
+
+    // Low-pass filtered terms of the previous reading, and the filtered
+    // gyroscope of the one before it
+    double m_rows[3][6];
+    double m_gyro[3];
+    double m_accel[3];
+    double m_gyroBefore[3];
+    double m_previousDt;
+    int m_filtered;      // readings since the filter (re)started
+    double m_settleTime; // s since the filter (re)started
+    double m_sampleTime; // s of samples accumulated, for the error estimate
+
+    double m_normal[kUnknowns][kUnknowns]; // sum of A^T A
+    double m_rhs[kUnknowns];               // sum of A^T accel
+    double m_sumSquares;                   // sum of |accel|^2
+    unsigned long long m_count;
+};
@@ -0,0 +1,144 @@
+#include "posebacklog.h"
+#include "igtlmessages.h"
+#include <cmath>
+
+namespace {
+
+const uint8_t kVersion = 1;
+const size_t kFixedSize = 12; // version, reserved, count, first time
+const int kFieldCount = 8;    // dt, q[4], t[3]
+const double kRotationScale = 16777216.0; // 2^24
+const double kTranslationScale = 1000.0;  // mm to um
+
+uint64_t zigzag(int64_t value)
+{
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value)
+{
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+void writeVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+bool readVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Quantized fields of one sample; time in us
+void quantize(const PoseBacklog::Sample &sample, int64_t fields[kFieldCount])
+{
+    fields[0] = int64_t(sample.timeNs / 1000);
+    for (int i = 0; i < 4; ++i) {
+        fields[1 + i] = std::llround(sample.pose.q[i] * kRotationScale);
+    }
+    for (int i = 0; i < 3; ++i) {
+        fields[5 + i] = std::llround(sample.pose.t[i] * kTranslationScale);
+    }
+}
+
+}
+
+namespace PoseBacklog {
+
+const char *const kMessageType = "POSEDELTA";
+
+void pack(std::vector<uint8_t> &out, const char *deviceName, const Sample *samples, size_t count)
+{
+    if (count == 0 || count > kMaxPoses) {
+        return;
+    }
+    const size_t start = out.size();
+    out.resize(start + IgtlMessages::kHeaderSize + kFixedSize);
+
+    int64_t previous[kFieldCount] = {};
+    int64_t fields[kFieldCount];
+    quantize(samples[0], fields);
+    previous[0] = fields[0];
+    const uint64_t firstUs = uint64_t(fields[0]);
+
+    for (size_t i = 0; i < count; ++i) {
+        quantize(samples[i], fields);
+        for (int field = 0; field < kFieldCount; ++field) {
+            writeVarint(out, zigzag(fields[field] - previous[field]));
+            previous[field] = fields[field];
+        }
+    }
+
+    uint8_t *body = out.data() + start + IgtlMessages::kHeaderSize;
+    body[0] = kVersion;
+    body[1] = 0;
+    body[2] = uint8_t(count >> 8);
+    body[3] = uint8_t(count);
+    for (int i = 0; i < 8; ++i) {
+        body[4 + i] = uint8_t(firstUs >> (56 - 8 * i));
+    }
+    const uint64_t bodySize = out.size() - start - IgtlMessages::kHeaderSize;
+    const uint64_t timestamp = IgtlMessages::timestamp(uint32_t(firstUs / 1000000),
+                                                       uint32_t(firstUs % 1000000) * 1000);
+    IgtlMessages::packHeader(out.data() + start, kMessageType, deviceName, timestamp, bodySize);
+}
+
+bool unpack(const uint8_t *body, size_t size, std::vector<Sample> &samples)
+{
+    if (size < kFixedSize || body[0] != kVersion) {
+        return false;
+    }
+    const size_t count = (size_t(body[2]) << 8) | body[3];
+    uint64_t firstUs = 0;
+    for (int i = 0; i < 8; ++i) {
+        firstUs = (firstUs << 8) | body[4 + i];
+    }
+
+    const uint8_t *p = body + kFixedSize;
+    const uint8_t *end = body + size;
+    int64_t fields[kFieldCount] = {int64_t(firstUs)};
+    for (size_t i = 0; i < count; ++i) {
+        for (int field = 0; field < kFieldCount; ++field) {
+            uint64_t delta;
+            if (!readVarint(p, end, delta)) {
+                return false;
+            }
+            fields[field] += unzigzag(delta);
+        }
+
+        Sample sample;
+        sample.timeNs = uint64_t(fields[0]) * 1000;
+        double norm = 0.0;
+        for (int k = 0; k < 4; ++k) {
+            sample.pose.q[k] = double(fields[1 + k]) / kRotationScale;
+            norm += sample.pose.q[k] * sample.pose.q[k];
+        }
+        // Undo the quantization's small departure from unit length
+        norm = std::sqrt(norm);
+        if (norm > 0.0) {
+            for (double &component : sample.pose.q) {
+                component /= norm;
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            sample.pose.t[k] = double(fields[5 + k]) / kTranslationScale;
+        }
+        samples.push_back(sample);
+    }
+    return p == end;
+}
+
+}
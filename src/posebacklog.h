@@ -0,0 +1,41 @@
+#pragma once
+
+// Compact encoding of a run of timestamped poses, used to send the poses
+// buffered while the connection was down (see SpillBuffer) once it is back.
+// A batch is one OpenIGTLink message of type "POSEDELTA" from the same device
+// as the TRANSFORM stream, timestamped with its first pose. Plain C++ (no Qt)
+// so the tools can decode it.
+//
+// Body, multi-byte fields big-endian:
+//   version(1) reserved(1) count(2) first time in us since the epoch(8)
+//   count x [ dt us, q w x y z, t x y z ]
+// Every per-pose field is a zigzag varint holding the difference to the same
+// field of the previous pose (of 0 for the first one). Rotations are
+// quantized to 2^-24, translations to 1 um, so a pose that barely changed
+// takes about 8 bytes instead of a 106 byte TRANSFORM message.
+
+#include "transformchain.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace PoseBacklog {
+
+extern const char *const kMessageType;
+// Keeps the body well below the 64 KiB a receiver reads in one go
+const size_t kMaxPoses = 1024;
+
+struct Sample {
+    uint64_t timeNs = 0; // since the Unix epoch
+    Pose pose;
+};
+
+// Appends one complete POSEDELTA message for count (1..kMaxPoses) samples
+// in time order
+void pack(std::vector<uint8_t> &out, const char *deviceName, const Sample *samples, size_t count);
+
+// Appends the samples of a POSEDELTA body. Returns false for a malformed
+// body; samples decoded up to that point are kept.
+bool unpack(const uint8_t *body, size_t size, std::vector<Sample> &samples);
+
+}
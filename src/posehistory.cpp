@@ -0,0 +1,256 @@
+#include "posehistory.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVariantMap>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+struct LevelConfig {
+    qint64 widthMs;
+    int capacity;
+};
+
+const LevelConfig kLevels[] = {
+    {0, 2048},       // raw
+    {1000, 600},     // 10 min of 1 s buckets
+    {10000, 360},    // 1 h of 10 s buckets
+    {60000, 720},    // 12 h of 60 s buckets
+};
+
+const char *const kChannelNames[] = {"roll", "pitch", "yaw"};
+
+}
+
+PoseHistory::PoseHistory(QObject *parent)
+    : QObject(parent)
+    , m_previous{0.0, 0.0, 0.0}
+    , m_hasPrevious(false)
+{
+    for (const LevelConfig &config : kLevels) {
+        Level level;
+        level.widthMs = config.widthMs;
+        level.ring.resize(config.capacity);
+        m_levels.append(level);
+    }
+    m_clock.start();
+}
+
+void PoseHistory::addPose(double w, double x, double y, double z)
+{
+    // Roll (X), pitch (Y), yaw (Z) in degrees
+    double angles[ChannelCount];
+    angles[Roll] = std::atan2(2.0 * (w * x + y * z), 1.0 - 2.0 * (x * x + y * y)) * 180.0 / M_PI;
+    angles[Pitch] = std::asin(qBound(-1.0, 2.0 * (w * y - z * x), 1.0)) * 180.0 / M_PI;
+    angles[Yaw] = std::atan2(2.0 * (w * z + x * y), 1.0 - 2.0 * (y * y + z * z)) * 180.0 / M_PI;
+
+    if (m_hasPrevious) {
+        for (int c = 0; c < ChannelCount; ++c) {
+            double delta = std::remainder(angles[c] - m_previous[c], 360.0);
+            angles[c] = m_previous[c] + delta;
+        }
+    }
+    for (int c = 0; c < ChannelCount; ++c) {
+        m_previous[c] = angles[c];
+    }
+    m_hasPrevious = true;
+
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < m_levels.size(); ++i) {
+        addToLevel(m_levels[i], now, angles);
+    }
+}
+
+void PoseHistory::clear()
+{
+    for (Level &level : m_levels) {
+        level.head = 0;
+        level.size = 0;
+        level.open.count = 0;
+    }
+    m_hasPrevious = false;
+    emit updated();
+}
+
+int PoseHistory::levelCount() const
+{
+    return m_levels.size();
+}
+
+double PoseHistory::durationSeconds() const
+{
+    // Span of the coarsest level, which reaches back the furthest
+    const Level &level = m_levels.last();
+    if (level.size == 0 && level.open.count == 0) {
+        return 0.0;
+    }
+    const int oldest = (level.head - level.size + level.ring.size()) % level.ring.size();
+    const qint64 startMs = level.size > 0 ? level.ring[oldest].startMs : level.open.startMs;
+    return (m_clock.elapsed() - startMs) / 1000.0;
+}
+
+double PoseHistory::levelSeconds(int level) const
+{
+    if (level < 0 || level >= m_levels.size()) {
+        return 0.0;
+    }
+    return m_levels[level].widthMs / 1000.0;
+}
+
+int PoseHistory::levelFor(double seconds, int maxPoints) const
+{
+    const qint64 sinceMs = m_clock.elapsed() - qint64(seconds * 1000.0);
+    for (int i = 0; i < m_levels.size(); ++i) {
+        const Level &level = m_levels[i];
+        const int oldest = (level.head - level.size + level.ring.size()) % level.ring.size();
+        // The level must reach back far enough (or hold everything so far) ...
+        const bool covers = level.size < level.ring.size() || level.ring[oldest].startMs <= sinceMs;
+        // ... without too many points
+        const double points = level.widthMs > 0 ? seconds * 1000.0 / level.widthMs : level.size;
+        if (covers && points <= maxPoints) {
+            return i;
+        }
+    }
+    return m_levels.size() - 1;
+}
+
+QVariantList PoseHistory::series(int level, int channel, double seconds) const
+{
+    QVariantList points;
+    if (level < 0 || level >= m_levels.size() || channel < 0 || channel >= ChannelCount) {
+        return points;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    const QVector<Bucket> buckets = snapshot(level, now - qint64(seconds * 1000.0));
+    points.reserve(buckets.size());
+    for (const Bucket &bucket : buckets) {
+        QVariantMap point;
+        point["t"] = (bucket.startMs - now) / 1000.0;
+        point["min"] = bucket.min[channel];
+        point["max"] = bucket.max[channel];
+        point["mean"] = bucket.sum[channel] / bucket.count;
+        points.append(point);
+    }
+    return points;
+}
+
+QString PoseHistory::exportCsv(double minutes) const
+{
+    const double seconds = minutes * 60.0;
+    // Finest level that reaches back far enough, regardless of point count
+    const int level = levelFor(seconds, std::numeric_limits<int>::max());
+    const qint64 now = m_clock.elapsed();
+    const QVector<Bucket> buckets = snapshot(level, now - qint64(seconds * 1000.0));
+
+    const QString dirPath = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("history");
+    QDir().mkpath(dirPath);
+    const QString path = QDir(dirPath).filePath(
+        QString("history-%1.csv").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss")));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "PoseHistory: Cannot write" << path << file.errorString();
+        return QString();
+    }
+
+    // Wall-clock time of each bucket start
+    const QDateTime wallNow = QDateTime::currentDateTime();
+    QByteArray header = "time,bucket_s,samples";
+    for (const char *name : kChannelNames) {
+        header += QByteArray(",") + name + "_min," + name + "_max," + name + "_mean";
+    }
+    file.write(header + "\n");
+    for (const Bucket &bucket : buckets) {
+        QByteArray line = wallNow.addMSecs(bucket.startMs - now).toString(Qt::ISODateWithMs).toUtf8() + ','
+                          + QByteArray::number(m_levels[level].widthMs / 1000.0) + ','
+                          + QByteArray::number(bucket.count);
+        for (int c = 0; c < ChannelCount; ++c) {
+            line += ',' + QByteArray::number(bucket.min[c], 'f', 3) + ','
+                    + QByteArray::number(bucket.max[c], 'f', 3) + ','
+                    + QByteArray::number(bucket.sum[c] / bucket.count, 'f', 3);
+        }
+        file.write(line + "\n");
+    }
+    if (!file.commit()) {
+        qWarning() << "PoseHistory: Cannot write" << path << file.errorString();
+        return QString();
+    }
+
+    qDebug() << "PoseHistory: Exported" << buckets.size() << "points of the last" << minutes
+             << "min at level" << level << "to" << path;
+    return path;
+}
+
+void PoseHistory::addToLevel(Level &level, qint64 timeMs, const double values[ChannelCount])
+{
+    if (level.widthMs == 0) {
+        Bucket bucket;
+        startBucket(bucket, timeMs, values);
+        pushBucket(level, bucket);
+        return;
+    }
+
+    if (level.open.count > 0 && timeMs >= level.open.startMs + level.widthMs) {
+        pushBucket(level, level.open);
+        level.open.count = 0;
+        if (level.widthMs == kLevels[1].widthMs) {
+            emit updated();
+        }
+    }
+
+    if (level.open.count == 0) {
+        // Buckets are aligned to multiples of their width
+        startBucket(level.open, timeMs - timeMs % level.widthMs, values);
+        return;
+    }
+
+    Bucket &open = level.open;
+    for (int c = 0; c < ChannelCount; ++c) {
+        open.min[c] = qMin(open.min[c], float(values[c]));
+        open.max[c] = qMax(open.max[c], float(values[c]));
+        open.sum[c] += values[c];
+    }
+    ++open.count;
+}
+
+void PoseHistory::pushBucket(Level &level, const Bucket &bucket)
+{
+    level.ring[level.head] = bucket;
+    level.head = (level.head + 1) % level.ring.size();
+    level.size = qMin(level.size + 1, int(level.ring.size()));
+}
+
+void PoseHistory::startBucket(Bucket &bucket, qint64 startMs, const double values[ChannelCount])
+{
+    bucket.startMs = startMs;
+    bucket.count = 1;
+    for (int c = 0; c < ChannelCount; ++c) {
+        bucket.min[c] = float(values[c]);
+        bucket.max[c] = float(values[c]);
+        bucket.sum[c] = values[c];
+    }
+}
+
+QVector<PoseHistory::Bucket> PoseHistory::snapshot(int levelIndex, qint64 sinceMs) const
+{
+    const Level &level = m_levels[levelIndex];
+    QVector<Bucket> buckets;
+    buckets.reserve(level.size + 1);
+    const int capacity = level.ring.size();
+    for (int i = 0; i < level.size; ++i) {
+        const Bucket &bucket = level.ring[(level.head - level.size + i + capacity) % capacity];
+        // Keep buckets that end after sinceMs
+        if (bucket.startMs + level.widthMs >= sinceMs) {
+            buckets.append(bucket);
+        }
+    }
+    if (level.open.count > 0) {
+        buckets.append(level.open);
+    }
+    return buckets;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QElapsedTimer>
+#include <QVariantList>
+#include <QVector>
+
+// Recent orientation history at several resolutions, for trend plots and
+// export. Every level is a fixed-size ring, so memory does not grow with the
+// session length:
+//
+//   level 0  raw samples        last 2048 samples
+//   level 1  1 s buckets        last 10 min
+//   level 2  10 s buckets       last 1 h
+//   level 3  60 s buckets       last 12 h
+//
+// Buckets hold min/max/mean of roll, pitch and yaw (degrees, relative to the
+// reset orientation) and are updated incrementally with each sample. Angles
+// are unwrapped sample to sample so a turn through +-180 does not average to
+// zero; they can therefore leave the +-180 range.
+class PoseHistory : public QObject
+{
+    Q_OBJECT
+    QML_ANONYMOUS
+
+    Q_PROPERTY(int levelCount READ levelCount CONSTANT)
+    Q_PROPERTY(double durationSeconds READ durationSeconds NOTIFY updated)
+
+public:
+    enum Channel {
+        Roll,
+        Pitch,
+        Yaw,
+        ChannelCount
+    };
+    Q_ENUM(Channel)
+
+    explicit PoseHistory(QObject *parent = nullptr);
+
+    void addPose(double w, double x, double y, double z);
+    void clear();
+
+    int levelCount() const;
+    double durationSeconds() const;
+
+    // Bucket width of a level in seconds (0 for raw samples)
+    Q_INVOKABLE double levelSeconds(int level) const;
+    // Finest level that covers the last `seconds` with at most maxPoints points
+    Q_INVOKABLE int levelFor(double seconds, int maxPoints) const;
+    // Points of the last `seconds` at a level, oldest first, as
+    // {t, min, max, mean} maps; t is seconds relative to now (<= 0)
+    Q_INVOKABLE QVariantList series(int level, int channel, double seconds) const;
+    // Writes the last `minutes` at the finest level that covers them to a CSV
+    // file in the app data directory and returns its path (empty on failure)
+    Q_INVOKABLE QString exportCsv(double minutes) const;
+
+signals:
+    // Emitted when a 1 s bucket closes, a good pace for redrawing trends
+    void updated();
+
+private:
+    struct Bucket {
+        qint64 startMs = 0;
+        int count = 0;
+        float min[ChannelCount];
+        float max[ChannelCount];
+        double sum[ChannelCount];
+    };
+
+    struct Level {
+        qint64 widthMs = 0; // 0 = raw samples, one per bucket
+        QVector<Bucket> ring;
+        int head = 0;       // next slot to write
+        int size = 0;
+        Bucket open;        // bucket being filled
+    };
+
+    void addToLevel(Level &level, qint64 timeMs, const double values[ChannelCount]);
+    static void pushBucket(Level &level, const Bucket &bucket);
+    static void startBucket(Bucket &bucket, qint64 startMs, const double values[ChannelCount]);
+    // Buckets of a level in time order, including the open one
+    QVector<Bucket> snapshot(int level, qint64 sinceMs) const;
+
+    QVector<Level> m_levels;
+    QElapsedTimer m_clock;
+    double m_previous[ChannelCount];
+    bool m_hasPrevious;
+};
@@ -0,0 +1,223 @@
+#include "poseresampler.h"
+#include <QTimer>
+#include <QDebug>
+#include <cmath>
+
+namespace {
+
+const double kDefaultRate = 30.0;
+// Extra interpolation delay on top of one output period, covering the
+// arrival jitter of the coarse sensor timer
+const qint64 kDelayMarginNs = 10 * 1000000ll;
+const qint64 kStatisticsIntervalNs = 1000 * 1000000ll;
+
+}
+
+PoseResampler::PoseResampler(QObject *parent)
+    : QObject(parent)
+    , m_historyCount(0)
+    , m_historyHead(-1)
+    , m_timer(new QTimer(this))
+    , m_periodNs(qint64(1e9 / kDefaultRate))
+    , m_nextDeadlineNs(0)
+    , m_isActive(false)
+{
+    m_clock.start();
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &PoseResampler::onTick);
+    resetStatistics();
+}
+
+void PoseResampler::start()
+{
+    if (m_isActive) {
+        return;
+    }
+    m_isActive = true;
+    m_historyCount = 0;
+    m_historyHead = -1;
+    resetStatistics();
+    m_nextDeadlineNs = m_clock.nsecsElapsed() + m_periodNs;
+    scheduleNext();
+}
+
+void PoseResampler::stop()
+{
+    m_timer->stop();
+    m_isActive = false;
+}
+
+bool PoseResampler::isActive() const
+{
+    return m_isActive;
+}
+
+double PoseResampler::rate() const
+{
+    return 1e9 / double(m_periodNs);
+}
+
+void PoseResampler::setRate(double hz)
+{
+    if (hz <= 0.0) {
+        hz = kDefaultRate;
+    }
+    qint64 periodNs = qint64(1e9 / hz);
+    if (periodNs == m_periodNs) {
+        return;
+    }
+    m_periodNs = periodNs;
+    qDebug() << "PoseResampler: Output rate" << hz << "Hz";
+    if (m_isActive) {
+        // Re-anchor so the new period applies from now on
+        m_nextDeadlineNs = m_clock.nsecsElapsed() + m_periodNs;
+        scheduleNext();
+    }
+    emit rateChanged();
+}
+
+void PoseResampler::addSample(double w, double x, double y, double z)
+{
+    m_historyHead = (m_historyHead + 1) % kHistorySize;
+    m_history[m_historyHead] = {m_clock.nsecsElapsed(), w, x, y, z};
+    if (m_historyCount < kHistorySize) {
+        ++m_historyCount;
+    }
+}
+
+double PoseResampler::jitterMeanUs() const
+{
+    return m_jitterMean;
+}
+
+double PoseResampler::jitterStdDevUs() const
+{
+    return m_tickCount > 1 ? std::sqrt(m_jitterM2 / double(m_tickCount - 1)) : 0.0;
+}
+
+double PoseResampler::jitterMaxUs() const
+{
+    return m_jitterMax;
+}
+
+quint64 PoseResampler::missedDeadlines() const
+{
+    return m_missedDeadlines;
+}
+
+void PoseResampler::resetStatistics()
+{
+    m_tickCount = 0;
+    m_jitterMean = 0.0;
+    m_jitterM2 = 0.0;
+    m_jitterMax = 0.0;
+    m_missedDeadlines = 0;
+    m_lastStatisticsNs = m_clock.nsecsElapsed();
+}
+
+void PoseResampler::onTick()
+{
+    if (!m_isActive) {
+        return;
+    }
+
+    const qint64 nowNs = m_clock.nsecsElapsed();
+    const qint64 deadlineNs = m_nextDeadlineNs;
+
+    // Lateness against the deadline, not against the previous tick, so that
+    // errors do not accumulate
+    double latenessUs = double(nowNs - deadlineNs) / 1000.0;
+    ++m_tickCount;
+    double delta = latenessUs - m_jitterMean;
+    m_jitterMean += delta / double(m_tickCount);
+    m_jitterM2 += delta * (latenessUs - m_jitterMean);
+    m_jitterMax = qMax(m_jitterMax, std::fabs(latenessUs));
+
+    Sample pose;
+    if (interpolate(deadlineNs - m_periodNs - kDelayMarginNs, pose)) {
+        emit poseReady(pose.w, pose.x, pose.y, pose.z);
+    }
+
+    m_nextDeadlineNs += m_periodNs;
+    if (m_nextDeadlineNs <= nowNs) {
+        // Skip ticks that are already overdue instead of bursting them
+        qint64 missed = (nowNs - m_nextDeadlineNs) / m_periodNs + 1;
+        m_missedDeadlines += quint64(missed);
+        m_nextDeadlineNs += missed * m_periodNs;
+    }
+    scheduleNext();
+
+    if (nowNs - m_lastStatisticsNs >= kStatisticsIntervalNs) {
+        m_lastStatisticsNs = nowNs;
+        emit statisticsChanged();
+    }
+}
+
+void PoseResampler::scheduleNext()
+{
+    // QTimer has millisecond resolution; rounding keeps ticks within +-0.5 ms
+    // of the deadline on average instead of always early
+    qint64 remainingNs = m_nextDeadlineNs - m_clock.nsecsElapsed();
+    m_timer->start(int(qMax<qint64>(0, (remainingNs + 500000) / 1000000)));
+}
+
+bool PoseResampler::interpolate(qint64 timeNs, Sample &out) const
+{
+    if (m_historyCount == 0) {
+        return false;
+    }
+
+    // Walk back from the newest sample to the pair that brackets timeNs
+    const Sample *newer = &m_history[m_historyHead];
+    if (timeNs >= newer->timeNs) {
+        out = *newer; // no newer data yet: hold
+        return true;
+    }
+    for (int i = 1; i < m_historyCount; ++i) {
+        const Sample *older = &m_history[(m_historyHead - i + kHistorySize) % kHistorySize];
+        if (older->timeNs <= timeNs) {
+            double t = double(timeNs - older->timeNs) / double(newer->timeNs - older->timeNs);
+            slerp(*older, *newer, t, out);
+            out.timeNs = timeNs;
+            return true;
+        }
+        newer = older;
+    }
+    out = *newer; // older than the history: use the oldest sample
+    return true;
+}
+
+void PoseResampler::slerp(const Sample &a, const Sample &b, double t, Sample &out)
+{
+    double bw = b.w, bx = b.x, by = b.y, bz = b.z;
+    double cosTheta = a.w * bw + a.x * bx + a.y * by + a.z * bz;
+
+    // Take the short way around
+    if (cosTheta < 0.0) {
+        bw = -bw; bx = -bx; by = -by; bz = -bz;
+        cosTheta = -cosTheta;
+    }
+
+    double ka, kb;
+    if (cosTheta > 0.9995) {
+        // Nearly parallel: linear interpolation is accurate and stable
+        ka = 1.0 - t;
+        kb = t;
+    } else {
+        double theta = std::acos(cosTheta);
+        double sinTheta = std::sin(theta);
+        ka = std::sin((1.0 - t) * theta) / sinTheta;
+        kb = std::sin(t * theta) / sinTheta;
+    }
+
+    out.w = ka * a.w + kb * bw;
+    out.x = ka * a.x + kb * bx;
+    out.y = ka * a.y + kb * by;
+    out.z = ka * a.z + kb * bz;
+
+    double norm = std::sqrt(out.w * out.w + out.x * out.x + out.y * out.y + out.z * out.z);
+    if (norm > 1e-12) {
+        out.w /= norm; out.x /= norm; out.y /= norm; out.z /= norm;
+    }
+}
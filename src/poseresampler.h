@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QElapsedTimer>
+
+class QTimer;
+
+// Re-emits poses on a fixed-rate, deadline-scheduled clock. Incoming poses
+// are stamped on arrival and kept in a short history; each output tick SLERPs
+// between the two samples around (deadline - delay), where the delay of one
+// output period plus a margin keeps the output interpolating rather than
+// extrapolating. Lateness of each tick against its deadline is tracked as
+// output jitter.
+class PoseResampler : public QObject
+{
+    Q_OBJECT
+    QML_ANONYMOUS
+
+    Q_PROPERTY(double rate READ rate NOTIFY rateChanged)
+    Q_PROPERTY(double jitterMeanUs READ jitterMeanUs NOTIFY statisticsChanged)
+    Q_PROPERTY(double jitterStdDevUs READ jitterStdDevUs NOTIFY statisticsChanged)
+    Q_PROPERTY(double jitterMaxUs READ jitterMaxUs NOTIFY statisticsChanged)
+    Q_PROPERTY(quint64 missedDeadlines READ missedDeadlines NOTIFY statisticsChanged)
+
+public:
+    explicit PoseResampler(QObject *parent = nullptr);
+
+    void start();
+    void stop();
+    bool isActive() const;
+
+    double rate() const;
+    void setRate(double hz);
+
+    void addSample(double w, double x, double y, double z);
+
+    double jitterMeanUs() const;
+    double jitterStdDevUs() const;
+    double jitterMaxUs() const;
+    quint64 missedDeadlines() const;
+    void resetStatistics();
+
+signals:
+    void poseReady(double w, double x, double y, double z);
+    void rateChanged();
+    void statisticsChanged();
+
+private slots:
+    void onTick();
+
+private:
+    struct Sample {
+        qint64 timeNs;
+        double w, x, y, z;
+    };
+
+    void scheduleNext();
+    bool interpolate(qint64 timeNs, Sample &out) const;
+    static void slerp(const Sample &a, const Sample &b, double t, Sample &out);
+
+    static const int kHistorySize = 32;
+    Sample m_history[kHistorySize];
+    int m_historyCount;
+    int m_historyHead; // index of the newest sample
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_periodNs;
+    qint64 m_nextDeadlineNs;
+    bool m_isActive;
+
+    // Jitter statistics (Welford), lateness of each tick in microseconds
+    quint64 m_tickCount;
+    double m_jitterMean;
+    double m_jitterM2;
+    double m_jitterMax;
+    quint64 m_missedDeadlines;
+    qint64 m_lastStatisticsNs;
+};
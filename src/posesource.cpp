@@ -0,0 +1,60 @@
+#include "posesource.h"
+
+PoseSource::PoseSource(QObject *parent)
+    : QObject(parent)
+    , m_poses(0)
+    , m_cpuNs(0)
+    , m_latencyPoses(0)
+    , m_latencyNs(0)
+    , m_maxLatencyNs(0)
+{
+}
+
+PoseSource::Stats PoseSource::stats() const
+{
+    Stats stats;
+    stats.poses = m_poses;
+    if (m_poses > 0) {
+        stats.cpuUsPerPose = double(m_cpuNs) / double(m_poses) / 1000.0;
+    }
+    if (m_latencyPoses > 0) {
+        stats.meanLatencyMs = double(m_latencyNs) / double(m_latencyPoses) / 1e6;
+        stats.maxLatencyMs = double(m_maxLatencyNs) / 1e6;
+    }
+    return stats;
+}
+
+QString PoseSource::statsReport() const
+{
+    const Stats current = stats();
+    return QString("%1 poses, %2 us CPU per pose, latency %3 ms (max %4 ms)")
+        .arg(current.poses)
+        .arg(current.cpuUsPerPose, 0, 'f', 1)
+        .arg(current.meanLatencyMs, 0, 'f', 1)
+        .arg(current.maxLatencyMs, 0, 'f', 1);
+}
+
+void PoseSource::resetStats()
+{
+    m_poses = 0;
+    m_cpuNs = 0;
+    m_latencyPoses = 0;
+    m_latencyNs = 0;
+    m_maxLatencyNs = 0;
+}
+
+void PoseSource::addCpuTime(qint64 ns)
+{
+    m_cpuNs += ns;
+}
+
+void PoseSource::emitPose(double w, double x, double y, double z, qint64 latencyNs)
+{
+    ++m_poses;
+    if (latencyNs >= 0) {
+        ++m_latencyPoses;
+        m_latencyNs += latencyNs;
+        m_maxLatencyNs = qMax(m_maxLatencyNs, latencyNs);
+    }
+    emit rotationChanged(w, x, y, z);
+}
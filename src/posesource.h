@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+
+// Where the poses come from: the app's own fusion of the raw sensors
+// (RotationSensor) or the rotation vector fused by the OS or the sensor hub
+// (OrientationSensor). Both report the rotation relative to the orientation
+// at the last reset. Each source keeps what its poses cost on the GUI thread
+// and how old they are when they go out, so the two can be compared on a
+// given device.
+class PoseSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        quint64 poses = 0;
+        double cpuUsPerPose = 0.0;  // time in the source's handlers per pose
+        double meanLatencyMs = 0.0; // from the arrival of the newest reading used to the pose
+        double maxLatencyMs = 0.0;
+    };
+
+    explicit PoseSource(QObject *parent = nullptr);
+
+    // "fusion" or "hardware", as in the sensors/poseSource setting
+    virtual QString name() const = 0;
+    // Connects the sensor backends if needed
+    virtual bool isAvailable() = 0;
+
+    virtual void start() = 0;
+    virtual void stop() = 0;
+    virtual bool isActive() const = 0;
+    virtual void resetOrientation() = 0;
+
+    // Output rate while moving; 0 restores the default
+    virtual void setOutputRate(double hz) = 0;
+    virtual double outputRate() const = 0;
+
+    // Since the last start()
+    Stats stats() const;
+    QString statsReport() const;
+
+signals:
+    void rotationChanged(double w, double x, double y, double z);
+
+protected:
+    void resetStats();
+    void addCpuTime(qint64 ns);
+    // Emits rotationChanged; latencyNs < 0 when unknown (simulated data, or
+    // no new reading since the last pose)
+    void emitPose(double w, double x, double y, double z, qint64 latencyNs);
+
+private:
+    quint64 m_poses;
+    qint64 m_cpuNs;
+    quint64 m_latencyPoses;
+    qint64 m_latencyNs;
+    qint64 m_maxLatencyNs;
+};
@@ -1,4 +1,5 @@
 #include "rotationsensor.h"
+#include "metricsregistry.h"
 #include <QMagnetometer>
 #include <QMagnetometerReading>
 #include <QAccelerometer>
@@ -6,26 +7,74 @@
 #include <QGyroscope>
 #include <QGyroscopeReading>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QDebug>
 #include <cmath>
 #include <chrono>
 
 RotationSensor::RotationSensor(QObject *parent)
-    : QObject(parent)
+    : PoseSource(parent)
     , m_magnetometer(new QMagnetometer(this))
     , m_accelerometer(new QAccelerometer(this))
     , m_gyroscope(new QGyroscope(this))
     , m_timer(new QTimer(this))
     , m_isActive(false)
+    , m_backendsConnected(false)
+    , m_motionScheduler(new MotionScheduler(this))
     , m_initialW(1.0), m_initialX(0.0), m_initialY(0.0), m_initialZ(0.0)
     , m_hasInitialOrientation(false)
-    , m_beta(0.1) // Madgwick filter gain
-    , m_q0(1.0), m_q1(0.0), m_q2(0.0), m_q3(0.0) // Initial quaternion
+    , m_lastGyroTime(0.0)
+    , m_hasLastGyroTime(false)
+    , m_newestSensorTime(0.0)
+    , m_newestArrivalNs(0)
+    , m_autoTune(false)
+    , m_driftTargetDegPerMin(1.0)
+    , m_nextTuneSeconds(0.0)
+    , m_hasTunedParameters(false)
+    , m_pivotCalibrating(false)
+    , m_pivotSamplesSinceUpdate(0)
+    , m_rawOutput(false)
+    , m_fusionEnabled(true)
+    , m_sensorLog(nullptr)
 {
-    // Configure timer for regular readings (30 FPS)
-    m_timer->setInterval(33);
+    // Configure timer for regular readings (30 FPS while moving, see MotionScheduler)
+    m_timer->setInterval(m_motionScheduler->outputIntervalMs());
     connect(m_timer, &QTimer::timeout, this, &RotationSensor::performSensorFusion);
     
+    // Gyroscope readings wake the pipeline up as soon as motion starts,
+    // without waiting for the slow still-state timer
+    connect(m_gyroscope, &QGyroscope::readingChanged, this, &RotationSensor::onGyroscopeReadingChanged);
+    connect(m_accelerometer, &QAccelerometer::readingChanged, this, &RotationSensor::onAccelerometerReadingChanged);
+    connect(m_magnetometer, &QMagnetometer::readingChanged, this, &RotationSensor::onMagnetometerReadingChanged);
+    connect(m_motionScheduler, &MotionScheduler::activityChanged, this, &RotationSensor::onActivityChanged);
+    m_clock.start();
+    
+    // Backends are connected on the first start() to keep them off the startup path
+}
+
+RotationSensor::~RotationSensor()
+{
+    stop();
+}
+
+void RotationSensor::connectBackends()
+{
+    if (m_backendsConnected) {
+        return;
+    }
+    m_backendsConnected = true;
+    
+    // OPENIGTLINK_SENSOR_BACKEND picks a backend family by identifier prefix,
+    // e.g. "synthetic" for the synthetic IMU plugin
+    const QString backend = qEnvironmentVariable("OPENIGTLINK_SENSOR_BACKEND");
+    if (!backend.isEmpty()) {
+        qDebug() << "RotationSensor: Using" << backend << "sensor backends";
+        m_magnetometer->setIdentifier((backend + ".magnetometer").toUtf8());
+        m_accelerometer->setIdentifier((backend + ".accelerometer").toUtf8());
+        m_gyroscope->setIdentifier((backend + ".gyroscope").toUtf8());
+    }
+    
     // Check if sensors are available
     if (!m_magnetometer->connectToBackend()) {
         qWarning("Magnetometer is not available on this device");
@@ -38,15 +87,59 @@ RotationSensor::RotationSensor(QObject *parent)
     }
 }
 
-RotationSensor::~RotationSensor()
+void RotationSensor::openSensorLog()
 {
-    stop();
+    // Raw fusion input as CSV for offline analysis (see tools/igtlbatch)
+    const QString path = qEnvironmentVariable("OPENIGTLINK_SENSOR_LOG");
+    if (path.isEmpty() || m_sensorLog) {
+        return;
+    }
+    m_sensorLog = new QFile(path, this);
+    if (!m_sensorLog->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "RotationSensor: Cannot write sensor log" << path << m_sensorLog->errorString();
+        delete m_sensorLog;
+        m_sensorLog = nullptr;
+        return;
+    }
+    m_sensorLog->write("t,ax,ay,az,gx,gy,gz,mx,my,mz\n");
+    m_sensorLogClock.start();
+    qDebug() << "RotationSensor: Logging sensor input to" << path;
+}
+
+void RotationSensor::logSensorInput(const FusionInput &input)
+{
+    if (!m_sensorLog) {
+        return;
+    }
+    const QByteArray line = QByteArray::number(m_sensorLogClock.nsecsElapsed() / 1e9, 'f', 6) + ','
+        + QByteArray::number(input.accel[0], 'g', 9) + ',' + QByteArray::number(input.accel[1], 'g', 9) + ','
+        + QByteArray::number(input.accel[2], 'g', 9) + ',' + QByteArray::number(input.gyro[0], 'g', 9) + ','
+        + QByteArray::number(input.gyro[1], 'g', 9) + ',' + QByteArray::number(input.gyro[2], 'g', 9) + ','
+        + QByteArray::number(input.mag[0], 'g', 9) + ',' + QByteArray::number(input.mag[1], 'g', 9) + ','
+        + QByteArray::number(input.mag[2], 'g', 9) + '\n';
+    m_sensorLog->write(line);
+}
+
+QString RotationSensor::name() const
+{
+    return QStringLiteral("fusion");
+}
+
+bool RotationSensor::isAvailable()
+{
+    return true;
 }
 
 void RotationSensor::start()
 {
     qDebug() << "RotationSensor::start() called";
     
+    connectBackends();
+    openSensorLog();
+    if (!m_isActive) {
+        resetStats();
+    }
+    
     bool hasAnyBackend = m_magnetometer->isConnectedToBackend() || 
                         m_accelerometer->isConnectedToBackend() ||
                         m_gyroscope->isConnectedToBackend();
@@ -64,6 +157,15 @@ void RotationSensor::start()
     
     if (!m_isActive) {
         qDebug() << "RotationSensor: Starting real sensors and timer";
+        m_motionScheduler->reset();
+        m_aligner.reset();
+        m_aligner.setStreamEnabled(SensorAligner::Accel, m_accelerometer->isConnectedToBackend());
+        m_aligner.setStreamEnabled(SensorAligner::Mag, m_magnetometer->isConnectedToBackend());
+        m_hasLastGyroTime = false;
+        m_timer->setInterval(m_motionScheduler->outputIntervalMs());
+        m_magnetometer->setDataRate(m_motionScheduler->sensorDataRate());
+        m_accelerometer->setDataRate(m_motionScheduler->sensorDataRate());
+        m_gyroscope->setDataRate(m_motionScheduler->sensorDataRate());
         m_magnetometer->start();
         m_accelerometer->start();
         m_gyroscope->start();
@@ -82,15 +184,192 @@ void RotationSensor::stop()
         m_accelerometer->stop();
         m_gyroscope->stop();
         m_isActive = false;
+        qDebug().noquote() << "RotationSensor: Motion statistics\n" + m_motionScheduler->statsReport();
+        qDebug().noquote() << "RotationSensor: Poses -" << statsReport();
+        const SensorAligner::Stats &alignment = m_aligner.stats();
+        qDebug() << "RotationSensor: Aligned" << alignment.samples << "gyroscope samples - accelerometer"
+                 << alignment.interpolated[SensorAligner::Accel] << "interpolated,"
+                 << alignment.late[SensorAligner::Accel] << "late," << alignment.early[SensorAligner::Accel]
+                 << "early; magnetometer" << alignment.interpolated[SensorAligner::Mag] << "interpolated,"
+                 << alignment.late[SensorAligner::Mag] << "late," << alignment.early[SensorAligner::Mag]
+                 << "early;" << alignment.gyroDropped << "gyroscope samples dropped";
+    }
+}
+
+MotionScheduler *RotationSensor::motionScheduler() const
+{
+    return m_motionScheduler;
+}
+
+void RotationSensor::setOutputRate(double hz)
+{
+    int intervalMs = hz > 0.0 ? qMax(1, qRound(1000.0 / hz)) : 0;
+    qDebug() << "RotationSensor: Output rate" << hz << "Hz, interval" << intervalMs << "ms";
+    m_motionScheduler->setMovingIntervalMs(intervalMs);
+    m_timer->setInterval(m_motionScheduler->outputIntervalMs());
+}
+
+double RotationSensor::outputRate() const
+{
+    return 1000.0 / m_motionScheduler->outputIntervalMs();
+}
+
+void RotationSensor::addReadingTime(double time)
+{
+    if (time >= m_newestSensorTime) {
+        m_newestSensorTime = time;
+        m_newestArrivalNs = m_clock.nsecsElapsed();
+    }
+}
+
+void RotationSensor::onAccelerometerReadingChanged()
+{
+    QAccelerometerReading *reading = m_accelerometer->reading();
+    if (!m_isActive || !reading) {
+        return;
+    }
+    const qint64 startNs = m_clock.nsecsElapsed();
+    const double value[3] = {reading->x(), reading->y(), reading->z()};
+    const double time = reading->timestamp() / 1e6;
+    addReadingTime(time);
+    m_aligner.addReading(SensorAligner::Accel, time, value);
+    addCpuTime(m_clock.nsecsElapsed() - startNs);
+}
+
+void RotationSensor::onMagnetometerReadingChanged()
+{
+    QMagnetometerReading *reading = m_magnetometer->reading();
+    if (!m_isActive || !reading) {
+        return;
+    }
+    const qint64 startNs = m_clock.nsecsElapsed();
+    const double value[3] = {reading->x(), reading->y(), reading->z()};
+    const double time = reading->timestamp() / 1e6;
+    addReadingTime(time);
+    m_aligner.addReading(SensorAligner::Mag, time, value);
+    addCpuTime(m_clock.nsecsElapsed() - startNs);
+}
+
+void RotationSensor::onGyroscopeReadingChanged()
+{
+    QGyroscopeReading *reading = m_gyroscope->reading();
+    if (!m_isActive || !reading) {
+        return;
+    }
+    const qint64 startNs = m_clock.nsecsElapsed();
+    double gx = reading->x() * M_PI / 180.0;
+    double gy = reading->y() * M_PI / 180.0;
+    double gz = reading->z() * M_PI / 180.0;
+    const double rate[3] = {gx, gy, gz};
+    const double time = reading->timestamp() / 1e6;
+    addReadingTime(time);
+    m_aligner.addGyro(time, rate);
+    addCpuTime(m_clock.nsecsElapsed() - startNs);
+    
+    // The rest is only needed while still; when moving the fusion timer
+    // feeds the scheduler
+    if (m_motionScheduler->activity() != MotionScheduler::Still) {
+        return;
+    }
+    m_motionScheduler->addGyroMagnitude(sqrt(gx*gx + gy*gy + gz*gz));
+    
+    // Still readings characterize the gyroscope noise (unless this one just
+    // woke the pipeline up)
+    if (m_autoTune && m_motionScheduler->activity() == MotionScheduler::Still) {
+        m_noiseEstimator.addSample(rate, time);
+        if (m_noiseEstimator.stillSeconds() >= m_nextTuneSeconds) {
+            tuneFusion();
+        }
+    }
+}
+
+void RotationSensor::tuneFusion()
+{
+    // Retune with each doubling of the still time, as longer cluster times
+    // become available
+    m_nextTuneSeconds = qMax(30.0, 2.0 * m_noiseEstimator.stillSeconds());
+    
+    const NoiseEstimator::Estimate estimate = m_noiseEstimator.estimate();
+    FusionCore::Parameters parameters = m_hasTunedParameters ? m_tunedParameters : m_fusion.parameters();
+    const double fusionRateHz = 1000.0 / m_motionScheduler->movingIntervalMs();
+    if (!NoiseEstimator::tune(estimate, m_driftTargetDegPerMin, fusionRateHz, parameters)) {
+        return;
+    }
+    
+    qDebug() << "RotationSensor: Gyro noise after" << estimate.stillSeconds << "s still - ARW"
+             << estimate.angleRandomWalk * 180.0 / M_PI * 60.0 << "deg/sqrt(h), bias instability"
+             << estimate.biasInstability * 180.0 / M_PI * 3600.0 << "deg/h, bias"
+             << estimate.bias[0] * 180.0 / M_PI << estimate.bias[1] * 180.0 / M_PI
+             << estimate.bias[2] * 180.0 / M_PI << "deg/s, predicted drift"
+             << NoiseEstimator::predictedDriftDegPerMin(estimate) << "deg/min ->"
+             << FusionCore::algorithmName(parameters.algorithm) << "beta" << parameters.beta;
+    
+    const FusionCore::Parameters current = m_fusion.parameters();
+    if (parameters.algorithm != current.algorithm) {
+        m_tunedParameters = parameters;
+        m_hasTunedParameters = true;
+    } else {
+        m_fusion.setParameters(parameters);
+        m_hasTunedParameters = false;
+    }
+    emit fusionTuned();
+}
+
+void RotationSensor::onActivityChanged(MotionScheduler::Activity activity)
+{
+    // Noise series must be contiguous and taken at one rate
+    m_noiseEstimator.breakSeries();
+    
+    qDebug() << "RotationSensor: Switching to" << MotionScheduler::activityName(activity)
+             << "rates - output interval" << m_motionScheduler->outputIntervalMs() << "ms, sensor rate"
+             << m_motionScheduler->sensorDataRate() << "Hz";
+    
+    m_timer->setInterval(m_motionScheduler->outputIntervalMs());
+    
+    // Backends only pick up a new data rate when (re)started
+    if (m_isActive) {
+        const int rate = m_motionScheduler->sensorDataRate();
+        const QList<QSensor *> sensors = {m_magnetometer, m_accelerometer, m_gyroscope};
+        for (QSensor *sensor : sensors) {
+            if (sensor->isConnectedToBackend()) {
+                sensor->stop();
+                sensor->setDataRate(rate);
+                sensor->start();
+            }
+        }
+    }
+    
+    // Send a fresh pose right away when motion starts (queued, as this may be
+    // called from within performSensorFusion)
+    if (activity == MotionScheduler::Moving && m_isActive) {
+        m_timer->start();
+        QMetaObject::invokeMethod(this, &RotationSensor::performSensorFusion, Qt::QueuedConnection);
     }
 }
 
+void RotationSensor::emitRotation(double w, double x, double y, double z, qint64 latencyNs)
+{
+    m_motionScheduler->recordMessage();
+    emitPose(w, x, y, z, latencyNs);
+}
+
 bool RotationSensor::isActive() const
 {
     return m_isActive;
 }
 
 void RotationSensor::performSensorFusion()
+{
+    QElapsedTimer fusionTimer;
+    fusionTimer.start();
+    fuseSensors();
+    const qint64 elapsedNs = fusionTimer.nsecsElapsed();
+    addCpuTime(elapsedNs);
+    MetricsRegistry::add(MetricsRegistry::FusionSamples);
+    MetricsRegistry::add(MetricsRegistry::FusionTimeNs, quint64(elapsedNs));
+}
+
+void RotationSensor::fuseSensors()
 {
     bool hasMagnetometer = m_magnetometer->isConnectedToBackend();
     bool hasAccelerometer = m_accelerometer->isConnectedToBackend();
@@ -113,100 +392,89 @@ void RotationSensor::performSensorFusion()
         if (m_hasInitialOrientation) {
             double relativeW, relativeX, relativeY, relativeZ;
             double initialConjW, initialConjX, initialConjY, initialConjZ;
-            quaternionConjugate(m_initialW, m_initialX, m_initialY, m_initialZ, initialConjW, initialConjX, initialConjY, initialConjZ);
-            quaternionMultiply(w, x, y, z, initialConjW, initialConjX, initialConjY, initialConjZ, relativeW, relativeX, relativeY, relativeZ);
-            emit rotationChanged(relativeW, relativeX, relativeY, relativeZ);
+            FusionCore::quaternionConjugate(m_initialW, m_initialX, m_initialY, m_initialZ, initialConjW, initialConjX, initialConjY, initialConjZ);
+            FusionCore::quaternionMultiply(w, x, y, z, initialConjW, initialConjX, initialConjY, initialConjZ, relativeW, relativeX, relativeY, relativeZ);
+            emitRotation(relativeW, relativeX, relativeY, relativeZ, -1);
         } else {
             m_initialW = w; m_initialX = x; m_initialY = y; m_initialZ = z;
             m_hasInitialOrientation = true;
-            emit rotationChanged(1.0, 0.0, 0.0, 0.0); // Identity quaternion for initial
+            emitRotation(1.0, 0.0, 0.0, 0.0, -1); // Identity quaternion for initial
         }
         return;
     }
     
-    // Get raw sensor readings
-    double ax = 0.0, ay = 0.0, az = -1.0; // Accelerometer (gravity)
-    double mx = 1.0, my = 0.0, mz = 0.0;  // Magnetometer (magnetic north)
-    double gyrox = 0.0, gyroy = 0.0, gyroz = 0.0; // Gyroscope (angular velocity)
-    
-    // Get accelerometer data
-    if (hasAccelerometer && m_accelerometer->reading()) {
-        QAccelerometerReading *accelReading = m_accelerometer->reading();
-        ax = accelReading->x();
-        ay = accelReading->y();
-        az = accelReading->z();
-    }
-    
-    // Get magnetometer data
-    if (hasMagnetometer && m_magnetometer->reading()) {
-        QMagnetometerReading *magReading = m_magnetometer->reading();
-        mx = magReading->x();
-        my = magReading->y();
-        mz = magReading->z();
-    }
+    FusionInput input;
+    double dt = 0.0;
+    bool fused = false;
     
-    // Get gyroscope data (in rad/s)
-    // Try different coordinate mapping for better decoupling
-    if (hasGyroscope && m_gyroscope->reading()) {
-        QGyroscopeReading *gyroReading = m_gyroscope->reading();
-        
-        // Original mapping
-        double raw_gx = gyroReading->x() * M_PI / 180.0;
-        double raw_gy = gyroReading->y() * M_PI / 180.0;
-        double raw_gz = gyroReading->z() * M_PI / 180.0;
+    if (hasGyroscope) {
+        // Every gyroscope sample since the last tick, with the accelerometer
+        // and magnetometer interpolated to its timestamp. Samples still
+        // waiting for those are taken too if none was ready, so a slow
+        // sensor delays the pose by at most one tick.
+        const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+        const qint64 nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count();
+        double time;
+        for (int pass = 0; pass < 2 && !fused; ++pass) {
+            while (m_aligner.next(input, time, pass == 1)) {
+                dt = m_hasLastGyroTime ? time - m_lastGyroTime : 0.0;
+                m_lastGyroTime = time;
+                m_hasLastGyroTime = true;
+                fuseInput(input, dt, quint64(nowNs - qint64((m_newestSensorTime - time) * 1e9)));
+                fused = true;
+            }
+        }
+        countAlignment();
+    } else {
+        // Without a gyroscope the latest accelerometer and magnetometer
+        // readings are all there is
+        double ax = 0.0, ay = 0.0, az = 1.0;  // Accelerometer (up, lying flat)
+        double mx = 1.0, my = 0.0, mz = 0.0;  // Magnetometer (magnetic north)
+        if (hasAccelerometer && m_accelerometer->reading()) {
+            QAccelerometerReading *accelReading = m_accelerometer->reading();
+            ax = accelReading->x();
+            ay = accelReading->y();
+            az = accelReading->z();
+        }
+        if (hasMagnetometer && m_magnetometer->reading()) {
+            QMagnetometerReading *magReading = m_magnetometer->reading();
+            mx = magReading->x();
+            my = magReading->y();
+            mz = magReading->z();
+        }
         
-        // Try coordinate system remapping for better decoupling
-        // This might need adjustment based on your device orientation
-        gyrox = raw_gx;  // X-axis (roll) - seems to work
-        gyroy = raw_gy;  // Y-axis (pitch) 
-        gyroz = raw_gz;  // Z-axis (yaw)
+        static auto lastTime = std::chrono::steady_clock::now();
+        auto currentTime = std::chrono::steady_clock::now();
+        dt = std::chrono::duration<double>(currentTime - lastTime).count();
+        lastTime = currentTime;
         
-        qDebug() << "Raw gyro - X:" << gyroReading->x() << "Y:" << gyroReading->y() << "Z:" << gyroReading->z() << "deg/s";
-        qDebug() << "Mapped gyro - gx:" << gyrox*180.0/M_PI << "gy:" << gyroy*180.0/M_PI << "gz:" << gyroz*180.0/M_PI << "deg/s";
+        input.accel[0] = ax; input.accel[1] = ay; input.accel[2] = az;
+        input.mag[0] = mx; input.mag[1] = my; input.mag[2] = mz;
+        input.hasAccel = hasAccelerometer;
+        input.hasMag = hasMagnetometer;
+        const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+        fuseInput(input, dt, quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count()));
+        fused = true;
     }
     
-    // Simple approach: Use gyroscope if available, fallback to accel+mag
-    double w, x, y, z;
-    
-    // Calculate dt for gyroscope integration and debug output
-    static auto lastTime = std::chrono::steady_clock::now();
-    auto currentTime = std::chrono::steady_clock::now();
-    double dt = std::chrono::duration<double>(currentTime - lastTime).count();
-    lastTime = currentTime;
+    // Without new samples the last pose goes out again
+    if (!m_fusionEnabled || (!fused && !m_hasInitialOrientation)) {
+        return;
+    }
     
-    if (hasGyroscope) {
-        // Use gyroscope for primary tracking with simple integration
-        
-        if (dt > 0.001 && dt < 0.1 && (abs(gyrox) + abs(gyroy) + abs(gyroz)) > 1e-6) {
-            // Simple quaternion integration from gyroscope
-            double half_dt = dt * 0.5;
-            double dq0 = -m_q1 * gyrox * half_dt - m_q2 * gyroy * half_dt - m_q3 * gyroz * half_dt;
-            double dq1 = m_q0 * gyrox * half_dt + m_q2 * gyroz * half_dt - m_q3 * gyroy * half_dt;
-            double dq2 = m_q0 * gyroy * half_dt - m_q1 * gyroz * half_dt + m_q3 * gyrox * half_dt;
-            double dq3 = m_q0 * gyroz * half_dt + m_q1 * gyroy * half_dt - m_q2 * gyrox * half_dt;
-            
-            m_q0 += dq0;
-            m_q1 += dq1;
-            m_q2 += dq2;
-            m_q3 += dq3;
-            
-            // Normalize quaternion
-            double norm = sqrt(m_q0*m_q0 + m_q1*m_q1 + m_q2*m_q2 + m_q3*m_q3);
-            if (norm > 1e-6) {
-                m_q0 /= norm; m_q1 /= norm; m_q2 /= norm; m_q3 /= norm;
-            } else {
-                m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
-            }
+    // Age of the newest reading fused: how long ago the newest reading
+    // arrived, plus how far that one is ahead of the last gyroscope sample
+    qint64 latencyNs = -1;
+    if (fused) {
+        latencyNs = m_clock.nsecsElapsed() - m_newestArrivalNs;
+        if (hasGyroscope) {
+            latencyNs += qint64((m_newestSensorTime - m_lastGyroTime) * 1e9);
         }
-        
-        w = m_q0; x = m_q1; y = m_q2; z = m_q3;
-    } else {
-        // Fallback to accelerometer + magnetometer approach
-        normalizeVector(ax, ay, az);
-        normalizeVector(mx, my, mz);
-        quaternionFromTwoVectors(ax, ay, az, mx, my, mz, w, x, y, z);
     }
     
+    double w, x, y, z;
+    m_fusion.orientation(w, x, y, z);
+    
     // If we don't have an initial orientation, set it now
     if (!m_hasInitialOrientation) {
         m_initialW = w;
@@ -217,269 +485,156 @@ void RotationSensor::performSensorFusion()
         qDebug() << "RotationSensor: Set initial orientation - w=" << m_initialW << "x=" << m_initialX << "y=" << m_initialY << "z=" << m_initialZ;
         
         // Emit identity quaternion for initial orientation
-        emit rotationChanged(1.0, 0.0, 0.0, 0.0);
+        emitRotation(1.0, 0.0, 0.0, 0.0, latencyNs);
         return;
     }
     
     // Calculate relative rotation (current * inverse(initial))
     double relativeW, relativeX, relativeY, relativeZ;
     double initialConjW, initialConjX, initialConjY, initialConjZ;
-    quaternionConjugate(m_initialW, m_initialX, m_initialY, m_initialZ, initialConjW, initialConjX, initialConjY, initialConjZ);
-    quaternionMultiply(w, x, y, z, initialConjW, initialConjX, initialConjY, initialConjZ, relativeW, relativeX, relativeY, relativeZ);
+    FusionCore::quaternionConjugate(m_initialW, m_initialX, m_initialY, m_initialZ, initialConjW, initialConjX, initialConjY, initialConjZ);
+    FusionCore::quaternionMultiply(w, x, y, z, initialConjW, initialConjX, initialConjY, initialConjZ, relativeW, relativeX, relativeY, relativeZ);
     
-    qDebug() << "RotationSensor: Accel - ax=" << ax << "ay=" << ay << "az=" << az;
-    qDebug() << "RotationSensor: Mag - mx=" << mx << "my=" << my << "mz=" << mz;
-    qDebug() << "RotationSensor: Gyro - gx=" << gyrox*180.0/M_PI << "gy=" << gyroy*180.0/M_PI << "gz=" << gyroz*180.0/M_PI << "deg/s";
-    qDebug() << "RotationSensor: dt=" << dt << "s";
+    if (fused) {
+        qDebug() << "RotationSensor: Accel - ax=" << input.accel[0] << "ay=" << input.accel[1] << "az=" << input.accel[2];
+        qDebug() << "RotationSensor: Mag - mx=" << input.mag[0] << "my=" << input.mag[1] << "mz=" << input.mag[2];
+        qDebug() << "RotationSensor: Gyro - gx=" << input.gyro[0]*180.0/M_PI << "gy=" << input.gyro[1]*180.0/M_PI << "gz=" << input.gyro[2]*180.0/M_PI << "deg/s";
+        qDebug() << "RotationSensor: dt=" << dt << "s";
+    }
     qDebug() << "RotationSensor (absolute): w=" << w << "x=" << x << "y=" << y << "z=" << z;
     qDebug() << "RotationSensor (relative): w=" << relativeW << "x=" << relativeX << "y=" << relativeY << "z=" << relativeZ;
-    emit rotationChanged(relativeW, relativeX, relativeY, relativeZ);
-}
-
-void RotationSensor::resetOrientation()
-{
-    qDebug() << "RotationSensor::resetOrientation() called";
-    m_hasInitialOrientation = false;
-    // The next reading will set the new initial orientation
+    emitRotation(relativeW, relativeX, relativeY, relativeZ, latencyNs);
 }
 
-void RotationSensor::quaternionFromTwoVectors(double gx, double gy, double gz, double mx, double my, double mz, double &w, double &x, double &y, double &z)
+void RotationSensor::fuseInput(const FusionInput &input, double dt, quint64 timeNs)
 {
-    // Create orthonormal basis from gravity and magnetic vectors (right-handed)
-    // Z-axis: opposite of gravity (up)
-    double zx = -gx, zy = -gy, zz = -gz;
-    
-    // X-axis: cross product of magnetic field and Z (east)
-    double xx, xy, xz;
-    vectorCross(mx, my, mz, zx, zy, zz, xx, xy, xz);
-    normalizeVector(xx, xy, xz);
-    
-    // Y-axis: cross product of Z and X (north)
-    double yx, yy, yz;
-    vectorCross(zx, zy, zz, xx, xy, xz, yx, yy, yz);
-    normalizeVector(yx, yy, yz);
-    
-    // Convert rotation matrix to quaternion (right-handed coordinate system)
-    // Rotation matrix:
-    // [xx, yx, zx]  (X=east, Y=north, Z=up)
-    // [xy, yy, zy]
-    // [xz, yz, zz]
+    if (input.hasGyro) {
+        m_motionScheduler->addGyroMagnitude(sqrt(input.gyro[0]*input.gyro[0] + input.gyro[1]*input.gyro[1] + input.gyro[2]*input.gyro[2]));
+    }
     
-    double trace = xx + yy + zz;
+    logSensorInput(input);
+    if (m_rawOutput) {
+        emit sensorSample(input, timeNs);
+    }
+    if (!m_fusionEnabled) {
+        return;
+    }
+    m_fusion.update(input, dt);
     
-    if (trace > 0.0) {
-        double s = sqrt(trace + 1.0) * 2.0; // s = 4 * qw
-        w = 0.25 * s;
-        x = (yz - zy) / s;
-        y = (zx - xz) / s;
-        z = (xy - yx) / s;
-    } else if ((xx > yy) && (xx > zz)) {
-        double s = sqrt(1.0 + xx - yy - zz) * 2.0; // s = 4 * qx
-        w = (yz - zy) / s;
-        x = 0.25 * s;
-        y = (yx + xy) / s;
-        z = (zx + xz) / s;
-    } else if (yy > zz) {
-        double s = sqrt(1.0 + yy - xx - zz) * 2.0; // s = 4 * qy
-        w = (zx - xz) / s;
-        x = (yx + xy) / s;
-        y = 0.25 * s;
-        z = (zy + yz) / s;
-    } else {
-        double s = sqrt(1.0 + zz - xx - yy) * 2.0; // s = 4 * qz
-        w = (xy - yx) / s;
-        x = (zx + xz) / s;
-        y = (zy + yz) / s;
-        z = 0.25 * s;
+    if (m_pivotCalibrating && input.hasAccel && input.hasGyro) {
+        double q[4];
+        m_fusion.orientation(q[0], q[1], q[2], q[3]);
+        m_pivot.addSample(q, input.gyro, input.accel, dt);
+        if (++m_pivotSamplesSinceUpdate >= 10) {
+            m_pivotSamplesSinceUpdate = 0;
+            emit pivotCalibrationUpdated();
+        }
     }
 }
 
-void RotationSensor::normalizeVector(double &x, double &y, double &z)
+void RotationSensor::countAlignment()
 {
-    double length = sqrt(x*x + y*y + z*z);
-    if (length > 0.0) {
-        x /= length;
-        y /= length;
-        z /= length;
+    // Late and early readings of both streams, as metrics
+    const SensorAligner::Stats &stats = m_aligner.stats();
+    quint64 late = 0;
+    quint64 early = 0;
+    for (int stream = 0; stream < SensorAligner::StreamCount; ++stream) {
+        late += stats.late[stream] - m_countedAlignment.late[stream];
+        early += stats.early[stream] - m_countedAlignment.early[stream];
+    }
+    if (late > 0) {
+        MetricsRegistry::add(MetricsRegistry::SensorReadingsLate, late);
     }
+    if (early > 0) {
+        MetricsRegistry::add(MetricsRegistry::SensorReadingsEarly, early);
+    }
+    m_countedAlignment = stats;
 }
 
-double RotationSensor::vectorDot(double x1, double y1, double z1, double x2, double y2, double z2)
+void RotationSensor::startPivotCalibration()
 {
-    return x1*x2 + y1*y2 + z1*z2;
+    qDebug() << "RotationSensor: Pivot calibration started";
+    m_pivot.reset();
+    m_pivotCalibrating = true;
+    m_pivotSamplesSinceUpdate = 0;
+    emit pivotCalibrationUpdated();
 }
 
-void RotationSensor::vectorCross(double x1, double y1, double z1, double x2, double y2, double z2, double &x, double &y, double &z)
+void RotationSensor::stopPivotCalibration()
 {
-    x = y1*z2 - z1*y2;
-    y = z1*x2 - x1*z2;
-    z = x1*y2 - y1*x2;
+    if (m_pivotCalibrating) {
+        m_pivotCalibrating = false;
+        emit pivotCalibrationUpdated();
+    }
 }
 
-void RotationSensor::quaternionMultiply(double q1w, double q1x, double q1y, double q1z, 
-                                       double q2w, double q2x, double q2y, double q2z, 
-                                       double &qw, double &qx, double &qy, double &qz)
+bool RotationSensor::isPivotCalibrating() const
 {
-    qw = q1w * q2w - q1x * q2x - q1y * q2y - q1z * q2z;
-    qx = q1w * q2x + q1x * q2w + q1y * q2z - q1z * q2y;
-    qy = q1w * q2y - q1x * q2z + q1y * q2w + q1z * q2x;
-    qz = q1w * q2z + q1x * q2y - q1y * q2x + q1z * q2w;
+    return m_pivotCalibrating;
 }
 
-void RotationSensor::quaternionConjugate(double qw, double qx, double qy, double qz, 
-                                         double &conjW, double &conjX, double &conjY, double &conjZ)
+PivotCalibration::Result RotationSensor::pivotResult() const
 {
-    conjW = qw;
-    conjX = -qx;
-    conjY = -qy;
-    conjZ = -qz;
+    return m_pivot.result();
 }
 
-void RotationSensor::madgwickUpdate(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, double dt)
+void RotationSensor::setRawOutput(bool enabled)
 {
-    // Safety checks for NaN prevention
-    if (!std::isfinite(gx) || !std::isfinite(gy) || !std::isfinite(gz) ||
-        !std::isfinite(ax) || !std::isfinite(ay) || !std::isfinite(az) ||
-        !std::isfinite(mx) || !std::isfinite(my) || !std::isfinite(mz) ||
-        !std::isfinite(dt) || dt <= 0.0) {
-        qDebug() << "Madgwick: Invalid input data, skipping update";
-        return;
-    }
-    
-    // Check if accelerometer data is valid (not zero vector)
-    double accel_norm = sqrt(ax * ax + ay * ay + az * az);
-    if (accel_norm < 1e-6) {
-        qDebug() << "Madgwick: Invalid accelerometer data, skipping update";
+    m_rawOutput = enabled;
+}
+
+void RotationSensor::setFusionEnabled(bool enabled)
+{
+    if (m_fusionEnabled == enabled) {
         return;
     }
-    
-    double recipNorm;
-    double s0, s1, s2, s3;
-    double qDot1, qDot2, qDot3, qDot4;
-    double hx, hy;
-    double _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
-    double q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
-
-    // Use IMU algorithm if magnetometer measurement is invalid (avoids NaN in magnetometer normalisation)
-    if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-        // IMU algorithm without magnetometer
-        recipNorm = 1.0 / sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
-
-        // Gradient decent algorithm corrective step
-        s0 = -2.0 * (2.0 * m_q1 * m_q3 - 2.0 * m_q0 * m_q2 - ax);
-        s1 = -2.0 * (2.0 * m_q0 * m_q1 + 2.0 * m_q2 * m_q3 - ay);
-        s2 = -2.0 * (1.0 - 2.0 * m_q1 * m_q1 - 2.0 * m_q2 * m_q2 - az);
-        s3 = -4.0 * m_q3 * (1.0 - 2.0 * m_q2 * m_q2 - 2.0 * m_q3 * m_q3 - az) + (-4.0) * m_q1 * (2.0 * m_q1 * m_q3 - 2.0 * m_q0 * m_q2 - ax);
-
-        double s_norm = sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
-        if (s_norm < 1e-12) {
-            qDebug() << "Madgwick: Invalid s vector norm, skipping feedback";
-            qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz);
-            qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy);
-            qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx);
-            qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx);
-        } else {
-            recipNorm = 1.0 / s_norm;
-            s0 *= recipNorm;
-            s1 *= recipNorm;
-            s2 *= recipNorm;
-            s3 *= recipNorm;
-        }
+    qDebug() << "RotationSensor: Fusion" << (enabled ? "enabled" : "disabled");
+    m_fusionEnabled = enabled;
+}
 
-        // Apply feedback step
-        qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz) - m_beta * s0;
-        qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy) - m_beta * s1;
-        qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx) - m_beta * s2;
-        qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx) - m_beta * s3;
-    } else {
-        // Full Madgwick algorithm with magnetometer
-        
-        // Normalise accelerometer measurement
-        recipNorm = 1.0 / sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
-
-        // Normalise magnetometer measurement
-        recipNorm = 1.0 / sqrt(mx * mx + my * my + mz * mz);
-        mx *= recipNorm;
-        my *= recipNorm;
-        mz *= recipNorm;
-
-        // Auxiliary variables to avoid repeated arithmetic
-        _2q0mx = 2.0 * m_q0 * mx;
-        _2q0my = 2.0 * m_q0 * my;
-        _2q0mz = 2.0 * m_q0 * mz;
-        _2q1mx = 2.0 * m_q1 * mx;
-        _2q0 = 2.0 * m_q0;
-        _2q1 = 2.0 * m_q1;
-        _2q2 = 2.0 * m_q2;
-        _2q3 = 2.0 * m_q3;
-        _2q0q2 = 2.0 * m_q0 * m_q2;
-        _2q2q3 = 2.0 * m_q2 * m_q3;
-        q0q0 = m_q0 * m_q0;
-        q0q1 = m_q0 * m_q1;
-        q0q2 = m_q0 * m_q2;
-        q0q3 = m_q0 * m_q3;
-        q1q1 = m_q1 * m_q1;
-        q1q2 = m_q1 * m_q2;
-        q1q3 = m_q1 * m_q3;
-        q2q2 = m_q2 * m_q2;
-        q2q3 = m_q2 * m_q3;
-        q3q3 = m_q3 * m_q3;
-
-        // Reference direction of Earth's magnetic field
-        hx = mx * q0q0 - _2q0my * m_q3 + _2q0mz * m_q2 + mx * q1q1 + _2q1 * my * m_q2 + _2q1 * mz * m_q3 - mx * q2q2 - mx * q3q3;
-        hy = _2q0mx * m_q3 + my * q0q0 - _2q0mz * m_q1 + _2q1mx * m_q2 - my * q1q1 + my * q2q2 + _2q2 * mz * m_q3 - my * q3q3;
-        _2bx = sqrt(hx * hx + hy * hy);
-        _2bz = -_2q0mx * m_q2 + _2q0my * m_q1 + mz * q0q0 + _2q1mx * m_q3 - mz * q1q1 + _2q2 * my * m_q3 - mz * q2q2 + mz * q3q3;
-        _4bx = 2.0 * _2bx;
-        _4bz = 2.0 * _2bz;
-
-        // Gradient descent algorithm corrective step
-        s0 = -_2q2 * (2.0 * q1q3 - _2q0q2 - ax) + _2q1 * (2.0 * q0q1 + _2q2q3 - ay) - _2bz * m_q2 * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * m_q3 + _2bz * m_q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * m_q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
-        s1 = _2q3 * (2.0 * q1q3 - _2q0q2 - ax) + _2q0 * (2.0 * q0q1 + _2q2q3 - ay) - 4.0 * m_q1 * (1.0 - 2.0 * q1q1 - 2.0 * q2q2 - az) + _2bz * m_q3 * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * m_q2 + _2bz * m_q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * m_q3 - _4bz * m_q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
-        s2 = -_2q0 * (2.0 * q1q3 - _2q0q2 - ax) + _2q3 * (2.0 * q0q1 + _2q2q3 - ay) - 4.0 * m_q2 * (1.0 - 2.0 * q1q1 - 2.0 * q2q2 - az) + (-_4bx * m_q2 - _2bz * m_q0) * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * m_q1 + _2bz * m_q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * m_q0 - _4bz * m_q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
-        s3 = _2q1 * (2.0 * q1q3 - _2q0q2 - ax) + _2q2 * (2.0 * q0q1 + _2q2q3 - ay) + (-_4bx * m_q3 + _2bz * m_q1) * (_2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * m_q0 + _2bz * m_q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * m_q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz);
-        
-        recipNorm = 1.0 / sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); 
-        s0 *= recipNorm;
-        s1 *= recipNorm;
-        s2 *= recipNorm;
-        s3 *= recipNorm;
-
-        // Apply feedback step
-        qDot1 = 0.5 * (-m_q1 * gx - m_q2 * gy - m_q3 * gz) - m_beta * s0;
-        qDot2 = 0.5 * (m_q0 * gx + m_q2 * gz - m_q3 * gy) - m_beta * s1;
-        qDot3 = 0.5 * (m_q0 * gy - m_q1 * gz + m_q3 * gx) - m_beta * s2;
-        qDot4 = 0.5 * (m_q0 * gz + m_q1 * gy - m_q2 * gx) - m_beta * s3;
-    }
-
-    // Integrate rate of change of quaternion to yield quaternion
-    m_q0 += qDot1 * dt;
-    m_q1 += qDot2 * dt;
-    m_q2 += qDot3 * dt;
-    m_q3 += qDot4 * dt;
-
-    // Normalise quaternion
-    double q_norm = sqrt(m_q0 * m_q0 + m_q1 * m_q1 + m_q2 * m_q2 + m_q3 * m_q3);
-    if (q_norm < 1e-12) {
-        qDebug() << "Madgwick: Quaternion norm too small, resetting to identity";
-        m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
-    } else {
-        recipNorm = 1.0 / q_norm;
-        m_q0 *= recipNorm;
-        m_q1 *= recipNorm;
-        m_q2 *= recipNorm;
-        m_q3 *= recipNorm;
-    }
+void RotationSensor::setAlignmentMaxWait(double ms)
+{
+    m_aligner.setMaxWait(ms / 1000.0);
+}
+
+SensorAligner::Stats RotationSensor::alignmentStats() const
+{
+    return m_aligner.stats();
+}
+
+void RotationSensor::resetOrientation()
+{
+    qDebug() << "RotationSensor::resetOrientation() called";
+    m_hasInitialOrientation = false;
+    // The next reading will set the new initial orientation
     
-    // Final validation
-    if (!std::isfinite(m_q0) || !std::isfinite(m_q1) || !std::isfinite(m_q2) || !std::isfinite(m_q3)) {
-        qDebug() << "Madgwick: NaN detected in quaternion, resetting to identity";
-        m_q0 = 1.0; m_q1 = 0.0; m_q2 = 0.0; m_q3 = 0.0;
+    if (m_hasTunedParameters) {
+        m_fusion.setParameters(m_tunedParameters);
+        m_hasTunedParameters = false;
+        qDebug() << "RotationSensor: Switched fusion to" << FusionCore::algorithmName(m_tunedParameters.algorithm);
     }
-}
\ No newline at end of file
+}
+
+FusionCore::Parameters RotationSensor::fusionParameters() const
+{
+    return m_hasTunedParameters ? m_tunedParameters : m_fusion.parameters();
+}
+
+void RotationSensor::setFusionParameters(const FusionCore::Parameters &parameters)
+{
+    m_fusion.setParameters(parameters);
+    m_hasTunedParameters = false;
+}
+
+void RotationSensor::setAutoTune(bool enabled, double driftTargetDegPerMin)
+{
+    m_autoTune = enabled;
+    m_driftTargetDegPerMin = driftTargetDegPerMin;
+    m_noiseEstimator.reset();
+    m_nextTuneSeconds = 0.0;
+}
+
+NoiseEstimator::Estimate RotationSensor::noiseEstimate() const
+{
+    return m_noiseEstimator.estimate();
+}
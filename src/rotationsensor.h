@@ -1,7 +1,13 @@
 #pragma once
 
-#include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
+#include "fusioncore.h"
+#include "motionscheduler.h"
+#include "noiseestimator.h"
+#include "pivotcalibration.h"
+#include "posesource.h"
+#include "sensoraligner.h"
 
 class QMagnetometer;
 class QMagnetometerReading;
@@ -9,8 +15,10 @@ class QAccelerometer;
 class QAccelerometerReading;
 class QGyroscope;
 class QGyroscopeReading;
+class QFile;
 
-class RotationSensor : public QObject
+// The app's own fusion of accelerometer, gyroscope and magnetometer
+class RotationSensor : public PoseSource
 {
     Q_OBJECT
 
@@ -18,17 +26,60 @@ public:
     explicit RotationSensor(QObject *parent = nullptr);
     ~RotationSensor();
 
-    void start();
-    void stop();
-    bool isActive() const;
+    QString name() const override;
+    // Always; without sensors it produces simulated data
+    bool isAvailable() override;
+
+    void start() override;
+    void stop() override;
+    bool isActive() const override;
+    
+    void resetOrientation() override;
+    
+    MotionScheduler *motionScheduler() const;
+    
+    void setOutputRate(double hz) override;
+    double outputRate() const override;
+    
+    FusionCore::Parameters fusionParameters() const;
+    void setFusionParameters(const FusionCore::Parameters &parameters);
+    
+    // Characterizes the gyroscope while the device is still and retunes the
+    // fusion to meet driftTargetDegPerMin (see NoiseEstimator::tune)
+    void setAutoTune(bool enabled, double driftTargetDegPerMin);
+    NoiseEstimator::Estimate noiseEstimate() const;
+    
+    // Pivot calibration (see PivotCalibration): fed from the fusion loop
+    // while the device is pivoted about its tip
+    void startPivotCalibration();
+    void stopPivotCalibration();
+    bool isPivotCalibrating() const;
+    PivotCalibration::Result pivotResult() const;
     
-    void resetOrientation();
+    // Raw output: every set of readings the fusion sees is also emitted as
+    // sensorSample. With fusion disabled only the raw readings go out (the
+    // server fuses them) and rotationChanged stays quiet.
+    void setRawOutput(bool enabled);
+    void setFusionEnabled(bool enabled);
+    
+    // How long a gyroscope sample may wait for the accelerometer and
+    // magnetometer readings around it (see SensorAligner)
+    void setAlignmentMaxWait(double ms);
+    SensorAligner::Stats alignmentStats() const;
 
 signals:
-    void rotationChanged(double w, double x, double y, double z);
+    void fusionTuned();
+    // A few times per second while calibrating
+    void pivotCalibrationUpdated();
+    // timeNs: Unix time of the readings
+    void sensorSample(const FusionInput &input, quint64 timeNs);
 
 private slots:
     void performSensorFusion();
+    void onGyroscopeReadingChanged();
+    void onAccelerometerReadingChanged();
+    void onMagnetometerReadingChanged();
+    void onActivityChanged(MotionScheduler::Activity activity);
 
 private:
     QMagnetometer *m_magnetometer;
@@ -36,21 +87,55 @@ private:
     QGyroscope *m_gyroscope;
     QTimer *m_timer;
     bool m_isActive;
+    bool m_backendsConnected;
+    MotionScheduler *m_motionScheduler;
+    
+    void connectBackends();
+    void fuseSensors();
+    void fuseInput(const FusionInput &input, double dt, quint64 timeNs);
+    void countAlignment();
+    void emitRotation(double w, double x, double y, double z, qint64 latencyNs);
+    void addReadingTime(double time);
+    void openSensorLog();
+    void logSensorInput(const FusionInput &input);
+    void tuneFusion();
     
     // Initial orientation for relative calculations
     double m_initialW, m_initialX, m_initialY, m_initialZ;
     bool m_hasInitialOrientation;
     
-    // Sensor fusion helpers
-    void quaternionFromTwoVectors(double gx, double gy, double gz, double mx, double my, double mz, double &w, double &x, double &y, double &z);
-    void normalizeVector(double &x, double &y, double &z);
-    double vectorDot(double x1, double y1, double z1, double x2, double y2, double z2);
-    void vectorCross(double x1, double y1, double z1, double x2, double y2, double z2, double &x, double &y, double &z);
-    
-    // Madgwick filter for IMU fusion
-    void madgwickUpdate(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, double dt);
-    double m_beta; // Madgwick filter gain
-    double m_q0, m_q1, m_q2, m_q3; // Madgwick quaternion state
-    void quaternionMultiply(double q1w, double q1x, double q1y, double q1z, double q2w, double q2x, double q2y, double q2z, double &qw, double &qx, double &qy, double &qz);
-    void quaternionConjugate(double qw, double qx, double qy, double qz, double &conjW, double &conjX, double &conjY, double &conjZ);
+    // Orientation fusion, shared with the offline tools
+    FusionCore m_fusion;
+    
+    // Readings by sensor timestamp, fused once per gyroscope sample. The
+    // newest timestamp seen, and when it arrived, map sensor time to
+    // wall-clock time and pose latency.
+    SensorAligner m_aligner;
+    SensorAligner::Stats m_countedAlignment;
+    double m_lastGyroTime;
+    bool m_hasLastGyroTime;
+    double m_newestSensorTime;
+    qint64 m_newestArrivalNs;
+    QElapsedTimer m_clock;
+    
+    // Gyroscope noise from still periods, and the parameters derived from it.
+    // A new algorithm waits for the next orientation reset, as the algorithms
+    // do not share a world frame.
+    NoiseEstimator m_noiseEstimator;
+    bool m_autoTune;
+    double m_driftTargetDegPerMin;
+    double m_nextTuneSeconds;
+    FusionCore::Parameters m_tunedParameters;
+    bool m_hasTunedParameters;
+    
+    PivotCalibration m_pivot;
+    bool m_pivotCalibrating;
+    int m_pivotSamplesSinceUpdate;
+    
+    bool m_rawOutput;
+    bool m_fusionEnabled;
+    
+    // Optional raw input log (OPENIGTLINK_SENSOR_LOG)
+    QFile *m_sensorLog;
+    QElapsedTimer m_sensorLogClock;
 };
\ No newline at end of file
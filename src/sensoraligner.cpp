@@ -0,0 +1,153 @@
+#include "sensoraligner.h"
+#include <cstring>
+
+bool SensorAligner::Ring::push(double time, const double value[3])
+{
+    bool overwritten = false;
+    if (count == kCapacity) {
+        popFront();
+        overwritten = true;
+    }
+    Reading &reading = readings[(first + count) % kCapacity];
+    reading.time = time;
+    std::memcpy(reading.value, value, sizeof(reading.value));
+    ++count;
+    return !overwritten;
+}
+
+void SensorAligner::Ring::popFront()
+{
+    first = (first + 1) % kCapacity;
+    --count;
+}
+
+SensorAligner::SensorAligner(double maxWait)
+    : m_maxWait(maxWait)
+{
+    for (int stream = 0; stream < StreamCount; ++stream) {
+        m_enabled[stream] = true;
+    }
+}
+
+void SensorAligner::reset()
+{
+    m_gyro.count = 0;
+    for (int stream = 0; stream < StreamCount; ++stream) {
+        m_streams[stream].count = 0;
+    }
+}
+
+void SensorAligner::setMaxWait(double seconds)
+{
+    m_maxWait = seconds > 0.0 ? seconds : 0.0;
+}
+
+double SensorAligner::maxWait() const
+{
+    return m_maxWait;
+}
+
+void SensorAligner::setStreamEnabled(Stream stream, bool enabled)
+{
+    m_enabled[stream] = enabled;
+    if (!enabled) {
+        m_streams[stream].count = 0;
+    }
+}
+
+void SensorAligner::addGyro(double time, const double rate[3])
+{
+    if (m_gyro.count > 0 && time <= m_gyro.newest().time) {
+        return;
+    }
+    if (!m_gyro.push(time, rate)) {
+        ++m_stats.gyroDropped;
+    }
+}
+
+void SensorAligner::addReading(Stream stream, double time, const double value[3])
+{
+    Ring &ring = m_streams[stream];
+    if (!m_enabled[stream]) {
+        return;
+    }
+    if (ring.count > 0 && time <= ring.newest().time) {
+        ++m_stats.outOfOrder[stream];
+        return;
+    }
+    ring.push(time, value);
+}
+
+bool SensorAligner::next(FusionInput &input, double &time, bool flush)
+{
+    if (m_gyro.count == 0) {
+        return false;
+    }
+    const Reading &gyro = m_gyro.at(0);
+
+    if (!flush && m_gyro.newest().time - gyro.time < m_maxWait) {
+        for (int stream = 0; stream < StreamCount; ++stream) {
+            const Ring &ring = m_streams[stream];
+            if (m_enabled[stream] && (ring.count == 0 || ring.newest().time < gyro.time)) {
+                return false;
+            }
+        }
+    }
+
+    time = gyro.time;
+    std::memcpy(input.gyro, gyro.value, sizeof(input.gyro));
+    input.hasGyro = true;
+    input.hasAccel = align(Accel, time, input.accel);
+    input.hasMag = align(Mag, time, input.mag);
+    m_gyro.popFront();
+    ++m_stats.samples;
+    return true;
+}
+
+bool SensorAligner::align(Stream stream, double time, double value[3])
+{
+    Ring &ring = m_streams[stream];
+    if (!m_enabled[stream] || ring.count == 0) {
+        return false;
+    }
+
+    // Readings before the one preceding this sample are no longer needed, as
+    // gyroscope samples come in time order
+    while (ring.count > 1 && ring.at(1).time <= time) {
+        ring.popFront();
+    }
+
+    const Reading &before = ring.at(0);
+    if (before.time > time) {
+        ++m_stats.early[stream];
+        std::memcpy(value, before.value, sizeof(before.value));
+        return true;
+    }
+    if (ring.count == 1) {
+        if (before.time == time) {
+            ++m_stats.interpolated[stream];
+        } else {
+            ++m_stats.late[stream];
+        }
+        std::memcpy(value, before.value, sizeof(before.value));
+        return true;
+    }
+
+    const Reading &after = ring.at(1);
+    const double weight = (time - before.time) / (after.time - before.time);
+    for (int i = 0; i < 3; ++i) {
+        value[i] = before.value[i] + weight * (after.value[i] - before.value[i]);
+    }
+    ++m_stats.interpolated[stream];
+    return true;
+}
+
+int SensorAligner::pending() const
+{
+    return m_gyro.count;
+}
+
+const SensorAligner::Stats &SensorAligner::stats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "fusioncore.h"
+
+// Time alignment of the accelerometer and magnetometer to the gyroscope. The
+// sensors report at their own rates, so their latest readings can be tens of
+// milliseconds apart. Every reading goes into a small ring buffer per sensor
+// with its timestamp, and each gyroscope sample gets the other two
+// interpolated to its time. A gyroscope sample waits until both streams have
+// a reading at or after it, for at most maxWait. Plain C++ (no Qt).
+class SensorAligner
+{
+public:
+    enum Stream {
+        Accel,
+        Mag,
+        StreamCount
+    };
+
+    // Per sensor; 0.3 s at 200 Hz
+    static const int kCapacity = 64;
+
+    struct Stats {
+        unsigned long long samples = 0;     // aligned sets handed out
+        unsigned long long gyroDropped = 0; // overwritten before they were handed out
+        // Per stream: readings on both sides of the gyroscope sample
+        unsigned long long interpolated[StreamCount] = {};
+        // No reading at or after the sample yet, the newest one was held
+        unsigned long long late[StreamCount] = {};
+        // Only readings after the sample (start or overrun), the oldest one was held
+        unsigned long long early[StreamCount] = {};
+        // Readings not newer than the previous one, discarded
+        unsigned long long outOfOrder[StreamCount] = {};
+    };
+
+    explicit SensorAligner(double maxWait = 0.02);
+
+    // Empties the buffers; the stats are kept
+    void reset();
+
+    void setMaxWait(double seconds);
+    double maxWait() const;
+
+    // A stream without a sensor is not waited for and its input is left out
+    void setStreamEnabled(Stream stream, bool enabled);
+
+    // Times in seconds, on one clock for all sensors
+    void addGyro(double time, const double rate[3]);
+    void addReading(Stream stream, double time, const double value[3]);
+
+    // Hands out the next gyroscope sample, in time order, with the other
+    // streams aligned to it. Samples still waiting for the other streams are
+    // handed out too when flush is set.
+    bool next(FusionInput &input, double &time, bool flush = false);
+
+    int pending() const;
+    const Stats &stats() const;
+
+private:
+    struct Reading {
+        double time;
+        double value[3];
+    };
+
+    struct Ring {
+        Reading readings[kCapacity];
+        int first = 0;
+        int count = 0;
+
+        const Reading &at(int index) const { return readings[(first + index) % kCapacity]; }
+        const Reading &newest() const { return at(count - 1); }
+        // False if a reading was overwritten to make room
+        bool push(double time, const double value[3]);
+        void popFront();
+    };
+
+    // Value of the stream at time, counted in the stats; false if it has no
+    // readings
+    bool align(Stream stream, double time, double value[3]);
+
+    double m_maxWait;
+    Ring m_gyro;
+    Ring m_streams[StreamCount];
+    bool m_enabled[StreamCount];
+    Stats m_stats;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+// On-disk layout of recorded sessions, shared by SessionRecorder (app) and
+// the igtlreplay tool. Plain C++ so tools do not need Qt.
+//
+// <name>.igtls  FileHeader, then records back to back:
+//               RecordHeader + `size` bytes exactly as written to the socket
+//               (one or more packed OpenIGTLink messages). The file is
+//               preallocated in chunks, so a record with size 0 marks the end
+//               of data when a session was not closed cleanly.
+// <name>.idx    IndexHeader, then one IndexEntry per index interval pointing
+//               at the first record at or after that time.
+//
+// All integers are little-endian; timestamps are nanoseconds since the Unix
+// epoch.
+
+#include <cstdint>
+#include <cstring>
+
+namespace SessionFormat {
+
+const char kSessionMagic[8] = {'I', 'G', 'T', 'L', 'S', 'E', 'S', '1'};
+const char kIndexMagic[8] = {'I', 'G', 'T', 'L', 'I', 'D', 'X', '1'};
+const uint32_t kVersion = 1;
+
+const char kSessionSuffix[] = ".igtls";
+const char kIndexSuffix[] = ".idx";
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t startTimeNs;
+};
+
+struct RecordHeader {
+    uint64_t timestampNs;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t intervalMs;
+};
+
+struct IndexEntry {
+    uint64_t timestampNs;
+    uint64_t offset;
+};
+
+static_assert(sizeof(FileHeader) == 24, "FileHeader layout");
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader layout");
+static_assert(sizeof(IndexHeader) == 16, "IndexHeader layout");
+static_assert(sizeof(IndexEntry) == 16, "IndexEntry layout");
+
+inline bool hasMagic(const char *magic, const char (&expected)[8])
+{
+    return std::memcmp(magic, expected, sizeof(expected)) == 0;
+}
+
+}
@@ -0,0 +1,192 @@
+#include "sessionrecorder.h"
+#include "sessionformat.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const qint64 kChunkSize = 4 * 1024 * 1024;
+const quint32 kIndexIntervalMs = 1000;
+
+quint64 nowNs()
+{
+    return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+}
+
+SessionRecorder::SessionRecorder(QObject *parent)
+    : QObject(parent)
+    , m_map(nullptr)
+    , m_mapOffset(0)
+    , m_writeOffset(0)
+    , m_nextIndexNs(0)
+    , m_recordCount(0)
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    close();
+}
+
+bool SessionRecorder::open(const QString &path)
+{
+    close();
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        fail("Cannot open session file: " + m_file.errorString());
+        return false;
+    }
+
+    QString indexPath = path;
+    if (indexPath.endsWith(SessionFormat::kSessionSuffix)) {
+        indexPath.chop(int(sizeof(SessionFormat::kSessionSuffix)) - 1);
+    }
+    indexPath += SessionFormat::kIndexSuffix;
+    m_indexFile.setFileName(indexPath);
+    if (!m_indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fail("Cannot open index file: " + m_indexFile.errorString());
+        return false;
+    }
+
+    SessionFormat::IndexHeader indexHeader;
+    std::memcpy(indexHeader.magic, SessionFormat::kIndexMagic, sizeof(indexHeader.magic));
+    indexHeader.version = SessionFormat::kVersion;
+    indexHeader.intervalMs = kIndexIntervalMs;
+    m_indexFile.write(reinterpret_cast<const char *>(&indexHeader), sizeof(indexHeader));
+    m_indexFile.flush();
+
+    m_writeOffset = 0;
+    m_recordCount = 0;
+    m_nextIndexNs = 0;
+    if (!mapChunk(0)) {
+        return false;
+    }
+
+    SessionFormat::FileHeader header;
+    std::memcpy(header.magic, SessionFormat::kSessionMagic, sizeof(header.magic));
+    header.version = SessionFormat::kVersion;
+    header.reserved = 0;
+    header.startTimeNs = nowNs();
+    write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    qDebug() << "SessionRecorder: Recording to" << path;
+    return true;
+}
+
+void SessionRecorder::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    if (m_file.isOpen()) {
+        // Drop the unused tail of the last chunk
+        m_file.resize(m_writeOffset);
+        m_file.close();
+        qDebug() << "SessionRecorder: Closed" << m_file.fileName() << "-" << m_recordCount
+                 << "records," << m_writeOffset << "bytes";
+    }
+    if (m_indexFile.isOpen()) {
+        m_indexFile.close();
+    }
+}
+
+bool SessionRecorder::isOpen() const
+{
+    return m_map != nullptr;
+}
+
+QString SessionRecorder::path() const
+{
+    return m_file.fileName();
+}
+
+void SessionRecorder::append(const char *data, int size)
+{
+    if (!m_map || size <= 0) {
+        return;
+    }
+
+    const quint64 timestampNs = nowNs();
+
+    // Index entries point at the first record of each interval
+    if (timestampNs >= m_nextIndexNs) {
+        SessionFormat::IndexEntry entry;
+        entry.timestampNs = timestampNs;
+        entry.offset = quint64(m_writeOffset);
+        m_indexFile.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        m_indexFile.flush();
+        m_nextIndexNs = timestampNs + quint64(kIndexIntervalMs) * 1000000ull;
+    }
+
+    SessionFormat::RecordHeader header;
+    header.timestampNs = timestampNs;
+    header.size = quint32(size);
+    header.reserved = 0;
+    if (write(reinterpret_cast<const char *>(&header), sizeof(header)) && write(data, size)) {
+        ++m_recordCount;
+    }
+}
+
+quint64 SessionRecorder::bytesRecorded() const
+{
+    return quint64(m_writeOffset);
+}
+
+quint64 SessionRecorder::recordCount() const
+{
+    return m_recordCount;
+}
+
+bool SessionRecorder::mapChunk(qint64 offset)
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    if (!m_file.resize(offset + kChunkSize)) {
+        fail("Cannot grow session file: " + m_file.errorString());
+        return false;
+    }
+    m_map = m_file.map(offset, kChunkSize);
+    if (!m_map) {
+        fail("Cannot map session file: " + m_file.errorString());
+        return false;
+    }
+    m_mapOffset = offset;
+    return true;
+}
+
+bool SessionRecorder::write(const char *data, qint64 size)
+{
+    while (size > 0) {
+        qint64 chunkEnd = m_mapOffset + kChunkSize;
+        if (m_writeOffset >= chunkEnd) {
+            if (!mapChunk(chunkEnd)) {
+                return false;
+            }
+            continue;
+        }
+        qint64 n = qMin(size, chunkEnd - m_writeOffset);
+        std::memcpy(m_map + (m_writeOffset - m_mapOffset), data, size_t(n));
+        m_writeOffset += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void SessionRecorder::fail(const QString &message)
+{
+    qWarning() << "SessionRecorder:" << message;
+    close();
+    emit error(message);
+}
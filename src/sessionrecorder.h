@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QObject>
+#include <QFile>
+#include <QString>
+
+// Append-only tee of the outgoing IGTL stream (see sessionformat.h).
+// The session file is grown in fixed chunks and written through a memory
+// mapping, so append() is a memcpy on the send path; file system calls only
+// happen once per chunk and once per index interval.
+class SessionRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SessionRecorder(QObject *parent = nullptr);
+    ~SessionRecorder();
+
+    // path is the session file; the index is written next to it
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+
+    void append(const char *data, int size);
+
+    quint64 bytesRecorded() const;
+    quint64 recordCount() const;
+
+signals:
+    void error(const QString &message);
+
+private:
+    bool mapChunk(qint64 offset);
+    bool write(const char *data, qint64 size);
+    void fail(const QString &message);
+
+    QFile m_file;
+    QFile m_indexFile;
+    uchar *m_map;
+    qint64 m_mapOffset;  // file offset of the mapped chunk
+    qint64 m_writeOffset; // next write position in the file
+    quint64 m_nextIndexNs;
+    quint64 m_recordCount;
+};
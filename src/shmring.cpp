@@ -0,0 +1,381 @@
+#include "shmring.h"
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define SHMRING_SUPPORTED 1
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint64_t recordSpan(size_t size)
+{
+    return (sizeof(ShmRing::RecordHeader) + size + 7) & ~uint64_t(7);
+}
+
+#ifdef SHMRING_SUPPORTED
+
+std::string shmPath(const std::string &name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+void setError(std::string *error, const std::string &what)
+{
+    if (error) {
+        *error = what + ": " + std::strerror(errno);
+    }
+}
+
+// The ring is shared between processes, so no FUTEX_PRIVATE_FLAG
+void futexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs)
+{
+    timespec timeout;
+    timespec *timeoutPointer = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = long(timeoutMs % 1000) * 1000000L;
+        timeoutPointer = &timeout;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, timeoutPointer, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#endif
+
+}
+
+namespace ShmRing {
+
+bool isSupported()
+{
+#ifdef SHMRING_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+}
+
+ShmRingWriter::ShmRingWriter()
+    : m_header(nullptr)
+    , m_data(nullptr)
+    , m_mappedSize(0)
+{
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    close();
+}
+
+bool ShmRingWriter::open(const std::string &name, uint32_t capacity, std::string *error)
+{
+    close();
+#ifdef SHMRING_SUPPORTED
+    uint32_t rounded = 4096;
+    while (rounded < capacity && rounded < (1u << 30)) {
+        rounded <<= 1;
+    }
+
+    // Start from a fresh segment; readers still attached to an old one see it
+    // closed and reattach
+    const std::string path = shmPath(name);
+    shm_unlink(path.c_str());
+    const int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        setError(error, "shm_open " + path);
+        return false;
+    }
+    const size_t mappedSize = sizeof(ShmRing::Header) + rounded;
+    if (ftruncate(fd, off_t(mappedSize)) != 0) {
+        setError(error, "ftruncate " + path);
+        ::close(fd);
+        shm_unlink(path.c_str());
+        return false;
+    }
+    void *mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        setError(error, "mmap " + path);
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    // The segment is zero-filled; the magic goes in last so readers never see
+    // a half-initialized header
+    m_header = new (mapping) ShmRing::Header();
+    m_header->version = ShmRing::kVersion;
+    m_header->capacity = rounded;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_header->magic, ShmRing::kMagic, sizeof(ShmRing::kMagic));
+    m_data = static_cast<uint8_t *>(mapping) + sizeof(ShmRing::Header);
+    m_mappedSize = mappedSize;
+    m_name = path;
+    return true;
+#else
+    (void)name;
+    (void)capacity;
+    if (error) {
+        *error = "shared memory transport is not supported on this platform";
+    }
+    return false;
+#endif
+}
+
+void ShmRingWriter::close()
+{
+#ifdef SHMRING_SUPPORTED
+    if (!m_header) {
+        return;
+    }
+    m_header->closed.store(1, std::memory_order_release);
+    m_header->sequence.fetch_add(1);
+    futexWakeAll(&m_header->sequence);
+    munmap(m_header, m_mappedSize);
+    shm_unlink(m_name.c_str());
+#endif
+    m_header = nullptr;
+    m_data = nullptr;
+    m_mappedSize = 0;
+    m_name.clear();
+}
+
+bool ShmRingWriter::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+const std::string &ShmRingWriter::name() const
+{
+    return m_name;
+}
+
+bool ShmRingWriter::publish(const void *data, size_t size)
+{
+#ifdef SHMRING_SUPPORTED
+    if (!m_header) {
+        return false;
+    }
+    const uint64_t capacity = m_header->capacity;
+    const uint64_t span = recordSpan(size);
+    if (span > capacity / 4) {
+        return false;
+    }
+
+    uint64_t position = m_header->head.load(std::memory_order_relaxed);
+    uint64_t offset = position & (capacity - 1);
+    const bool wraps = offset + span > capacity;
+    const uint64_t end = (wraps ? position + (capacity - offset) : position) + span;
+
+    // Announce the bytes about to be overwritten before touching them (see
+    // ShmRingReader::tryRead)
+    m_header->writing.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (wraps) {
+        ShmRing::RecordHeader padding = {uint32_t(capacity - offset - sizeof(ShmRing::RecordHeader)), ShmRing::kPaddingRecord};
+        std::memcpy(m_data + offset, &padding, sizeof(padding));
+        position += capacity - offset;
+        offset = 0;
+    }
+    ShmRing::RecordHeader record = {uint32_t(size), 0};
+    std::memcpy(m_data + offset, &record, sizeof(record));
+    std::memcpy(m_data + offset + sizeof(record), data, size);
+
+    m_header->head.store(end, std::memory_order_release);
+    m_header->sequence.fetch_add(1);
+    if (m_header->waiters.load() > 0) {
+        futexWakeAll(&m_header->sequence);
+    }
+    return true;
+#else
+    (void)data;
+    (void)size;
+    return false;
+#endif
+}
+
+ShmRingReader::ShmRingReader()
+    : m_header(nullptr)
+    , m_data(nullptr)
+    , m_mappedSize(0)
+    , m_position(0)
+    , m_overruns(0)
+{
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+bool ShmRingReader::open(const std::string &name, std::string *error)
+{
+    close();
+#ifdef SHMRING_SUPPORTED
+    const std::string path = shmPath(name);
+    // Read-write only for the waiter count; message data is never written
+    const int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        setError(error, "shm_open " + path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(ShmRing::Header)) {
+        if (error) {
+            *error = path + " is not a shared-memory ring";
+        }
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, size_t(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        setError(error, "mmap " + path);
+        return false;
+    }
+
+    ShmRing::Header *header = static_cast<ShmRing::Header *>(mapping);
+    const uint32_t capacity = header->capacity;
+    if (std::memcmp(header->magic, ShmRing::kMagic, sizeof(ShmRing::kMagic)) != 0 || header->version != ShmRing::kVersion
+        || capacity == 0 || (capacity & (capacity - 1)) != 0 || sizeof(ShmRing::Header) + capacity > size_t(info.st_size)) {
+        if (error) {
+            *error = path + " is not a shared-memory ring of version " + std::to_string(ShmRing::kVersion);
+        }
+        munmap(mapping, size_t(info.st_size));
+        return false;
+    }
+
+    m_header = header;
+    m_data = static_cast<const uint8_t *>(mapping) + sizeof(ShmRing::Header);
+    m_mappedSize = size_t(info.st_size);
+    m_position = header->head.load(std::memory_order_acquire);
+    m_overruns = 0;
+    return true;
+#else
+    (void)name;
+    if (error) {
+        *error = "shared memory transport is not supported on this platform";
+    }
+    return false;
+#endif
+}
+
+void ShmRingReader::close()
+{
+#ifdef SHMRING_SUPPORTED
+    if (m_header) {
+        munmap(m_header, m_mappedSize);
+    }
+#endif
+    m_header = nullptr;
+    m_data = nullptr;
+    m_mappedSize = 0;
+}
+
+bool ShmRingReader::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+uint64_t ShmRingReader::overruns() const
+{
+    return m_overruns;
+}
+
+ShmRingReader::Status ShmRingReader::read(std::vector<uint8_t> &message, int timeoutMs)
+{
+#ifdef SHMRING_SUPPORTED
+    if (!m_header) {
+        return Closed;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        // Sample the futex word before looking for data: a publish after this
+        // point changes it, so the wait below cannot miss the wakeup
+        const uint32_t sequence = m_header->sequence.load();
+        Status status;
+        if (tryRead(message, status)) {
+            return status;
+        }
+        if (m_header->closed.load(std::memory_order_acquire)) {
+            return Closed;
+        }
+
+        int remainingMs = -1;
+        if (timeoutMs >= 0) {
+            remainingMs = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+            if (remainingMs <= 0) {
+                return Timeout;
+            }
+        }
+        m_header->waiters.fetch_add(1);
+        futexWait(&m_header->sequence, sequence, remainingMs);
+        m_header->waiters.fetch_sub(1);
+    }
+#else
+    (void)message;
+    (void)timeoutMs;
+    return Closed;
+#endif
+}
+
+bool ShmRingReader::tryRead(std::vector<uint8_t> &message, Status &status)
+{
+    const uint64_t capacity = m_header->capacity;
+    for (;;) {
+        const uint64_t head = m_header->head.load(std::memory_order_acquire);
+        if (m_position == head) {
+            return false;
+        }
+        if (head - m_position > capacity) {
+            ++m_overruns;
+            m_position = head;
+            status = Overrun;
+            return true;
+        }
+
+        const uint64_t offset = m_position & (capacity - 1);
+        ShmRing::RecordHeader record;
+        std::memcpy(&record, m_data + offset, sizeof(record));
+        const bool padding = record.flags & ShmRing::kPaddingRecord;
+        const bool valid = offset + recordSpan(record.size) <= capacity;
+        if (valid && !padding) {
+            message.assign(m_data + offset + sizeof(record), m_data + offset + sizeof(record) + record.size);
+        }
+
+        // Seqlock-style check: if the writer has started to overwrite what
+        // was just copied, the copy may be torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->writing.load(std::memory_order_relaxed) - m_position > capacity || !valid) {
+            ++m_overruns;
+            m_position = m_header->head.load(std::memory_order_acquire);
+            status = Overrun;
+            return true;
+        }
+
+        if (padding) {
+            m_position += capacity - offset;
+            continue;
+        }
+        m_position += recordSpan(record.size);
+        status = Message;
+        return true;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// Shared-memory transport for receivers on the same Linux host. The app
+// publishes packed OpenIGTLink messages into a ring in POSIX shared memory;
+// any number of readers follow it and are woken through a futex, so a pose
+// reaches them without going through the TCP stack. Plain C++; this file and
+// shmring.cpp form the igtlshm reader library.
+//
+// Layout of /dev/shm/<name>: Header, then `capacity` bytes of records. Each
+// record is a RecordHeader and `size` message bytes, padded to 8 bytes. A
+// record never wraps; a padding record fills the rest of the ring instead.
+// Readers that fall more than `capacity` bytes behind skip to the newest
+// message and report an overrun. Not available on Android and other
+// platforms (isSupported() is false there).
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ShmRing {
+
+const char kMagic[8] = {'I', 'G', 'T', 'L', 'S', 'H', 'M', '1'};
+const uint32_t kVersion = 1;
+const char kDefaultName[] = "openigtlink-mobile";
+const uint32_t kDefaultCapacity = 1 << 20;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;              // bytes of record data, a power of two
+    std::atomic<uint64_t> head;     // bytes published so far
+    std::atomic<uint64_t> writing;  // end of the record being written
+    std::atomic<uint32_t> sequence; // futex word, bumped after each publish
+    std::atomic<uint32_t> waiters;  // readers blocked on sequence
+    std::atomic<uint32_t> closed;   // set when the writer goes away
+    uint32_t reserved[5];
+};
+
+struct RecordHeader {
+    uint32_t size;
+    uint32_t flags;
+};
+
+const uint32_t kPaddingRecord = 1;
+
+static_assert(sizeof(Header) == 64, "Header layout");
+static_assert(sizeof(RecordHeader) == 8, "RecordHeader layout");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free to be shared");
+
+bool isSupported();
+
+}
+
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    // Creates (or replaces) the ring; capacity is rounded up to a power of two
+    bool open(const std::string &name, uint32_t capacity = ShmRing::kDefaultCapacity, std::string *error = nullptr);
+    // Marks the ring closed, wakes the readers and removes the name
+    void close();
+    bool isOpen() const;
+    const std::string &name() const;
+
+    // Publishes one message; fails only for messages larger than a quarter
+    // of the ring
+    bool publish(const void *data, size_t size);
+
+private:
+    ShmRingWriter(const ShmRingWriter &) = delete;
+    ShmRingWriter &operator=(const ShmRingWriter &) = delete;
+
+    std::string m_name;
+    ShmRing::Header *m_header;
+    uint8_t *m_data;
+    size_t m_mappedSize;
+};
+
+class ShmRingReader
+{
+public:
+    enum Status {
+        Message, // message holds the next message
+        Timeout, // nothing new within the timeout
+        Overrun, // fell behind; continues with the next message published
+        Closed   // the writer closed the ring (or it was never opened)
+    };
+
+    ShmRingReader();
+    ~ShmRingReader();
+
+    // Attaches to a ring; reading starts with the next message published
+    bool open(const std::string &name = ShmRing::kDefaultName, std::string *error = nullptr);
+    void close();
+    bool isOpen() const;
+
+    // Waits up to timeoutMs (-1 = no limit) for the next message
+    Status read(std::vector<uint8_t> &message, int timeoutMs = -1);
+    uint64_t overruns() const;
+
+private:
+    ShmRingReader(const ShmRingReader &) = delete;
+    ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+    // Takes the next message if there is one; false if the ring is empty
+    bool tryRead(std::vector<uint8_t> &message, Status &status);
+
+    ShmRing::Header *m_header;
+    const uint8_t *m_data;
+    size_t m_mappedSize;
+    uint64_t m_position;
+    uint64_t m_overruns;
+};
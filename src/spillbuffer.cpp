@@ -0,0 +1,217 @@
+#include "spillbuffer.h"
+#include "igtlmessages.h"
+#include "metricsregistry.h"
+#include <QDebug>
+#include <vector>
+
+namespace {
+
+// Poses moved to the file at a time, one POSEDELTA message each
+const int kSpillBatch = 256;
+
+// Pose count field of a POSEDELTA message (see posebacklog.h)
+quint64 posesIn(const QByteArray &message)
+{
+    const qsizetype offset = qsizetype(IgtlMessages::kHeaderSize) + 2;
+    if (message.size() < offset + 2) {
+        return 0;
+    }
+    const uchar *count = reinterpret_cast<const uchar *>(message.constData()) + offset;
+    return (quint64(count[0]) << 8) | count[1];
+}
+
+// File records: message size and pose count (native byte order, the file
+// never leaves the device), then the message
+struct RecordHeader {
+    quint32 size;
+    quint32 poses;
+};
+
+}
+
+SpillBuffer::SpillBuffer()
+    : m_head(0)
+    , m_count(0)
+    , m_fileLimitBytes(0)
+    , m_readOffset(0)
+    , m_writeOffset(0)
+    , m_filePoses(0)
+    , m_droppedCount(0)
+    , m_deviceName("MobileDevice")
+    , m_returnedPoses(0)
+{
+}
+
+SpillBuffer::~SpillBuffer()
+{
+    clear();
+}
+
+void SpillBuffer::configure(int memoryPoses, qint64 fileLimitBytes, const QString &spillPath)
+{
+    clear();
+    m_ring.resize(qMax(kSpillBatch, memoryPoses));
+    m_fileLimitBytes = spillPath.isEmpty() ? 0 : qMax<qint64>(0, fileLimitBytes);
+    m_spillPath = spillPath;
+}
+
+void SpillBuffer::setDeviceName(const QByteArray &name)
+{
+    m_deviceName = name;
+}
+
+void SpillBuffer::append(quint64 timeNs, const Pose &pose)
+{
+    if (m_ring.isEmpty()) {
+        return;
+    }
+    if (m_count == m_ring.size() && !spillOldest()) {
+        dropOldest(kSpillBatch);
+    }
+    PoseBacklog::Sample &sample = m_ring[(m_head + m_count) % m_ring.size()];
+    sample.timeNs = timeNs;
+    sample.pose = pose;
+    ++m_count;
+}
+
+bool SpillBuffer::isEmpty() const
+{
+    return m_count == 0 && m_filePoses == 0 && m_returned.isEmpty();
+}
+
+quint64 SpillBuffer::poseCount() const
+{
+    return quint64(m_count) + m_filePoses + m_returnedPoses;
+}
+
+quint64 SpillBuffer::droppedCount() const
+{
+    return m_droppedCount;
+}
+
+QByteArray SpillBuffer::takeBatch(int maxPoses)
+{
+    if (!m_returned.isEmpty()) {
+        const QByteArray message = m_returned.takeFirst();
+        m_returnedPoses -= posesIn(message);
+        return message;
+    }
+    if (m_filePoses > 0) {
+        RecordHeader record = {0, 0};
+        QByteArray message;
+        if (m_file.seek(m_readOffset)
+            && m_file.read(reinterpret_cast<char *>(&record), sizeof(record)) == qint64(sizeof(record))) {
+            message = m_file.read(record.size);
+        }
+        if (message.size() != qint64(record.size) || message.isEmpty()) {
+            qWarning() << "SpillBuffer: Cannot read" << m_spillPath << m_file.errorString();
+            m_droppedCount += m_filePoses;
+            MetricsRegistry::add(MetricsRegistry::MessagesDropped, m_filePoses);
+            resetFile();
+        } else {
+            m_readOffset += qint64(sizeof(record)) + record.size;
+            m_filePoses -= record.poses;
+            if (m_filePoses == 0) {
+                resetFile();
+            }
+            return message;
+        }
+    }
+    if (m_count == 0) {
+        return QByteArray();
+    }
+
+    // The ring may wrap, so copy out the batch in order
+    const int count = qBound(1, maxPoses, qMin(m_count, int(PoseBacklog::kMaxPoses)));
+    std::vector<PoseBacklog::Sample> samples(size_t(count));
+    for (int i = 0; i < count; ++i) {
+        samples[size_t(i)] = m_ring[(m_head + i) % m_ring.size()];
+    }
+    m_head = (m_head + count) % m_ring.size();
+    m_count -= count;
+
+    std::vector<uint8_t> message;
+    PoseBacklog::pack(message, m_deviceName.constData(), samples.data(), samples.size());
+    return QByteArray(reinterpret_cast<const char *>(message.data()), qsizetype(message.size()));
+}
+
+void SpillBuffer::putBack(const QByteArray &message)
+{
+    if (message.isEmpty()) {
+        return;
+    }
+    m_returned.prepend(message);
+    m_returnedPoses += posesIn(message);
+}
+
+void SpillBuffer::clear()
+{
+    if (!isEmpty()) {
+        qDebug() << "SpillBuffer: Discarding" << poseCount() << "poses";
+    }
+    m_head = 0;
+    m_count = 0;
+    m_returned.clear();
+    m_returnedPoses = 0;
+    resetFile();
+}
+
+// Moves the oldest poses in memory to the file; false if there is no room
+bool SpillBuffer::spillOldest()
+{
+    if (m_fileLimitBytes <= 0) {
+        return false;
+    }
+    const int count = qMin(kSpillBatch, m_count);
+    PoseBacklog::Sample samples[kSpillBatch];
+    for (int i = 0; i < count; ++i) {
+        samples[i] = m_ring[(m_head + i) % m_ring.size()];
+    }
+    std::vector<uint8_t> message;
+    PoseBacklog::pack(message, m_deviceName.constData(), samples, size_t(count));
+
+    const RecordHeader record = {quint32(message.size()), quint32(count)};
+    if (m_writeOffset + qint64(sizeof(record)) + qint64(message.size()) > m_fileLimitBytes) {
+        return false;
+    }
+    if (!m_file.isOpen()) {
+        m_file.setFileName(m_spillPath);
+        if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            qWarning() << "SpillBuffer: Cannot open" << m_spillPath << m_file.errorString();
+            m_fileLimitBytes = 0;
+            return false;
+        }
+        qDebug() << "SpillBuffer: Spilling to" << m_spillPath;
+    }
+    if (!m_file.seek(m_writeOffset)
+        || m_file.write(reinterpret_cast<const char *>(&record), sizeof(record)) != qint64(sizeof(record))
+        || m_file.write(reinterpret_cast<const char *>(message.data()), qint64(message.size())) != qint64(message.size())) {
+        qWarning() << "SpillBuffer: Cannot write" << m_spillPath << m_file.errorString();
+        return false;
+    }
+    m_writeOffset += qint64(sizeof(record)) + qint64(message.size());
+    m_filePoses += quint64(count);
+    m_head = (m_head + count) % m_ring.size();
+    m_count -= count;
+    return true;
+}
+
+void SpillBuffer::dropOldest(int count)
+{
+    count = qMin(count, m_count);
+    m_head = (m_head + count) % m_ring.size();
+    m_count -= count;
+    m_droppedCount += quint64(count);
+    MetricsRegistry::add(MetricsRegistry::MessagesDropped, quint64(count));
+}
+
+void SpillBuffer::resetFile()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+        m_file.remove();
+    }
+    m_readOffset = 0;
+    m_writeOffset = 0;
+    m_filePoses = 0;
+}
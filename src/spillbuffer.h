@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "posebacklog.h"
+
+// Bounded store for the poses produced while the connection is down (see
+// NetworkManager). The newest poses are kept in a fixed-size memory ring;
+// when it is full the oldest are encoded into POSEDELTA batches (see
+// posebacklog.h) and appended to a spill file, up to a size limit. Past the
+// limit the oldest poses in memory are dropped, so the stream keeps its
+// beginning and its most recent part. Batches come out oldest first: the
+// file, then memory.
+class SpillBuffer
+{
+public:
+    SpillBuffer();
+    ~SpillBuffer();
+
+    // fileLimitBytes = 0 keeps everything in memory. Discards what is
+    // waiting.
+    void configure(int memoryPoses, qint64 fileLimitBytes, const QString &spillPath);
+    // Device name of the batches written to the file
+    void setDeviceName(const QByteArray &name);
+
+    void append(quint64 timeNs, const Pose &pose);
+
+    bool isEmpty() const;
+    quint64 poseCount() const; // waiting, in memory and in the file
+    quint64 droppedCount() const;
+
+    // The next POSEDELTA message, or an empty array when nothing is waiting.
+    // From memory it holds at most maxPoses poses; batches from the file keep
+    // the size they were written with.
+    QByteArray takeBatch(int maxPoses);
+    // Returns a POSEDELTA message from takeBatch() that did not go out; it
+    // is the next one taken. Put several back newest first.
+    void putBack(const QByteArray &message);
+
+    void clear();
+
+private:
+    bool spillOldest();
+    void dropOldest(int count);
+    void resetFile();
+
+    QVector<PoseBacklog::Sample> m_ring;
+    int m_head;  // oldest sample
+    int m_count;
+    qint64 m_fileLimitBytes;
+    QString m_spillPath;
+    QFile m_file;
+    qint64 m_readOffset;
+    qint64 m_writeOffset;
+    quint64 m_filePoses;
+    quint64 m_droppedCount;
+    QByteArray m_deviceName;
+    QList<QByteArray> m_returned; // put back, taken before anything else
+    quint64 m_returnedPoses;
+};
@@ -0,0 +1,127 @@
+#include "startupprofiler.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QDebug>
+#include <cstring>
+
+StartupProfiler &StartupProfiler::instance()
+{
+    static StartupProfiler profiler;
+    return profiler;
+}
+
+StartupProfiler::StartupProfiler()
+    : m_finished(false)
+{
+    m_clock.start();
+    m_events.reserve(32);
+}
+
+void StartupProfiler::beginPhase(const char *name)
+{
+    if (m_finished) {
+        return;
+    }
+    m_events.append({name, elapsedUs(), -1});
+}
+
+void StartupProfiler::endPhase(const char *name)
+{
+    if (m_finished) {
+        return;
+    }
+    // Close the innermost open phase with this name
+    for (int i = m_events.size() - 1; i >= 0; --i) {
+        Event &event = m_events[i];
+        if (event.durationUs < 0 && std::strcmp(event.name, name) == 0) {
+            event.durationUs = elapsedUs() - event.startUs;
+            return;
+        }
+    }
+    qWarning() << "StartupProfiler: endPhase without beginPhase:" << name;
+}
+
+void StartupProfiler::mark(const char *name)
+{
+    if (m_finished) {
+        return;
+    }
+    m_events.append({name, elapsedUs(), 0});
+}
+
+qint64 StartupProfiler::elapsedUs() const
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+bool StartupProfiler::isFinished() const
+{
+    return m_finished;
+}
+
+QString StartupProfiler::defaultTracePath()
+{
+    const QString overridePath = qEnvironmentVariable("OPENIGTLINK_STARTUP_TRACE");
+    if (!overridePath.isEmpty()) {
+        return overridePath;
+    }
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return QDir(dir).filePath("startup-trace.json");
+}
+
+bool StartupProfiler::finish(const QString &path)
+{
+    if (m_finished) {
+        return false;
+    }
+
+    const qint64 firstFrameUs = elapsedUs();
+    mark("firstFrame");
+    m_finished = true;
+
+    QJsonArray traceEvents;
+    for (Event &event : m_events) {
+        if (event.durationUs < 0) {
+            event.durationUs = firstFrameUs - event.startUs;
+        }
+
+        QJsonObject object;
+        object["name"] = QString::fromLatin1(event.name);
+        object["cat"] = "startup";
+        object["ph"] = event.durationUs > 0 ? "X" : "i";
+        object["ts"] = double(event.startUs);
+        if (event.durationUs > 0) {
+            object["dur"] = double(event.durationUs);
+        } else {
+            object["s"] = "g";
+        }
+        object["pid"] = 1;
+        object["tid"] = 1;
+        traceEvents.append(object);
+
+        qDebug() << "StartupProfiler:" << event.name << "at" << event.startUs / 1000.0
+                 << "ms, took" << event.durationUs / 1000.0 << "ms";
+    }
+    qInfo() << "StartupProfiler: time to first frame" << firstFrameUs / 1000.0 << "ms";
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = "ms";
+
+    const QString tracePath = path.isEmpty() ? defaultTracePath() : path;
+    QDir().mkpath(QFileInfo(tracePath).absolutePath());
+    QFile file(tracePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "StartupProfiler: Cannot write trace to" << tracePath << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    qDebug() << "StartupProfiler: Wrote startup trace to" << tracePath;
+    return true;
+}
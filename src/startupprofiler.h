@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// Records wall-clock startup phases (construction, QML load, first frame)
+// and writes them as a Chrome trace-event JSON file (chrome://tracing,
+// Perfetto). Phases are recorded on the GUI thread only.
+class StartupProfiler
+{
+public:
+    static StartupProfiler &instance();
+
+    void beginPhase(const char *name);
+    void endPhase(const char *name);
+    void mark(const char *name);
+
+    qint64 elapsedUs() const;
+    bool isFinished() const;
+
+    // Closes any open phases and writes the trace. Called once, on the first
+    // swapped frame. An empty path uses the default location.
+    bool finish(const QString &path = QString());
+
+    static QString defaultTracePath();
+
+private:
+    StartupProfiler();
+
+    struct Event {
+        const char *name;
+        qint64 startUs;
+        qint64 durationUs; // -1 while open, 0 for instant marks
+    };
+
+    QElapsedTimer m_clock;
+    QVector<Event> m_events;
+    bool m_finished;
+};
+
+// Scoped helper: records a phase for the lifetime of the object.
+class StartupPhase
+{
+public:
+    explicit StartupPhase(const char *name) : m_name(name) { StartupProfiler::instance().beginPhase(m_name); }
+    ~StartupPhase() { StartupProfiler::instance().endPhase(m_name); }
+
+    StartupPhase(const StartupPhase &) = delete;
+    StartupPhase &operator=(const StartupPhase &) = delete;
+
+private:
+    const char *m_name;
+};
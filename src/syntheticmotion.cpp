@@ -0,0 +1,231 @@
+#include "syntheticmotion.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+const double kDegToRad = kPi / 180.0;
+const double kGravity = 9.80665;
+// Magnetic field in the world frame (x east, y north, z up), roughly mid-latitude
+const double kWorldMag[3] = {0.0, 22.0, -42.0};
+// Largest integration step for the true motion
+const double kMaxStep = 0.0005;
+
+void rotateToBody(const double q[4], const double v[3], double out[3])
+{
+    // out = R(q)^T * v
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    double r00 = 1 - 2 * (y * y + z * z), r01 = 2 * (x * y - w * z), r02 = 2 * (x * z + w * y);
+    double r10 = 2 * (x * y + w * z), r11 = 1 - 2 * (x * x + z * z), r12 = 2 * (y * z - w * x);
+    double r20 = 2 * (x * z - w * y), r21 = 2 * (y * z + w * x), r22 = 1 - 2 * (x * x + y * y);
+    out[0] = r00 * v[0] + r10 * v[1] + r20 * v[2];
+    out[1] = r01 * v[0] + r11 * v[1] + r21 * v[2];
+    out[2] = r02 * v[0] + r12 * v[1] + r22 * v[2];
+}
+
+MotionSegment constant(double duration, double wx, double wy, double wz)
+{
+    MotionSegment s;
+    s.kind = MotionSegment::Constant;
+    s.duration = duration;
+    s.value[0] = wx; s.value[1] = wy; s.value[2] = wz;
+    return s;
+}
+
+MotionSegment sine(double duration, double wx, double wy, double wz, double frequency)
+{
+    MotionSegment s = constant(duration, wx, wy, wz);
+    s.kind = MotionSegment::Sine;
+    s.frequency = frequency;
+    return s;
+}
+
+}
+
+bool MotionProfile::fromName(const std::string &name, MotionProfile &profile)
+{
+    profile = MotionProfile();
+    if (name == "still") {
+        profile.addSegment(constant(1.0, 0, 0, 0));
+    } else if (name == "yaw") {
+        profile.addSegment(constant(1.0, 0, 0, 30));
+    } else if (name == "wobble") {
+        profile.addSegment(sine(10.0, 40, 0, 0, 0.5));
+        profile.addSegment(sine(10.0, 0, 40, 0, 0.7));
+        profile.addSegment(sine(10.0, 0, 0, 40, 0.3));
+    } else if (name == "handheld") {
+        // Resting, picked up, turned around, tilted back, put down
+        profile.addSegment(constant(5.0, 0, 0, 0));
+        profile.addSegment(sine(2.0, 60, 20, 0, 0.25));
+        profile.addSegment(constant(3.0, 0, 0, 60));
+        profile.addSegment(sine(4.0, 30, 30, 10, 1.5));
+        profile.addSegment(sine(2.0, -60, -20, 0, 0.25));
+        profile.addSegment(constant(5.0, 0, 0, 0));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool MotionProfile::fromScript(const std::string &path, MotionProfile &profile, std::string *error)
+{
+    profile = MotionProfile();
+    std::ifstream in(path);
+    if (!in) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kind;
+        MotionSegment segment;
+        if (!(fields >> segment.duration)) {
+            continue; // blank line
+        }
+        bool ok = bool(fields >> kind >> segment.value[0] >> segment.value[1] >> segment.value[2]);
+        if (ok && kind == "sine") {
+            segment.kind = MotionSegment::Sine;
+            ok = bool(fields >> segment.frequency);
+        } else if (kind != "constant") {
+            ok = false;
+        }
+        if (!ok || segment.duration <= 0.0) {
+            if (error) *error = path + ":" + std::to_string(lineNumber) + ": invalid segment";
+            return false;
+        }
+        profile.addSegment(segment);
+    }
+
+    if (profile.isEmpty()) {
+        if (error) *error = path + ": no segments";
+        return false;
+    }
+    return true;
+}
+
+bool MotionProfile::load(const std::string &nameOrPath, MotionProfile &profile, std::string *error)
+{
+    if (fromName(nameOrPath, profile)) {
+        return true;
+    }
+    return fromScript(nameOrPath, profile, error);
+}
+
+void MotionProfile::addSegment(const MotionSegment &segment)
+{
+    m_segments.push_back(segment);
+    m_period += segment.duration;
+}
+
+bool MotionProfile::isEmpty() const
+{
+    return m_segments.empty();
+}
+
+void MotionProfile::angularVelocity(double t, double omega[3]) const
+{
+    omega[0] = omega[1] = omega[2] = 0.0;
+    if (m_segments.empty()) {
+        return;
+    }
+
+    double local = std::fmod(t, m_period);
+    for (const MotionSegment &segment : m_segments) {
+        if (local < segment.duration) {
+            double scale = segment.kind == MotionSegment::Sine
+                               ? std::sin(2.0 * kPi * segment.frequency * local)
+                               : 1.0;
+            for (int i = 0; i < 3; ++i) {
+                omega[i] = segment.value[i] * scale * kDegToRad;
+            }
+            return;
+        }
+        local -= segment.duration;
+    }
+}
+
+SyntheticImu::SyntheticImu(const MotionProfile &profile, const ImuNoiseModel &noise, unsigned seed)
+    : m_profile(profile)
+    , m_noise(noise)
+    , m_rng(seed)
+    , m_normal(0.0, 1.0)
+    , m_time(0.0)
+    , m_q{1.0, 0.0, 0.0, 0.0}
+    , m_biasWalk{0.0, 0.0, 0.0}
+{
+}
+
+ImuSample SyntheticImu::sample(double t, double rate)
+{
+    double previous = m_time;
+    advanceTo(t);
+
+    ImuSample s;
+    s.t = m_time;
+    for (int i = 0; i < 4; ++i) {
+        s.truth[i] = m_q[i];
+    }
+
+    // White noise standard deviation for this sample rate
+    double gyroSigma = m_noise.gyroNoiseDensity * std::sqrt(rate);
+    double accelSigma = m_noise.accelNoiseDensity * std::sqrt(rate);
+    double walkSigma = m_noise.gyroBiasWalk * std::sqrt(std::max(0.0, m_time - previous));
+
+    double omega[3];
+    m_profile.angularVelocity(m_time, omega);
+
+    const double gravity[3] = {0.0, 0.0, kGravity};
+    double accel[3], mag[3];
+    rotateToBody(m_q, gravity, accel);
+    rotateToBody(m_q, kWorldMag, mag);
+
+    for (int i = 0; i < 3; ++i) {
+        m_biasWalk[i] += walkSigma * m_normal(m_rng);
+        s.gyro[i] = omega[i] + m_noise.gyroBias[i] + m_biasWalk[i] + gyroSigma * m_normal(m_rng);
+        s.accel[i] = accel[i] + accelSigma * m_normal(m_rng);
+        s.mag[i] = mag[i] + m_noise.magNoise * m_normal(m_rng);
+    }
+    return s;
+}
+
+void SyntheticImu::integrate(double q[4], const double omega[3], double dt)
+{
+    // Exact update for constant body rate over dt: q <- q * exp(omega*dt/2)
+    double wx = omega[0], wy = omega[1], wz = omega[2];
+    double rate = std::sqrt(wx * wx + wy * wy + wz * wz);
+    double half = 0.5 * rate * dt;
+    double c = std::cos(half);
+    double k = rate > 1e-12 ? std::sin(half) / rate : 0.5 * dt;
+    double dw = c, dx = wx * k, dy = wy * k, dz = wz * k;
+
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    q[0] = w * dw - x * dx - y * dy - z * dz;
+    q[1] = w * dx + x * dw + y * dz - z * dy;
+    q[2] = w * dy - x * dz + y * dw + z * dx;
+    q[3] = w * dz + x * dy - y * dx + z * dw;
+
+    double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; ++i) {
+        q[i] /= norm;
+    }
+}
+
+void SyntheticImu::advanceTo(double t)
+{
+    while (m_time < t) {
+        double dt = std::min(kMaxStep, t - m_time);
+        // Midpoint rate keeps sinusoidal segments accurate
+        double omega[3];
+        m_profile.angularVelocity(m_time + 0.5 * dt, omega);
+        integrate(m_q, omega, dt);
+        m_time += dt;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Scripted device motion and an IMU model on top of it, used by the synthetic
+// Qt Sensors backend and the offline tools. Plain C++ (no Qt).
+//
+// A motion profile is a looping list of segments, each giving the body-frame
+// angular velocity for a duration. The true orientation is integrated from it
+// exactly; the IMU model derives gravity and magnetic field in the body frame
+// and adds white noise, a constant bias and a bias random walk.
+
+#include <random>
+#include <string>
+#include <vector>
+
+struct MotionSegment {
+    enum Kind {
+        Constant, // rate = value
+        Sine      // rate = value * sin(2*pi*frequency*t)
+    };
+    Kind kind = Constant;
+    double duration = 1.0;          // s
+    double value[3] = {0, 0, 0};    // deg/s
+    double frequency = 0.0;         // Hz, Sine only
+};
+
+class MotionProfile
+{
+public:
+    // Built-in profiles: still, yaw, wobble, handheld
+    static bool fromName(const std::string &name, MotionProfile &profile);
+
+    // Script, one segment per line ('#' starts a comment):
+    //   <duration_s> constant <wx> <wy> <wz>
+    //   <duration_s> sine <wx> <wy> <wz> <frequency_hz>
+    // with rates in deg/s. The script loops.
+    static bool fromScript(const std::string &path, MotionProfile &profile, std::string *error = nullptr);
+
+    // Name of a built-in profile or path to a script
+    static bool load(const std::string &nameOrPath, MotionProfile &profile, std::string *error = nullptr);
+
+    void addSegment(const MotionSegment &segment);
+    bool isEmpty() const;
+
+    // Body-frame angular velocity in rad/s
+    void angularVelocity(double t, double omega[3]) const;
+
+private:
+    std::vector<MotionSegment> m_segments;
+    double m_period = 0.0;
+};
+
+struct ImuNoiseModel {
+    double gyroNoiseDensity = 0.005;     // rad/s/sqrt(Hz)
+    double gyroBias[3] = {0.002, -0.001, 0.0015}; // rad/s
+    double gyroBiasWalk = 0.0001;        // rad/s/sqrt(s)
+    double accelNoiseDensity = 0.002;    // (m/s^2)/sqrt(Hz)
+    double magNoise = 0.5;               // uT per sample
+};
+
+struct ImuSample {
+    double t;                 // s since start
+    double accel[3];          // m/s^2, +9.81 on Z when flat and at rest
+    double gyro[3];           // rad/s
+    double mag[3];            // uT
+    double truth[4];          // true orientation w, x, y, z (body to world)
+};
+
+class SyntheticImu
+{
+public:
+    SyntheticImu(const MotionProfile &profile, const ImuNoiseModel &noise, unsigned seed = 1);
+
+    // Advances the true motion to time t (non-decreasing) and returns a noisy
+    // measurement. rate is the sampling rate the noise density applies to.
+    ImuSample sample(double t, double rate);
+
+    static void integrate(double q[4], const double omega[3], double dt);
+
+private:
+    void advanceTo(double t);
+
+    MotionProfile m_profile;
+    ImuNoiseModel m_noise;
+    std::mt19937 m_rng;
+    std::normal_distribution<double> m_normal;
+    double m_time;
+    double m_q[4];
+    double m_biasWalk[3];
+};
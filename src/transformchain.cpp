@@ -0,0 +1,271 @@
+#include "transformchain.h"
+#include <cmath>
+#include <sstream>
+
+namespace {
+
+void multiply(const double a[4], const double b[4], double out[4])
+{
+    double w = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+    double x = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+    double y = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+    double z = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+    out[0] = w; out[1] = x; out[2] = y; out[3] = z;
+}
+
+void rotate(const double q[4], const double v[3], double out[3])
+{
+    // v + 2w(u x v) + 2u x (u x v), u = vector part
+    double ux = q[1], uy = q[2], uz = q[3];
+    double cx = uy * v[2] - uz * v[1];
+    double cy = uz * v[0] - ux * v[2];
+    double cz = ux * v[1] - uy * v[0];
+    out[0] = v[0] + 2.0 * (q[0] * cx + uy * cz - uz * cy);
+    out[1] = v[1] + 2.0 * (q[0] * cy + uz * cx - ux * cz);
+    out[2] = v[2] + 2.0 * (q[0] * cz + ux * cy - uy * cx);
+}
+
+}
+
+void Pose::toMatrix(double m[3][4]) const
+{
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    m[0][0] = 1.0 - 2.0 * (y*y + z*z);
+    m[0][1] = 2.0 * (x*y - w*z);
+    m[0][2] = 2.0 * (x*z + w*y);
+    m[1][0] = 2.0 * (x*y + w*z);
+    m[1][1] = 1.0 - 2.0 * (x*x + z*z);
+    m[1][2] = 2.0 * (y*z - w*x);
+    m[2][0] = 2.0 * (x*z - w*y);
+    m[2][1] = 2.0 * (y*z + w*x);
+    m[2][2] = 1.0 - 2.0 * (x*x + y*y);
+    m[0][3] = t[0];
+    m[1][3] = t[1];
+    m[2][3] = t[2];
+}
+
+TransformChain::TransformChain()
+    : m_axis{0, 1, 2}
+    , m_sign{-1, 1, 1} // X flip, as the stream has always been sent
+    , m_tip{0.0, 0.0, 0.0}
+    , m_left{1.0, 0.0, 0.0, 0.0}
+    , m_right{1.0, 0.0, 0.0, 0.0}
+    , m_conjugate(false)
+    , m_generation(0)
+{
+    compose();
+}
+
+bool TransformChain::setAxisMap(const std::string &spec)
+{
+    int axis[3], sign[3];
+    bool used[3] = {false, false, false};
+    std::istringstream in(spec);
+    std::string token;
+    int count = 0;
+    while (std::getline(in, token, ',')) {
+        // Trim spaces
+        token.erase(0, token.find_first_not_of(' '));
+        token.erase(token.find_last_not_of(' ') + 1);
+        if (count == 3 || token.empty()) {
+            return false;
+        }
+        int s = 1;
+        if (token[0] == '-' || token[0] == '+') {
+            s = token[0] == '-' ? -1 : 1;
+            token.erase(0, 1);
+        }
+        if (token.size() != 1 || token[0] < 'x' || token[0] > 'z' || used[token[0] - 'x']) {
+            return false;
+        }
+        axis[count] = token[0] - 'x';
+        sign[count] = s;
+        used[axis[count]] = true;
+        ++count;
+    }
+    if (count != 3) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        m_axis[i] = axis[i];
+        m_sign[i] = sign[i];
+    }
+    compose();
+    return true;
+}
+
+std::string TransformChain::axisMap() const
+{
+    std::string spec;
+    for (int i = 0; i < 3; ++i) {
+        if (i > 0) spec += ',';
+        if (m_sign[i] < 0) spec += '-';
+        spec += char('x' + m_axis[i]);
+    }
+    return spec;
+}
+
+void TransformChain::setTipOffset(double x, double y, double z)
+{
+    m_tip[0] = x;
+    m_tip[1] = y;
+    m_tip[2] = z;
+    compose();
+}
+
+void TransformChain::toOutputAxes(const double device[3], double out[3]) const
+{
+    for (int i = 0; i < 3; ++i) {
+        out[i] = m_sign[i] * device[m_axis[i]];
+    }
+}
+
+bool TransformChain::setRegistration(const double matrix[3][4])
+{
+    // Only rigid transforms can be applied as a quaternion and translation.
+    // The comparisons fail for NaN.
+    for (int i = 0; i < 3; ++i) {
+        if (!std::isfinite(matrix[i][3])) {
+            return false;
+        }
+        for (int j = 0; j < 3; ++j) {
+            const double dot = matrix[i][0] * matrix[j][0] + matrix[i][1] * matrix[j][1] + matrix[i][2] * matrix[j][2];
+            if (!(std::abs(dot - (i == j ? 1.0 : 0.0)) <= 1e-3)) {
+                return false;
+            }
+        }
+    }
+    // Orthonormal rows can still describe a reflection (det = -1), which no
+    // rotation quaternion can represent
+    const double det = matrix[0][0] * (matrix[1][1] * matrix[2][2] - matrix[1][2] * matrix[2][1])
+                     - matrix[0][1] * (matrix[1][0] * matrix[2][2] - matrix[1][2] * matrix[2][0])
+                     + matrix[0][2] * (matrix[1][0] * matrix[2][1] - matrix[1][1] * matrix[2][0]);
+    if (!(std::abs(det - 1.0) <= 1e-3)) {
+        return false;
+    }
+
+    Pose registration;
+    const double r[3][3] = {
+        {matrix[0][0], matrix[0][1], matrix[0][2]},
+        {matrix[1][0], matrix[1][1], matrix[1][2]},
+        {matrix[2][0], matrix[2][1], matrix[2][2]},
+    };
+    quaternionFromMatrix(r, registration.q);
+    for (int i = 0; i < 3; ++i) {
+        registration.t[i] = matrix[i][3];
+    }
+    setRegistration(registration);
+    return true;
+}
+
+void TransformChain::setRegistration(const Pose &registration)
+{
+    m_registration = registration;
+    double norm = std::sqrt(m_registration.q[0] * m_registration.q[0] + m_registration.q[1] * m_registration.q[1] +
+                            m_registration.q[2] * m_registration.q[2] + m_registration.q[3] * m_registration.q[3]);
+    if (norm > 0.0) {
+        for (int i = 0; i < 4; ++i) {
+            m_registration.q[i] /= norm;
+        }
+    } else {
+        m_registration = Pose();
+    }
+    compose();
+}
+
+void TransformChain::resetRegistration()
+{
+    setRegistration(Pose());
+}
+
+Pose TransformChain::apply(double w, double x, double y, double z) const
+{
+    Pose pose;
+    double norm = std::sqrt(w*w + x*x + y*y + z*z);
+    double q[4] = {1.0, 0.0, 0.0, 0.0};
+    if (norm > 0.0) {
+        double s = m_conjugate ? -1.0 / norm : 1.0 / norm;
+        q[0] = w / norm;
+        q[1] = x * s;
+        q[2] = y * s;
+        q[3] = z * s;
+    }
+
+    double temp[4];
+    multiply(m_left, q, temp);
+    multiply(temp, m_right, pose.q);
+
+    rotate(pose.q, m_tip, pose.t);
+    for (int i = 0; i < 3; ++i) {
+        pose.t[i] += m_registration.t[i];
+    }
+    return pose;
+}
+
+uint64_t TransformChain::generation() const
+{
+    return m_generation;
+}
+
+void TransformChain::quaternionFromMatrix(const double r[3][3], double q[4])
+{
+    double trace = r[0][0] + r[1][1] + r[2][2];
+    if (trace > 0.0) {
+        double s = std::sqrt(trace + 1.0) * 2.0;
+        q[0] = 0.25 * s;
+        q[1] = (r[2][1] - r[1][2]) / s;
+        q[2] = (r[0][2] - r[2][0]) / s;
+        q[3] = (r[1][0] - r[0][1]) / s;
+    } else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+        double s = std::sqrt(1.0 + r[0][0] - r[1][1] - r[2][2]) * 2.0;
+        q[0] = (r[2][1] - r[1][2]) / s;
+        q[1] = 0.25 * s;
+        q[2] = (r[0][1] + r[1][0]) / s;
+        q[3] = (r[0][2] + r[2][0]) / s;
+    } else if (r[1][1] > r[2][2]) {
+        double s = std::sqrt(1.0 + r[1][1] - r[0][0] - r[2][2]) * 2.0;
+        q[0] = (r[0][2] - r[2][0]) / s;
+        q[1] = (r[0][1] + r[1][0]) / s;
+        q[2] = 0.25 * s;
+        q[3] = (r[1][2] + r[2][1]) / s;
+    } else {
+        double s = std::sqrt(1.0 + r[2][2] - r[0][0] - r[1][1]) * 2.0;
+        q[0] = (r[1][0] - r[0][1]) / s;
+        q[1] = (r[0][2] + r[2][0]) / s;
+        q[2] = (r[1][2] + r[2][1]) / s;
+        q[3] = 0.25 * s;
+    }
+}
+
+void TransformChain::compose()
+{
+    // The remap S acts on the quaternion vector part. A proper S (det +1) is
+    // the rotation P = S, applied as p q p*. An improper S is -P for the
+    // rotation P = -S; then (w, S v) = p q* p*.
+    double s[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    for (int i = 0; i < 3; ++i) {
+        s[i][m_axis[i]] = m_sign[i];
+    }
+    double det = s[0][0] * (s[1][1] * s[2][2] - s[1][2] * s[2][1])
+               - s[0][1] * (s[1][0] * s[2][2] - s[1][2] * s[2][0])
+               + s[0][2] * (s[1][0] * s[2][1] - s[1][1] * s[2][0]);
+    m_conjugate = det < 0.0;
+    if (m_conjugate) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                s[i][j] = -s[i][j];
+            }
+        }
+    }
+
+    double p[4];
+    quaternionFromMatrix(s, p);
+    multiply(m_registration.q, p, m_left);
+    m_right[0] = p[0];
+    m_right[1] = -p[1];
+    m_right[2] = -p[2];
+    m_right[3] = -p[3];
+
+    ++m_generation;
+}
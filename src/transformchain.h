@@ -0,0 +1,72 @@
+#pragma once
+
+// Frame transforms applied to every pose before it is encoded. Plain C++
+// (no Qt).
+//
+// The output pose is
+//   registration * remap(device rotation) * tipOffset
+// where remap is a signed axis permutation of the quaternion vector part
+// (the default "-x,y,z" is the historical X flip), tipOffset moves the
+// reported point along the remapped device axes (e.g. to a tool tip) and
+// registration maps the device frame into the reference frame.
+//
+// Changing a parameter recomposes the chain once into two quaternions and
+// a few flags; apply() is then a fixed sequence of quaternion products.
+
+#include <cstdint>
+#include <string>
+
+struct Pose {
+    double q[4] = {1.0, 0.0, 0.0, 0.0}; // rotation w, x, y, z
+    double t[3] = {0.0, 0.0, 0.0};      // translation in mm
+
+    // Rows of the 3x4 matrix [R | t]
+    void toMatrix(double m[3][4]) const;
+};
+
+class TransformChain
+{
+public:
+    TransformChain();
+
+    // Comma-separated signed axes, one per output component, e.g. "-x,y,z"
+    // or "y,-x,z". Returns false (and keeps the current map) if the spec is
+    // not a signed permutation.
+    bool setAxisMap(const std::string &spec);
+    std::string axisMap() const;
+
+    void setTipOffset(double x, double y, double z);
+    // A device-frame vector in the remapped axes setTipOffset() takes, e.g.
+    // for a tip found by pivot calibration
+    void toOutputAxes(const double device[3], double out[3]) const;
+
+    // Device-to-reference registration, rows of [R | t] with the
+    // translation in mm. Returns false (and keeps the current registration)
+    // unless R is a rotation: orthonormal with determinant 1, all finite.
+    bool setRegistration(const double matrix[3][4]);
+    void setRegistration(const Pose &registration);
+    void resetRegistration();
+
+    Pose apply(double w, double x, double y, double z) const;
+
+    // Incremented on every change, lets callers notice a new configuration
+    uint64_t generation() const;
+
+    static void quaternionFromMatrix(const double r[3][3], double q[4]);
+
+private:
+    void compose();
+
+    // Parameters
+    int m_axis[3];      // source component (0..2) per output component
+    int m_sign[3];
+    double m_tip[3];
+    Pose m_registration;
+
+    // Composed form: q_out = m_left * (m_conjugate ? q* : q) * m_right,
+    // t_out = q_out * tip + registration translation
+    double m_left[4];
+    double m_right[4];
+    bool m_conjugate;
+    uint64_t m_generation;
+};
@@ -0,0 +1,295 @@
+// crc64bench - checks the CRC64 implementations and the hand-rolled message
+// packing against OpenIGTLink, then measures their throughput for the body
+// sizes the app sends.
+//
+//   crc64bench [--sizes <n,n,...>] [--seconds <per case>] [--verify-only]
+
+#include "crc64.h"
+#include "igtlmessages.h"
+#include "igtl_util.h"
+#include "igtlSensorMessage.h"
+#include "igtlTransformMessage.h"
+#include "igtlUnit.h"
+#include "igtlTimeStamp.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// TRANSFORM body, STATUS body with an empty message, a batch of 8 TRANSFORM
+// messages and a large block for reference
+const char kDefaultSizes[] = "48,31,848,65536";
+
+struct Options {
+    std::vector<size_t> sizes;
+    double seconds = 0.5;
+    bool verifyOnly = false;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr, "Usage: crc64bench [--sizes <n,n,...>] [--seconds <per case>] [--verify-only]\n");
+}
+
+bool parseSizes(const std::string &text, std::vector<size_t> &sizes)
+{
+    sizes.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const long value = std::atol(item.c_str());
+        if (value <= 0) {
+            return false;
+        }
+        sizes.push_back(size_t(value));
+    }
+    return !sizes.empty();
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    parseSizes(kDefaultSizes, options.sizes);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            if (!parseSizes(argv[++i], options.sizes)) {
+                return false;
+            }
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::atof(argv[++i]);
+            if (options.seconds <= 0.0) {
+                return false;
+            }
+        } else if (arg == "--verify-only") {
+            options.verifyOnly = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+const Crc64::Implementation kImplementations[] = {Crc64::Bytewise, Crc64::Slice8, Crc64::Clmul};
+
+// Every implementation against igtl_util_crc64 for all lengths up to 1 KiB at
+// every alignment, plus the standard check value
+bool verifyCrc()
+{
+    bool ok = true;
+    const uint64_t check = Crc64::compute(Crc64::Bytewise, "123456789", 9);
+    if (check != 0x6C40DF5F0B497347ULL) {
+        std::fprintf(stderr, "crc64bench: check value %016llx, expected 6c40df5f0b497347\n",
+                     static_cast<unsigned long long>(check));
+        ok = false;
+    }
+
+    std::mt19937_64 random(1);
+    std::vector<uint8_t> buffer(1024 + 16);
+    for (uint8_t &byte : buffer) {
+        byte = uint8_t(random());
+    }
+
+    for (Crc64::Implementation implementation : kImplementations) {
+        if (!Crc64::isAvailable(implementation)) {
+            continue;
+        }
+        int failures = 0;
+        for (size_t offset = 0; offset < 16; ++offset) {
+            for (size_t size = 0; size <= 1024; ++size) {
+                uint8_t *data = buffer.data() + offset;
+                const uint64_t expected = igtl_util_crc64(0, size, data);
+                if (Crc64::compute(implementation, data, size) != expected) {
+                    ++failures;
+                }
+                // Continuing from a previous CRC
+                const size_t split = size / 3;
+                const uint64_t head = Crc64::compute(implementation, data, split);
+                if (Crc64::compute(implementation, data + split, size - split, head) != expected) {
+                    ++failures;
+                }
+            }
+        }
+        std::printf("verify %-8s %s\n", Crc64::name(implementation), failures == 0 ? "ok" : "FAILED");
+        ok = ok && failures == 0;
+    }
+    return ok;
+}
+
+// IgtlMessages::packTransform against igtl::TransformMessage::Pack()
+bool verifyTransform()
+{
+    std::mt19937_64 random(2);
+    std::uniform_real_distribution<double> value(-500.0, 500.0);
+    int failures = 0;
+    for (int i = 0; i < 1000; ++i) {
+        double rows[3][4];
+        igtl::Matrix4x4 matrix;
+        igtl::IdentityMatrix(matrix);
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                rows[r][c] = value(random);
+                matrix[r][c] = float(rows[r][c]);
+            }
+        }
+        const uint32_t seconds = uint32_t(random());
+        const uint32_t nanoseconds = uint32_t(random() % 1000000000);
+
+        igtl::TimeStamp::Pointer ts = igtl::TimeStamp::New();
+        ts->SetTime(seconds, nanoseconds);
+        igtl::TransformMessage::Pointer message = igtl::TransformMessage::New();
+        message->SetDeviceName("MobileDevice");
+        message->SetMatrix(matrix);
+        message->SetTimeStamp(ts);
+        message->Pack();
+
+        uint8_t packed[IgtlMessages::kTransformMessageSize];
+        IgtlMessages::packTransform(packed, "MobileDevice", IgtlMessages::timestamp(seconds, nanoseconds), rows);
+        if (size_t(message->GetPackSize()) != sizeof(packed)
+            || std::memcmp(message->GetPackPointer(), packed, sizeof(packed)) != 0) {
+            ++failures;
+        }
+    }
+    std::printf("verify %-8s %s\n", "transform", failures == 0 ? "ok" : "FAILED");
+    return failures == 0;
+}
+
+// IgtlMessages::packSensor and packUnit against igtl::SensorMessage and
+// igtl::Unit
+bool verifySensor()
+{
+    igtl::Unit reference;
+    reference.SetPrefix(IGTL_UNIT_PREFIX_NONE);
+    reference.Append(IGTL_UNIT_SI_BASE_METER, 1);
+    reference.Append(IGTL_UNIT_SI_BASE_SECOND, -2);
+    const IgtlMessages::UnitFactor factors[] = {{IgtlMessages::kUnitMeter, 1}, {IgtlMessages::kUnitSecond, -2}};
+    const igtlUint64 unit = IgtlMessages::packUnit(factors, 2);
+    int failures = reference.Pack() == unit ? 0 : 1;
+
+    std::mt19937_64 random(4);
+    std::uniform_real_distribution<double> value(-50.0, 50.0);
+    for (int i = 0; i < 1000; ++i) {
+        double values[3];
+        const uint32_t seconds = uint32_t(random());
+        const uint32_t nanoseconds = uint32_t(random() % 1000000000);
+
+        igtl::TimeStamp::Pointer ts = igtl::TimeStamp::New();
+        ts->SetTime(seconds, nanoseconds);
+        igtl::SensorMessage::Pointer message = igtl::SensorMessage::New();
+        message->SetDeviceName("MobileDevice-Accel");
+        message->SetLength(3);
+        for (int k = 0; k < 3; ++k) {
+            values[k] = value(random);
+            message->SetValue(k, values[k]);
+        }
+        message->SetUnit(unit);
+        message->SetTimeStamp(ts);
+        message->Pack();
+
+        uint8_t packed[IgtlMessages::kHeaderSize + IgtlMessages::kSensorFixedSize + 3 * 8];
+        IgtlMessages::packSensor(packed, "MobileDevice-Accel", IgtlMessages::timestamp(seconds, nanoseconds),
+                                 values, 3, unit);
+        if (size_t(message->GetPackSize()) != sizeof(packed)
+            || std::memcmp(message->GetPackPointer(), packed, sizeof(packed)) != 0) {
+            ++failures;
+        }
+    }
+    std::printf("verify %-8s %s\n", "sensor", failures == 0 ? "ok" : "FAILED");
+    return failures == 0;
+}
+
+// Runs fn repeatedly for about `seconds` and returns nanoseconds per call
+template <typename Function>
+double measure(double seconds, Function fn)
+{
+    using Clock = std::chrono::steady_clock;
+    size_t calls = 0;
+    size_t batch = 1024;
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    auto now = start;
+    while (now < end) {
+        for (size_t i = 0; i < batch; ++i) {
+            fn();
+        }
+        calls += batch;
+        now = Clock::now();
+    }
+    return std::chrono::duration<double, std::nano>(now - start).count() / double(calls);
+}
+
+volatile uint64_t g_sink;
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    bool ok = verifyCrc();
+    ok = verifyTransform() && ok;
+    ok = verifySensor() && ok;
+    if (!ok) {
+        return 1;
+    }
+    if (options.verifyOnly) {
+        return 0;
+    }
+
+    std::printf("\nselected: %s\n\n", Crc64::name(Crc64::best()));
+    std::printf("%10s %-10s %10s %12s\n", "bytes", "impl", "ns/call", "GB/s");
+
+    std::mt19937_64 random(3);
+    for (size_t size : options.sizes) {
+        std::vector<uint8_t> buffer(size);
+        for (uint8_t &byte : buffer) {
+            byte = uint8_t(random());
+        }
+
+        const double reference = measure(options.seconds, [&] {
+            g_sink = igtl_util_crc64(0, buffer.size(), buffer.data());
+        });
+        std::printf("%10zu %-10s %10.1f %12.3f\n", size, "igtl", reference, double(size) / reference);
+
+        for (Crc64::Implementation implementation : kImplementations) {
+            if (!Crc64::isAvailable(implementation)) {
+                continue;
+            }
+            const double ns = measure(options.seconds, [&] {
+                g_sink = Crc64::compute(implementation, buffer.data(), buffer.size());
+            });
+            std::printf("%10zu %-10s %10.1f %12.3f\n", size, Crc64::name(implementation), ns, double(size) / ns);
+        }
+    }
+
+    // Whole TRANSFORM message, as the app packs one per pose
+    double rows[3][4] = {{1, 0, 0, 10}, {0, 1, 0, 20}, {0, 0, 1, 30}};
+    igtl::Matrix4x4 matrix;
+    igtl::IdentityMatrix(matrix);
+    const double library = measure(options.seconds, [&] {
+        igtl::TransformMessage::Pointer message = igtl::TransformMessage::New();
+        message->SetDeviceName("MobileDevice");
+        message->SetMatrix(matrix);
+        message->Pack();
+        g_sink = message->GetPackSize();
+    });
+    uint8_t packed[IgtlMessages::kTransformMessageSize];
+    const double handRolled = measure(options.seconds, [&] {
+        IgtlMessages::packTransform(packed, "MobileDevice", 0, rows);
+        g_sink = packed[IgtlMessages::kHeaderSize - 1];
+    });
+    std::printf("\n%-28s %10.1f ns/message\n", "TransformMessage::Pack()", library);
+    std::printf("%-28s %10.1f ns/message\n", "IgtlMessages::packTransform", handRolled);
+    return 0;
+}
@@ -0,0 +1,663 @@
+// igtlbatch - runs the app's orientation fusion (see fusioncore.h) over many
+// recorded sensor sessions and a grid of filter parameters, in parallel, and
+// reports accuracy, drift and throughput per parameter set.
+//
+//   igtlbatch [<session.csv>|<directory>]... [--synthetic <count>]
+//             [--profile <name|script>] [--duration <seconds>] [--rate <Hz>]
+//             [--algorithm <list>] [--integrator <list>] [--beta <list>]
+//             [--rates <list>] [--ideal] [--warmup <seconds>]
+//             [--threads <n>] [--output <results.csv>]
+//   igtlbatch <sessions>... --noise [--drift-target <deg/min>] [--rate <Hz>]
+//
+// Sessions are CSV files with the columns t,ax,ay,az,gx,gy,gz,mx,my,mz (time
+// in s, gyroscope in rad/s, accelerometer and magnetometer in any unit) as
+// written by the app with OPENIGTLINK_SENSOR_LOG, optionally followed by a
+// ground-truth orientation qw,qx,qy,qz. --synthetic adds generated sessions
+// with ground truth (see syntheticmotion.h). Lists are comma-separated.
+//
+// Accuracy is the angle between the fused and the reference rotation since
+// the end of the warm-up, measured in the device frame so each algorithm's
+// choice of world frame does not matter. The reference is the ground truth
+// when present, otherwise the drift-free accelerometer + magnetometer
+// estimate.
+//
+// --rates repeats the run at each sample rate: synthetic sessions are
+// generated at it and recorded ones thinned out to it, so the drift of each
+// gyro integrator (see FusionCore::Integrator) can be compared against the
+// rate. --ideal leaves noise and bias out of the synthetic IMU, which leaves
+// only the integration error.
+//
+// --noise treats each session as a recording of a device at rest and prints
+// the gyroscope Allan deviation and the fusion parameters the app would tune
+// itself to (see noiseestimator.h) for a fusion rate of --rate.
+
+#include "fusioncore.h"
+#include "noiseestimator.h"
+#include "syntheticmotion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Sample {
+    double t;
+    FusionInput input;
+    double truth[4];
+};
+
+struct Session {
+    std::string name;
+    std::vector<Sample> samples;
+    bool hasTruth = false;
+};
+
+struct Result {
+    double rmsErrorDeg = 0.0;
+    double maxErrorDeg = 0.0;
+    double driftDegPerMin = 0.0;
+    size_t samples = 0;
+};
+
+struct Options {
+    std::vector<std::string> inputs;
+    int syntheticCount = 0;
+    std::string profile = "handheld";
+    double duration = 60.0;
+    double rate = 100.0;
+    std::vector<FusionCore::Algorithm> algorithms = {FusionCore::GyroIntegration};
+    std::vector<FusionCore::Integrator> integrators = {FusionCore::ExpMap};
+    std::vector<double> betas = {0.1};
+    std::vector<double> rates; // empty: --rate and the recorded rates
+    bool ideal = false;
+    double warmup = 10.0;
+    unsigned threads = 0;
+    std::string outputPath;
+    bool noise = false;
+    double driftTarget = 1.0;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+                 "Usage: igtlbatch [<session.csv>|<directory>]... [--synthetic <count>]\n"
+                 "                 [--profile <name|script>] [--duration <seconds>] [--rate <Hz>]\n"
+                 "                 [--algorithm gyro,madgwick,accelmag] [--integrator euler,expmap,rk4]\n"
+                 "                 [--beta <list>] [--rates <list>] [--ideal]\n"
+                 "                 [--warmup <seconds>] [--threads <n>] [--output <results.csv>]\n"
+                 "       igtlbatch <sessions>... --noise [--drift-target <deg/min>] [--rate <Hz>]\n");
+}
+
+std::vector<std::string> splitList(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--synthetic" && hasValue) {
+            options.syntheticCount = std::atoi(argv[++i]);
+        } else if (arg == "--profile" && hasValue) {
+            options.profile = argv[++i];
+        } else if (arg == "--duration" && hasValue) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::atof(argv[++i]);
+        } else if (arg == "--algorithm" && hasValue) {
+            options.algorithms.clear();
+            for (const std::string &name : splitList(argv[++i])) {
+                FusionCore::Algorithm algorithm;
+                if (!FusionCore::algorithmFromName(name.c_str(), algorithm)) {
+                    std::fprintf(stderr, "igtlbatch: unknown algorithm %s\n", name.c_str());
+                    return false;
+                }
+                options.algorithms.push_back(algorithm);
+            }
+        } else if (arg == "--integrator" && hasValue) {
+            options.integrators.clear();
+            for (const std::string &name : splitList(argv[++i])) {
+                FusionCore::Integrator integrator;
+                if (!FusionCore::integratorFromName(name.c_str(), integrator)) {
+                    std::fprintf(stderr, "igtlbatch: unknown integrator %s\n", name.c_str());
+                    return false;
+                }
+                options.integrators.push_back(integrator);
+            }
+        } else if (arg == "--rates" && hasValue) {
+            options.rates.clear();
+            for (const std::string &value : splitList(argv[++i])) {
+                options.rates.push_back(std::atof(value.c_str()));
+                if (options.rates.back() <= 0.0) {
+                    return false;
+                }
+            }
+        } else if (arg == "--ideal") {
+            options.ideal = true;
+        } else if (arg == "--beta" && hasValue) {
+            options.betas.clear();
+            for (const std::string &value : splitList(argv[++i])) {
+                options.betas.push_back(std::atof(value.c_str()));
+            }
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::atof(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = unsigned(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--noise") {
+            options.noise = true;
+        } else if (arg == "--drift-target" && hasValue) {
+            options.driftTarget = std::atof(argv[++i]);
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    return (!options.inputs.empty() || options.syntheticCount > 0) && options.rate > 0.0 &&
+           !options.algorithms.empty() && !options.integrators.empty() && !options.betas.empty();
+}
+
+bool loadCsv(const std::string &path, Session &session)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line)) {
+        return false;
+    }
+
+    // Column positions from the header
+    std::map<std::string, int> columns;
+    {
+        std::istringstream header(line);
+        std::string name;
+        int index = 0;
+        while (std::getline(header, name, ',')) {
+            name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+            columns[name] = index++;
+        }
+    }
+    auto has = [&](std::initializer_list<const char *> names) {
+        for (const char *name : names) {
+            if (!columns.count(name)) return false;
+        }
+        return true;
+    };
+    if (!has({"t"})) {
+        std::fprintf(stderr, "igtlbatch: %s has no t column\n", path.c_str());
+        return false;
+    }
+    const bool hasAccel = has({"ax", "ay", "az"});
+    const bool hasGyro = has({"gx", "gy", "gz"});
+    const bool hasMag = has({"mx", "my", "mz"});
+    session.hasTruth = has({"qw", "qx", "qy", "qz"});
+
+    std::vector<double> values;
+    while (std::getline(in, line)) {
+        values.clear();
+        std::istringstream fields(line);
+        std::string field;
+        while (std::getline(fields, field, ',')) {
+            values.push_back(std::atof(field.c_str()));
+        }
+        if (values.size() < columns.size()) {
+            continue;
+        }
+        auto value = [&](const char *name) { return values[columns[name]]; };
+
+        Sample sample;
+        sample.t = value("t");
+        sample.input.hasAccel = hasAccel;
+        sample.input.hasGyro = hasGyro;
+        sample.input.hasMag = hasMag;
+        if (hasAccel) {
+            sample.input.accel[0] = value("ax"); sample.input.accel[1] = value("ay"); sample.input.accel[2] = value("az");
+        }
+        if (hasGyro) {
+            sample.input.gyro[0] = value("gx"); sample.input.gyro[1] = value("gy"); sample.input.gyro[2] = value("gz");
+        }
+        if (hasMag) {
+            sample.input.mag[0] = value("mx"); sample.input.mag[1] = value("my"); sample.input.mag[2] = value("mz");
+        }
+        if (session.hasTruth) {
+            sample.truth[0] = value("qw"); sample.truth[1] = value("qx");
+            sample.truth[2] = value("qy"); sample.truth[3] = value("qz");
+        }
+        session.samples.push_back(sample);
+    }
+    session.name = path;
+    return !session.samples.empty();
+}
+
+Session makeSynthetic(const MotionProfile &profile, int index, double duration, double rate, bool ideal)
+{
+    Session session;
+    session.name = "synthetic-" + std::to_string(index);
+    session.hasTruth = true;
+
+    ImuNoiseModel noise;
+    if (ideal) {
+        noise = ImuNoiseModel{0.0, {0.0, 0.0, 0.0}, 0.0, 0.0, 0.0};
+    }
+    SyntheticImu imu(profile, noise, unsigned(index + 1));
+    const size_t count = size_t(duration * rate);
+    session.samples.reserve(count);
+    for (size_t i = 1; i <= count; ++i) {
+        ImuSample imuSample = imu.sample(i / rate, rate);
+        Sample sample;
+        sample.t = imuSample.t;
+        std::copy(imuSample.accel, imuSample.accel + 3, sample.input.accel);
+        std::copy(imuSample.gyro, imuSample.gyro + 3, sample.input.gyro);
+        std::copy(imuSample.mag, imuSample.mag + 3, sample.input.mag);
+        std::copy(imuSample.truth, imuSample.truth + 4, sample.truth);
+        sample.input.hasAccel = sample.input.hasGyro = sample.input.hasMag = true;
+        session.samples.push_back(sample);
+    }
+    return session;
+}
+
+// The session as a sensor running at rate would have delivered it: every
+// sample at least 1/rate after the previously kept one
+Session thinOut(const Session &session, double rate)
+{
+    Session thinned;
+    thinned.name = session.name;
+    thinned.hasTruth = session.hasTruth;
+    const double interval = 1.0 / rate;
+    double next = session.samples.front().t;
+    for (const Sample &sample : session.samples) {
+        // Small tolerance for timestamp jitter
+        if (sample.t >= next - 0.01 * interval) {
+            thinned.samples.push_back(sample);
+            next += interval;
+            if (next < sample.t) {
+                next = sample.t + interval;
+            }
+        }
+    }
+    return thinned;
+}
+
+// Mean sample rate of a set of sessions
+double measuredRate(const std::vector<Session> &sessions)
+{
+    double intervals = 0.0, seconds = 0.0;
+    for (const Session &session : sessions) {
+        intervals += double(session.samples.size() - 1);
+        seconds += session.samples.back().t - session.samples.front().t;
+    }
+    return seconds > 0.0 ? intervals / seconds : 0.0;
+}
+
+// Rotation angle in degrees between a0* a1 and b0* b1
+double relativeErrorDeg(const double a0[4], const double a1[4], const double b0[4], const double b1[4])
+{
+    double ra[4], rb[4];
+    FusionCore::quaternionMultiply(a0[0], -a0[1], -a0[2], -a0[3], a1[0], a1[1], a1[2], a1[3], ra[0], ra[1], ra[2], ra[3]);
+    FusionCore::quaternionMultiply(b0[0], -b0[1], -b0[2], -b0[3], b1[0], b1[1], b1[2], b1[3], rb[0], rb[1], rb[2], rb[3]);
+    double dot = std::abs(ra[0] * rb[0] + ra[1] * rb[1] + ra[2] * rb[2] + ra[3] * rb[3]);
+    return 2.0 * std::acos(std::min(1.0, dot)) * 180.0 / M_PI;
+}
+
+Result evaluate(const Session &session, const FusionCore::Parameters &parameters, double warmup)
+{
+    FusionCore fusion;
+    fusion.setParameters(parameters);
+
+    // Without ground truth, accelerometer + magnetometer is the reference
+    FusionCore reference;
+    FusionCore::Parameters referenceParameters;
+    referenceParameters.algorithm = FusionCore::AccelMag;
+    reference.setParameters(referenceParameters);
+
+    Result result;
+    double start[4] = {1, 0, 0, 0}, startReference[4] = {1, 0, 0, 0};
+    bool aligned = false;
+    double sumSquares = 0.0;
+    // Least-squares slope of the error over time
+    double sumT = 0.0, sumE = 0.0, sumTT = 0.0, sumTE = 0.0;
+    size_t count = 0;
+
+    double previousT = session.samples.front().t;
+    const double firstT = previousT;
+    for (const Sample &sample : session.samples) {
+        fusion.update(sample.input, sample.t - previousT);
+        previousT = sample.t;
+
+        double q[4], r[4];
+        fusion.orientation(q[0], q[1], q[2], q[3]);
+        if (session.hasTruth) {
+            std::copy(sample.truth, sample.truth + 4, r);
+        } else {
+            reference.update(sample.input, 0.0);
+            reference.orientation(r[0], r[1], r[2], r[3]);
+        }
+
+        if (sample.t - firstT < warmup) {
+            continue;
+        }
+        if (!aligned) {
+            std::copy(q, q + 4, start);
+            std::copy(r, r + 4, startReference);
+            aligned = true;
+        }
+
+        double error = relativeErrorDeg(start, q, startReference, r);
+        double t = sample.t - firstT;
+        sumSquares += error * error;
+        result.maxErrorDeg = std::max(result.maxErrorDeg, error);
+        sumT += t; sumE += error; sumTT += t * t; sumTE += t * error;
+        ++count;
+    }
+
+    result.samples = session.samples.size();
+    if (count > 0) {
+        result.rmsErrorDeg = std::sqrt(sumSquares / double(count));
+        double denominator = double(count) * sumTT - sumT * sumT;
+        if (denominator > 0.0) {
+            result.driftDegPerMin = 60.0 * (double(count) * sumTE - sumT * sumE) / denominator;
+        }
+    }
+    return result;
+}
+
+// Allan deviation table and tuning for one session recorded at rest
+void printNoise(FILE *out, const Session &session, const Options &options)
+{
+    NoiseEstimator estimator;
+    for (const Sample &sample : session.samples) {
+        if (sample.input.hasGyro) {
+            estimator.addSample(sample.input.gyro, sample.t);
+        }
+    }
+
+    std::fprintf(out, "%s\n%12s %14s %10s\n", session.name.c_str(), "tau_s", "adev_deg_per_h", "clusters");
+    for (int level = 0; level < NoiseEstimator::kLevelCount && estimator.clusterCount(level) > 0; ++level) {
+        std::fprintf(out, "%12.3f %14.3f %10llu\n", estimator.clusterTime(level),
+                     estimator.allanDeviation(level) * 180.0 / M_PI * 3600.0, estimator.clusterCount(level));
+    }
+
+    const NoiseEstimator::Estimate estimate = estimator.estimate();
+    FusionCore::Parameters parameters;
+    const bool tuned = NoiseEstimator::tune(estimate, options.driftTarget, options.rate, parameters);
+    std::fprintf(out, "ARW %.4f deg/sqrt(h), bias instability %.3f deg/h, bias %.4f %.4f %.4f deg/s, "
+                 "predicted gyro drift %.3f deg/min\n",
+                 estimate.angleRandomWalk * 180.0 / M_PI * 60.0, estimate.biasInstability * 180.0 / M_PI * 3600.0,
+                 estimate.bias[0] * 180.0 / M_PI, estimate.bias[1] * 180.0 / M_PI, estimate.bias[2] * 180.0 / M_PI,
+                 NoiseEstimator::predictedDriftDegPerMin(estimate));
+    if (tuned) {
+        std::fprintf(out, "tuned: %s, beta %.4f\n\n", FusionCore::algorithmName(parameters.algorithm), parameters.beta);
+    } else {
+        std::fprintf(out, "tuned: not enough data (%.1f s)\n\n", estimate.stillSeconds);
+    }
+}
+
+// Fixed set of workers, each with its own task deque. A worker takes work
+// from the back of its own deque and, when that is empty, steals from the
+// front of the others', so long sessions do not leave cores idle at the end.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned workers)
+        : m_queues(workers)
+    {
+    }
+
+    void run(std::vector<std::function<void()>> tasks)
+    {
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            m_queues[i % m_queues.size()].tasks.push_back(std::move(tasks[i]));
+        }
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < m_queues.size(); ++i) {
+            threads.emplace_back([this, i]() { work(i); });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint64_t steals() const
+    {
+        return m_steals;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(size_t self, std::function<void()> &task)
+    {
+        {
+            Queue &own = m_queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+            Queue &victim = m_queues[(self + offset) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                ++m_steals;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        // Tasks never create tasks, so all deques empty means done
+        std::function<void()> task;
+        while (take(self, task)) {
+            task();
+        }
+    }
+
+    std::vector<Queue> m_queues;
+    std::atomic<uint64_t> m_steals{0};
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Load everything up front; sessions are shared read-only by the workers
+    std::vector<std::string> paths;
+    for (const std::string &input : options.inputs) {
+        if (std::filesystem::is_directory(input)) {
+            for (const auto &entry : std::filesystem::directory_iterator(input)) {
+                if (entry.path().extension() == ".csv") {
+                    paths.push_back(entry.path().string());
+                }
+            }
+        } else {
+            paths.push_back(input);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Session> recorded;
+    for (const std::string &path : paths) {
+        Session session;
+        if (loadCsv(path, session)) {
+            recorded.push_back(std::move(session));
+        } else {
+            std::fprintf(stderr, "igtlbatch: skipping %s\n", path.c_str());
+        }
+    }
+    MotionProfile profile;
+    if (options.syntheticCount > 0) {
+        std::string error;
+        if (!MotionProfile::load(options.profile, profile, &error)) {
+            std::fprintf(stderr, "igtlbatch: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // One group of sessions per sample rate
+    std::vector<std::vector<Session>> groups;
+    if (options.rates.empty()) {
+        groups.push_back(std::move(recorded));
+        for (int i = 0; i < options.syntheticCount; ++i) {
+            groups.back().push_back(makeSynthetic(profile, i, options.duration, options.rate, options.ideal));
+        }
+    } else {
+        for (double rate : options.rates) {
+            groups.emplace_back();
+            for (const Session &session : recorded) {
+                Session thinned = thinOut(session, rate);
+                if (thinned.samples.size() > 1) {
+                    groups.back().push_back(std::move(thinned));
+                }
+            }
+            for (int i = 0; i < options.syntheticCount; ++i) {
+                groups.back().push_back(makeSynthetic(profile, i, options.duration, rate, options.ideal));
+            }
+        }
+    }
+    if (groups.front().empty()) {
+        std::fprintf(stderr, "igtlbatch: no sessions to process\n");
+        return 1;
+    }
+
+    if (options.noise) {
+        for (const Session &session : groups.front()) {
+            printNoise(stdout, session, options);
+        }
+        return 0;
+    }
+
+    // Parameter grid
+    std::vector<FusionCore::Parameters> grid;
+    for (FusionCore::Algorithm algorithm : options.algorithms) {
+        for (FusionCore::Integrator integrator : options.integrators) {
+            for (double beta : options.betas) {
+                FusionCore::Parameters parameters;
+                parameters.algorithm = algorithm;
+                parameters.integrator = integrator;
+                parameters.beta = beta;
+                grid.push_back(parameters);
+                if (algorithm != FusionCore::Madgwick) {
+                    break; // beta only affects Madgwick
+                }
+            }
+            if (algorithm != FusionCore::GyroIntegration) {
+                break; // the integrator only affects gyro integration
+            }
+        }
+    }
+
+    // One task per (rate, parameter set, session); every task writes its own
+    // slot
+    std::vector<std::vector<Result>> results(groups.size());
+    std::vector<std::function<void()>> tasks;
+    size_t sessionCount = 0;
+    for (size_t r = 0; r < groups.size(); ++r) {
+        const std::vector<Session> &sessions = groups[r];
+        sessionCount += sessions.size();
+        results[r].resize(grid.size() * sessions.size());
+        for (size_t g = 0; g < grid.size(); ++g) {
+            for (size_t s = 0; s < sessions.size(); ++s) {
+                tasks.push_back([&, r, g, s]() {
+                    results[r][g * groups[r].size() + s] = evaluate(groups[r][s], grid[g], options.warmup);
+                });
+            }
+        }
+    }
+
+    std::fprintf(stderr, "igtlbatch: %zu sessions x %zu parameter sets on %u threads\n",
+                 sessionCount, grid.size(), options.threads);
+
+    WorkStealingPool pool(options.threads);
+    auto startTime = std::chrono::steady_clock::now();
+    pool.run(std::move(tasks));
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    FILE *out = stdout;
+    if (!options.outputPath.empty()) {
+        out = std::fopen(options.outputPath.c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "igtlbatch: cannot write %s\n", options.outputPath.c_str());
+            return 1;
+        }
+    }
+
+    std::fprintf(out, "algorithm,integrator,beta,rate_hz,sessions,samples,rms_error_deg,max_error_deg,drift_deg_per_min\n");
+    size_t totalSamples = 0;
+    for (size_t r = 0; r < groups.size(); ++r) {
+        const std::vector<Session> &sessions = groups[r];
+        if (sessions.empty()) {
+            continue;
+        }
+        const double rate = measuredRate(sessions);
+        for (size_t g = 0; g < grid.size(); ++g) {
+            double rms = 0.0, maxError = 0.0, drift = 0.0;
+            size_t samples = 0;
+            for (size_t s = 0; s < sessions.size(); ++s) {
+                const Result &result = results[r][g * sessions.size() + s];
+                rms += result.rmsErrorDeg;
+                drift += result.driftDegPerMin;
+                maxError = std::max(maxError, result.maxErrorDeg);
+                samples += result.samples;
+            }
+            totalSamples += samples;
+            const char *integrator = grid[g].algorithm == FusionCore::GyroIntegration
+                ? FusionCore::integratorName(grid[g].integrator) : "-";
+            std::fprintf(out, "%s,%s,%g,%.1f,%zu,%zu,%.4f,%.4f,%.4f\n",
+                         FusionCore::algorithmName(grid[g].algorithm), integrator, grid[g].beta, rate,
+                         sessions.size(), samples, rms / double(sessions.size()), maxError,
+                         drift / double(sessions.size()));
+        }
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    std::fprintf(stderr, "igtlbatch: %zu samples in %.3f s (%.0f samples/s, %llu steals)\n",
+                 totalSamples, wallSeconds, double(totalSamples) / wallSeconds,
+                 static_cast<unsigned long long>(pool.steals()));
+    return 0;
+}
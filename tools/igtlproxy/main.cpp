@@ -0,0 +1,878 @@
+// igtlproxy - network impairment proxy for reproducible transport
+// benchmarks on one Linux machine. Sits between the app (or igtlswarm,
+// igtlreplay) and a receiver and delays, jitters, loses, rate-limits and
+// stalls the traffic in both directions following a scripted profile.
+//
+//   igtlproxy [--listen <port>] [--target <host:port>] [--udp]
+//             [--profile <name|file>] [--delay <ms>] [--jitter <ms>]
+//             [--loss <percent>] [--rate <kbit/s>] [--buffer <KiB>]
+//             [--seed <n>] [--duration <s>]
+//
+// A profile is a looping list of segments, one per line ('#' starts a
+// comment):
+//   <duration_s> [delay=<ms>] [jitter=<ms>] [loss=<percent>] [rate=<kbit/s>] [stall]
+// delay is one way and applies to each direction; jitter is the standard
+// deviation added to it; rate caps each direction (0 = unlimited); stall
+// holds all traffic for the segment, like a Wi-Fi roam. Built-in profiles:
+// clean, lan, wifi, hospital-wifi, cellular, flaky. --delay, --jitter, --loss
+// and --rate without --profile make a one-segment profile. The profile clock
+// starts with the first connection (or datagram), so runs are repeatable;
+// --seed fixes the random jitter and loss.
+//
+// TCP data is cut into segments of at most 1448 bytes that stay in order; a
+// lost segment is delivered one retransmission timeout late, which is how
+// loss shows up to a TCP application. In UDP mode (--udp) a lost datagram is
+// dropped and jitter may reorder datagrams; replies go to the client that
+// sent last. A direction that has --buffer bytes waiting stops reading its
+// source, so a slow or stalled link pushes back on the sender.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+struct Impairment {
+    double delayMs = 0.0;
+    double jitterMs = 0.0;
+    double lossPercent = 0.0;
+    double rateKbps = 0.0; // 0 = unlimited
+    bool stall = false;
+};
+
+struct ProfileSegment {
+    double duration = 1.0; // s
+    Impairment impairment;
+};
+
+const char *const kBuiltinProfiles[][2] = {
+    {"clean", "60\n"},
+    {"lan", "60 delay=0.5 jitter=0.2\n"},
+    {"wifi", "60 delay=3 jitter=4 loss=0.2\n"},
+    // Good coverage with a roam between access points now and then
+    {"hospital-wifi",
+     "25 delay=4 jitter=6 loss=0.3\n"
+     "1.5 stall\n"
+     "10 delay=25 jitter=30 loss=2 rate=4000\n"
+     "0.5 stall\n"
+     "20 delay=6 jitter=8 loss=0.5\n"},
+    {"cellular", "60 delay=40 jitter=15 loss=0.5 rate=8000\n"},
+    {"flaky",
+     "8 delay=10 jitter=5\n"
+     "3 stall\n"
+     "5 delay=120 jitter=80 loss=5 rate=500\n"},
+};
+
+class ImpairmentProfile
+{
+public:
+    static bool fromText(const std::string &text, const std::string &source, ImpairmentProfile &profile,
+                         std::string *error)
+    {
+        profile = ImpairmentProfile();
+        std::istringstream in(text);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line)) {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            ProfileSegment segment;
+            if (!(fields >> segment.duration)) {
+                continue; // blank line
+            }
+            bool ok = segment.duration > 0.0;
+            std::string field;
+            while (ok && fields >> field) {
+                const size_t equals = field.find('=');
+                const std::string key = field.substr(0, equals);
+                const double value = equals == std::string::npos ? 0.0 : std::atof(field.c_str() + equals + 1);
+                if (key == "stall" && equals == std::string::npos) {
+                    segment.impairment.stall = true;
+                } else if (equals == std::string::npos || value < 0.0) {
+                    ok = false;
+                } else if (key == "delay") {
+                    segment.impairment.delayMs = value;
+                } else if (key == "jitter") {
+                    segment.impairment.jitterMs = value;
+                } else if (key == "loss" && value <= 100.0) {
+                    segment.impairment.lossPercent = value;
+                } else if (key == "rate") {
+                    segment.impairment.rateKbps = value;
+                } else {
+                    ok = false;
+                }
+            }
+            if (!ok) {
+                if (error) *error = source + ":" + std::to_string(lineNumber) + ": invalid segment";
+                return false;
+            }
+            profile.addSegment(segment);
+        }
+        if (profile.m_segments.empty()) {
+            if (error) *error = source + ": no segments";
+            return false;
+        }
+        return true;
+    }
+
+    // Name of a built-in profile or path to a script
+    static bool load(const std::string &nameOrPath, ImpairmentProfile &profile, std::string *error)
+    {
+        for (const auto &builtin : kBuiltinProfiles) {
+            if (nameOrPath == builtin[0]) {
+                return fromText(builtin[1], nameOrPath, profile, error);
+            }
+        }
+        std::ifstream in(nameOrPath);
+        if (!in) {
+            if (error) *error = "no built-in profile or file named " + nameOrPath;
+            return false;
+        }
+        std::stringstream text;
+        text << in.rdbuf();
+        return fromText(text.str(), nameOrPath, profile, error);
+    }
+
+    void addSegment(const ProfileSegment &segment)
+    {
+        m_segments.push_back(segment);
+        m_period += segment.duration;
+    }
+
+    // Segment in effect t seconds into the profile, and when it ends
+    const ProfileSegment &at(double t, double *end, size_t *index) const
+    {
+        const double loopStart = std::floor(t / m_period) * m_period;
+        double local = t - loopStart;
+        double start = loopStart;
+        for (size_t i = 0; i < m_segments.size(); ++i) {
+            if (local < m_segments[i].duration || i + 1 == m_segments.size()) {
+                if (end) *end = start + m_segments[i].duration;
+                if (index) *index = i;
+                return m_segments[i];
+            }
+            local -= m_segments[i].duration;
+            start += m_segments[i].duration;
+        }
+        return m_segments.front(); // not reached
+    }
+
+private:
+    std::vector<ProfileSegment> m_segments;
+    double m_period = 0.0;
+};
+
+struct Options {
+    int listenPort = 18945;
+    std::string targetHost = "localhost";
+    int targetPort = 18944;
+    bool udp = false;
+    std::string profile;
+    Impairment impairment;
+    bool hasInline = false;
+    size_t bufferBytes = 4 << 20;
+    unsigned seed = 1;
+    double duration = 0.0; // 0 = until interrupted
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+                 "Usage: igtlproxy [--listen <port>] [--target <host:port>] [--udp]\n"
+                 "                 [--profile <name|file>] [--delay <ms>] [--jitter <ms>]\n"
+                 "                 [--loss <percent>] [--rate <kbit/s>] [--buffer <KiB>]\n"
+                 "                 [--seed <n>] [--duration <s>]\n");
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--listen" && hasValue) {
+            options.listenPort = std::atoi(argv[++i]);
+        } else if (arg == "--target" && hasValue) {
+            const std::string target = argv[++i];
+            const size_t colon = target.rfind(':');
+            if (colon == std::string::npos) {
+                return false;
+            }
+            options.targetHost = target.substr(0, colon);
+            options.targetPort = std::atoi(target.c_str() + colon + 1);
+        } else if (arg == "--udp") {
+            options.udp = true;
+        } else if (arg == "--profile" && hasValue) {
+            options.profile = argv[++i];
+        } else if (arg == "--delay" && hasValue) {
+            options.impairment.delayMs = std::atof(argv[++i]);
+            options.hasInline = true;
+        } else if (arg == "--jitter" && hasValue) {
+            options.impairment.jitterMs = std::atof(argv[++i]);
+            options.hasInline = true;
+        } else if (arg == "--loss" && hasValue) {
+            options.impairment.lossPercent = std::atof(argv[++i]);
+            options.hasInline = true;
+        } else if (arg == "--rate" && hasValue) {
+            options.impairment.rateKbps = std::atof(argv[++i]);
+            options.hasInline = true;
+        } else if (arg == "--buffer" && hasValue) {
+            options.bufferBytes = size_t(std::max(1, std::atoi(argv[++i]))) * 1024;
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = unsigned(std::atoi(argv[++i]));
+        } else if (arg == "--duration" && hasValue) {
+            options.duration = std::atof(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    const Impairment &impairment = options.impairment;
+    return options.listenPort > 0 && options.targetPort > 0 && !(options.hasInline && !options.profile.empty())
+           && impairment.delayMs >= 0.0 && impairment.jitterMs >= 0.0 && impairment.lossPercent >= 0.0
+           && impairment.lossPercent <= 100.0 && impairment.rateKbps >= 0.0;
+}
+
+int64_t nowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+const size_t kSegmentSize = 1448; // TCP payload of a 1500-byte Ethernet frame
+const size_t kReadSize = 16 * 1024;
+const int64_t kMinRetransmitNs = 200000000; // Linux minimum RTO
+
+struct Counters {
+    uint64_t bytes = 0;
+    uint64_t lost = 0; // UDP: dropped, TCP: delivered late
+};
+
+// One direction of one connection: data waiting for its delivery time
+class Pipe
+{
+public:
+    explicit Pipe(bool ordered)
+        : m_ordered(ordered)
+    {
+    }
+
+    // Queues data that arrived now; false if it was lost (UDP only)
+    bool schedule(const uint8_t *data, size_t size, int64_t now, const Impairment &impairment, std::mt19937 &rng,
+                  Counters &counters)
+    {
+        std::normal_distribution<double> jitter(0.0, 1.0);
+        std::uniform_real_distribution<double> uniform(0.0, 100.0);
+        double delayMs = impairment.delayMs + impairment.jitterMs * jitter(rng);
+        delayMs = std::max(0.0, delayMs);
+        if (impairment.lossPercent > 0.0 && uniform(rng) < impairment.lossPercent) {
+            ++counters.lost;
+            if (!m_ordered) {
+                return false;
+            }
+            // Round trip plus variance, as TCP estimates its timeout
+            const double rtoMs = 2.0 * impairment.delayMs + 4.0 * impairment.jitterMs;
+            delayMs += std::max(double(kMinRetransmitNs) / 1e6, rtoMs);
+        }
+
+        int64_t due = now + int64_t(delayMs * 1e6);
+        if (impairment.rateKbps > 0.0) {
+            // Serialized behind everything else on the bottleneck link
+            const int64_t transmitNs = int64_t(double(size) * 8.0 / impairment.rateKbps * 1e6);
+            due = std::max(due, m_linkFreeNs) + transmitNs;
+            m_linkFreeNs = due;
+        }
+        if (m_ordered) {
+            due = std::max(due, m_lastDueNs);
+            m_lastDueNs = due;
+        }
+        m_queue.emplace(due, std::vector<uint8_t>(data, data + size));
+        m_queuedBytes += size;
+        return true;
+    }
+
+    bool isEmpty() const { return m_queue.empty(); }
+    size_t queuedBytes() const { return m_queuedBytes; }
+    int64_t nextDue() const { return m_queue.empty() ? INT64_MAX : m_queue.begin()->first; }
+
+    // Front chunk, from the first byte not yet written
+    const uint8_t *frontData() const { return m_queue.begin()->second.data() + m_frontOffset; }
+    size_t frontSize() const { return m_queue.begin()->second.size() - m_frontOffset; }
+
+    void consume(size_t size)
+    {
+        m_frontOffset += size;
+        m_queuedBytes -= size;
+        if (m_frontOffset == m_queue.begin()->second.size()) {
+            m_queue.erase(m_queue.begin());
+            m_frontOffset = 0;
+        }
+    }
+
+    bool sourceClosed = false;
+    bool shutdownSent = false;
+    bool waitingForWritable = false;
+
+private:
+    bool m_ordered;
+    std::multimap<int64_t, std::vector<uint8_t>> m_queue; // by due time, FIFO among equal times
+    size_t m_frontOffset = 0;
+    size_t m_queuedBytes = 0;
+    int64_t m_linkFreeNs = 0;
+    int64_t m_lastDueNs = 0;
+};
+
+struct Connection;
+
+struct Handler {
+    enum Kind { Listen, Timer, Client, Server, UdpClient, UdpServer };
+    Kind kind;
+    Connection *connection;
+};
+
+struct Connection {
+    Connection()
+        : upstream(true)
+        , downstream(true)
+    {
+    }
+
+    int clientFd = -1;
+    int serverFd = -1;
+    bool connected = false;
+    bool closed = false;
+    Pipe upstream;   // client -> server
+    Pipe downstream; // server -> client
+    Handler clientHandler = {Handler::Client, nullptr};
+    Handler serverHandler = {Handler::Server, nullptr};
+};
+
+class Proxy
+{
+public:
+    Proxy(const Options &options, const ImpairmentProfile &profile, const sockaddr_storage &target,
+          socklen_t targetLength)
+        : m_options(options)
+        , m_profile(profile)
+        , m_target(target)
+        , m_targetLength(targetLength)
+        , m_rng(options.seed)
+        , m_udpUpstream(false)
+        , m_udpDownstream(false)
+    {
+    }
+
+    bool open()
+    {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        watch(m_timer, EPOLLIN, &m_timerHandler);
+
+        m_listenFd = socket(AF_INET6, (m_options.udp ? SOCK_DGRAM : SOCK_STREAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        const int off = 0, on = 1;
+        setsockopt(m_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(uint16_t(m_options.listenPort));
+        if (bind(m_listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || (!m_options.udp && listen(m_listenFd, 64) != 0)) {
+            std::fprintf(stderr, "igtlproxy: cannot listen on port %d: %s\n", m_options.listenPort, std::strerror(errno));
+            return false;
+        }
+
+        if (m_options.udp) {
+            m_udpServerFd = socket(m_target.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (connect(m_udpServerFd, reinterpret_cast<const sockaddr *>(&m_target), m_targetLength) != 0) {
+                std::fprintf(stderr, "igtlproxy: cannot reach target: %s\n", std::strerror(errno));
+                return false;
+            }
+            watch(m_listenFd, EPOLLIN, &m_udpClientHandler);
+            watch(m_udpServerFd, EPOLLIN, &m_udpServerHandler);
+        } else {
+            watch(m_listenFd, EPOLLIN, &m_listenHandler);
+        }
+        return true;
+    }
+
+    void run()
+    {
+        const int64_t startNs = nowNs();
+        const int64_t endNs = m_options.duration > 0.0 ? startNs + int64_t(m_options.duration * 1e9) : INT64_MAX;
+        int64_t nextReportNs = startNs + 1000000000;
+        std::vector<epoll_event> events(64);
+        for (;;) {
+            const int64_t now = nowNs();
+            if (now >= endNs) {
+                break;
+            }
+            if (now >= nextReportNs) {
+                report(now);
+                nextReportNs += 1000000000;
+            }
+            flush(now);
+            armTimer(std::min({nextDelivery(now), nextReportNs, endNs}));
+
+            const int count = epoll_wait(m_epoll, events.data(), int(events.size()), -1);
+            for (int i = 0; i < count; ++i) {
+                handle(*static_cast<Handler *>(events[i].data.ptr), events[i].events);
+            }
+            // Connections closed while handling events go only now, as later
+            // events of this batch may still point at them
+            m_closed.clear();
+        }
+        report(nowNs());
+        std::printf("total: up %llu bytes, down %llu bytes, lost up %llu, lost down %llu, %llu connections\n",
+                    static_cast<unsigned long long>(m_up.bytes), static_cast<unsigned long long>(m_down.bytes),
+                    static_cast<unsigned long long>(m_up.lost), static_cast<unsigned long long>(m_down.lost),
+                    static_cast<unsigned long long>(m_connectionCount));
+    }
+
+private:
+    void watch(int fd, uint32_t events, Handler *handler, int operation = EPOLL_CTL_ADD)
+    {
+        epoll_event event = {};
+        event.events = events;
+        event.data.ptr = handler;
+        epoll_ctl(m_epoll, operation, fd, &event);
+    }
+
+    // Profile time, from the first connection or datagram
+    double profileTime(int64_t now)
+    {
+        if (m_profileStartNs == 0) {
+            m_profileStartNs = now;
+        }
+        return double(now - m_profileStartNs) / 1e9;
+    }
+
+    const ProfileSegment &segmentAt(int64_t now, int64_t *endNs = nullptr, size_t *index = nullptr)
+    {
+        double end = 0.0;
+        const ProfileSegment &segment = m_profile.at(profileTime(now), &end, index);
+        if (endNs) {
+            *endNs = m_profileStartNs + int64_t(end * 1e9);
+        }
+        return segment;
+    }
+
+    void handle(const Handler &handler, uint32_t events)
+    {
+        switch (handler.kind) {
+        case Handler::Listen:
+            acceptConnections();
+            break;
+        case Handler::Timer: {
+            uint64_t expirations;
+            while (read(m_timer, &expirations, sizeof(expirations)) > 0) {
+            }
+            break;
+        }
+        case Handler::Client:
+        case Handler::Server:
+            if (handler.connection->closed) {
+                break;
+            }
+            handleConnection(*handler.connection, handler.kind == Handler::Client, events);
+            break;
+        case Handler::UdpClient:
+            receiveDatagrams(true);
+            break;
+        case Handler::UdpServer:
+            receiveDatagrams(false);
+            break;
+        }
+    }
+
+    void acceptConnections()
+    {
+        for (;;) {
+            const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            auto connection = std::make_unique<Connection>();
+            connection->clientFd = fd;
+            connection->serverFd = socket(m_target.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            const int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            setsockopt(connection->serverFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            if (connect(connection->serverFd, reinterpret_cast<const sockaddr *>(&m_target), m_targetLength) != 0
+                && errno != EINPROGRESS) {
+                std::fprintf(stderr, "igtlproxy: cannot connect to target: %s\n", std::strerror(errno));
+                ::close(connection->serverFd);
+                ::close(fd);
+                continue;
+            }
+            connection->clientHandler.connection = connection.get();
+            connection->serverHandler.connection = connection.get();
+            // The client is read once the target has accepted
+            watch(connection->clientFd, 0, &connection->clientHandler);
+            watch(connection->serverFd, EPOLLOUT, &connection->serverHandler);
+            profileTime(nowNs());
+            ++m_connectionCount;
+            m_connections.push_back(std::move(connection));
+        }
+    }
+
+    void handleConnection(Connection &connection, bool client, uint32_t events)
+    {
+        const int64_t now = nowNs();
+        if (!client && !connection.connected) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(connection.serverFd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                std::fprintf(stderr, "igtlproxy: cannot connect to target: %s\n", std::strerror(error));
+                close(connection);
+                return;
+            }
+            connection.connected = true;
+        } else if (events & EPOLLERR) {
+            close(connection);
+            return;
+        }
+
+        Pipe &incoming = client ? connection.upstream : connection.downstream;
+        Pipe &outgoing = client ? connection.downstream : connection.upstream;
+        const int fd = client ? connection.clientFd : connection.serverFd;
+        if ((events & EPOLLHUP) && incoming.sourceClosed) {
+            // Gone in both directions; nothing more can be delivered to it
+            close(connection);
+            return;
+        }
+        if ((events & (EPOLLIN | EPOLLHUP)) && !incoming.sourceClosed) {
+            if (!readInto(fd, incoming, now, client ? m_up : m_down)) {
+                close(connection);
+                return;
+            }
+        }
+        if (events & EPOLLOUT) {
+            outgoing.waitingForWritable = false;
+        }
+        if (!flushConnection(connection, now)) {
+            close(connection);
+            return;
+        }
+        updateInterest(connection);
+    }
+
+    bool readInto(int fd, Pipe &pipe, int64_t now, Counters &counters)
+    {
+        uint8_t buffer[kReadSize];
+        const Impairment &impairment = segmentAt(now).impairment;
+        while (pipe.queuedBytes() < m_options.bufferBytes) {
+            const ssize_t received = ::read(fd, buffer, sizeof(buffer));
+            if (received == 0) {
+                pipe.sourceClosed = true;
+                return true;
+            }
+            if (received < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            for (size_t offset = 0; offset < size_t(received); offset += kSegmentSize) {
+                pipe.schedule(buffer + offset, std::min(kSegmentSize, size_t(received) - offset), now, impairment,
+                              m_rng, counters);
+            }
+        }
+        return true;
+    }
+
+    // Writes what is due; false if the connection failed
+    bool flushPipe(Pipe &pipe, int fd, int64_t now, Counters &counters)
+    {
+        while (!pipe.isEmpty() && !pipe.waitingForWritable && pipe.nextDue() <= now) {
+            const ssize_t written = ::send(fd, pipe.frontData(), pipe.frontSize(), MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    pipe.waitingForWritable = true;
+                    return true;
+                }
+                return errno == EINTR;
+            }
+            counters.bytes += uint64_t(written);
+            pipe.consume(size_t(written));
+        }
+        if (pipe.isEmpty() && pipe.sourceClosed && !pipe.shutdownSent) {
+            shutdown(fd, SHUT_WR);
+            pipe.shutdownSent = true;
+        }
+        return true;
+    }
+
+    bool flushConnection(Connection &connection, int64_t now)
+    {
+        if (!connection.connected || segmentAt(now).impairment.stall) {
+            return true;
+        }
+        if (!flushPipe(connection.upstream, connection.serverFd, now, m_up)
+            || !flushPipe(connection.downstream, connection.clientFd, now, m_down)) {
+            return false;
+        }
+        return !(connection.upstream.shutdownSent && connection.downstream.shutdownSent);
+    }
+
+    void updateInterest(Connection &connection)
+    {
+        if (!connection.connected) {
+            return;
+        }
+        const auto interest = [this](const Pipe &incoming, const Pipe &outgoing) {
+            uint32_t events = 0;
+            if (!incoming.sourceClosed && incoming.queuedBytes() < m_options.bufferBytes) {
+                events |= EPOLLIN;
+            }
+            if (outgoing.waitingForWritable) {
+                events |= EPOLLOUT;
+            }
+            return events;
+        };
+        watch(connection.clientFd, interest(connection.upstream, connection.downstream), &connection.clientHandler,
+              EPOLL_CTL_MOD);
+        watch(connection.serverFd, interest(connection.downstream, connection.upstream), &connection.serverHandler,
+              EPOLL_CTL_MOD);
+    }
+
+    void close(Connection &connection)
+    {
+        for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+            if (it->get() == &connection) {
+                connection.closed = true;
+                ::close(connection.clientFd);
+                ::close(connection.serverFd);
+                m_closed.push_back(std::move(*it));
+                m_connections.erase(it);
+                return;
+            }
+        }
+    }
+
+    void receiveDatagrams(bool fromClient)
+    {
+        const int64_t now = nowNs();
+        const Impairment &impairment = segmentAt(now).impairment;
+        uint8_t buffer[65536];
+        for (;;) {
+            sockaddr_storage from = {};
+            socklen_t fromLength = sizeof(from);
+            const ssize_t received = recvfrom(fromClient ? m_listenFd : m_udpServerFd, buffer, sizeof(buffer), 0,
+                                              reinterpret_cast<sockaddr *>(&from), &fromLength);
+            if (received < 0) {
+                return;
+            }
+            if (fromClient) {
+                m_udpClient = from;
+                m_udpClientLength = fromLength;
+            }
+            Pipe &pipe = fromClient ? m_udpUpstream : m_udpDownstream;
+            if (pipe.queuedBytes() < m_options.bufferBytes) {
+                pipe.schedule(buffer, size_t(received), now, impairment, m_rng, fromClient ? m_up : m_down);
+            } else {
+                ++(fromClient ? m_up : m_down).lost; // bottleneck queue full
+            }
+        }
+    }
+
+    void flushDatagrams(int64_t now)
+    {
+        if (m_profileStartNs == 0 || segmentAt(now).impairment.stall) {
+            return;
+        }
+        while (!m_udpUpstream.isEmpty() && m_udpUpstream.nextDue() <= now) {
+            if (send(m_udpServerFd, m_udpUpstream.frontData(), m_udpUpstream.frontSize(), 0) >= 0) {
+                m_up.bytes += m_udpUpstream.frontSize();
+            }
+            m_udpUpstream.consume(m_udpUpstream.frontSize());
+        }
+        while (!m_udpDownstream.isEmpty() && m_udpDownstream.nextDue() <= now) {
+            if (m_udpClientLength > 0
+                && sendto(m_listenFd, m_udpDownstream.frontData(), m_udpDownstream.frontSize(), 0,
+                          reinterpret_cast<const sockaddr *>(&m_udpClient), m_udpClientLength) >= 0) {
+                m_down.bytes += m_udpDownstream.frontSize();
+            }
+            m_udpDownstream.consume(m_udpDownstream.frontSize());
+        }
+    }
+
+    void flush(int64_t now)
+    {
+        if (m_options.udp) {
+            flushDatagrams(now);
+            return;
+        }
+        for (size_t i = 0; i < m_connections.size();) {
+            Connection &connection = *m_connections[i];
+            if (!flushConnection(connection, now)) {
+                close(connection);
+                continue;
+            }
+            updateInterest(connection);
+            ++i;
+        }
+        m_closed.clear();
+    }
+
+    // Earliest time something can be delivered; during a stall, its end
+    int64_t nextDelivery(int64_t now)
+    {
+        int64_t next = INT64_MAX;
+        const auto consider = [&next](const Pipe &pipe) {
+            if (!pipe.waitingForWritable) {
+                next = std::min(next, pipe.nextDue());
+            }
+        };
+        if (m_options.udp) {
+            consider(m_udpUpstream);
+            consider(m_udpDownstream);
+        } else {
+            for (const auto &connection : m_connections) {
+                if (connection->connected) {
+                    consider(connection->upstream);
+                    consider(connection->downstream);
+                }
+            }
+        }
+        if (next != INT64_MAX && m_profileStartNs != 0) {
+            int64_t segmentEnd = 0;
+            if (segmentAt(now, &segmentEnd).impairment.stall) {
+                next = std::max(next, segmentEnd);
+            }
+        }
+        return next;
+    }
+
+    void armTimer(int64_t due)
+    {
+        itimerspec spec = {};
+        due = std::max<int64_t>(due, 1);
+        spec.it_value.tv_sec = due / 1000000000;
+        spec.it_value.tv_nsec = due % 1000000000;
+        timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void report(int64_t now)
+    {
+        size_t queued = m_udpUpstream.queuedBytes() + m_udpDownstream.queuedBytes();
+        for (const auto &connection : m_connections) {
+            queued += connection->upstream.queuedBytes() + connection->downstream.queuedBytes();
+        }
+        std::string state = "waiting for a connection";
+        if (m_profileStartNs != 0) {
+            size_t index = 0;
+            const Impairment &impairment = segmentAt(now, nullptr, &index).impairment;
+            char text[160];
+            if (impairment.stall) {
+                std::snprintf(text, sizeof(text), "segment %zu stall", index + 1);
+            } else {
+                std::snprintf(text, sizeof(text), "segment %zu delay %g+-%g ms loss %g%% rate %g kbit/s", index + 1,
+                              impairment.delayMs, impairment.jitterMs, impairment.lossPercent, impairment.rateKbps);
+            }
+            state = text;
+        }
+        std::printf("%8.1f s  %-52s up %8.1f kB/s  down %8.1f kB/s  queued %7.1f kB  lost %llu/%llu  conns %zu\n",
+                    m_profileStartNs != 0 ? profileTime(now) : 0.0, state.c_str(),
+                    double(m_up.bytes - m_lastUpBytes) / 1000.0, double(m_down.bytes - m_lastDownBytes) / 1000.0,
+                    double(queued) / 1000.0, static_cast<unsigned long long>(m_up.lost),
+                    static_cast<unsigned long long>(m_down.lost), m_connections.size());
+        std::fflush(stdout);
+        m_lastUpBytes = m_up.bytes;
+        m_lastDownBytes = m_down.bytes;
+    }
+
+    const Options &m_options;
+    const ImpairmentProfile &m_profile;
+    sockaddr_storage m_target;
+    socklen_t m_targetLength;
+    std::mt19937 m_rng;
+    int m_epoll = -1;
+    int m_timer = -1;
+    int m_listenFd = -1;
+    Handler m_listenHandler = {Handler::Listen, nullptr};
+    Handler m_timerHandler = {Handler::Timer, nullptr};
+    int64_t m_profileStartNs = 0;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    std::vector<std::unique_ptr<Connection>> m_closed;
+    uint64_t m_connectionCount = 0;
+
+    // UDP mode
+    int m_udpServerFd = -1;
+    Handler m_udpClientHandler = {Handler::UdpClient, nullptr};
+    Handler m_udpServerHandler = {Handler::UdpServer, nullptr};
+    sockaddr_storage m_udpClient = {};
+    socklen_t m_udpClientLength = 0;
+    Pipe m_udpUpstream;
+    Pipe m_udpDownstream;
+
+    Counters m_up;
+    Counters m_down;
+    uint64_t m_lastUpBytes = 0;
+    uint64_t m_lastDownBytes = 0;
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    ImpairmentProfile profile;
+    std::string error;
+    if (options.hasInline) {
+        ProfileSegment segment;
+        segment.duration = 3600.0;
+        segment.impairment = options.impairment;
+        profile.addSegment(segment);
+    } else if (!ImpairmentProfile::load(options.profile.empty() ? "clean" : options.profile, profile, &error)) {
+        std::fprintf(stderr, "igtlproxy: %s\n", error.c_str());
+        return 1;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = options.udp ? SOCK_DGRAM : SOCK_STREAM;
+    addrinfo *result = nullptr;
+    const std::string port = std::to_string(options.targetPort);
+    if (getaddrinfo(options.targetHost.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::fprintf(stderr, "igtlproxy: cannot resolve %s\n", options.targetHost.c_str());
+        return 1;
+    }
+    sockaddr_storage target = {};
+    std::memcpy(&target, result->ai_addr, result->ai_addrlen);
+    const socklen_t targetLength = socklen_t(result->ai_addrlen);
+    freeaddrinfo(result);
+
+    Proxy proxy(options, profile, target, targetLength);
+    if (!proxy.open()) {
+        return 1;
+    }
+    std::fprintf(stderr, "igtlproxy: %s port %d -> %s:%d, profile %s\n", options.udp ? "UDP" : "TCP",
+                 options.listenPort, options.targetHost.c_str(), options.targetPort,
+                 options.hasInline ? "from the command line" : (options.profile.empty() ? "clean" : options.profile.c_str()));
+    proxy.run();
+    return 0;
+}
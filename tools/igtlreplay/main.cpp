@@ -0,0 +1,262 @@
+// igtlreplay - re-streams a session recorded by the app (see sessionformat.h)
+// to an OpenIGTLink server, in real time or as fast as possible.
+//
+//   igtlreplay <session.igtls> [--host <name>] [--port <port>]
+//              [--start <seconds>] [--speed <factor>|max] [--info]
+//              [--expand-backlog]
+//
+// --expand-backlog sends the poses of POSEDELTA batches (the backlog sent
+// after a reconnect, see posebacklog.h) as individual TRANSFORM messages
+// with their original timestamps, for receivers that only know TRANSFORM.
+
+#include "sessionformat.h"
+#include "igtlmessages.h"
+#include "posebacklog.h"
+#include "igtlClientSocket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string sessionPath;
+    std::string host = "localhost";
+    int port = 18944;
+    double startSeconds = 0.0;
+    double speed = 1.0; // 0 = as fast as possible
+    bool infoOnly = false;
+    bool expandBacklog = false;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+                 "Usage: igtlreplay <session.igtls> [--host <name>] [--port <port>]\n"
+                 "                  [--start <seconds>] [--speed <factor>|max] [--info]\n"
+                 "                  [--expand-backlog]\n");
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--start" && hasValue) {
+            options.startSeconds = std::atof(argv[++i]);
+        } else if (arg == "--speed" && hasValue) {
+            std::string value = argv[++i];
+            options.speed = value == "max" ? 0.0 : std::atof(value.c_str());
+            if (options.speed < 0.0) {
+                return false;
+            }
+        } else if (arg == "--info") {
+            options.infoOnly = true;
+        } else if (arg == "--expand-backlog") {
+            options.expandBacklog = true;
+        } else if (!arg.empty() && arg[0] != '-' && options.sessionPath.empty()) {
+            options.sessionPath = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.sessionPath.empty();
+}
+
+std::string indexPathFor(const std::string &sessionPath)
+{
+    std::string base = sessionPath;
+    const std::string suffix = SessionFormat::kSessionSuffix;
+    if (base.size() > suffix.size() && base.compare(base.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        base.resize(base.size() - suffix.size());
+    }
+    return base + SessionFormat::kIndexSuffix;
+}
+
+std::vector<SessionFormat::IndexEntry> readIndex(const std::string &path)
+{
+    std::vector<SessionFormat::IndexEntry> entries;
+    std::ifstream in(path, std::ios::binary);
+    SessionFormat::IndexHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        !SessionFormat::hasMagic(header.magic, SessionFormat::kIndexMagic)) {
+        return entries;
+    }
+    SessionFormat::IndexEntry entry;
+    while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+// Offset of the first record to play: the last index entry not after the
+// requested time, or the first record when there is no usable index
+uint64_t seekOffset(const std::vector<SessionFormat::IndexEntry> &index, uint64_t targetNs)
+{
+    uint64_t offset = sizeof(SessionFormat::FileHeader);
+    auto it = std::upper_bound(index.begin(), index.end(), targetNs,
+                               [](uint64_t t, const SessionFormat::IndexEntry &e) { return t < e.timestampNs; });
+    if (it != index.begin()) {
+        offset = std::max(offset, std::prev(it)->offset);
+    }
+    return offset;
+}
+
+uint64_t readBigEndian64(const char *data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | uint8_t(data[i]);
+    }
+    return value;
+}
+
+// Appends one TRANSFORM message per pose of a POSEDELTA message
+void expandPoseDelta(const char *message, size_t size, std::vector<char> &expanded)
+{
+    const size_t deviceOffset = 14;
+    char deviceName[IgtlMessages::kDeviceNameSize + 1] = {};
+    std::memcpy(deviceName, message + deviceOffset, IgtlMessages::kDeviceNameSize);
+
+    std::vector<PoseBacklog::Sample> samples;
+    if (!PoseBacklog::unpack(reinterpret_cast<const uint8_t *>(message) + IgtlMessages::kHeaderSize,
+                             size - IgtlMessages::kHeaderSize, samples)) {
+        std::fprintf(stderr, "igtlreplay: malformed %s message, %zu poses recovered\n",
+                     PoseBacklog::kMessageType, samples.size());
+    }
+    const size_t start = expanded.size();
+    expanded.resize(start + samples.size() * IgtlMessages::kTransformMessageSize);
+    uint8_t *out = reinterpret_cast<uint8_t *>(expanded.data() + start);
+    for (const PoseBacklog::Sample &sample : samples) {
+        double matrix[3][4];
+        sample.pose.toMatrix(matrix);
+        const uint64_t timestamp = IgtlMessages::timestamp(uint32_t(sample.timeNs / 1000000000),
+                                                           uint32_t(sample.timeNs % 1000000000));
+        IgtlMessages::packTransform(out, deviceName, timestamp, matrix);
+        out += IgtlMessages::kTransformMessageSize;
+    }
+}
+
+// A record holds everything one write sent, e.g. a batch of TRANSFORM
+// messages followed by a POSEDELTA message. Rewrites every POSEDELTA message
+// in it as one TRANSFORM message per pose and keeps the others as they are.
+// Returns false if the record has no backlog batch.
+bool expandBacklog(const std::vector<char> &record, std::vector<char> &expanded)
+{
+    const size_t typeOffset = 2;
+    const size_t bodySizeOffset = 42;
+    bool found = false;
+    expanded.clear();
+    size_t offset = 0;
+    while (record.size() - offset >= IgtlMessages::kHeaderSize) {
+        const char *message = record.data() + offset;
+        const uint64_t bodySize = readBigEndian64(message + bodySizeOffset);
+        if (bodySize > record.size() - offset - IgtlMessages::kHeaderSize) {
+            std::fprintf(stderr, "igtlreplay: truncated message in record, sent as recorded\n");
+            break;
+        }
+        const size_t size = IgtlMessages::kHeaderSize + size_t(bodySize);
+        if (std::strncmp(message + typeOffset, PoseBacklog::kMessageType, 12) == 0) {
+            expandPoseDelta(message, size, expanded);
+            found = true;
+        } else {
+            expanded.insert(expanded.end(), message, message + size);
+        }
+        offset += size;
+    }
+    if (found) {
+        // Whatever could not be parsed goes out unchanged
+        expanded.insert(expanded.end(), record.begin() + std::ptrdiff_t(offset), record.end());
+    }
+    return found;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    std::ifstream session(options.sessionPath, std::ios::binary);
+    SessionFormat::FileHeader fileHeader;
+    if (!session.read(reinterpret_cast<char *>(&fileHeader), sizeof(fileHeader)) ||
+        !SessionFormat::hasMagic(fileHeader.magic, SessionFormat::kSessionMagic)) {
+        std::fprintf(stderr, "igtlreplay: %s is not a session file\n", options.sessionPath.c_str());
+        return 1;
+    }
+
+    const std::vector<SessionFormat::IndexEntry> index = readIndex(indexPathFor(options.sessionPath));
+    if (options.infoOnly) {
+        double duration = index.empty() ? 0.0 : (index.back().timestampNs - fileHeader.startTimeNs) * 1e-9;
+        std::printf("Session:     %s\nIndex:       %zu entries\nDuration:   >= %.1f s\n",
+                    options.sessionPath.c_str(), index.size(), duration);
+        return 0;
+    }
+
+    const uint64_t targetNs = fileHeader.startTimeNs + uint64_t(options.startSeconds * 1e9);
+    session.seekg(std::streamoff(seekOffset(index, targetNs)));
+
+    igtl::ClientSocket::Pointer socket = igtl::ClientSocket::New();
+    if (socket->ConnectToServer(options.host.c_str(), options.port) != 0) {
+        std::fprintf(stderr, "igtlreplay: cannot connect to %s:%d\n", options.host.c_str(), options.port);
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point wallStart;
+    uint64_t firstNs = 0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    std::vector<char> payload;
+    std::vector<char> expanded;
+
+    SessionFormat::RecordHeader record;
+    while (session.read(reinterpret_cast<char *>(&record), sizeof(record)) && record.size > 0) {
+        payload.resize(record.size);
+        if (!session.read(payload.data(), record.size)) {
+            break; // truncated last record
+        }
+        if (record.timestampNs < targetNs) {
+            continue;
+        }
+
+        if (records == 0) {
+            wallStart = Clock::now();
+            firstNs = record.timestampNs;
+        } else if (options.speed > 0.0) {
+            auto offset = std::chrono::nanoseconds(int64_t((record.timestampNs - firstNs) / options.speed));
+            std::this_thread::sleep_until(wallStart + offset);
+        }
+
+        const std::vector<char> &message =
+            options.expandBacklog && expandBacklog(payload, expanded) ? expanded : payload;
+        if (!message.empty() && !socket->Send(message.data(), message.size())) {
+            std::fprintf(stderr, "igtlreplay: send failed after %llu records\n", (unsigned long long)records);
+            socket->CloseSocket();
+            return 1;
+        }
+        ++records;
+        bytes += record.size;
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - wallStart).count();
+    std::printf("Replayed %llu records (%llu bytes) in %.2f s\n",
+                (unsigned long long)records, (unsigned long long)bytes, records ? elapsed : 0.0);
+    socket->CloseSocket();
+    return 0;
+}
@@ -0,0 +1,145 @@
+// igtlshmread - follows the app's shared-memory ring (see shmring.h) and
+// reports message rate and delivery latency, measured from the OpenIGTLink
+// timestamp the app puts in each header. Also a minimal example of the
+// igtlshm reader library.
+//
+//   igtlshmread [<ring name>] [--count <n>] [--print]
+
+#include "shmring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string name = ShmRing::kDefaultName;
+    long count = 0; // 0 = until the ring closes
+    bool print = false;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr, "Usage: igtlshmread [<ring name>] [--count <n>] [--print]\n");
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    bool hasName = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--count" && hasValue) {
+            options.count = std::atol(argv[++i]);
+        } else if (arg == "--print") {
+            options.print = true;
+        } else if (!arg.empty() && arg[0] != '-' && !hasName) {
+            options.name = arg;
+            hasName = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t readBigEndian64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// OpenIGTLink timestamp (seconds << 32 | fraction) as nanoseconds
+int64_t timestampNs(uint64_t timestamp)
+{
+    const uint64_t seconds = timestamp >> 32;
+    const uint64_t fraction = timestamp & 0xFFFFFFFFULL;
+    return int64_t(seconds * 1000000000ULL + ((fraction * 1000000000ULL) >> 32));
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void report(std::vector<double> &latenciesUs, long messages, uint64_t overruns, double seconds)
+{
+    if (latenciesUs.empty()) {
+        return;
+    }
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    const auto percentile = [&latenciesUs](double p) {
+        return latenciesUs[std::min(latenciesUs.size() - 1, size_t(p * latenciesUs.size()))];
+    };
+    std::printf("%ld messages, %.1f/s, overruns %llu, latency us p50 %.1f p99 %.1f max %.1f\n",
+                messages, messages / seconds, static_cast<unsigned long long>(overruns),
+                percentile(0.5), percentile(0.99), latenciesUs.back());
+    std::fflush(stdout);
+    latenciesUs.clear();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    ShmRingReader reader;
+    std::string error;
+    if (!reader.open(options.name, &error)) {
+        std::fprintf(stderr, "igtlshmread: %s\n", error.c_str());
+        return 1;
+    }
+
+    const size_t headerSize = 58;
+    std::vector<uint8_t> message;
+    std::vector<double> latenciesUs;
+    long total = 0;
+    long interval = 0;
+    auto intervalStart = std::chrono::steady_clock::now();
+
+    for (;;) {
+        const ShmRingReader::Status status = reader.read(message, 1000);
+        if (status == ShmRingReader::Closed) {
+            std::fprintf(stderr, "igtlshmread: ring closed\n");
+            break;
+        }
+        if (status == ShmRingReader::Message && message.size() >= headerSize) {
+            const int64_t latencyNs = nowNs() - timestampNs(readBigEndian64(message.data() + 34));
+            latenciesUs.push_back(latencyNs / 1000.0);
+            ++total;
+            ++interval;
+            if (options.print) {
+                const std::string type(reinterpret_cast<const char *>(message.data() + 2), 12);
+                const std::string device(reinterpret_cast<const char *>(message.data() + 14), 20);
+                std::printf("%s %s %zu bytes\n", type.c_str(), device.c_str(), message.size());
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - intervalStart).count();
+        if (elapsed >= 1.0) {
+            report(latenciesUs, interval, reader.overruns(), elapsed);
+            interval = 0;
+            intervalStart = now;
+        }
+        if (options.count > 0 && total >= options.count) {
+            break;
+        }
+    }
+    report(latenciesUs, interval, reader.overruns(),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - intervalStart).count());
+    return 0;
+}
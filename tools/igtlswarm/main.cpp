@@ -0,0 +1,707 @@
+// igtlswarm - load generator for OpenIGTLink servers. Runs N virtual devices
+// in one process, each with its own synthetic IMU, fusion state, device name
+// and TCP connection, driven by epoll on a few threads. Prints the aggregate
+// send rate every second and the latency of every stream at the end.
+//
+//   igtlswarm [--host <name>] [--port <port>] [--devices <n>] [--rate <Hz>]
+//             [--duration <s>] [--ramp <s>] [--threads <n>] [--prefix <name>]
+//             [--profile <name|file>] [--output <per-stream.csv>]
+//
+// Latencies per stream:
+//   send  from the time a pose was due until its last byte was handed to the
+//         kernel; grows when the generator or the server falls behind
+//   ack   from handing a message to the kernel until the server acknowledged
+//         it (STATUS OK with a message count, see the README); only servers
+//         that acknowledge report it
+
+#include "fusioncore.h"
+#include "igtlmessages.h"
+#include "syntheticmotion.h"
+#include "transformchain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    std::string host = "localhost";
+    int port = 18944;
+    int devices = 100;
+    double rate = 30.0;
+    double duration = 30.0;
+    double ramp = 5.0; // s over which the devices connect
+    int threads = 0;   // 0 = up to 4, one per core
+    std::string prefix = "Swarm";
+    std::string profile = "handheld";
+    std::string outputPath;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+                 "Usage: igtlswarm [--host <name>] [--port <port>] [--devices <n>] [--rate <Hz>]\n"
+                 "                 [--duration <s>] [--ramp <s>] [--threads <n>] [--prefix <name>]\n"
+                 "                 [--profile <name|file>] [--output <per-stream.csv>]\n");
+}
+
+bool parseArguments(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--devices" && hasValue) {
+            options.devices = std::atoi(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::atof(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "--ramp" && hasValue) {
+            options.ramp = std::atof(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--prefix" && hasValue) {
+            options.prefix = argv[++i];
+        } else if (arg == "--profile" && hasValue) {
+            options.profile = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.devices > 0 && options.rate > 0.0 && options.duration > 0.0 && options.ramp >= 0.0
+           && options.threads >= 0;
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Fixed-size latency histogram, buckets growing by 10% from 1 us to ~2 min
+class LatencyHistogram
+{
+public:
+    void add(double us)
+    {
+        int bucket = us <= 1.0 ? 0 : int(std::log(us) / std::log(kGrowth)) + 1;
+        ++m_counts[std::min(bucket, kBuckets - 1)];
+        ++m_total;
+        m_max = std::max(m_max, us);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < kBuckets; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t count() const { return m_total; }
+    double max() const { return m_max; }
+
+    // Upper bound of the bucket holding the p-quantile
+    double percentile(double p) const
+    {
+        if (m_total == 0) {
+            return 0.0;
+        }
+        const uint64_t rank = uint64_t(std::ceil(p * m_total));
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += m_counts[i];
+            if (seen >= rank && m_counts[i] > 0) {
+                return std::min(std::pow(kGrowth, i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static constexpr int kBuckets = 200;
+    static constexpr double kGrowth = 1.1;
+    uint64_t m_counts[kBuckets] = {};
+    uint64_t m_total = 0;
+    double m_max = 0.0;
+};
+
+const size_t kMaxPendingBytes = 64 * 1024; // like the app, drop instead of queueing forever
+const size_t kSendTimeSlots = 1024;        // messages remembered for ack latency
+const uint64_t kTimerToken = ~uint64_t(0);
+// Poses due this soon are sent right away instead of sleeping for them; with
+// thousands of phase-shifted streams this saves a timer wakeup per message
+const int64_t kCoalesceNs = 250000;
+
+struct Device {
+    enum State { Waiting, Connecting, Streaming, Closed };
+
+    Device(int deviceIndex, const std::string &deviceName, const MotionProfile &profile)
+        : index(deviceIndex)
+        , name(deviceName)
+        , imu(profile, ImuNoiseModel(), unsigned(deviceIndex + 1))
+        , sendTimes(kSendTimeSlots, 0)
+    {
+    }
+
+    int index;
+    std::string name;
+    State state = Waiting;
+    int fd = -1;
+    SyntheticImu imu;
+    FusionCore fusion;
+    TransformChain chain;
+    int64_t dueNs = 0;
+    int64_t streamStartNs = 0;
+
+    // Bytes not yet accepted by the kernel, and the due time of the
+    // messages in it (absolute end offset in the stream, due time)
+    std::vector<uint8_t> out;
+    size_t outOffset = 0;
+    bool waitingForWritable = false;
+    uint64_t bytesQueued = 0;
+    uint64_t bytesWritten = 0;
+    std::deque<std::pair<uint64_t, int64_t>> inFlight;
+    std::vector<int64_t> sendTimes; // by message number, for ack latency
+
+    std::vector<uint8_t> in;
+
+    uint64_t messages = 0; // fully written
+    uint64_t acked = 0;
+    uint64_t dropped = 0;
+    double connectMs = 0.0;
+    std::string error;
+    LatencyHistogram sendLatency;
+    LatencyHistogram ackLatency;
+};
+
+struct WorkerCounters {
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<int> streaming{0};
+    std::atomic<int> closed{0};
+};
+
+uint64_t readBigEndian64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+class Worker
+{
+public:
+    Worker(const Options &options, const sockaddr_storage &address, socklen_t addressLength,
+           std::vector<Device *> devices, WorkerCounters &counters)
+        : m_options(options)
+        , m_address(address)
+        , m_addressLength(addressLength)
+        , m_devices(std::move(devices))
+        , m_counters(counters)
+        , m_periodNs(int64_t(1e9 / options.rate))
+    {
+    }
+
+    void run(int64_t startNs, int64_t endNs)
+    {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epoll_event timerEvent = {};
+        timerEvent.events = EPOLLIN;
+        timerEvent.data.u64 = kTimerToken;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &timerEvent);
+
+        // Connections are spread over the ramp, poses over the period
+        const int total = m_options.devices;
+        for (size_t i = 0; i < m_devices.size(); ++i) {
+            Device *device = m_devices[i];
+            device->dueNs = startNs + int64_t(m_options.ramp * 1e9 * device->index / total);
+            m_schedule.push({device->dueNs, i});
+        }
+
+        std::vector<epoll_event> events(256);
+        for (;;) {
+            const int64_t now = nowNs();
+            if (now >= endNs) {
+                break;
+            }
+            runDue(now + kCoalesceNs);
+            armTimer(endNs);
+
+            const int count = epoll_wait(m_epoll, events.data(), int(events.size()), -1);
+            for (int i = 0; i < count; ++i) {
+                if (events[i].data.u64 == kTimerToken) {
+                    uint64_t expirations;
+                    while (::read(m_timer, &expirations, sizeof(expirations)) > 0) {
+                    }
+                    continue;
+                }
+                Device *device = m_devices[size_t(events[i].data.u64)];
+                handleEvent(device, size_t(events[i].data.u64), events[i].events);
+            }
+        }
+
+        for (Device *device : m_devices) {
+            if (device->fd >= 0) {
+                ::close(device->fd);
+                device->fd = -1;
+            }
+        }
+        ::close(m_timer);
+        ::close(m_epoll);
+    }
+
+private:
+    struct Due {
+        int64_t dueNs;
+        size_t slot;
+        bool operator>(const Due &other) const { return dueNs > other.dueNs; }
+    };
+
+    void armTimer(int64_t endNs)
+    {
+        const int64_t next = m_schedule.empty() ? endNs : std::min(m_schedule.top().dueNs, endNs);
+        itimerspec spec = {};
+        spec.it_value.tv_sec = time_t(next / 1000000000);
+        spec.it_value.tv_nsec = long(next % 1000000000);
+        timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void runDue(int64_t until)
+    {
+        while (!m_schedule.empty() && m_schedule.top().dueNs <= until) {
+            const size_t slot = m_schedule.top().slot;
+            m_schedule.pop();
+            Device *device = m_devices[slot];
+            if (device->state == Device::Waiting) {
+                startConnect(device, slot);
+            } else if (device->state == Device::Streaming) {
+                sendPose(device, slot);
+                device->dueNs += m_periodNs;
+                m_schedule.push({device->dueNs, slot});
+            }
+        }
+    }
+
+    void startConnect(Device *device, size_t slot)
+    {
+        device->fd = socket(m_address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (device->fd < 0) {
+            close(device, std::string("socket: ") + std::strerror(errno));
+            return;
+        }
+        const int one = 1;
+        setsockopt(device->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        device->state = Device::Connecting;
+        device->streamStartNs = nowNs();
+        if (connect(device->fd, reinterpret_cast<const sockaddr *>(&m_address), m_addressLength) != 0 && errno != EINPROGRESS) {
+            close(device, std::string("connect: ") + std::strerror(errno));
+            return;
+        }
+        epoll_event event = {};
+        event.events = EPOLLOUT | EPOLLIN;
+        event.data.u64 = slot;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, device->fd, &event);
+    }
+
+    void handleEvent(Device *device, size_t slot, uint32_t events)
+    {
+        if (device->state == Device::Connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(device->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                close(device, std::string("connect: ") + std::strerror(error));
+                return;
+            }
+            if (!(events & EPOLLOUT)) {
+                return;
+            }
+            const int64_t now = nowNs();
+            device->connectMs = (now - device->streamStartNs) / 1e6;
+            device->state = Device::Streaming;
+            m_counters.streaming.fetch_add(1, std::memory_order_relaxed);
+            // First pose at the device's phase within the period
+            const int64_t phase = m_periodNs * device->index / m_options.devices;
+            device->streamStartNs = now;
+            device->dueNs = now + phase;
+            m_schedule.push({device->dueNs, slot});
+            watch(device, slot, false);
+            return;
+        }
+        if (device->state != Device::Streaming) {
+            return;
+        }
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            close(device, "connection closed by server");
+            return;
+        }
+        if (events & EPOLLIN) {
+            receive(device);
+        }
+        if (device->state == Device::Streaming && (events & EPOLLOUT)) {
+            flush(device, slot);
+        }
+    }
+
+    void watch(Device *device, size_t slot, bool writable)
+    {
+        epoll_event event = {};
+        event.events = writable ? uint32_t(EPOLLIN | EPOLLOUT) : uint32_t(EPOLLIN);
+        event.data.u64 = slot;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, device->fd, &event);
+    }
+
+    void sendPose(Device *device, size_t slot)
+    {
+        const double rate = m_options.rate;
+        const double t = (device->dueNs - device->streamStartNs) / 1e9;
+        const ImuSample sample = device->imu.sample(t, rate);
+        FusionInput input;
+        std::copy(sample.accel, sample.accel + 3, input.accel);
+        std::copy(sample.gyro, sample.gyro + 3, input.gyro);
+        std::copy(sample.mag, sample.mag + 3, input.mag);
+        input.hasAccel = input.hasGyro = input.hasMag = true;
+        device->fusion.update(input, 1.0 / rate);
+
+        if (device->out.size() - device->outOffset > kMaxPendingBytes) {
+            ++device->dropped;
+            m_counters.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        double w, x, y, z;
+        device->fusion.orientation(w, x, y, z);
+        double matrix[3][4];
+        device->chain.apply(w, x, y, z).toMatrix(matrix);
+
+        const size_t offset = device->out.size();
+        device->out.resize(offset + IgtlMessages::kTransformMessageSize);
+        IgtlMessages::packTransform(device->out.data() + offset, device->name.c_str(), IgtlMessages::timestampNow(), matrix);
+        device->bytesQueued += IgtlMessages::kTransformMessageSize;
+        device->inFlight.emplace_back(device->bytesQueued, device->dueNs);
+        flush(device, slot);
+    }
+
+    void flush(Device *device, size_t slot)
+    {
+        while (device->outOffset < device->out.size()) {
+            const ssize_t written = ::send(device->fd, device->out.data() + device->outOffset,
+                                           device->out.size() - device->outOffset, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                close(device, std::string("send: ") + std::strerror(errno));
+                return;
+            }
+            device->outOffset += size_t(written);
+            device->bytesWritten += uint64_t(written);
+            m_counters.bytes.fetch_add(uint64_t(written), std::memory_order_relaxed);
+        }
+
+        const int64_t now = nowNs();
+        while (!device->inFlight.empty() && device->inFlight.front().first <= device->bytesWritten) {
+            device->sendLatency.add(std::max<int64_t>(0, now - device->inFlight.front().second) / 1e3);
+            device->sendTimes[device->messages % kSendTimeSlots] = now;
+            ++device->messages;
+            m_counters.messages.fetch_add(1, std::memory_order_relaxed);
+            device->inFlight.pop_front();
+        }
+
+        if (device->outOffset == device->out.size()) {
+            device->out.clear();
+            device->outOffset = 0;
+        } else if (device->outOffset > kMaxPendingBytes) {
+            device->out.erase(device->out.begin(), device->out.begin() + long(device->outOffset));
+            device->outOffset = 0;
+        }
+
+        // Wait for EPOLLOUT only while something is left to write
+        const bool blocked = !device->out.empty();
+        if (blocked != device->waitingForWritable) {
+            device->waitingForWritable = blocked;
+            watch(device, slot, blocked);
+        }
+    }
+
+    // Server messages: STATUS OK acknowledges messages, the rest is skipped
+    void receive(Device *device)
+    {
+        uint8_t buffer[4096];
+        for (;;) {
+            const ssize_t received = ::recv(device->fd, buffer, sizeof(buffer), 0);
+            if (received == 0) {
+                close(device, "connection closed by server");
+                return;
+            }
+            if (received < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    close(device, std::string("recv: ") + std::strerror(errno));
+                }
+                break;
+            }
+            device->in.insert(device->in.end(), buffer, buffer + received);
+        }
+
+        const size_t headerSize = IgtlMessages::kHeaderSize;
+        size_t offset = 0;
+        const int64_t now = nowNs();
+        while (device->in.size() - offset >= headerSize) {
+            const uint8_t *header = device->in.data() + offset;
+            const uint64_t bodySize = readBigEndian64(header + 42);
+            if (device->in.size() - offset - headerSize < bodySize) {
+                break;
+            }
+            const uint8_t *body = header + headerSize;
+            if (std::strncmp(reinterpret_cast<const char *>(header + 2), "STATUS", 12) == 0 && bodySize >= 10
+                && ((body[0] << 8) | body[1]) == 1) {
+                uint64_t count = readBigEndian64(body + 2);
+                if (count == 0 || count > device->messages) {
+                    count = device->messages; // 0 = everything so far
+                }
+                if (count > device->acked) {
+                    const uint64_t last = count - 1;
+                    if (device->messages - last <= kSendTimeSlots) {
+                        device->ackLatency.add((now - device->sendTimes[last % kSendTimeSlots]) / 1e3);
+                    }
+                    device->acked = count;
+                }
+            }
+            offset += headerSize + size_t(bodySize);
+        }
+        device->in.erase(device->in.begin(), device->in.begin() + long(offset));
+    }
+
+    void close(Device *device, const std::string &error)
+    {
+        if (device->state == Device::Streaming) {
+            m_counters.streaming.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (device->fd >= 0) {
+            ::close(device->fd);
+            device->fd = -1;
+        }
+        device->state = Device::Closed;
+        device->error = error;
+        m_counters.closed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const Options &m_options;
+    sockaddr_storage m_address;
+    socklen_t m_addressLength;
+    std::vector<Device *> m_devices;
+    WorkerCounters &m_counters;
+    int64_t m_periodNs;
+    int m_epoll = -1;
+    int m_timer = -1;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> m_schedule;
+};
+
+bool resolve(const Options &options, sockaddr_storage &address, socklen_t &length)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    const std::string port = std::to_string(options.port);
+    const int status = getaddrinfo(options.host.c_str(), port.c_str(), &hints, &result);
+    if (status != 0 || !result) {
+        std::fprintf(stderr, "igtlswarm: cannot resolve %s: %s\n", options.host.c_str(), gai_strerror(status));
+        return false;
+    }
+    std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+    length = socklen_t(result->ai_addrlen);
+    freeaddrinfo(result);
+    return true;
+}
+
+// One descriptor per device, plus a few per worker
+void raiseFileLimit(int devices)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return;
+    }
+    const rlim_t needed = rlim_t(devices) + 64;
+    if (limit.rlim_cur < needed) {
+        limit.rlim_cur = std::min(needed, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < needed) {
+        std::fprintf(stderr, "igtlswarm: open file limit %llu is too low for %d devices\n",
+                     static_cast<unsigned long long>(limit.rlim_cur), devices);
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    if (options.threads == 0) {
+        options.threads = int(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+    }
+    options.threads = std::min(options.threads, options.devices);
+
+    MotionProfile profile;
+    std::string error;
+    if (!MotionProfile::load(options.profile, profile, &error)) {
+        std::fprintf(stderr, "igtlswarm: %s\n", error.c_str());
+        return 1;
+    }
+    sockaddr_storage address = {};
+    socklen_t addressLength = 0;
+    if (!resolve(options, address, addressLength)) {
+        return 1;
+    }
+    raiseFileLimit(options.devices);
+
+    std::vector<std::unique_ptr<Device>> devices;
+    devices.reserve(size_t(options.devices));
+    for (int i = 0; i < options.devices; ++i) {
+        char name[IgtlMessages::kDeviceNameSize + 1];
+        std::snprintf(name, sizeof(name), "%s-%04d", options.prefix.c_str(), i);
+        devices.push_back(std::make_unique<Device>(i, name, profile));
+    }
+
+    std::vector<WorkerCounters> counters(size_t(options.threads));
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int w = 0; w < options.threads; ++w) {
+        std::vector<Device *> assigned;
+        for (int i = w; i < options.devices; i += options.threads) {
+            assigned.push_back(devices[size_t(i)].get());
+        }
+        workers.push_back(std::make_unique<Worker>(options, address, addressLength, std::move(assigned), counters[size_t(w)]));
+    }
+
+    std::printf("igtlswarm: %d devices at %.1f Hz to %s:%d on %d threads, ramp %.1f s\n",
+                options.devices, options.rate, options.host.c_str(), options.port, options.threads, options.ramp);
+    const int64_t startNs = nowNs();
+    const int64_t endNs = startNs + int64_t((options.ramp + options.duration) * 1e9);
+    std::vector<std::thread> threads;
+    for (auto &worker : workers) {
+        Worker *w = worker.get();
+        threads.emplace_back([w, startNs, endNs] { w->run(startNs, endNs); });
+    }
+
+    // Aggregate rate once a second; the last report comes at the end, not
+    // up to a second after it
+    uint64_t lastMessages = 0;
+    uint64_t lastBytes = 0;
+    int64_t lastNs = startNs;
+    for (int64_t remainingNs = endNs - nowNs(); remainingNs > 0; remainingNs = endNs - nowNs()) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(remainingNs, 1000000000)));
+        uint64_t messages = 0, bytes = 0, dropped = 0;
+        int streaming = 0, closed = 0;
+        for (const WorkerCounters &c : counters) {
+            messages += c.messages.load(std::memory_order_relaxed);
+            bytes += c.bytes.load(std::memory_order_relaxed);
+            dropped += c.dropped.load(std::memory_order_relaxed);
+            streaming += c.streaming.load(std::memory_order_relaxed);
+            closed += c.closed.load(std::memory_order_relaxed);
+        }
+        const int64_t now = nowNs();
+        const double seconds = (now - lastNs) / 1e9;
+        std::printf("%6.1f s  streams %d/%d  closed %d  %.0f msg/s  %.2f MB/s  dropped %llu\n",
+                    (now - startNs) / 1e9, streaming, options.devices, closed,
+                    (messages - lastMessages) / seconds, (bytes - lastBytes) / seconds / 1e6,
+                    static_cast<unsigned long long>(dropped));
+        std::fflush(stdout);
+        lastMessages = messages;
+        lastBytes = bytes;
+        lastNs = now;
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    const int64_t finishedNs = nowNs();
+
+    // Summary over all streams, then per stream
+    LatencyHistogram sendLatency;
+    LatencyHistogram ackLatency;
+    uint64_t messages = 0;
+    int failed = 0;
+    for (const auto &device : devices) {
+        sendLatency.merge(device->sendLatency);
+        ackLatency.merge(device->ackLatency);
+        messages += device->messages;
+        failed += device->error.empty() ? 0 : 1;
+    }
+    const double elapsed = (finishedNs - startNs) / 1e9;
+    std::printf("\n%llu messages in %.1f s (%.0f msg/s including the ramp), %d streams failed\n",
+                static_cast<unsigned long long>(messages), elapsed, messages / elapsed, failed);
+    std::printf("send latency us  p50 %.0f  p99 %.0f  max %.0f\n",
+                sendLatency.percentile(0.5), sendLatency.percentile(0.99), sendLatency.max());
+    if (elapsed > options.ramp + options.duration + 0.5) {
+        std::printf("warning: the generator fell %.1f s behind; the latencies include its own lag "
+                    "(use more --threads or fewer devices)\n", elapsed - options.ramp - options.duration);
+    }
+    if (ackLatency.count() > 0) {
+        std::printf("ack latency us   p50 %.0f  p99 %.0f  max %.0f\n",
+                    ackLatency.percentile(0.5), ackLatency.percentile(0.99), ackLatency.max());
+    } else {
+        std::printf("ack latency      not reported (server does not acknowledge)\n");
+    }
+
+    if (!options.outputPath.empty()) {
+        std::ofstream out(options.outputPath);
+        if (!out) {
+            std::fprintf(stderr, "igtlswarm: cannot write %s\n", options.outputPath.c_str());
+            return 1;
+        }
+        out << "device,connect_ms,messages,dropped,acked,send_p50_us,send_p99_us,send_max_us,"
+               "ack_p50_us,ack_p99_us,ack_max_us,error\n";
+        for (const auto &device : devices) {
+            char line[512];
+            std::snprintf(line, sizeof(line), "%s,%.2f,%llu,%llu,%llu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%s\n",
+                          device->name.c_str(), device->connectMs,
+                          static_cast<unsigned long long>(device->messages),
+                          static_cast<unsigned long long>(device->dropped),
+                          static_cast<unsigned long long>(device->acked),
+                          device->sendLatency.percentile(0.5), device->sendLatency.percentile(0.99), device->sendLatency.max(),
+                          device->ackLatency.percentile(0.5), device->ackLatency.percentile(0.99), device->ackLatency.max(),
+                          device->error.c_str());
+            out << line;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}